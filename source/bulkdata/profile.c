@@ -29,6 +29,7 @@
 #include "t2log_wrapper.h"
 #include "busInterface.h"
 #include "curlinterface.h"
+#include "reportspool.h"
 #include "scheduler.h"
 #include "persistence.h"
 #include "vector.h"
@@ -40,6 +41,36 @@ static bool initialized = false;
 static Vector *profileList;
 static pthread_mutex_t plMutex;
 static pthread_mutex_t reportLock;
+static pthread_mutex_t triggerConsumerMutex = PTHREAD_MUTEX_INITIALIZER;
+static bool triggerConsumerRunning = false;
+static bool triggerConsumerPending = false;
+// Guards the upload state of all profiles, signalled when a profile has no uploads left
+static pthread_mutex_t uploadMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadCond = PTHREAD_COND_INITIALIZER;
+// Serializes profile deletions, which wait for reports and uploads without plMutex
+static pthread_mutex_t deleteMutex = PTHREAD_MUTEX_INITIALIZER;
+// Settled uploads whose spool files are written by the spool worker, guarded by uploadMutex
+static Vector *spoolWork = NULL;
+static bool spoolWorkerRunning = false;
+
+/*
+ * Reports of one collection, or of one spool replay, handed to the uploader. They
+ * complete in any order, the last one to complete settles the upload.
+ */
+typedef struct _ProfileUpload
+{
+    Profile *profile;
+    char *httpUrl;
+    ReportSpool *spool;
+    // Failed reports of a collection, spooled together once the upload settles
+    Vector *failedReports;
+    // Records of a replay, NULL for a collection, and the batches they were packed into
+    Vector *spooledReports;
+    Vector *batchReports;
+    unsigned int remaining;
+    bool failed;
+    bool commitDelta;
+}ProfileUpload;
 
 static void freeRequestURIparam(void *data)
 {
@@ -119,6 +150,18 @@ static void freeProfile(void *data)
         {
             Vector_Destroy(profile->triggerConditionList, freeTriggerCondition);
         }
+        if(profile->reportTemplate)
+        {
+            freeJSONReportTemplate(profile->reportTemplate);
+        }
+        if(profile->urlTemplate)
+        {
+            freeHTTPUrlTemplate(profile->urlTemplate);
+        }
+        if(profile->reportDelta)
+        {
+            freeReportDelta(profile->reportDelta);
+        }
         free(profile);
     }
     T2Debug("%s ++out \n", __FUNCTION__);
@@ -148,18 +191,24 @@ static T2ERROR getProfile(const char *profileName, Profile **profile)
     return T2ERROR_PROFILE_NOT_FOUND;
 }
 
-static T2ERROR initJSONReportProfile(cJSON** jsonObj, cJSON **valArray)
+static T2ERROR initJSONReportProfile(Profile *profile)
 {
-    *jsonObj = cJSON_CreateObject();
-    if(*jsonObj == NULL)
+    T2ERROR ret = T2ERROR_FAILURE;
+    if(profile->reportTemplate)
+    {
+        ret = initJSONReportFromTemplate(&profile->jsonReportObj, "Report", profile->reportTemplate);
+    }
+    else
+    {
+        size_t sizeHint = estimateJSONReportSize(profile->staticParamList, profile->paramList, profile->gMarkerList, profile->eMarkerList);
+        ret = initJSONReport(&profile->jsonReportObj, "Report", sizeHint);
+    }
+    if(T2ERROR_SUCCESS != ret)
     {
-        T2Error("Failed to create cJSON object\n");
+        T2Error("Failed to create JSON report\n");
         return T2ERROR_FAILURE;
     }
 
-    cJSON_AddItemToObject(*jsonObj, "Report", *valArray = cJSON_CreateArray());
-
-
     return T2ERROR_SUCCESS;
 }
 
@@ -196,6 +245,402 @@ T2ERROR profileWithNameExists(const char *profileName, bool *bProfileExists)
     return T2ERROR_PROFILE_NOT_FOUND;
 }
 
+static void acknowledgeSpooledReport(Vector *spooledReports, HTTPReport *report)
+{
+    size_t index;
+    for(index = 0; index < Vector_Size(spooledReports); index++)
+    {
+        SpooledReport *spooled = (SpooledReport *) Vector_At(spooledReports, index);
+        // Every record packed into a batch is acknowledged with it
+        if(spooled->upload == report)
+            spooled->acknowledged = true;
+    }
+}
+
+static void spoolProfileReports(ReportSpool *spool, const char *httpUrl, Vector *reports)
+{
+    if(T2ERROR_SUCCESS != appendReportSpool(spool, httpUrl, reports))
+        T2Error("Unable to spool %d reports, they are lost\n", Vector_Size(reports));
+}
+
+static ProfileUpload* createProfileUpload(Profile *profile, const char *httpUrl, ReportSpool *spool)
+{
+    ProfileUpload *upload = (ProfileUpload *) calloc(1, sizeof(ProfileUpload));
+    if(upload == NULL)
+        return NULL;
+    if(httpUrl && (upload->httpUrl = strdup(httpUrl)) == NULL)
+    {
+        free(upload);
+        return NULL;
+    }
+    upload->profile = profile;
+    upload->spool = spool;
+    Vector_Create(&upload->failedReports);
+    return upload;
+}
+
+static void queueProfileUpload(ProfileUpload *upload, Vector *reports, Vector *urls);
+
+static void profileUploadComplete(HTTPReport *report, T2ERROR status, void *userData);
+
+static bool isSpooledReportBatchable(SpooledReport *spooled)
+{
+    return strcmp(spooled->report->contentType, HEADER_CONTENTTYPE) == 0 && decompressHTTPReport(spooled->report) == T2ERROR_SUCCESS;
+}
+
+/**
+ * Pack consecutive JSON records of the same URL into batches up to the maximum
+ * report size, each compressed like the profile's reports. Records that cannot be
+ * batched are sent on their own.
+ */
+static void batchSpooledReports(Profile *profile, ProfileUpload *upload, Vector *reports, Vector *urls)
+{
+    Vector *spooledReports = upload->spooledReports;
+    Vector *run = NULL;
+    size_t index = 0;
+    size_t end = 0;
+    size_t packed = 0;
+    size_t count = 0;
+    size_t member;
+
+    Vector_Create(&upload->batchReports);
+    while(index < Vector_Size(spooledReports))
+    {
+        SpooledReport *spooled = (SpooledReport *) Vector_At(spooledReports, index);
+        if(!isSpooledReportBatchable(spooled))
+        {
+            Vector_PushBack(reports, spooled->report);
+            Vector_PushBack(urls, spooled->url);
+            index++;
+            continue;
+        }
+        Vector_Create(&run);
+        for(end = index; end < Vector_Size(spooledReports); end++)
+        {
+            SpooledReport *next = (SpooledReport *) Vector_At(spooledReports, end);
+            if(strcmp(next->url, spooled->url) != 0 || (end > index && !isSpooledReportBatchable(next)))
+                break;
+            Vector_PushBack(run, next->report);
+        }
+        for(packed = 0; packed < Vector_Size(run); packed += count)
+        {
+            HTTPReport *batch = createHTTPReportBatch(run, packed, ReportProfiles_getMaxReportSize(), profile->t2HTTPDest->CachedReportBatch, &count);
+            SpooledReport *head = (SpooledReport *) Vector_At(spooledReports, index + packed);
+            if(batch == NULL || count == 1)
+            {
+                freeHTTPReport(batch);
+                count = 1;
+                batch = head->report;
+            }
+            else
+            {
+                T2Info("Sending %zu spooled reports in one request\n", count);
+                Vector_PushBack(upload->batchReports, batch);
+                for(member = index + packed; member < index + packed + count; member++)
+                    ((SpooledReport *) Vector_At(spooledReports, member))->upload = batch;
+            }
+            if(T2ERROR_SUCCESS != compressHTTPReport(batch, profile->t2HTTPDest->Compression, profile->t2HTTPDest->CompressionLevel))
+                T2Warning("Sending spooled reports of %s uncompressed\n", profile->name);
+            Vector_PushBack(reports, batch);
+            Vector_PushBack(urls, head->url);
+        }
+        Vector_Destroy(run, NULL);
+        index = end;
+    }
+}
+
+/**
+ * Replay the destination's spool oldest first after an upload to it succeeded.
+ */
+static void replaySpooledReports(Profile *profile, ReportSpool *spool)
+{
+    ProfileUpload *upload = NULL;
+    Vector *spooledReports = NULL;
+    Vector *reports = NULL;
+    Vector *urls = NULL;
+    size_t index;
+
+    Vector_Create(&spooledReports);
+    if(T2ERROR_SUCCESS != loadReportSpool(spool, spooledReports))
+    {
+        Vector_Destroy(spooledReports, freeSpooledReport);
+        return;
+    }
+    T2Info("Trying to send  %d spooled reports\n", Vector_Size(spooledReports));
+    upload = createProfileUpload(profile, NULL, spool);
+    if(upload == NULL)
+    {
+        finishReportSpoolReplay(spool, spooledReports);
+        Vector_Destroy(spooledReports, freeSpooledReport);
+        return;
+    }
+    upload->spooledReports = spooledReports;
+    Vector_Create(&reports);
+    Vector_Create(&urls);
+    if(profile->t2HTTPDest->CachedReportBatch != BATCH_NONE)
+    {
+        batchSpooledReports(profile, upload, reports, urls);
+    }
+    else
+    {
+        for(index = 0; index < Vector_Size(spooledReports); index++)
+        {
+            SpooledReport *spooled = (SpooledReport *) Vector_At(spooledReports, index);
+            Vector_PushBack(reports, spooled->report);
+            Vector_PushBack(urls, spooled->url);
+        }
+    }
+    queueProfileUpload(upload, reports, urls);
+    Vector_Destroy(reports, NULL);
+    Vector_Destroy(urls, NULL);
+}
+
+/**
+ * Spool what failed and remove what was replayed, called once for an upload
+ * after its last report completed.
+ */
+static void settleProfileUpload(ProfileUpload *upload)
+{
+    if(Vector_Size(upload->failedReports) > 0)
+        spoolProfileReports(upload->spool, upload->httpUrl, upload->failedReports);
+    Vector_Destroy(upload->failedReports, freeHTTPReport);
+
+    if(upload->spooledReports)
+    {
+        finishReportSpoolReplay(upload->spool, upload->spooledReports);
+        Vector_Destroy(upload->spooledReports, freeSpooledReport);
+        Vector_Destroy(upload->batchReports, freeHTTPReport);
+    }
+    else if(!upload->failed && upload->profile->enable && getReportSpoolCount(upload->spool) > 0)
+    {
+        replaySpooledReports(upload->profile, upload->spool);
+    }
+    free(upload->httpUrl);
+    free(upload);
+}
+
+static void releaseProfileUpload(Profile *profile)
+{
+    pthread_mutex_lock(&uploadMutex);
+    profile->pendingUploads--;
+    if(profile->pendingUploads == 0)
+        pthread_cond_broadcast(&uploadCond);
+    pthread_mutex_unlock(&uploadMutex);
+}
+
+/**
+ * Settles uploads until none is left. Each one holds a pending upload of its
+ * profile, released once its spool files are written.
+ */
+static void* spoolWorker(void *data)
+{
+    (void) data;
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&uploadMutex);
+    while(Vector_Size(spoolWork) > 0)
+    {
+        ProfileUpload *upload = (ProfileUpload *) Vector_At(spoolWork, 0);
+        Profile *profile = upload->profile;
+        Vector_RemoveItem(spoolWork, upload, NULL);
+        pthread_mutex_unlock(&uploadMutex);
+
+        settleProfileUpload(upload);
+        releaseProfileUpload(profile);
+
+        pthread_mutex_lock(&uploadMutex);
+    }
+    spoolWorkerRunning = false;
+    pthread_mutex_unlock(&uploadMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return NULL;
+}
+
+/**
+ * Hand a settled upload to the spool worker, so that the spool file I/O does not
+ * hold up the uploader thread. Settled on the calling thread if no worker can run.
+ */
+static void queueSpoolWork(ProfileUpload *upload)
+{
+    pthread_t workerThread;
+    pthread_attr_t attr;
+    Profile *profile = upload->profile;
+    bool started = true;
+
+    pthread_mutex_lock(&uploadMutex);
+    if(spoolWork == NULL)
+        Vector_Create(&spoolWork);
+    if(spoolWork == NULL || T2ERROR_SUCCESS != Vector_PushBack(spoolWork, upload))
+    {
+        pthread_mutex_unlock(&uploadMutex);
+        settleProfileUpload(upload);
+        releaseProfileUpload(profile);
+        return;
+    }
+    if(!spoolWorkerRunning)
+    {
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        spoolWorkerRunning = true;
+        started = (pthread_create(&workerThread, &attr, spoolWorker, NULL) == 0);
+        pthread_attr_destroy(&attr);
+    }
+    pthread_mutex_unlock(&uploadMutex);
+
+    if(!started)
+    {
+        T2Error("Unable to start the spool worker, settling the upload of %s here\n", profile->name);
+        spoolWorker(NULL);
+    }
+}
+
+static void profileUploadComplete(HTTPReport *report, T2ERROR status, void *userData)
+{
+    ProfileUpload *upload = (ProfileUpload *) userData;
+    Profile *profile = upload->profile;
+    bool settled = false;
+
+    pthread_mutex_lock(&uploadMutex);
+    if(upload->spooledReports) {
+        // Replayed reports belong to their spool records
+        if(status == T2ERROR_SUCCESS)
+            acknowledgeSpooledReport(upload->spooledReports, report);
+        else
+            upload->failed = true;
+    }else if(status == T2ERROR_SUCCESS) {
+        freeHTTPReport(report);
+    }else {
+        upload->failed = true;
+        Vector_PushBack(upload->failedReports, report);
+    }
+    upload->remaining--;
+    if(upload->remaining == 0)
+    {
+        // Deltas are taken against the last report that reached the server, unless
+        // replayed reports with older values reached it after this one
+        if(!upload->failed && upload->commitDelta && getReportSpoolReplayCount(upload->spool) == profile->spoolReplayCount)
+            commitReportDelta(profile->reportDelta);
+        settled = true;
+    }
+    pthread_mutex_unlock(&uploadMutex);
+
+    // The spool worker releases the last pending upload once the spool files are written
+    if(settled)
+        queueSpoolWork(upload);
+    else
+        releaseProfileUpload(profile);
+}
+
+/**
+ * Hand reports to the uploader, each to the URL at the same index of urls or to the
+ * upload's URL.
+ */
+static void queueProfileUpload(ProfileUpload *upload, Vector *reports, Vector *urls)
+{
+    Profile *profile = upload->profile;
+    size_t reportIndex;
+    size_t reportCount = Vector_Size(reports);
+
+    upload->remaining = reportCount;
+    pthread_mutex_lock(&uploadMutex);
+    profile->pendingUploads += reportCount;
+    pthread_mutex_unlock(&uploadMutex);
+
+    for(reportIndex = 0; reportIndex < reportCount; reportIndex++)
+    {
+        HTTPReport *report = (HTTPReport *) Vector_At(reports, reportIndex);
+        const char *httpUrl = urls ? (const char *) Vector_At(urls, reportIndex) : upload->httpUrl;
+        if(T2ERROR_SUCCESS != queueHTTPReport(httpUrl, report, profileUploadComplete, upload))
+            profileUploadComplete(report, T2ERROR_FAILURE, upload);
+    }
+}
+
+/**
+ * Upload the reports of a collection, failed ones are spooled once all of them completed.
+ */
+static void queueProfileReports(Profile *profile, const char *httpUrl, Vector *reports, bool commitDelta)
+{
+    ReportSpool *spool = getReportSpool(httpUrl);
+    ProfileUpload *upload = NULL;
+
+    if(Vector_Size(reports) == 0)
+        return;
+    upload = createProfileUpload(profile, httpUrl, spool);
+    if(upload == NULL)
+    {
+        T2Error("Unable to queue reports of %s, spooling them\n", profile->name);
+        spoolProfileReports(spool, httpUrl, reports);
+        while(Vector_Size(reports) > 0)
+        {
+            HTTPReport *report = (HTTPReport *) Vector_At(reports, 0);
+            Vector_RemoveItem(reports, report, freeHTTPReport);
+        }
+        return;
+    }
+    upload->commitDelta = commitDelta;
+    queueProfileUpload(upload, reports, NULL);
+}
+
+/**
+ * Retry handler of the uploader, has the spool worker replay the spool of the first
+ * enabled profile reporting to a destination whose backoff ran out. Does not wait
+ * for plMutex, the uploader thread completes the transfers of all profiles.
+ */
+static bool retrySpooledReports(const char *destination)
+{
+    size_t profileIndex;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(pthread_mutex_trylock(&plMutex) != 0)
+    {
+        T2Debug("%s --out\n", __FUNCTION__);
+        return false;
+    }
+    for(profileIndex = 0; profileIndex < Vector_Size(profileList); profileIndex++)
+    {
+        Profile *tempProfile = (Profile *) Vector_At(profileList, profileIndex);
+        char *profileDestination = NULL;
+        ReportSpool *spool = NULL;
+        if(!tempProfile->enable || tempProfile->t2HTTPDest == NULL || tempProfile->t2HTTPDest->URL == NULL)
+            continue;
+        profileDestination = getHTTPDestination(tempProfile->t2HTTPDest->URL);
+        if(profileDestination == NULL || strcmp(profileDestination, destination) != 0)
+        {
+            free(profileDestination);
+            continue;
+        }
+        free(profileDestination);
+        spool = getReportSpool(tempProfile->t2HTTPDest->URL);
+        if(spool && getReportSpoolCount(spool) > 0)
+        {
+            // An upload without reports, the spool worker replays the spool when settling it
+            ProfileUpload *upload = createProfileUpload(tempProfile, NULL, spool);
+            if(upload == NULL)
+            {
+                pthread_mutex_unlock(&plMutex);
+                T2Debug("%s --out\n", __FUNCTION__);
+                return false;
+            }
+            T2Info("Retrying spooled reports of %s\n", tempProfile->name);
+            pthread_mutex_lock(&uploadMutex);
+            tempProfile->pendingUploads++;
+            pthread_mutex_unlock(&uploadMutex);
+            queueSpoolWork(upload);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&plMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return true;
+}
+
+static void waitForProfileUploads(Profile *profile)
+{
+    pthread_mutex_lock(&uploadMutex);
+    while(profile->pendingUploads > 0)
+        pthread_cond_wait(&uploadCond, &uploadMutex);
+    pthread_mutex_unlock(&uploadMutex);
+}
+
 static void* CollectAndReport(void* data)
 {
     if(data == NULL)
@@ -208,8 +653,6 @@ static void* CollectAndReport(void* data)
 
     Vector *profileParamVals = NULL;
     Vector *grepResultList = NULL;
-    cJSON *valArray = NULL;
-    char* jsonReport = NULL;
 
     struct timespec startTime;
     struct timespec endTime;
@@ -223,88 +666,159 @@ static void* CollectAndReport(void* data)
     if(!strcmp(profile->encodingType, "JSON") || !strcmp(profile->encodingType, "MessagePack"))
     {
         JSONEncoding *jsonEncoding = profile->jsonEncoding;
-        if (jsonEncoding->reportFormat != JSONRF_KEYVALUEPAIR)
+        MsgPackReportWriter *msgPackReport = NULL;
+        bool msgPackEncoding = (strcmp(profile->encodingType, "MessagePack") == 0);
+        Vector *reportParts = NULL;
+        int partIndex = 0;
+        bool reportSent = true;
+
+        if(msgPackEncoding)
         {
-            //TODO: Support 'ObjectHierarchy' format in RDKB-26154.
-            T2Error("Only JSON name-value pair format is supported \n");
+            if(T2ERROR_SUCCESS != initMsgPackReport(&msgPackReport, "Report"))
+            {
+                T2Error("Failed to initialize MessagePack Report\n");
+                profile->reportInProgress = false;
+                return NULL;
+            }
+        }
+        else if (jsonEncoding == NULL || (jsonEncoding->reportFormat != JSONRF_KEYVALUEPAIR
+                && !(jsonEncoding->reportFormat == JSONRF_OBJHIERARCHY && profile->reportTemplate && profile->reportTemplate->hierarchy)))
+        {
+            T2Error("Unsupported JSON report format for %s \n", profile->name);
             profile->reportInProgress = false;
             return NULL;
         }
-
-        if(T2ERROR_SUCCESS != initJSONReportProfile(&profile->jsonReportObj, &valArray))
+        else if(T2ERROR_SUCCESS != initJSONReportProfile(profile))
         {
             T2Error("Failed to initialize JSON Report\n");
             profile->reportInProgress = false;
             return NULL;
         }
+        // Delta state belongs to the previous report until its uploads settle
+        waitForProfileUploads(profile);
+        if(profile->reportDelta)
+        {
+            // Spooled reports are older than this one and may reach the server after it,
+            // only a full report keeps their values from being taken as the latest
+            ReportSpool *spool = profile->t2HTTPDest ? getReportSpool(profile->t2HTTPDest->URL) : NULL;
+            unsigned int replayCount = getReportSpoolReplayCount(spool);
+            beginReportDelta(profile->reportDelta, getReportSpoolCount(spool) > 0 || replayCount != profile->spoolReplayCount);
+            profile->spoolReplayCount = replayCount;
+        }
+        if(msgPackEncoding)
+            msgPackReport->delta = profile->reportDelta;
         else
+            profile->jsonReportObj->delta = profile->reportDelta;
+
+        if(Vector_Size(profile->staticParamList) > 0)
         {
-            if(Vector_Size(profile->staticParamList) > 0)
-            {
-                T2Debug(" Adding static Parameter Values to Json report\n");
-                encodeStaticParamsInJSON(valArray, profile->staticParamList);
-            }
-            if(Vector_Size(profile->paramList) > 0)
-            {
-                T2Debug("Fetching TR-181 Object/Parameter Values\n");
-                profileParamVals = getProfileParameterValues(profile->paramList);
-                if(profileParamVals != NULL)
-                {
-                    encodeParamResultInJSON(valArray, profile->paramList, profileParamVals);
-                }
-                Vector_Destroy(profileParamVals, freeProfileValues);
-            }
-            if(Vector_Size(profile->gMarkerList) > 0)
-            {
-                getGrepResults(profile->name, profile->gMarkerList, &grepResultList, profile->bClearSeekMap);
-                encodeGrepResultInJSON(valArray, grepResultList);
-                Vector_Destroy(grepResultList, freeGResult);
-            }
-            if(Vector_Size(profile->eMarkerList) > 0)
+            T2Debug(" Adding static Parameter Values to Json report\n");
+            if(msgPackEncoding)
+                encodeStaticParamsInMsgPack(msgPackReport, profile->staticParamList);
+            else
+                encodeStaticParamsInJSON(profile->jsonReportObj, profile->staticParamList);
+        }
+        if(msgPackEncoding)
+            encodeReportTypeInMsgPack(msgPackReport);
+        else
+            encodeReportTypeInJSON(profile->jsonReportObj);
+        if(Vector_Size(profile->paramList) > 0)
+        {
+            T2Debug("Fetching TR-181 Object/Parameter Values\n");
+            profileParamVals = getProfileParameterValues(profile->paramList);
+            if(profileParamVals != NULL)
             {
-                encodeEventMarkersInJSON(valArray, profile->eMarkerList);
+                if(msgPackEncoding)
+                    encodeParamResultInMsgPack(msgPackReport, profile->paramList, profileParamVals);
+                else
+                    encodeParamResultInJSON(profile->jsonReportObj, profile->paramList, profileParamVals);
             }
-            ret = prepareJSONReport(profile->jsonReportObj, &jsonReport);
+            Vector_Destroy(profileParamVals, freeProfileValues);
+        }
+        if(Vector_Size(profile->gMarkerList) > 0)
+        {
+            getGrepResults(profile->name, profile->gMarkerList, &grepResultList, profile->bClearSeekMap);
+            if(msgPackEncoding)
+                encodeGrepResultInMsgPack(msgPackReport, grepResultList);
+            else
+                encodeGrepResultInJSON(profile->jsonReportObj, grepResultList);
+            Vector_Destroy(grepResultList, freeGResult);
+        }
+        if(Vector_Size(profile->eMarkerList) > 0)
+        {
+            if(msgPackEncoding)
+                encodeEventMarkersInMsgPack(msgPackReport, profile->eMarkerList);
+            else
+                encodeEventMarkersInJSON(profile->jsonReportObj, profile->eMarkerList);
+        }
+        Vector_Create(&reportParts);
+        if(msgPackEncoding)
+        {
+            ret = prepareMsgPackReportParts(msgPackReport, ReportProfiles_getMaxReportSize(), reportParts);
+            destroyMsgPackReport(msgPackReport);
+        }
+        else
+        {
+            ret = prepareJSONReportParts(profile->jsonReportObj, ReportProfiles_getMaxReportSize(), reportParts);
             destroyJSONReport(profile->jsonReportObj);
             profile->jsonReportObj = NULL;
+        }
 
-            if(ret != T2ERROR_SUCCESS)
+        if(ret != T2ERROR_SUCCESS)
+        {
+            T2Error("Unable to generate report for : %s\n", profile->name);
+            Vector_Destroy(reportParts, freeReportPart);
+            profile->reportInProgress = false;
+            return NULL;
+        }
+        if(strcmp(profile->protocol, "HTTP") == 0) {
+            char *preparedUrl = NULL;
+            const char *httpUrl = NULL;
+            if(profile->urlTemplate)
+                httpUrl = buildHttpUrl(profile->urlTemplate); /* Append URL with http properties */
+            else
+                httpUrl = preparedUrl = prepareHttpUrl(profile->t2HTTPDest);
+            Vector *reportList = NULL;
+            Vector_Create(&reportList);
+            // Parts of a split report are uploaded and cached independently
+            for(partIndex = 0; partIndex < Vector_Size(reportParts); partIndex++)
             {
-                T2Error("Unable to generate report for : %s\n", profile->name);
-                profile->reportInProgress = false;
-                return NULL;
-            }
-            long size = strlen(jsonReport);
-            T2Info("cJSON Report = %s\n", jsonReport);
-            T2Info("Report Size = %ld\n", size);
-            if(size > DEFAULT_MAX_REPORT_SIZE) {
-                T2Warning("Report size is exceeding the max limit : %d\n", DEFAULT_MAX_REPORT_SIZE);
-            }
-            if(strcmp(profile->protocol, "HTTP") == 0) {
-                char *httpUrl = prepareHttpUrl(profile->t2HTTPDest); /* Append URL with http properties */
-                ret = sendReportOverHTTP(httpUrl, jsonReport);
-
-                if(ret == T2ERROR_FAILURE) {
-                    if(Vector_Size(profile->cachedReportList) == MAX_CACHED_REPORTS) {
-                        T2Debug("Max Cached Reports Limit Reached, Overwriting third recent report\n");
-                        char *thirdCachedReport = (char *) Vector_At(profile->cachedReportList, MAX_CACHED_REPORTS - 3);
-                        Vector_RemoveItem(profile->cachedReportList, thirdCachedReport, NULL);
-                        free(thirdCachedReport);
-                    }
-                    Vector_PushBack(profile->cachedReportList, jsonReport);
-
-                    T2Info("Report Cached, No. of reportes cached = %d\n", Vector_Size(profile->cachedReportList));
-                }else if(Vector_Size(profile->cachedReportList) > 0) {
-                    T2Info("Trying to send  %d cached reports\n", Vector_Size(profile->cachedReportList));
-                    ret = sendCachedReportsOverHTTP(httpUrl, profile->cachedReportList);
+                ReportPart *part = (ReportPart *) Vector_At(reportParts, partIndex);
+                HTTPReport *report = NULL;
+                if(!msgPackEncoding)
+                    T2Info("cJSON Report = %s\n", part->data);
+                T2Info("Report Size = %ld\n", (long) part->length);
+
+                report = createHTTPReport(part->data, part->length, msgPackEncoding ? HEADER_CONTENTTYPE_MSGPACK : HEADER_CONTENTTYPE);
+                if(report == NULL) {
+                    reportSent = false;
+                    continue;
                 }
-                free(httpUrl);
+                // The report owns the payload from here on
+                part->data = NULL;
+                // Compressed once, a cached report is kept and resent in its compressed form
+                if(T2ERROR_SUCCESS != compressHTTPReport(report, profile->t2HTTPDest->Compression, profile->t2HTTPDest->CompressionLevel))
+                    T2Warning("Sending report of %s uncompressed\n", profile->name);
+                Vector_PushBack(reportList, report);
+            }
+            // The report thread returns once the parts are queued, completion is handled by profileUploadComplete
+            if(httpUrl)
+            {
+                queueProfileReports(profile, httpUrl, reportList, reportSent);
+                Vector_Destroy(reportList, NULL);
             }
             else
             {
-                T2Error("Unsupported report send protocol : %s\n", profile->protocol);
+                T2Error("Unable to prepare the upload URL of %s, report dropped\n", profile->name);
+                Vector_Destroy(reportList, freeHTTPReport);
             }
+            free(preparedUrl);
+        }
+        else
+        {
+            T2Error("Unsupported report send protocol : %s\n", profile->protocol);
         }
+        Vector_Destroy(reportParts, freeReportPart);
     }
     else
     {
@@ -313,11 +827,6 @@ static void* CollectAndReport(void* data)
     clock_gettime(CLOCK_REALTIME, &endTime);
     getLapsedTime(&elapsedTime, &endTime, &startTime);
     T2Info("Elapsed Time for : %s = %lu.%lu (Sec.NanoSec)\n", profile->name, elapsedTime.tv_sec, elapsedTime.tv_nsec);
-    if(ret == T2ERROR_SUCCESS && jsonReport)
-    {
-        free(jsonReport);
-        jsonReport = NULL;
-    }
 
     profile->reportInProgress = false;
     T2Info("%s --out\n", __FUNCTION__);
@@ -424,6 +933,26 @@ T2ERROR addProfile(Profile *profile)
         T2Error("profile list is not initialized yet, ignoring\n");
         return T2ERROR_FAILURE;
     }
+    // Static report sections are serialized once, an updated profile is added as a new Profile
+    if(profile->reportTemplate == NULL)
+    {
+        profile->reportTemplate = compileJSONReportTemplate(profile->staticParamList, profile->paramList, profile->eMarkerList,
+                profile->jsonEncoding && profile->jsonEncoding->reportFormat == JSONRF_OBJHIERARCHY);
+        if(profile->reportTemplate == NULL)
+            T2Warning("Report template unavailable for %s, encoding names on each report\n", profile->name);
+    }
+    if(profile->t2HTTPDest && profile->urlTemplate == NULL)
+    {
+        profile->urlTemplate = compileHTTPUrlTemplate(profile->t2HTTPDest);
+        if(profile->urlTemplate == NULL)
+            T2Warning("Upload URL template unavailable for %s, building the URL on each report\n", profile->name);
+    }
+    if(profile->deltaReporting && profile->reportDelta == NULL)
+    {
+        profile->reportDelta = createReportDelta(Vector_Size(profile->paramList), Vector_Size(profile->eMarkerList), profile->deltaSnapshotPeriod);
+        if(profile->reportDelta == NULL)
+            T2Warning("Delta reporting unavailable for %s, sending full reports\n", profile->name);
+    }
     pthread_mutex_lock(&plMutex);
     Vector_PushBack(profileList, profile);
 
@@ -470,7 +999,9 @@ T2ERROR enableProfile(const char *profileName)
             eMarker = (EventMarker *)Vector_At(profile->eMarkerList, emIndex);
             addT2EventMarker(eMarker->markerName, eMarker->compName, profile->name, eMarker->skipFreq);
         }
-        if(registerProfileWithScheduler(profile->name, profile->reportingInterval, profile->activationTimeoutPeriod, true) != T2ERROR_SUCCESS)
+        if(Vector_Size(profile->paramList) > 0)
+            subscribeProfileParams(profile->paramList);
+        if(registerProfileWithScheduler(profile->name, profile->reportingInterval, profile->activationTimeoutPeriod, true, profile->timeRef) != T2ERROR_SUCCESS)
         {
             profile->enable = false;
             T2Error("Unable to register profile : %s with Scheduler\n", profileName);
@@ -556,6 +1087,7 @@ T2ERROR deleteAllProfiles(bool delFromDisk) {
         return T2ERROR_FAILURE;
     }
 
+    pthread_mutex_lock(&deleteMutex);
     pthread_mutex_lock(&plMutex);
     count = Vector_Size(profileList);
     pthread_mutex_unlock(&plMutex);
@@ -572,12 +1104,17 @@ T2ERROR deleteAllProfiles(bool delFromDisk) {
             T2Error("Profile : %s failed to  unregister from scheduler\n", tempProfile->name);
         }
 
-        pthread_mutex_lock(&plMutex);
+        // Timeouts of the other profiles take plMutex, it is not held while waiting
         if (tempProfile->reportThread)
             pthread_join(tempProfile->reportThread, NULL);
+        waitForProfileUploads(tempProfile);
 
+        pthread_mutex_lock(&plMutex);
         if (Vector_Size(tempProfile->gMarkerList) > 0)
             removeGrepConfig(tempProfile->name);
+
+        if (Vector_Size(tempProfile->paramList) > 0)
+            unsubscribeProfileParams(tempProfile->paramList);
         pthread_mutex_unlock(&plMutex);
         if(delFromDisk == true){
            removeProfileFromDisk(REPORTPROFILES_PERSISTENCE_PATH, tempProfile->name);
@@ -593,6 +1130,7 @@ T2ERROR deleteAllProfiles(bool delFromDisk) {
     profileList = NULL;
     Vector_Create(&profileList);
     pthread_mutex_unlock(&plMutex);
+    pthread_mutex_unlock(&deleteMutex);
 
     T2Debug("%s --out\n", __FUNCTION__);
 
@@ -628,11 +1166,13 @@ T2ERROR deleteProfile(const char *profileName)
     }
 
     Profile *profile = NULL;
+    pthread_mutex_lock(&deleteMutex);
     pthread_mutex_lock(&plMutex);
     if(T2ERROR_SUCCESS != getProfile(profileName, &profile))
     {
         T2Error("Profile : %s not found\n", profileName);
         pthread_mutex_unlock(&plMutex);
+        pthread_mutex_unlock(&deleteMutex);
         return T2ERROR_FAILURE;
     }
 
@@ -645,11 +1185,15 @@ T2ERROR deleteProfile(const char *profileName)
         T2Info("Profile : %s already removed from scheduler\n", profileName);
     }
 
+    // Timeouts of the other profiles take plMutex, it is not held while waiting.
+    // The profile is disabled and unregistered, no report of it starts anymore.
     T2Info("Waiting for CollectAndReport to be complete : %s\n", profileName);
-    pthread_mutex_lock(&plMutex);
     if (profile->reportThread) {
         pthread_join(profile->reportThread, NULL);
     }
+    waitForProfileUploads(profile);
+
+    pthread_mutex_lock(&plMutex);
 
     if(Vector_Size(profile->triggerConditionList) > 0){
         rbusT2ConsumerUnReg(profile->triggerConditionList);
@@ -658,10 +1202,14 @@ T2ERROR deleteProfile(const char *profileName)
     if (Vector_Size(profile->gMarkerList) > 0)
         removeGrepConfig((char*)profileName);
 
+    if (Vector_Size(profile->paramList) > 0)
+        unsubscribeProfileParams(profile->paramList);
+
     T2Info("removing profile : %s from profile list\n", profile->name);
     Vector_RemoveItem(profileList, profile, freeProfile);
 
     pthread_mutex_unlock(&plMutex);
+    pthread_mutex_unlock(&deleteMutex);
     T2Debug("%s --out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
@@ -778,6 +1326,7 @@ T2ERROR initProfileList()
     pthread_mutex_init(&reportLock, NULL);
 
     Vector_Create(&profileList);
+    setHTTPRetryHandler(retrySpooledReports);
 
     loadReportProfilesFromDisk();
 
@@ -837,6 +1386,12 @@ T2ERROR uninitProfileList()
     initialized = false;
     deleteAllProfiles(false); // avoid removing multiProfiles from Disc
 
+    // Every upload settled while the profiles were deleted
+    pthread_mutex_lock(&uploadMutex);
+    Vector_Destroy(spoolWork, NULL);
+    spoolWork = NULL;
+    pthread_mutex_unlock(&uploadMutex);
+
     pthread_mutex_destroy(&reportLock);
     pthread_mutex_destroy(&plMutex);
 
@@ -844,6 +1399,11 @@ T2ERROR uninitProfileList()
     return T2ERROR_SUCCESS;
 }
 
+/**
+ * Subscribe the trigger conditions of all profiles. The scheduler calls this for every
+ * profile it registers, only one caller runs the registration and retries at a time. Callers
+ * arriving meanwhile get their conditions picked up by one more pass of the running one.
+ */
 T2ERROR registerTriggerConditionConsumer()
 {
 
@@ -856,6 +1416,19 @@ T2ERROR registerTriggerConditionConsumer()
     int ret = T2ERROR_SUCCESS;
     Profile *tempProfile = NULL;
 
+    pthread_mutex_lock(&triggerConsumerMutex);
+    if(triggerConsumerRunning)
+    {
+        triggerConsumerPending = true;
+        pthread_mutex_unlock(&triggerConsumerMutex);
+        T2Debug("Trigger condition registration in progress, queued another pass\n");
+        T2Debug("%s --out\n", __FUNCTION__);
+        return T2ERROR_SUCCESS;
+    }
+    triggerConsumerRunning = true;
+    triggerConsumerPending = false;
+    pthread_mutex_unlock(&triggerConsumerMutex);
+
     while(retry_count <= MAX_RETRY_COUNT){
         pthread_mutex_lock(&plMutex);
 	profileIndex = 0;
@@ -873,6 +1446,17 @@ T2ERROR registerTriggerConditionConsumer()
 
         }
         pthread_mutex_unlock(&plMutex);
+
+        pthread_mutex_lock(&triggerConsumerMutex);
+        if(triggerConsumerPending)
+        {
+            // Profiles were added during this pass, cover them without waiting
+            triggerConsumerPending = false;
+            pthread_mutex_unlock(&triggerConsumerMutex);
+            continue;
+        }
+        pthread_mutex_unlock(&triggerConsumerMutex);
+
 	if(retry == 1){
 	   if(retry_count >= MAX_RETRY_COUNT)
 	      break;
@@ -886,12 +1470,19 @@ T2ERROR registerTriggerConditionConsumer()
 	   break;  
         }		
     }
+
+    pthread_mutex_lock(&triggerConsumerMutex);
+    triggerConsumerRunning = false;
+    pthread_mutex_unlock(&triggerConsumerMutex);
     T2Debug("%s --out\n", __FUNCTION__);
     return ret;
 }
 
-
-T2ERROR triggerReportOnCondtion(const char *referenceName)
+/**
+ * Trigger a report of every profile with a condition on referenceName matching the
+ * operator and threshold of the subscription the event was delivered for.
+ */
+T2ERROR triggerReportOnCondtion(const char *referenceName, const char *oprator, int threshold)
 {
     T2Debug("%s ++in\n", __FUNCTION__);
 
@@ -906,16 +1497,15 @@ T2ERROR triggerReportOnCondtion(const char *referenceName)
         {
              for( j = 0; j < tempProfile->triggerConditionList->count; j++ ) {
                 TriggerCondition *triggerCondition = ((TriggerCondition *) Vector_At(tempProfile->triggerConditionList, j));
-                if(strcmp(triggerCondition->reference,referenceName) == 0)
+                if(strcmp(triggerCondition->reference,referenceName) == 0 && strcmp(triggerCondition->oprator, oprator) == 0
+                        && (strcmp(oprator, "any") == 0 || triggerCondition->threshold == threshold))
                 {
 	             T2Debug("Triggering report on condition for %s with %s operator, %d threshold\n",
 				     triggerCondition->reference, triggerCondition->oprator, triggerCondition->threshold);
                      tempProfile->triggerReportOnCondition = true;
                      tempProfile->minThresholdDuration = triggerCondition->minThresholdDuration;
                      SendInterruptToTimeoutThread(tempProfile->name);
-                     T2Debug("%s --out\n", __FUNCTION__);
-                     pthread_mutex_unlock(&plMutex);
-                     return T2ERROR_SUCCESS;
+                     break;
                 }
              }
         }
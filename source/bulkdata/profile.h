@@ -46,6 +46,7 @@ typedef struct _Profile
     bool generateNow;
     bool bClearSeekMap;
     bool triggerReportOnCondition;
+    bool deltaReporting;
     char* hash;
     char* name;
     char* protocol;
@@ -58,13 +59,19 @@ typedef struct _Profile
     unsigned int timeRef;
     unsigned int paramNumOfEntries;
     unsigned int minThresholdDuration;
+    unsigned int deltaSnapshotPeriod;
     Vector *paramList;
     Vector *staticParamList;
     T2HTTP *t2HTTPDest;
     Vector *eMarkerList;
     Vector *gMarkerList;
-    Vector *cachedReportList;
-    cJSON *jsonReportObj;
+    unsigned int pendingUploads;
+    JSONReportWriter *jsonReportObj;
+    JSONReportTemplate *reportTemplate;
+    HTTPUrlTemplate *urlTemplate;
+    ReportDelta *reportDelta;
+    // Replays of the destination's spool when the report in progress began
+    unsigned int spoolReplayCount;
     pthread_t reportThread;
     Vector *triggerConditionList;
 }Profile;
@@ -101,7 +108,7 @@ bool isProfileEnabled(const char *profileName);
 
 T2ERROR registerTriggerConditionConsumer();
 
-T2ERROR triggerReportOnCondtion(const char *referenceName);
+T2ERROR triggerReportOnCondtion(const char *referenceName, const char *oprator, int threshold);
 
 unsigned int getMinThresholdDuration(char *profileName);
 
@@ -40,6 +40,8 @@
 static bool initialized = false;
 static ProfileXConf *singleProfile = NULL;
 static pthread_mutex_t plMutex; /* TODO - we can remove plMutex most likely but first check that CollectAndReport doesn't cause issue */
+// Set while the profile waits for its report to be removed, no report starts meanwhile
+static bool profileDeleting = false;
 
 static void freeConfig(void *data)
 {
@@ -91,43 +93,35 @@ static void freeProfileXConf()
     }
 }
 
-static T2ERROR initJSONReportXconf(cJSON** jsonObj, cJSON **valArray)
+static T2ERROR initJSONReportXconf(ProfileXConf *profile)
 {
-    *jsonObj = cJSON_CreateObject();
-    if(*jsonObj == NULL)
+    size_t sizeHint = estimateJSONReportSize(NULL, profile->paramList, profile->gMarkerList, profile->eMarkerList);
+    if(T2ERROR_SUCCESS != initJSONReport(&profile->jsonReportObj, "searchResult", sizeHint))
     {
-        T2Error("Failed to create cJSON object\n");
+        T2Error("Failed to create JSON report\n");
         return T2ERROR_FAILURE;
     }
 
-    cJSON_AddItemToObject(*jsonObj, "searchResult", *valArray = cJSON_CreateArray());
-
-    cJSON *arrayItem = NULL;
     char *currenTime ;
 
-    arrayItem = cJSON_CreateObject();
-    cJSON_AddStringToObject(arrayItem, T2REPORT_HEADER, T2REPORT_HEADERVAL);
-    cJSON_AddItemToArray(*valArray, arrayItem);
+    addJSONReportString(profile->jsonReportObj, T2REPORT_HEADER, T2REPORT_HEADERVAL);
 
-    arrayItem = cJSON_CreateObject();
     // Requirement from field triage to be a fixed string instead of actual profile name .
 #if defined(ENABLE_RDKB_SUPPORT)
-    cJSON_AddStringToObject(arrayItem, "Profile", "RDKB");
+    addJSONReportString(profile->jsonReportObj, "Profile", "RDKB");
 #else
-    cJSON_AddStringToObject(arrayItem, "Profile", "RDKV");
+    addJSONReportString(profile->jsonReportObj, "Profile", "RDKV");
 #endif
-    cJSON_AddItemToArray(*valArray, arrayItem);
 
     getTimeStamp(&currenTime);
-    arrayItem = cJSON_CreateObject( );
     if (NULL != currenTime) {
-        cJSON_AddStringToObject(arrayItem, "Time", currenTime);
+        addJSONReportString(profile->jsonReportObj, "Time", currenTime);
         free(currenTime);
         currenTime = NULL;
     } else {
-        cJSON_AddStringToObject(arrayItem, "Time", "Unknown");
+        addJSONReportString(profile->jsonReportObj, "Time", "Unknown");
     }
-    cJSON_AddItemToArray(*valArray, arrayItem);
+    markJSONReportHeader(profile->jsonReportObj);
 
     return T2ERROR_SUCCESS;
 }
@@ -138,8 +132,8 @@ static void* CollectAndReportXconf(void* data)
 
     Vector *profileParamVals = NULL;
     Vector *grepResultList = NULL;
-    cJSON *valArray = NULL;
-    char* jsonReport = NULL;
+    Vector *reportParts = NULL;
+    int partIndex = 0;
 
     struct timespec startTime;
     struct timespec endTime;
@@ -152,7 +146,7 @@ static void* CollectAndReportXconf(void* data)
     clock_gettime(CLOCK_REALTIME, &startTime);
     if(!strcmp(profile->encodingType, "JSON"))
     {
-        if(T2ERROR_SUCCESS != initJSONReportXconf(&profile->jsonReportObj, &valArray))
+        if(T2ERROR_SUCCESS != initJSONReportXconf(profile))
         {
             T2Error("Failed to initialize JSON Report\n");
             profile->reportInProgress = false;
@@ -167,7 +161,7 @@ static void* CollectAndReportXconf(void* data)
                 T2Info("Fetch complete for TR-181 Object/Parameter Values for parameters \n");
                 if(profileParamVals != NULL)
                 {
-                    encodeParamResultInJSON(valArray, profile->paramList, profileParamVals);
+                    encodeParamResultInJSON(profile->jsonReportObj, profile->paramList, profileParamVals);
                 }
                 Vector_Destroy(profileParamVals, freeProfileValues);
             }
@@ -175,79 +169,74 @@ static void* CollectAndReportXconf(void* data)
             {
                 getGrepResults(profile->name, profile->gMarkerList, &grepResultList, profile->bClearSeekMap);
                 T2Info("Grep complete for %d markers \n", Vector_Size(profile->gMarkerList));
-                encodeGrepResultInJSON(valArray, grepResultList);
+                encodeGrepResultInJSON(profile->jsonReportObj, grepResultList);
                 Vector_Destroy(grepResultList, freeGResult);
             }
             if(Vector_Size(profile->eMarkerList) > 0)
             {
-                encodeEventMarkersInJSON(valArray, profile->eMarkerList);
+                encodeEventMarkersInJSON(profile->jsonReportObj, profile->eMarkerList);
             }
-            ret = prepareJSONReport(profile->jsonReportObj, &jsonReport);
+            Vector_Create(&reportParts);
+            ret = prepareJSONReportParts(profile->jsonReportObj, ReportProfiles_getMaxReportSize(), reportParts);
             destroyJSONReport(profile->jsonReportObj);
             profile->jsonReportObj = NULL;
 
             if(ret != T2ERROR_SUCCESS)
             {
                 T2Error("Unable to generate report for : %s\n", profile->name);
+                Vector_Destroy(reportParts, freeReportPart);
                 profile->reportInProgress = false;
                 return NULL;
             }
-            long size = strlen(jsonReport);
-            T2Info("cJSON Report = %s\n", jsonReport);
-            T2Info("Report Size = %ld\n", size);
-            if(profile->isUpdated)
+            // Parts of a split report are sent and cached independently
+            for(partIndex = 0; partIndex < Vector_Size(reportParts); partIndex++)
             {
-                T2Info("Profile is udpated, report is cached to send with updated Profile TIMEOUT\n");
-                if(Vector_Size(profile->cachedReportList) == MAX_CACHED_REPORTS)
+                ReportPart *part = (ReportPart *) Vector_At(reportParts, partIndex);
+                char *jsonReport = part->data;
+                T2Info("cJSON Report = %s\n", jsonReport);
+                T2Info("Report Size = %ld\n", (long) part->length);
+                if(profile->isUpdated)
                 {
-                    T2Debug("Max Cached Reports Limit Reached, Overwriting third recent report\n");
-                    char *thirdCachedReport = (char *)Vector_At(profile->cachedReportList, MAX_CACHED_REPORTS-3);
-                    Vector_RemoveItem(profile->cachedReportList, thirdCachedReport, NULL);
-                    free(thirdCachedReport);
+                    T2Info("Profile is udpated, report is cached to send with updated Profile TIMEOUT\n");
+                    ret = T2ERROR_FAILURE;
                 }
-                Vector_PushBack(profile->cachedReportList, strdup(jsonReport));
-                profile->reportInProgress = false;
-		if(jsonReport){
-                        free(jsonReport);
-			jsonReport= NULL;
-		}
-                T2Debug("%s --out\n", __FUNCTION__);
-                return NULL;
-            }
-            else
-            {
-                if(size > DEFAULT_MAX_REPORT_SIZE)
+                else if(strcmp(profile->protocol, "HTTP") != 0)
                 {
-                    T2Warning("Report size is exceeding the max limit : %d\n", DEFAULT_MAX_REPORT_SIZE);
+                    T2Error("Unsupported report send protocol : %s\n", profile->protocol);
+                    continue;
                 }
-                if(strcmp(profile->protocol, "HTTP") == 0)
+                else
                 {
                     ret = sendReportOverHTTP(profile->t2HTTPDest->URL, jsonReport);
-
-                    if(ret == T2ERROR_FAILURE)
-                    {
-                        if(Vector_Size(profile->cachedReportList) == MAX_CACHED_REPORTS)
-                        {
-                            T2Debug("Max Cached Reports Limit Reached, Overwriting third recent report\n");
-                            char *thirdCachedReport = (char *)Vector_At(profile->cachedReportList, MAX_CACHED_REPORTS-3);
-                            Vector_RemoveItem(profile->cachedReportList, thirdCachedReport, NULL);
-                            free(thirdCachedReport);
-                        }
-                        Vector_PushBack(profile->cachedReportList, strdup(jsonReport));
-
-                        T2Info("Report Cached, No. of reportes cached = %d\n", Vector_Size(profile->cachedReportList));
-                    }
-                    else if(Vector_Size(profile->cachedReportList) > 0)
-                    {
-                        T2Info("Trying to send  %d cached reports\n", Vector_Size(profile->cachedReportList));
-                        ret = sendCachedReportsOverHTTP(profile->t2HTTPDest->URL, profile->cachedReportList);
-                    }
                 }
-                else
+                if(ret == T2ERROR_FAILURE)
                 {
-                    T2Error("Unsupported report send protocol : %s\n", profile->protocol);
+                    if(Vector_Size(profile->cachedReportList) == MAX_CACHED_REPORTS)
+                    {
+                        T2Debug("Max Cached Reports Limit Reached, Overwriting third recent report\n");
+                        char *thirdCachedReport = (char *)Vector_At(profile->cachedReportList, MAX_CACHED_REPORTS-3);
+                        Vector_RemoveItem(profile->cachedReportList, thirdCachedReport, NULL);
+                        free(thirdCachedReport);
+                    }
+                    // The cache owns the part from here on
+                    Vector_PushBack(profile->cachedReportList, jsonReport);
+                    part->data = NULL;
+
+                    T2Info("Report Cached, No. of reportes cached = %d\n", Vector_Size(profile->cachedReportList));
                 }
             }
+            Vector_Destroy(reportParts, freeReportPart);
+            if(profile->isUpdated)
+            {
+                profile->reportInProgress = false;
+                T2Debug("%s --out\n", __FUNCTION__);
+                return NULL;
+            }
+            if(ret == T2ERROR_SUCCESS && strcmp(profile->protocol, "HTTP") == 0 && Vector_Size(profile->cachedReportList) > 0)
+            {
+                T2Info("Trying to send  %d cached reports\n", Vector_Size(profile->cachedReportList));
+                ret = sendCachedReportsOverHTTP(profile->t2HTTPDest->URL, profile->cachedReportList);
+            }
         }
     }
     else
@@ -257,11 +246,6 @@ static void* CollectAndReportXconf(void* data)
     clock_gettime(CLOCK_REALTIME, &endTime);
     getLapsedTime(&elapsedTime, &endTime, &startTime);
     T2Info("Elapsed Time for : %s = %lu.%lu (Sec.NanoSec)\n", profile->name, elapsedTime.tv_sec, elapsedTime.tv_nsec);
-    if(jsonReport)
-    {
-        free(jsonReport);
-        jsonReport = NULL;
-    }
 
     profile->reportInProgress = false;
     T2Debug("%s --out\n", __FUNCTION__);
@@ -322,6 +306,9 @@ T2ERROR ProfileXConf_uninit()
     initialized = false;
 
     pthread_mutex_lock(&plMutex);
+    profileDeleting = true;
+    pthread_mutex_unlock(&plMutex);
+    // Timeout callbacks of all profiles take plMutex, it is not held while waiting
     if(singleProfile->reportInProgress)
     {
         T2Debug("Waiting for final report before uninit\n");
@@ -329,7 +316,9 @@ T2ERROR ProfileXConf_uninit()
         singleProfile->reportInProgress = false ;
         T2Info("Final report is completed, releasing profile memory\n");
     }
+    pthread_mutex_lock(&plMutex);
     freeProfileXConf();
+    profileDeleting = false;
     pthread_mutex_unlock(&plMutex);
 
     pthread_mutex_destroy(&plMutex);
@@ -356,7 +345,7 @@ T2ERROR ProfileXConf_set(ProfileXConf *profile)
             eMarker = (EventMarker *)Vector_At(singleProfile->eMarkerList, emIndex);
             addT2EventMarker(eMarker->markerName, eMarker->compName, singleProfile->name, eMarker->skipFreq);
         }
-        if(registerProfileWithScheduler(singleProfile->name, singleProfile->reportingInterval, INFINITE_TIMEOUT, true) == T2ERROR_SUCCESS)
+        if(registerProfileWithScheduler(singleProfile->name, singleProfile->reportingInterval, INFINITE_TIMEOUT, true, 0) == T2ERROR_SUCCESS)
         {
             T2Info("Successfully set profile : %s\n", singleProfile->name);
             #ifdef _COSA_INTEL_XB3_ARM_
@@ -437,7 +426,10 @@ T2ERROR ProfileXConf_delete(ProfileXConf *profile)
     }
 
     pthread_mutex_lock(&plMutex);
+    profileDeleting = true;
+    pthread_mutex_unlock(&plMutex);
 
+    // Timeout callbacks of all profiles take plMutex, it is not held while waiting
     if(singleProfile->reportInProgress)
     {
         T2Info("Waiting for CollectAndReport to be complete : %s\n", singleProfile->name);
@@ -445,6 +437,8 @@ T2ERROR ProfileXConf_delete(ProfileXConf *profile)
         singleProfile->reportInProgress = false ;
     }
 
+    pthread_mutex_lock(&plMutex);
+
     int count = Vector_Size(singleProfile->cachedReportList);
     // Copy any cached message present in previous single profile to new profile
     if(profile != NULL) {
@@ -468,6 +462,7 @@ T2ERROR ProfileXConf_delete(ProfileXConf *profile)
 #endif
     T2Info("removing profile : %s\n", singleProfile->name);
     freeProfileXConf();
+    profileDeleting = false;
 
     pthread_mutex_unlock(&plMutex);
     T2Debug("%s --out\n", __FUNCTION__);
@@ -530,7 +525,11 @@ void ProfileXConf_notifyTimeout(bool isClearSeekMap)
         pthread_mutex_unlock(&plMutex);
         return ;
     }
-    if(!singleProfile->reportInProgress)
+    if(profileDeleting)
+    {
+        T2Warning("Received profileTimeoutCb while the profile is being removed - ignoring the request\n");
+    }
+    else if(!singleProfile->reportInProgress)
     {
         singleProfile->bClearSeekMap = isClearSeekMap;
         singleProfile->reportInProgress = true;
@@ -59,7 +59,7 @@ typedef struct _ProfileXConf
     Vector *eMarkerList;
     Vector *gMarkerList;
     Vector *cachedReportList;
-    cJSON *jsonReportObj;
+    JSONReportWriter *jsonReportObj;
     pthread_t reportThread;
 }ProfileXConf;
 
@@ -237,6 +237,10 @@ T2ERROR ReportProfiles_storeMarkerEvent(char *profileName, T2Event *eventInfo) {
     return T2ERROR_SUCCESS;
 }
 
+unsigned int ReportProfiles_getMaxReportSize() {
+    return bulkdata.maxReportSize ? bulkdata.maxReportSize : DEFAULT_MAX_REPORT_SIZE;
+}
+
 T2ERROR ReportProfiles_setProfileXConf(ProfileXConf *profile) {
     T2Debug("%s ++in\n", __FUNCTION__);
     if(T2ERROR_SUCCESS != ProfileXConf_set(profile)) {
@@ -85,6 +85,8 @@ void ReportProfiles_ProcessReportProfilesBlob(cJSON *profiles_root);
 
 void ReportProfiles_Interrupt();
 
+unsigned int ReportProfiles_getMaxReportSize();
+
 /* MSGPACK Declarations */
 
 struct __msgpack__
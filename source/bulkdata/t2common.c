@@ -31,6 +31,10 @@ void freeParam(void *data)
             free((char*)param->alias);
         if(param->paramType)
             free(param->paramType);
+        if(param->firstValue)
+            free(param->firstValue);
+        if(param->lastValue)
+            free(param->lastValue);
         free(param);
     }
 }
@@ -30,6 +30,18 @@ typedef enum
     MTYPE_ABSOLUTE
 }MarkerType;
 
+typedef enum
+{
+    PARAM_METHOD_POLL,
+    PARAM_METHOD_ONCHANGE
+}ParamMethod;
+
+typedef enum
+{
+    PARAM_USE_ABSOLUTE,
+    PARAM_USE_COUNT,
+    PARAM_USE_SUMMARY
+}ParamUse;
 
 typedef struct _Param
 {
@@ -37,6 +49,13 @@ typedef struct _Param
     char* paramType;
     char* name;
     const char* alias;
+    ParamMethod method;
+    ParamUse use;
+    bool isSubscribed;
+    // Value change state of onChange parameters, guarded by the rbus subscription lock
+    char* firstValue;
+    char* lastValue;
+    unsigned int changeCount;
 }Param;
 
 typedef struct _StaticParam
@@ -19,6 +19,7 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 #include <rbus/rbus.h>
 
 #include "t2log_wrapper.h"
@@ -29,6 +30,9 @@
 #endif
 
 #include "rbusInterface.h"
+#include "paramCache.h"
+#include "paramCollector.h"
+#include "profile.h"
 
 static bool isRbus = false ;
 static bool isBusInit = false ;
@@ -59,9 +63,30 @@ T2ERROR getParameterValue(const char* paramName, char **paramValue)
 {
     T2Debug("%s ++in \n", __FUNCTION__);
     T2ERROR ret = T2ERROR_FAILURE ;
+    profileValues *cached = NULL;
+    ParamCacheStatus status;
     if(!isBusInit)
         busInit();
 
+    status = paramCacheLookup(paramName, &cached);
+    if(status == PARAM_CACHE_INFLIGHT)
+        status = paramCacheWait(paramName, &cached);
+    if(status == PARAM_CACHE_HIT)
+    {
+        if(cached->paramValueCount > 0 && cached->paramValues[0] && cached->paramValues[0]->parameterValue)
+        {
+            *paramValue = strdup(cached->paramValues[0]->parameterValue);
+            ret = T2ERROR_SUCCESS;
+        }
+        freeParamValueSt(cached->paramValues, cached->paramValueCount > 0 ? cached->paramValueCount : 1);
+        free(cached);
+        if(ret == T2ERROR_SUCCESS)
+        {
+            T2Debug("%s --out \n", __FUNCTION__);
+            return ret;
+        }
+    }
+
     if(isRbus)
         ret = getRbusParameterVal(paramName,paramValue);
 #if defined(CCSP_SUPPORT_ENABLED)
@@ -69,28 +94,178 @@ T2ERROR getParameterValue(const char* paramName, char **paramValue)
         ret = getCCSPParamVal(paramName, paramValue);
 #endif
 
+    if(status == PARAM_CACHE_CLAIMED)
+    {
+        if(ret == T2ERROR_SUCCESS && *paramValue)
+        {
+            profileValues *fetched = createParamValues(paramName, *paramValue);
+            if(fetched)
+            {
+                fetched->paramValueCount = 1;
+                paramCachePut(paramName, fetched);
+                freeParamValueSt(fetched->paramValues, 1);
+                free(fetched);
+            }
+            else
+                paramCacheAbort(paramName);
+        }
+        else
+            paramCacheAbort(paramName);
+    }
+
     T2Debug("%s --out \n", __FUNCTION__);
     return ret;
 }
 
+/**
+ * Fetch the listed parameters from the bus and publish the results to the shared cache.
+ */
+static void fetchClaimedParams(Vector *paramList, int *indexes, int count, profileValues **results)
+{
+    Vector *fetchList = NULL;
+    Vector *fetched = NULL;
+    int i = 0;
+
+    if(count == 0)
+        return;
+
+    Vector_Create(&fetchList);
+    for( i = 0; i < count; i++ )
+        Vector_PushBack(fetchList, Vector_At(paramList, indexes[i]));
+
+    if(isRbus)
+    	fetched = getRbusProfileParamValues(fetchList);
+#if defined(CCSP_SUPPORT_ENABLED)
+    else
+        fetched = getCCSPProfileParamValues(fetchList);
+#endif
+
+    for( i = 0; i < count; i++ )
+    {
+        const char *name = ((Param *) Vector_At(paramList, indexes[i]))->alias;
+        if(fetched && i < Vector_Size(fetched))
+        {
+            results[indexes[i]] = (profileValues *) Vector_At(fetched, i);
+            paramCachePut(name, results[indexes[i]]);
+        }
+        else
+            paramCacheAbort(name);
+    }
+    // Only the containers are released, values are handed over to results
+    if(fetched)
+        Vector_Destroy(fetched, NULL);
+    Vector_Destroy(fetchList, NULL);
+}
+
+/**
+ * Profile parameters are served from the value cache shared between profiles when
+ * possible. Parameters another profile is fetching at the same time are waited for
+ * instead of being requested twice.
+ */
 Vector* getProfileParameterValues(Vector *paramList)
 {
     T2Debug("%s ++in\n", __FUNCTION__);
     Vector *profileValueList = NULL;
+    profileValues **results = NULL;
+    ParamCacheStatus *status = NULL;
+    int *indexes = NULL;
+    int count = 0, claimed = 0, hits = 0;
+    int i = 0;
     if(!isBusInit)
         busInit();
 
-    if(isRbus)
-    	profileValueList = getRbusProfileParamValues(paramList);
-#if defined(CCSP_SUPPORT_ENABLED)
-    else
-        profileValueList = getCCSPProfileParamValues(paramList);
-#endif
+    count = Vector_Size(paramList);
+    results = (profileValues **) calloc(count > 0 ? count : 1, sizeof(profileValues *));
+    status = (ParamCacheStatus *) calloc(count > 0 ? count : 1, sizeof(ParamCacheStatus));
+    indexes = (int *) calloc(count > 0 ? count : 1, sizeof(int));
+    if(results == NULL || status == NULL || indexes == NULL)
+    {
+        T2Error("Unable to allocate memory for profile param values\n");
+        free(results);
+        free(status);
+        free(indexes);
+        return NULL;
+    }
+
+    for( i = 0; i < count; i++ )
+    {
+        Param *param = (Param *) Vector_At(paramList, i);
+        char *heldValue = NULL;
+        if(isRbus && param->isSubscribed && getRbusSubscribedParamValue(param, &heldValue))
+        {
+            // Value is held from change events, nothing to fetch
+            results[i] = createParamValues(param->alias, heldValue);
+            free(heldValue);
+            if(results[i])
+            {
+                results[i]->paramValueCount = 1;
+                status[i] = PARAM_CACHE_HIT;
+                hits++;
+                continue;
+            }
+        }
+        status[i] = paramCacheLookup(param->alias, &results[i]);
+        if(status[i] == PARAM_CACHE_CLAIMED)
+            indexes[claimed++] = i;
+        else if(status[i] == PARAM_CACHE_HIT)
+            hits++;
+    }
+    T2Debug("Param cache hits : %d, fetching : %d of %d\n", hits, claimed, count);
+    fetchClaimedParams(paramList, indexes, claimed, results);
+
+    // Own claims are published before waiting, so collectors never wait on each other in a cycle
+    claimed = 0;
+    for( i = 0; i < count; i++ )
+    {
+        if(status[i] == PARAM_CACHE_INFLIGHT
+                && PARAM_CACHE_CLAIMED == paramCacheWait(((Param *) Vector_At(paramList, i))->alias, &results[i]))
+            indexes[claimed++] = i;
+    }
+    fetchClaimedParams(paramList, indexes, claimed, results);
+
+    Vector_Create(&profileValueList);
+    for( i = 0; i < count; i++ )
+    {
+        Param *param = (Param *) Vector_At(paramList, i);
+        if(results[i] == NULL)
+            results[i] = createParamValues(param->alias, "NULL");
+        else if(isRbus && param->isSubscribed && results[i]->paramValueCount == 1)
+            rbusT2ParamSeedValue(param, results[i]->paramValues[0]->parameterValue);
+        Vector_PushBack(profileValueList, results[i]);
+    }
+    free(results);
+    free(status);
+    free(indexes);
 
     T2Debug("%s --Out\n", __FUNCTION__);
     return profileValueList;
 }
 
+T2ERROR subscribeProfileParams(Vector *paramList)
+{
+    T2ERROR ret = T2ERROR_SUCCESS;
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(!isBusInit)
+        busInit();
+
+    if(isRbus)
+        ret = rbusT2ParamSubscribe(paramList);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
+T2ERROR unsubscribeProfileParams(Vector *paramList)
+{
+    T2ERROR ret = T2ERROR_SUCCESS;
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(isRbus)
+        ret = rbusT2ParamUnSubscribe(paramList);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
 void freeParamValueSt(tr181ValStruct_t **valStructs, int valSize) {
     int i;
     if(valStructs == NULL)
@@ -147,5 +322,13 @@ T2ERROR busUninit()
     {
     	unregisterRbusT2EventListener();
     }
+#if defined(CCSP_SUPPORT_ENABLED)
+    else
+    {
+        clearDestComponentCache();
+    }
+#endif
+    uninitParamCollector();
+    paramCacheClear();
     return T2ERROR_SUCCESS;
 }
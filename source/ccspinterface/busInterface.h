@@ -60,6 +60,11 @@ T2ERROR getParameterValue(const char* paramName, char **paramValue);
 
 Vector* getProfileParameterValues(Vector *paramList);
 
+// onChange parameters are only subscribed in rBus mode, they are polled otherwise
+T2ERROR subscribeProfileParams(Vector *paramList);
+
+T2ERROR unsubscribeProfileParams(Vector *paramList);
+
 void freeParamValueSt(tr181ValStruct_t **valStructs, int valSize);
 
 T2ERROR registerForTelemetryEvents(TelemetryEventCallback eventCB);
@@ -20,16 +20,30 @@
 
 #include <stdbool.h>
 #include <syslog.h>
+#include <pthread.h>
+#include <time.h>
 #include <ccsp/ansc_platform.h>
 
 #include "busInterface.h"
 #include "ccspinterface.h"
+#include "paramCollector.h"
 #include "t2log_wrapper.h"
 #include "vector.h"
 #include "t2common.h"
+#include "t2collection.h"
 #include "ssp_global.h"
 
+typedef struct _DestComponent
+{
+    char *compName;
+    char *dbusPath;
+    time_t expiry;
+} DestComponent;
+
 static void *bus_handle = NULL;
+static hash_map_t *destComponentMap = NULL;
+static pthread_mutex_t destComponentMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t busHandleMutex = PTHREAD_MUTEX_INITIALIZER;
 
 static T2ERROR ccspGetParameterValues(const char **paramNames, const int paramNamesCount, parameterValStruct_t ***valStructs, int *valSize);
 
@@ -39,12 +53,23 @@ static T2ERROR getParameterNames(const char *objName, parameterInfoStruct_t ***p
 
 void freeParamInfoSt(parameterInfoStruct_t **paramNamesSt, int paramNamesLength);
 
+/**
+ * Connect to the message bus once. Safe to call from every entry point and from
+ * the collector threads, only the first caller performs the initialization.
+ */
 static T2ERROR CCSPInterface_Init()
 {
-    T2Debug("%s ++in\n", __FUNCTION__);
     char *pCfg = CCSP_MSG_BUS_CFG;
     char *componentId = NULL;
 
+    pthread_mutex_lock(&busHandleMutex);
+    if(bus_handle)
+    {
+        pthread_mutex_unlock(&busHandleMutex);
+        return T2ERROR_SUCCESS;
+    }
+    T2Debug("%s ++in\n", __FUNCTION__);
+
 #ifndef _COSA_INTEL_USG_ATOM_    /* Avoid duplicate componentId in multiprocessor devices */
     componentId = getComponentId();
 #endif
@@ -57,19 +82,98 @@ static T2ERROR CCSPInterface_Init()
 
     if (ret == -1)
     {
+        bus_handle = NULL;
+        pthread_mutex_unlock(&busHandleMutex);
         T2Error("%s:%d, init failed\n", __func__, __LINE__);
         return T2ERROR_FAILURE;
     }
+    pthread_mutex_unlock(&busHandleMutex);
     T2Debug("%s --out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
+static time_t getMonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void freeDestComponent(void *data)
+{
+    if(data != NULL)
+    {
+        hash_element_t *element = (hash_element_t *) data;
+        DestComponent *dest = (DestComponent *) element->data;
+        if(dest)
+        {
+            free(dest->compName);
+            free(dest->dbusPath);
+            free(dest);
+        }
+        free(element->key);
+        free(element);
+    }
+}
+
+/**
+ * Drop the cached owner of a namespace, used when a get through the cached
+ * component fails so that the next lookup goes back to the CR.
+ */
+static void invalidateDestComponent(const char *paramName)
+{
+    DestComponent *dest = NULL;
+    pthread_mutex_lock(&destComponentMutex);
+    if(destComponentMap)
+    {
+        dest = (DestComponent *) hash_map_remove(destComponentMap, paramName);
+        if(dest)
+        {
+            T2Debug("Invalidated cached component for %s\n", paramName);
+            free(dest->compName);
+            free(dest->dbusPath);
+            free(dest);
+        }
+    }
+    pthread_mutex_unlock(&destComponentMutex);
+}
+
+/**
+ * Resolve the component owning a namespace. Results of the CR lookup are cached
+ * for DEST_COMPONENT_CACHE_TTL seconds. The cache is keyed on the full namespace
+ * as the CR allows different components to register parameters of the same object.
+ */
 static int findDestComponent(char *paramName, char **destCompName, char **destPath)
 {
     int ret, size =0;
     char dst_pathname_cr[256] = {0};
     componentStruct_t **ppComponents = NULL;
+    DestComponent *dest = NULL;
     T2Debug("%s ++in for paramName : %s\n", __FUNCTION__, paramName);
+
+    pthread_mutex_lock(&destComponentMutex);
+    if(destComponentMap)
+    {
+        dest = (DestComponent *) hash_map_get(destComponentMap, paramName);
+        if(dest && dest->expiry > getMonotonicSeconds())
+        {
+            *destCompName = strdup(dest->compName);
+            *destPath = strdup(dest->dbusPath);
+            pthread_mutex_unlock(&destComponentMutex);
+            T2Debug("Cached destCompName = %s destPath = %s \n", *destCompName, *destPath);
+            T2Debug("%s --out\n", __FUNCTION__);
+            return CCSP_SUCCESS;
+        }
+    }
+    pthread_mutex_unlock(&destComponentMutex);
+
+    // The CR lookup needs the bus, which may not be connected yet on a cache miss
+    if(T2ERROR_SUCCESS != CCSPInterface_Init())
+    {
+        T2Error("Message bus is not initialized, unable to resolve component for %s\n", paramName);
+        return CCSP_ERR_NOT_CONNECT;
+    }
+
     snprintf(dst_pathname_cr, sizeof(dst_pathname_cr), "eRT.%s", CCSP_DBUS_INTERFACE_CR);
     ret = CcspBaseIf_discComponentSupportingNamespace(bus_handle, dst_pathname_cr, paramName, "", &ppComponents, &size);
     if ( ret == CCSP_SUCCESS && size >= 1)
@@ -85,10 +189,50 @@ static int findDestComponent(char *paramName, char **destCompName, char **destPa
     }
     free_componentStruct_t(bus_handle, size, ppComponents);
 
+    dest = (DestComponent *) malloc(sizeof(DestComponent));
+    if(dest)
+    {
+        dest->compName = strdup(*destCompName);
+        dest->dbusPath = strdup(*destPath);
+        dest->expiry = getMonotonicSeconds() + DEST_COMPONENT_CACHE_TTL;
+        pthread_mutex_lock(&destComponentMutex);
+        if(destComponentMap == NULL)
+            destComponentMap = hash_map_create();
+        if(destComponentMap)
+        {
+            DestComponent *stale = (DestComponent *) hash_map_remove(destComponentMap, paramName);
+            if(stale)
+            {
+                free(stale->compName);
+                free(stale->dbusPath);
+                free(stale);
+            }
+            hash_map_put(destComponentMap, strdup(paramName), dest);
+        }
+        else
+        {
+            free(dest->compName);
+            free(dest->dbusPath);
+            free(dest);
+        }
+        pthread_mutex_unlock(&destComponentMutex);
+    }
+
     T2Debug("%s --out\n", __FUNCTION__);
     return ret;
 }
 
+void clearDestComponentCache()
+{
+    pthread_mutex_lock(&destComponentMutex);
+    if(destComponentMap)
+    {
+        hash_map_destroy(destComponentMap, freeDestComponent);
+        destComponentMap = NULL;
+    }
+    pthread_mutex_unlock(&destComponentMutex);
+}
+
 bool isCCSPInitialized(){
 
     return bus_handle != NULL ? true : false ;
@@ -100,7 +244,7 @@ T2ERROR ccspGetParameterValues(const char **paramNames, const int paramNamesCoun
     T2ERROR retErrCode = T2ERROR_FAILURE;
     T2Debug("%s ++in\n", __FUNCTION__);
     *valSize = 0 ;
-    if(!bus_handle && T2ERROR_SUCCESS != CCSPInterface_Init())
+    if(T2ERROR_SUCCESS != CCSPInterface_Init())
     {
         return T2ERROR_FAILURE;
     }
@@ -116,6 +260,7 @@ T2ERROR ccspGetParameterValues(const char **paramNames, const int paramNamesCoun
         if (ret != CCSP_SUCCESS)
         {
             T2Error("CcspBaseIf_getParameterValues failed for : %s with ret = %d\n", paramNames[0], ret);
+            invalidateDestComponent(paramNames[0]);
         }
         else
         {
@@ -149,7 +294,7 @@ T2ERROR getParameterNames(const char *objName, parameterInfoStruct_t ***paramNam
     char *destCompName = NULL, *destCompPath = NULL;
     T2Debug("%s ++in\n", __FUNCTION__);
 
-    if(!bus_handle && T2ERROR_SUCCESS != CCSPInterface_Init())
+    if(T2ERROR_SUCCESS != CCSPInterface_Init())
     {
         return T2ERROR_FAILURE;
     }
@@ -202,7 +347,7 @@ T2ERROR getCCSPParamVal(const char* paramName, char **paramValue)
     parameterValStruct_t **valStructs = NULL;
     int valSize = 0;
     char *paramNames[1] = {NULL};
-    if(!bus_handle && T2ERROR_SUCCESS != CCSPInterface_Init())
+    if(T2ERROR_SUCCESS != CCSPInterface_Init())
     {
         return T2ERROR_FAILURE;
     }
@@ -222,71 +367,209 @@ T2ERROR getCCSPParamVal(const char* paramName, char **paramValue)
     return T2ERROR_SUCCESS;
 }
 
+static profileValues* getCCSPSingleParamValues(const char *param)
+{
+    parameterValStruct_t **ccspParamValues = NULL;
+    const char *paramNames[1] = { param };
+    int paramValCount = 0;
+    int iterate = 0;
+    profileValues *profVals = NULL;
+
+    if(T2ERROR_SUCCESS != ccspGetParameterValues(paramNames, 1, &ccspParamValues, &paramValCount)) {
+        T2Error("Failed to retrieve param : %s\n", param);
+        paramValCount = 0;
+    }else {
+        if(ccspParamValues == NULL || paramValCount == 0)
+            T2Info("ParameterName : %s Retrieved value count : %d\n", param, paramValCount);
+    }
+
+    // Populate bus independent parameter value array
+    if(paramValCount == 0)
+        return createParamValues(param, "NULL");
+
+    profVals = (profileValues *) malloc(sizeof(profileValues));
+    if(profVals == NULL) {
+        free_parameterValStruct_t(bus_handle, paramValCount, ccspParamValues);
+        return NULL;
+    }
+    profVals->paramValueCount = paramValCount;
+    profVals->paramValues = (tr181ValStruct_t**) malloc(paramValCount * sizeof(tr181ValStruct_t*));
+    if(profVals->paramValues != NULL) {
+        for( iterate = 0; iterate < paramValCount; ++iterate ) {
+            profVals->paramValues[iterate] = NULL;
+            if(ccspParamValues[iterate]) {
+                profVals->paramValues[iterate] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
+                if(profVals->paramValues[iterate]) {
+                    profVals->paramValues[iterate]->parameterName = strdup((ccspParamValues[iterate])->parameterName);
+                    profVals->paramValues[iterate]->parameterValue = strdup((ccspParamValues[iterate])->parameterValue);
+                }
+            }
+        }
+    }
+    free_parameterValStruct_t(bus_handle, paramValCount, ccspParamValues);
+    return profVals;
+}
+
+/**
+ * Only fully qualified names can be matched back to the request by name,
+ * partial paths are fetched individually.
+ */
+static bool isBatchableParam(const char *param)
+{
+    size_t len = strlen(param);
+    return (len > 0 && param[len - 1] != '.');
+}
+
+/**
+ * Fetch parameters owned by one component with a single CcspBaseIf_getParameterValues
+ * call. A failing batch is retried parameter by parameter so that one invalid name
+ * does not fail the rest of the batch.
+ */
+static void getCCSPParamBatch(ParamBatch *batch, const char **paramNames, profileValues **results)
+{
+    parameterValStruct_t **ccspParamValues = NULL;
+    char **batchNames = NULL;
+    int paramValCount = 0;
+    int i = 0, j = 0, ret = 0;
+
+    if(batch->count == 1 || batch->provider == NULL) {
+        for( i = 0; i < batch->count; i++ )
+            results[batch->paramIndex[i]] = getCCSPSingleParamValues(paramNames[batch->paramIndex[i]]);
+        return;
+    }
+
+    batchNames = (char **) malloc(batch->count * sizeof(char*));
+    if(batchNames == NULL)
+        return;
+    for( i = 0; i < batch->count; i++ )
+        batchNames[i] = (char*) paramNames[batch->paramIndex[i]];
+
+    T2Debug("Calling CcspBaseIf_getParameterValues for %d params on %s\n", batch->count, batch->provider);
+    ret = CcspBaseIf_getParameterValues(bus_handle, batch->provider, batch->providerPath, batchNames, batch->count, &paramValCount, &ccspParamValues);
+    if(ret != CCSP_SUCCESS) {
+        T2Info("Batch get of %d params from %s failed with ret = %d, retrying individually\n", batch->count, batch->provider, ret);
+        for( i = 0; i < batch->count; i++ ) {
+            invalidateDestComponent(batchNames[i]);
+            results[batch->paramIndex[i]] = getCCSPSingleParamValues(batchNames[i]);
+        }
+        free(batchNames);
+        return;
+    }
+
+    for( j = 0; j < paramValCount; j++ ) {
+        if(ccspParamValues[j] == NULL || ccspParamValues[j]->parameterName == NULL)
+            continue;
+        for( i = 0; i < batch->count; i++ ) {
+            if(results[batch->paramIndex[i]] == NULL && strcmp(ccspParamValues[j]->parameterName, batchNames[i]) == 0) {
+                profileValues *profVals = createParamValues(ccspParamValues[j]->parameterName, ccspParamValues[j]->parameterValue ? ccspParamValues[j]->parameterValue : "");
+                if(profVals != NULL)
+                    profVals->paramValueCount = 1;
+                results[batch->paramIndex[i]] = profVals;
+                break;
+            }
+        }
+    }
+    if(ccspParamValues)
+        free_parameterValStruct_t(bus_handle, paramValCount, ccspParamValues);
+
+    for( i = 0; i < batch->count; i++ ) {
+        if(results[batch->paramIndex[i]] == NULL) {
+            T2Info("ParameterName : %s missing from batch response\n", batchNames[i]);
+            results[batch->paramIndex[i]] = createParamValues(batchNames[i], "NULL");
+        }
+    }
+    free(batchNames);
+}
+
 Vector* getCCSPProfileParamValues(Vector *paramList) {
-    unsigned int i = 0;
+    int i = 0, j = 0;
     int count = Vector_Size(paramList);
     Vector *profileValueList = NULL;
+    Vector *batches = NULL;
+    const char **paramNames = NULL;
+    char **compNames = NULL;
+    char **compPaths = NULL;
+    bool *grouped = NULL;
+    profileValues **results = NULL;
     Vector_Create(&profileValueList);
 
     T2Debug("%s ++in\n", __FUNCTION__);
-    if(!bus_handle && T2ERROR_SUCCESS != CCSPInterface_Init()) {
+    if(T2ERROR_SUCCESS != CCSPInterface_Init()) {
+        return profileValueList;
+    }
+
+    T2Info("TR-181 Param count : %d\n", count);
+    if(count == 0) {
+        T2Debug("%s --Out\n", __FUNCTION__);
         return profileValueList;
     }
 
-    char** paramNames = (char **) malloc(count * sizeof(char*));
-    if(!paramNames) {
+    paramNames = (const char **) malloc(count * sizeof(char*));
+    compNames = (char **) calloc(count, sizeof(char*));
+    compPaths = (char **) calloc(count, sizeof(char*));
+    grouped = (bool *) calloc(count, sizeof(bool));
+    results = (profileValues **) calloc(count, sizeof(profileValues*));
+    if(!paramNames || !compNames || !compPaths || !grouped || !results) {
         T2Error("Unable allocate memory for paramNames\n");
+        free(paramNames);
+        free(compNames);
+        free(compPaths);
+        free(grouped);
+        free(results);
         return profileValueList;
     }
 
-    T2Info("TR-181 Param count : %d\n", count);
-    for( ; i < count; i++ ) {
-        tr181ValStruct_t **paramValues = NULL;
-        parameterValStruct_t **ccspParamValues = NULL;
-        int paramValCount = 0;
-        int iterate = 0;
-        profileValues *profVals = (profileValues *) malloc(sizeof(profileValues));
-        paramNames[0] = strdup(((Param *) Vector_At(paramList, i))->alias);
-        if(T2ERROR_SUCCESS != ccspGetParameterValues((const char**)paramNames, 1, &ccspParamValues, &paramValCount)) {
-            T2Error("Failed to retrieve param : %s\n", paramNames[0]);
-            paramValCount = 0;
-        }else {
-            if(ccspParamValues == NULL || paramValCount == 0)
-                T2Info("ParameterName : %s Retrieved value count : %d\n", paramNames[0], paramValCount);
+    // Resolve owning component of each parameter, mostly served from the component cache
+    for( i = 0; i < count; i++ ) {
+        paramNames[i] = ((Param *) Vector_At(paramList, i))->alias;
+        if(isBatchableParam(paramNames[i]) && CCSP_SUCCESS != findDestComponent((char*)paramNames[i], &compNames[i], &compPaths[i])) {
+            T2Debug("Unable to find supporting component for parameter : %s\n", paramNames[i]);
+            free(compNames[i]);
+            free(compPaths[i]);
+            compNames[i] = NULL;
+            compPaths[i] = NULL;
         }
+    }
 
-        profVals->paramValueCount = paramValCount;
-
-        // Populate bus independent parameter value array
-        if(paramValCount == 0) {
-            paramValues = (tr181ValStruct_t**) malloc(sizeof(tr181ValStruct_t*));
-            if(paramValues != NULL) {
-                paramValues[0] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
-                paramValues[0]->parameterName = strdup(paramNames[0]);
-                paramValues[0]->parameterValue = strdup("NULL");
-            }
-        }else {
-            paramValues = (tr181ValStruct_t**) malloc(paramValCount * sizeof(tr181ValStruct_t*));
-            if(paramValues != NULL) {
-                for( iterate = 0; iterate < paramValCount; ++iterate ) {
-                    if(ccspParamValues[iterate]) {
-                        paramValues[iterate] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
-                        if(paramValues[iterate]) {
-                            paramValues[iterate]->parameterName = strdup((ccspParamValues[iterate])->parameterName);
-                            paramValues[iterate]->parameterValue = strdup((ccspParamValues[iterate])->parameterValue);
-                        }
-                    }
+    Vector_Create(&batches);
+    for( i = 0; i < count; i++ ) {
+        ParamBatch *batch = NULL;
+        if(grouped[i])
+            continue;
+        grouped[i] = true;
+        batch = createParamBatch(compNames[i], compPaths[i], CCSP_GET_BATCH_SIZE);
+        if(batch == NULL)
+            continue;
+        batch->paramIndex[batch->count++] = i;
+        if(compNames[i]) {
+            for( j = i + 1; j < count && batch->count < CCSP_GET_BATCH_SIZE; j++ ) {
+                if(!grouped[j] && compNames[j] && strcmp(compNames[i], compNames[j]) == 0
+                        && strcmp(compPaths[i], compPaths[j]) == 0) {
+                    grouped[j] = true;
+                    batch->paramIndex[batch->count++] = j;
                 }
-                free_parameterValStruct_t(bus_handle, paramValCount, ccspParamValues);
             }
         }
+        Vector_PushBack(batches, batch);
+    }
+
+    // Components are queried in parallel, the collector owns the batches from here on
+    collectParamBatches(batches, paramNames, count, getCCSPParamBatch, results);
 
-        profVals->paramValues = paramValues;
-        // End of populating bus independent parameter value array
-        Vector_PushBack(profileValueList, profVals);
+    // Keep the result list aligned with the profile param list
+    for( i = 0; i < count; i++ ) {
+        if(results[i] == NULL)
+            results[i] = createParamValues(paramNames[i], "NULL");
+        Vector_PushBack(profileValueList, results[i]);
+        free(compNames[i]);
+        free(compPaths[i]);
     }
-    if(paramNames)
-        free(paramNames);
+
+    free(paramNames);
+    free(compNames);
+    free(compPaths);
+    free(grouped);
+    free(results);
 
     T2Debug("%s --Out\n", __FUNCTION__);
     return profileValueList;
@@ -297,7 +580,7 @@ T2ERROR registerCcspT2EventListener(TelemetryEventCallback eventCB)
 {
     int ret;
     T2Debug("%s ++in\n", __FUNCTION__);
-    if(!bus_handle && T2ERROR_SUCCESS != CCSPInterface_Init())
+    if(T2ERROR_SUCCESS != CCSPInterface_Init())
     {
         return T2ERROR_FAILURE;
     }
@@ -29,8 +29,20 @@
 #include "busInterface.h"
 #include "telemetry2_0.h"
 
+/* Seconds a CR namespace lookup is reused before asking the CR again */
+#ifndef DEST_COMPONENT_CACHE_TTL
+#define DEST_COMPONENT_CACHE_TTL 300
+#endif
+
+/* Maximum number of parameters of one component fetched by a single get */
+#ifndef CCSP_GET_BATCH_SIZE
+#define CCSP_GET_BATCH_SIZE 16
+#endif
+
 bool isCCSPInitialized();
 
+void clearDestComponentCache();
+
 T2ERROR getCCSPParamVal(const char* paramName, char **paramValue);
 
 Vector* getCCSPProfileParamValues(Vector *paramList);
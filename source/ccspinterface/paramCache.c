@@ -0,0 +1,367 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "paramCache.h"
+#include "t2collection.h"
+#include "t2log_wrapper.h"
+#include "vector.h"
+
+typedef struct _ParamCacheEntry
+{
+    profileValues *value;
+    time_t expiry;
+    bool lifetime;
+    bool inflight;
+} ParamCacheEntry;
+
+typedef struct _ParamCacheRule
+{
+    char *nameOrPrefix;
+    int ttl;
+} ParamCacheRule;
+
+/* Standard identity parameters which only change across a reboot, others are
+ * given a cacheTTL of -1 in the profile configuration */
+static const char *lifetimeParams[] = {
+    "Device.DeviceInfo.SerialNumber",
+    "Device.DeviceInfo.Manufacturer",
+    "Device.DeviceInfo.ManufacturerOUI",
+    "Device.DeviceInfo.ModelName",
+    "Device.DeviceInfo.HardwareVersion",
+    "Device.DeviceInfo.SoftwareVersion",
+    NULL
+};
+
+static hash_map_t *paramCacheMap = NULL;
+static Vector *paramCacheRules = NULL;
+static pthread_mutex_t paramCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t paramCacheCond;
+static pthread_once_t paramCacheOnce = PTHREAD_ONCE_INIT;
+
+static void freeParamCacheRule(void *data)
+{
+    if(data != NULL)
+    {
+        ParamCacheRule *rule = (ParamCacheRule *) data;
+        free(rule->nameOrPrefix);
+        free(rule);
+    }
+}
+
+static void freeCachedValues(profileValues *value)
+{
+    if(value != NULL)
+    {
+        // Placeholder entries are allocated even when the value count is 0
+        freeParamValueSt(value->paramValues, value->paramValueCount > 0 ? value->paramValueCount : 1);
+        free(value);
+    }
+}
+
+static void freeParamCacheEntry(void *data)
+{
+    if(data != NULL)
+    {
+        hash_element_t *element = (hash_element_t *) data;
+        ParamCacheEntry *entry = (ParamCacheEntry *) element->data;
+        if(entry)
+        {
+            freeCachedValues(entry->value);
+            free(entry);
+        }
+        free(element->key);
+        free(element);
+    }
+}
+
+static void addParamCacheRule(const char *nameOrPrefix, int ttl)
+{
+    ParamCacheRule *rule = (ParamCacheRule *) malloc(sizeof(ParamCacheRule));
+    if(rule)
+    {
+        rule->nameOrPrefix = strdup(nameOrPrefix);
+        rule->ttl = ttl;
+        Vector_PushBack(paramCacheRules, rule);
+    }
+}
+
+static void initParamCache()
+{
+    pthread_condattr_t condAttr;
+    int i = 0;
+
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&paramCacheCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+
+    paramCacheMap = hash_map_create();
+    Vector_Create(&paramCacheRules);
+    for( i = 0; lifetimeParams[i] != NULL; i++ )
+        addParamCacheRule(lifetimeParams[i], PARAM_CACHE_TTL_LIFETIME);
+    // Telemetry's own data model is written through the bus and must be read fresh
+    addParamCacheRule("Device.X_RDKCENTRAL-COM_T2.", PARAM_CACHE_TTL_NONE);
+}
+
+static time_t getMonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+/**
+ * TTL of a parameter from the longest matching rule. Rules ending with '.' match
+ * every parameter below that object, other rules match the exact name only.
+ */
+static int getParamTTL(const char *paramName)
+{
+    int ttl = PARAM_CACHE_DEFAULT_TTL;
+    size_t bestLen = 0;
+    int i = 0;
+
+    for( i = 0; i < Vector_Size(paramCacheRules); i++ )
+    {
+        ParamCacheRule *rule = (ParamCacheRule *) Vector_At(paramCacheRules, i);
+        size_t len = strlen(rule->nameOrPrefix);
+        bool match = false;
+        if(len > 0 && rule->nameOrPrefix[len - 1] == '.')
+            match = (strncmp(paramName, rule->nameOrPrefix, len) == 0);
+        else
+            match = (strcmp(paramName, rule->nameOrPrefix) == 0);
+        if(match && len > bestLen)
+        {
+            bestLen = len;
+            ttl = rule->ttl;
+        }
+    }
+    return ttl;
+}
+
+/**
+ * Set the TTL of a parameter, or of all parameters below an object when the name
+ * ends with '.'. Use PARAM_CACHE_TTL_LIFETIME to keep a value until restart and
+ * PARAM_CACHE_TTL_NONE to disable caching. Configured through the cacheTTL field of
+ * dataModel parameters; the cache is shared, so the last profile to set a rule wins.
+ */
+T2ERROR setParamCacheTTL(const char *nameOrPrefix, int ttl)
+{
+    int i = 0;
+    if(nameOrPrefix == NULL || ttl < PARAM_CACHE_TTL_LIFETIME)
+        return T2ERROR_INVALID_ARGS;
+
+    pthread_once(&paramCacheOnce, initParamCache);
+    pthread_mutex_lock(&paramCacheMutex);
+    for( i = 0; i < Vector_Size(paramCacheRules); i++ )
+    {
+        ParamCacheRule *rule = (ParamCacheRule *) Vector_At(paramCacheRules, i);
+        if(strcmp(rule->nameOrPrefix, nameOrPrefix) == 0)
+        {
+            rule->ttl = ttl;
+            pthread_mutex_unlock(&paramCacheMutex);
+            return T2ERROR_SUCCESS;
+        }
+    }
+    addParamCacheRule(nameOrPrefix, ttl);
+    pthread_mutex_unlock(&paramCacheMutex);
+    return T2ERROR_SUCCESS;
+}
+
+profileValues* copyProfileValues(profileValues *value)
+{
+    profileValues *copy = NULL;
+    int count = 0, i = 0;
+
+    if(value == NULL || value->paramValues == NULL)
+        return NULL;
+
+    count = value->paramValueCount > 0 ? value->paramValueCount : 1;
+    copy = (profileValues *) malloc(sizeof(profileValues));
+    if(copy == NULL)
+        return NULL;
+    copy->paramValueCount = value->paramValueCount;
+    copy->paramValues = (tr181ValStruct_t **) calloc(count, sizeof(tr181ValStruct_t *));
+    if(copy->paramValues == NULL)
+    {
+        free(copy);
+        return NULL;
+    }
+    for( i = 0; i < count; i++ )
+    {
+        if(value->paramValues[i] == NULL)
+            continue;
+        copy->paramValues[i] = (tr181ValStruct_t *) malloc(sizeof(tr181ValStruct_t));
+        if(copy->paramValues[i])
+        {
+            copy->paramValues[i]->parameterName = value->paramValues[i]->parameterName ? strdup(value->paramValues[i]->parameterName) : NULL;
+            copy->paramValues[i]->parameterValue = value->paramValues[i]->parameterValue ? strdup(value->paramValues[i]->parameterValue) : NULL;
+        }
+    }
+    return copy;
+}
+
+/* Caller holds paramCacheMutex */
+static ParamCacheStatus lookupLocked(const char *paramName, profileValues **value)
+{
+    ParamCacheEntry *entry = NULL;
+    int ttl = getParamTTL(paramName);
+
+    if(ttl == PARAM_CACHE_TTL_NONE)
+        return PARAM_CACHE_CLAIMED;
+
+    entry = (ParamCacheEntry *) hash_map_get(paramCacheMap, paramName);
+    if(entry)
+    {
+        if(entry->value && (entry->lifetime || entry->expiry > getMonotonicSeconds()))
+        {
+            *value = copyProfileValues(entry->value);
+            if(*value)
+                return PARAM_CACHE_HIT;
+        }
+        if(entry->inflight)
+            return PARAM_CACHE_INFLIGHT;
+        entry->inflight = true;
+        return PARAM_CACHE_CLAIMED;
+    }
+
+    entry = (ParamCacheEntry *) calloc(1, sizeof(ParamCacheEntry));
+    if(entry)
+    {
+        entry->inflight = true;
+        hash_map_put(paramCacheMap, strdup(paramName), entry);
+    }
+    return PARAM_CACHE_CLAIMED;
+}
+
+/**
+ * Look up a parameter without blocking. A miss claims the fetch for the caller so
+ * that concurrent collectors asking for the same parameter wait for its result.
+ */
+ParamCacheStatus paramCacheLookup(const char *paramName, profileValues **value)
+{
+    ParamCacheStatus status;
+
+    *value = NULL;
+    pthread_once(&paramCacheOnce, initParamCache);
+    pthread_mutex_lock(&paramCacheMutex);
+    status = lookupLocked(paramName, value);
+    pthread_mutex_unlock(&paramCacheMutex);
+    return status;
+}
+
+/**
+ * Wait for an in-flight fetch of the parameter. Returns PARAM_CACHE_CLAIMED if the
+ * other fetch failed or did not complete in time; the caller then fetches it itself.
+ */
+ParamCacheStatus paramCacheWait(const char *paramName, profileValues **value)
+{
+    ParamCacheStatus status = PARAM_CACHE_INFLIGHT;
+    struct timespec deadline;
+
+    *value = NULL;
+    pthread_once(&paramCacheOnce, initParamCache);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += PARAM_CACHE_WAIT_TIMEOUT;
+
+    pthread_mutex_lock(&paramCacheMutex);
+    while((status = lookupLocked(paramName, value)) == PARAM_CACHE_INFLIGHT)
+    {
+        if(pthread_cond_timedwait(&paramCacheCond, &paramCacheMutex, &deadline) != 0)
+        {
+            T2Info("Timed out waiting for in-flight fetch of %s\n", paramName);
+            status = PARAM_CACHE_CLAIMED;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&paramCacheMutex);
+    return status;
+}
+
+/**
+ * Store a fetched value and wake up collectors waiting on it. Only values the
+ * provider actually returned are cached, placeholders for failed or timed out
+ * gets are not.
+ */
+void paramCachePut(const char *paramName, profileValues *value)
+{
+    ParamCacheEntry *entry = NULL;
+    int ttl = 0;
+
+    if(value == NULL || value->paramValueCount <= 0)
+    {
+        paramCacheAbort(paramName);
+        return;
+    }
+
+    pthread_once(&paramCacheOnce, initParamCache);
+    pthread_mutex_lock(&paramCacheMutex);
+    ttl = getParamTTL(paramName);
+    if(ttl != PARAM_CACHE_TTL_NONE)
+    {
+        entry = (ParamCacheEntry *) hash_map_get(paramCacheMap, paramName);
+        if(entry == NULL)
+        {
+            entry = (ParamCacheEntry *) calloc(1, sizeof(ParamCacheEntry));
+            if(entry)
+                hash_map_put(paramCacheMap, strdup(paramName), entry);
+        }
+        if(entry)
+        {
+            freeCachedValues(entry->value);
+            entry->value = copyProfileValues(value);
+            entry->lifetime = (ttl == PARAM_CACHE_TTL_LIFETIME);
+            entry->expiry = getMonotonicSeconds() + (ttl > 0 ? ttl : 0);
+            entry->inflight = false;
+        }
+    }
+    pthread_cond_broadcast(&paramCacheCond);
+    pthread_mutex_unlock(&paramCacheMutex);
+}
+
+/**
+ * Release a claim without storing a value.
+ */
+void paramCacheAbort(const char *paramName)
+{
+    ParamCacheEntry *entry = NULL;
+
+    pthread_once(&paramCacheOnce, initParamCache);
+    pthread_mutex_lock(&paramCacheMutex);
+    entry = (ParamCacheEntry *) hash_map_get(paramCacheMap, paramName);
+    if(entry)
+        entry->inflight = false;
+    pthread_cond_broadcast(&paramCacheCond);
+    pthread_mutex_unlock(&paramCacheMutex);
+}
+
+void paramCacheClear()
+{
+    pthread_once(&paramCacheOnce, initParamCache);
+    pthread_mutex_lock(&paramCacheMutex);
+    hash_map_destroy(paramCacheMap, freeParamCacheEntry);
+    paramCacheMap = hash_map_create();
+    pthread_cond_broadcast(&paramCacheCond);
+    pthread_mutex_unlock(&paramCacheMutex);
+}
@@ -0,0 +1,66 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef _PARAMCACHE_H_
+#define _PARAMCACHE_H_
+
+#include <stdbool.h>
+
+#include "busInterface.h"
+#include "telemetry2_0.h"
+
+/* Seconds a fetched value is shared between profiles when no TTL rule matches,
+ * by default only parameters with a rule are cached */
+#ifndef PARAM_CACHE_DEFAULT_TTL
+#define PARAM_CACHE_DEFAULT_TTL 0
+#endif
+
+/* Seconds a collector waits for another collector fetching the same parameter */
+#ifndef PARAM_CACHE_WAIT_TIMEOUT
+#define PARAM_CACHE_WAIT_TIMEOUT 30
+#endif
+
+/* TTL for values that cannot change while the process runs, e.g. device identity */
+#define PARAM_CACHE_TTL_LIFETIME -1
+/* TTL for values that must always be fetched from the bus */
+#define PARAM_CACHE_TTL_NONE 0
+
+typedef enum
+{
+    PARAM_CACHE_HIT,        /* value copied from the cache */
+    PARAM_CACHE_CLAIMED,    /* caller must fetch the value and call paramCachePut or paramCacheAbort */
+    PARAM_CACHE_INFLIGHT    /* another collector is fetching the value, use paramCacheWait */
+} ParamCacheStatus;
+
+T2ERROR setParamCacheTTL(const char *nameOrPrefix, int ttl);
+
+ParamCacheStatus paramCacheLookup(const char *paramName, profileValues **value);
+
+ParamCacheStatus paramCacheWait(const char *paramName, profileValues **value);
+
+void paramCachePut(const char *paramName, profileValues *value);
+
+void paramCacheAbort(const char *paramName);
+
+profileValues* copyProfileValues(profileValues *value);
+
+void paramCacheClear();
+
+#endif /* _PARAMCACHE_H_ */
@@ -0,0 +1,524 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "paramCollector.h"
+#include "t2log_wrapper.h"
+
+typedef struct _CollectorContext
+{
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refCount;
+    int completed;
+    bool expired;
+    Vector *batches;
+    bool *batchDone;
+    char **paramNames;
+    int paramCount;
+    profileValues **results;
+    ParamBatchFetcher fetcher;
+} CollectorContext;
+
+typedef struct _CollectorJob
+{
+    CollectorContext *ctx;
+    int batchIndex;
+} CollectorJob;
+
+// Workers are shared by all reports and live until uninitParamCollector
+static pthread_mutex_t poolMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t spaceCond;
+static bool spaceCondInitialized = false;
+static CollectorJob jobQueue[PARAM_COLLECTION_QUEUE_SIZE];
+static int queueHead = 0;
+static int queueLength = 0;
+static int poolWorkers = 0;
+static bool poolShutdown = false;
+// Provider each worker is fetching from and since when, to spot providers that hang
+static char *activeProvider[PARAM_COLLECTION_WORKERS];
+static struct timespec activeSince[PARAM_COLLECTION_WORKERS];
+
+static long getElapsedMs(struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_nsec - start->tv_nsec) / 1000000;
+}
+
+ParamBatch* createParamBatch(const char *provider, const char *providerPath, int maxCount)
+{
+    ParamBatch *batch = (ParamBatch *) malloc(sizeof(ParamBatch));
+    if(batch == NULL)
+        return NULL;
+
+    batch->provider = provider ? strdup(provider) : NULL;
+    batch->providerPath = providerPath ? strdup(providerPath) : NULL;
+    batch->paramIndex = (int *) malloc(maxCount * sizeof(int));
+    batch->count = 0;
+    batch->elapsedMs = 0;
+    if(batch->paramIndex == NULL)
+    {
+        freeParamBatch(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void freeParamBatch(void *data)
+{
+    if(data != NULL)
+    {
+        ParamBatch *batch = (ParamBatch *) data;
+        free(batch->provider);
+        free(batch->providerPath);
+        free(batch->paramIndex);
+        free(batch);
+    }
+}
+
+profileValues* createParamValues(const char *paramName, const char *paramValue)
+{
+    profileValues *profVals = (profileValues *) malloc(sizeof(profileValues));
+    if(profVals == NULL)
+        return NULL;
+
+    // Parameters without values are reported with a placeholder value and count 0
+    profVals->paramValueCount = 0;
+    profVals->paramValues = (tr181ValStruct_t**) malloc(sizeof(tr181ValStruct_t*));
+    if(profVals->paramValues != NULL)
+    {
+        profVals->paramValues[0] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
+        if(profVals->paramValues[0] != NULL)
+        {
+            profVals->paramValues[0]->parameterName = strdup(paramName);
+            profVals->paramValues[0]->parameterValue = strdup(paramValue);
+        }
+    }
+    return profVals;
+}
+
+static void freeCollectedValues(profileValues *profVals)
+{
+    if(profVals != NULL)
+    {
+        // Placeholder entries are allocated even when the value count is 0
+        freeParamValueSt(profVals->paramValues, profVals->paramValueCount > 0 ? profVals->paramValueCount : 1);
+        free(profVals);
+    }
+}
+
+static void releaseContext(CollectorContext *ctx)
+{
+    int i = 0;
+    bool last = false;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->refCount--;
+    last = (ctx->refCount == 0);
+    pthread_mutex_unlock(&ctx->lock);
+    if(!last)
+        return;
+
+    // Values of batches that completed after the deadline were never handed out
+    for( i = 0; i < ctx->paramCount; i++ )
+    {
+        freeCollectedValues(ctx->results[i]);
+        free(ctx->paramNames[i]);
+    }
+    free(ctx->results);
+    free(ctx->paramNames);
+    free(ctx->batchDone);
+    Vector_Destroy(ctx->batches, freeParamBatch);
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+}
+
+static void runJob(CollectorJob *job)
+{
+    CollectorContext *ctx = job->ctx;
+    ParamBatch *batch = NULL;
+    struct timespec start;
+    bool expired = false;
+
+    pthread_mutex_lock(&ctx->lock);
+    expired = ctx->expired;
+    pthread_mutex_unlock(&ctx->lock);
+
+    // Batches of a report that already gave up waiting are not fetched any more
+    if(!expired)
+    {
+        batch = (ParamBatch *) Vector_At(ctx->batches, job->batchIndex);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        ctx->fetcher(batch, (const char **) ctx->paramNames, ctx->results);
+
+        pthread_mutex_lock(&ctx->lock);
+        batch->elapsedMs = getElapsedMs(&start);
+        ctx->batchDone[job->batchIndex] = true;
+        ctx->completed++;
+        pthread_cond_signal(&ctx->cond);
+        pthread_mutex_unlock(&ctx->lock);
+    }
+    releaseContext(ctx);
+}
+
+static void* collectorWorker(void *arg)
+{
+    CollectorJob job;
+    ParamBatch *batch = NULL;
+    int slot = (int) (intptr_t) arg;
+
+    pthread_mutex_lock(&poolMutex);
+    while(true)
+    {
+        while(queueLength == 0 && !poolShutdown)
+            pthread_cond_wait(&jobCond, &poolMutex);
+        if(queueLength == 0)
+            break;
+
+        job = jobQueue[queueHead];
+        queueHead = (queueHead + 1) % PARAM_COLLECTION_QUEUE_SIZE;
+        queueLength--;
+        pthread_cond_signal(&spaceCond);
+        // The batch stays valid while the job holds its reference on the context,
+        // the slot keeps its own copy as the last reference may be released by runJob
+        batch = (ParamBatch *) Vector_At(job.ctx->batches, job.batchIndex);
+        activeProvider[slot] = batch->provider ? strdup(batch->provider) : NULL;
+        clock_gettime(CLOCK_MONOTONIC, &activeSince[slot]);
+        pthread_mutex_unlock(&poolMutex);
+
+        runJob(&job);
+
+        pthread_mutex_lock(&poolMutex);
+        free(activeProvider[slot]);
+        activeProvider[slot] = NULL;
+    }
+    poolWorkers--;
+    pthread_mutex_unlock(&poolMutex);
+    return NULL;
+}
+
+/**
+ * Start the missing pool workers, called with poolMutex held. Returns the number
+ * of workers available to take jobs.
+ */
+static int startCollectorWorkers()
+{
+    pthread_condattr_t condAttr;
+    pthread_attr_t threadAttr;
+    pthread_t tid;
+
+    if(poolShutdown)
+        return 0;
+
+    if(!spaceCondInitialized)
+    {
+        pthread_condattr_init(&condAttr);
+        pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+        pthread_cond_init(&spaceCond, &condAttr);
+        pthread_condattr_destroy(&condAttr);
+        spaceCondInitialized = true;
+    }
+
+    pthread_attr_init(&threadAttr);
+    pthread_attr_setdetachstate(&threadAttr, PTHREAD_CREATE_DETACHED);
+    while(poolWorkers < PARAM_COLLECTION_WORKERS)
+    {
+        activeProvider[poolWorkers] = NULL;
+        if(pthread_create(&tid, &threadAttr, collectorWorker, (void *) (intptr_t) poolWorkers) != 0)
+        {
+            T2Error("Unable to start param collector worker\n");
+            break;
+        }
+        poolWorkers++;
+    }
+    pthread_attr_destroy(&threadAttr);
+    return poolWorkers;
+}
+
+/**
+ * A provider is stalled while a worker has been fetching from it for longer than a
+ * report deadline. Called with poolMutex held.
+ */
+static bool isProviderStalled(const char *provider)
+{
+    int i = 0;
+
+    if(provider == NULL)
+        return false;
+    for( i = 0; i < poolWorkers; i++ )
+    {
+        if(activeProvider[i] && strcmp(activeProvider[i], provider) == 0
+                && getElapsedMs(&activeSince[i]) >= PARAM_COLLECTION_TIMEOUT * 1000L)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Remove the jobs of an expired report that no worker picked up yet. Returns the
+ * number of jobs removed, each of which still holds a reference on the context.
+ */
+static int dropQueuedJobs(CollectorContext *ctx)
+{
+    int i = 0, kept = 0, dropped = 0;
+
+    pthread_mutex_lock(&poolMutex);
+    for( i = 0; i < queueLength; i++ )
+    {
+        CollectorJob *job = &jobQueue[(queueHead + i) % PARAM_COLLECTION_QUEUE_SIZE];
+        if(job->ctx == ctx)
+        {
+            dropped++;
+            continue;
+        }
+        jobQueue[(queueHead + kept) % PARAM_COLLECTION_QUEUE_SIZE] = *job;
+        kept++;
+    }
+    queueLength = kept;
+    if(dropped > 0)
+        pthread_cond_broadcast(&spaceCond);
+    pthread_mutex_unlock(&poolMutex);
+    return dropped;
+}
+
+static void logProviderTiming(Vector *batches)
+{
+    int i = 0, j = 0;
+    int count = Vector_Size(batches);
+
+    for( i = 0; i < count; i++ )
+    {
+        ParamBatch *batch = (ParamBatch *) Vector_At(batches, i);
+        const char *provider = batch->provider ? batch->provider : "unresolved";
+        long totalMs = 0;
+        int params = 0;
+        bool reported = false;
+
+        for( j = 0; j < i && !reported; j++ )
+        {
+            ParamBatch *prev = (ParamBatch *) Vector_At(batches, j);
+            const char *prevProvider = prev->provider ? prev->provider : "unresolved";
+            reported = (strcmp(provider, prevProvider) == 0);
+        }
+        if(reported)
+            continue;
+
+        for( j = i; j < count; j++ )
+        {
+            ParamBatch *next = (ParamBatch *) Vector_At(batches, j);
+            const char *nextProvider = next->provider ? next->provider : "unresolved";
+            if(strcmp(provider, nextProvider) == 0)
+            {
+                totalMs += next->elapsedMs;
+                params += next->count;
+            }
+        }
+        T2Info("Provider %s : %d params collected in %ld ms\n", provider, params, totalMs);
+    }
+}
+
+/**
+ * Queues every batch on the shared pool of PARAM_COLLECTION_WORKERS threads and waits
+ * at most PARAM_COLLECTION_TIMEOUT seconds. Parameters of batches that did not complete
+ * in time are reported with PARAM_TIMEOUT_VALUE so that a partial report can still be sent.
+ * The job queue is bounded, a provider that hangs ties up at most the pool's workers and
+ * never makes reports start new threads. Ownership of the batches moves to the collector;
+ * a worker still blocked on a provider after the deadline releases the shared state when
+ * it returns.
+ */
+T2ERROR collectParamBatches(Vector *batches, const char **paramNames, int paramCount, ParamBatchFetcher fetcher, profileValues **results)
+{
+    T2Debug("%s ++in\n", __FUNCTION__);
+    CollectorContext *ctx = NULL;
+    pthread_condattr_t condAttr;
+    struct timespec deadline;
+    int batchCount = Vector_Size(batches);
+    int queued = 0, dropped = 0;
+    bool full = false;
+    int i = 0, j = 0, timedOut = 0;
+
+    if(batchCount == 0)
+    {
+        Vector_Destroy(batches, freeParamBatch);
+        T2Debug("%s --out\n", __FUNCTION__);
+        return T2ERROR_SUCCESS;
+    }
+
+    ctx = (CollectorContext *) calloc(1, sizeof(CollectorContext));
+    if(ctx == NULL)
+    {
+        Vector_Destroy(batches, freeParamBatch);
+        return T2ERROR_MEMALLOC_FAILED;
+    }
+    ctx->batches = batches;
+    ctx->paramCount = paramCount;
+    ctx->fetcher = fetcher;
+    ctx->refCount = 1;
+    ctx->batchDone = (bool *) calloc(batchCount, sizeof(bool));
+    ctx->results = (profileValues **) calloc(paramCount, sizeof(profileValues *));
+    ctx->paramNames = (char **) calloc(paramCount, sizeof(char *));
+    pthread_mutex_init(&ctx->lock, NULL);
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ctx->cond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+    if(ctx->batchDone == NULL || ctx->results == NULL || ctx->paramNames == NULL)
+    {
+        ctx->paramCount = 0;
+        releaseContext(ctx);
+        return T2ERROR_MEMALLOC_FAILED;
+    }
+    // Workers may outlive the caller's parameter list
+    for( i = 0; i < paramCount; i++ )
+        ctx->paramNames[i] = strdup(paramNames[i]);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += PARAM_COLLECTION_TIMEOUT;
+
+    // Every queued job holds a reference, taken up front as workers may finish before queueing does
+    pthread_mutex_lock(&ctx->lock);
+    ctx->refCount += batchCount;
+    pthread_mutex_unlock(&ctx->lock);
+
+    pthread_mutex_lock(&poolMutex);
+    if(startCollectorWorkers() > 0)
+    {
+        for( i = 0; i < batchCount && !full; i++ )
+        {
+            ParamBatch *batch = (ParamBatch *) Vector_At(batches, i);
+            // A hung provider would tie up one more worker with every report
+            if(isProviderStalled(batch->provider))
+            {
+                T2Warning("Provider %s has not returned from an earlier collection, not queued\n", batch->provider);
+                continue;
+            }
+            while(queueLength == PARAM_COLLECTION_QUEUE_SIZE && !poolShutdown)
+            {
+                if(pthread_cond_timedwait(&spaceCond, &poolMutex, &deadline) != 0)
+                    break;
+            }
+            if(queueLength == PARAM_COLLECTION_QUEUE_SIZE || poolShutdown)
+            {
+                T2Warning("Param collector queue is full, %d of %d batches not queued\n", batchCount - i, batchCount);
+                full = true;
+                break;
+            }
+            jobQueue[(queueHead + queueLength) % PARAM_COLLECTION_QUEUE_SIZE].ctx = ctx;
+            jobQueue[(queueHead + queueLength) % PARAM_COLLECTION_QUEUE_SIZE].batchIndex = i;
+            queueLength++;
+            queued++;
+            pthread_cond_signal(&jobCond);
+        }
+        pthread_mutex_unlock(&poolMutex);
+    }
+    else
+    {
+        pthread_mutex_unlock(&poolMutex);
+        // Fall back to collecting on the calling thread
+        for( queued = 0; queued < batchCount; queued++ )
+        {
+            CollectorJob job = { ctx, queued };
+            runJob(&job);
+        }
+    }
+    // Drop the references of batches that never made it into the queue
+    for( i = queued; i < batchCount; i++ )
+        releaseContext(ctx);
+
+    pthread_mutex_lock(&ctx->lock);
+    while(ctx->completed < queued)
+    {
+        if(pthread_cond_timedwait(&ctx->cond, &ctx->lock, &deadline) != 0 && ctx->completed < queued)
+        {
+            T2Warning("Param collection deadline of %d sec reached with %d of %d batches complete\n", PARAM_COLLECTION_TIMEOUT, ctx->completed, batchCount);
+            break;
+        }
+    }
+    ctx->expired = true;
+
+    for( i = 0; i < batchCount; i++ )
+    {
+        ParamBatch *batch = (ParamBatch *) Vector_At(batches, i);
+        for( j = 0; j < batch->count; j++ )
+        {
+            int index = batch->paramIndex[j];
+            if(ctx->batchDone[i])
+            {
+                results[index] = ctx->results[index];
+                ctx->results[index] = NULL;
+            }
+            else
+            {
+                results[index] = createParamValues(paramNames[index], PARAM_TIMEOUT_VALUE);
+                timedOut++;
+            }
+        }
+        if(!ctx->batchDone[i])
+        {
+            T2Warning("Provider %s timed out, %d params reported as %s\n", batch->provider ? batch->provider : "unresolved", batch->count, PARAM_TIMEOUT_VALUE);
+        }
+    }
+    logProviderTiming(batches);
+    pthread_mutex_unlock(&ctx->lock);
+
+    // Jobs still waiting in the queue are not run for an expired report
+    dropped = dropQueuedJobs(ctx);
+    for( i = 0; i < dropped; i++ )
+        releaseContext(ctx);
+
+    releaseContext(ctx);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return (timedOut == 0) ? T2ERROR_SUCCESS : T2ERROR_FAILURE;
+}
+
+/**
+ * Stop the idle pool workers. Workers blocked on a provider exit once it returns,
+ * later collections run on the calling thread.
+ */
+void uninitParamCollector()
+{
+    CollectorJob pending[PARAM_COLLECTION_QUEUE_SIZE];
+    int count = 0;
+    int i = 0;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&poolMutex);
+    poolShutdown = true;
+    for( i = 0; i < queueLength; i++ )
+        pending[count++] = jobQueue[(queueHead + i) % PARAM_COLLECTION_QUEUE_SIZE];
+    queueLength = 0;
+    pthread_cond_broadcast(&jobCond);
+    if(spaceCondInitialized)
+        pthread_cond_broadcast(&spaceCond);
+    pthread_mutex_unlock(&poolMutex);
+
+    for( i = 0; i < count; i++ )
+        releaseContext(pending[i].ctx);
+    T2Debug("%s --out\n", __FUNCTION__);
+}
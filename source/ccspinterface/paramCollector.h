@@ -0,0 +1,72 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef _PARAMCOLLECTOR_H_
+#define _PARAMCOLLECTOR_H_
+
+#include <vector.h>
+
+#include "busInterface.h"
+#include "telemetry2_0.h"
+
+/* Number of worker threads fetching provider batches in parallel */
+#ifndef PARAM_COLLECTION_WORKERS
+#define PARAM_COLLECTION_WORKERS 4
+#endif
+
+/* Batches waiting for a worker across all reports, queueing blocks until the report deadline when full */
+#ifndef PARAM_COLLECTION_QUEUE_SIZE
+#define PARAM_COLLECTION_QUEUE_SIZE 64
+#endif
+
+/* Seconds allowed for collecting all parameters of a report */
+#ifndef PARAM_COLLECTION_TIMEOUT
+#define PARAM_COLLECTION_TIMEOUT 30
+#endif
+
+/* Value reported for parameters whose provider did not answer within the deadline */
+#define PARAM_TIMEOUT_VALUE "TIMEOUT"
+
+typedef struct _ParamBatch
+{
+    char *provider;
+    char *providerPath;
+    int *paramIndex;
+    int count;
+    long elapsedMs;
+} ParamBatch;
+
+/**
+ * Fetches the parameters of one batch and stores them in results at the index of
+ * each requested parameter. Called from a pool worker thread.
+ */
+typedef void (*ParamBatchFetcher)(ParamBatch *batch, const char **paramNames, profileValues **results);
+
+ParamBatch* createParamBatch(const char *provider, const char *providerPath, int maxCount);
+
+void freeParamBatch(void *data);
+
+profileValues* createParamValues(const char *paramName, const char *paramValue);
+
+T2ERROR collectParamBatches(Vector *batches, const char **paramNames, int paramCount, ParamBatchFetcher fetcher, profileValues **results);
+
+void uninitParamCollector();
+
+#endif /* _PARAMCOLLECTOR_H_ */
@@ -25,6 +25,9 @@
 #include <rbus/rbus_property.h>
 #include <rbus/rbus_value.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <glib.h>
 #include <glib/gi18n.h>
@@ -32,6 +35,8 @@
 #include "t2collection.h"
 #include "t2common.h"
 #include "busInterface.h"
+#include "rbusInterface.h"
+#include "paramCollector.h"
 #include "telemetry2_0.h"
 #include "t2log_wrapper.h"
 #include "profile.h"
@@ -49,10 +54,33 @@ static dataModelMsgPckCallBack dmMsgPckProcessingCallBack = NULL;
 
 static hash_map_t *compTr181ParamMap = NULL;
 
+typedef struct _ProviderCacheEntry
+{
+    char *provider;     // NULL when the provider could not be discovered
+    time_t expiry;
+} ProviderCacheEntry;
+
+// Discovered provider of each parameter name, guarded by providerCacheMutex
+static hash_map_t *providerCache = NULL;
+static pthread_mutex_t providerCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
 static char* reportProfileVal = NULL ;
 static char* reportProfilemsgPckVal = NULL ;
 T2ERROR T2RbusConsumer(TriggerCondition *triggerCondition);
 
+static void freeProviderCacheEntry(void *data) {
+    if(data != NULL) {
+        hash_element_t *element = (hash_element_t *) data;
+        ProviderCacheEntry *entry = (ProviderCacheEntry *) element->data;
+        if(entry) {
+            free(entry->provider);
+            free(entry);
+        }
+        free(element->key);
+        free(element);
+    }
+}
+
 bool isRbusInitialized( ) {
 
     return t2bus_handle != NULL ? true : false;
@@ -87,6 +115,12 @@ static T2ERROR rBusInterface_Init( ) {
 
 static void rBusInterface_Uninit( ) {
     rbus_close(t2bus_handle);
+
+    // Providers may register differently on the next connection
+    pthread_mutex_lock(&providerCacheMutex);
+    hash_map_destroy(providerCache, freeProviderCacheEntry);
+    providerCache = NULL;
+    pthread_mutex_unlock(&providerCacheMutex);
 }
 
 T2ERROR getRbusParameterVal(const char* paramName, char **paramValue) {
@@ -127,9 +161,259 @@ T2ERROR getRbusParameterVal(const char* paramName, char **paramValue) {
     return T2ERROR_SUCCESS;
 }
 
+static profileValues* getRbusSingleParamValues(const char *param) {
+    rbusProperty_t rbusPropertyValues = NULL;
+    int paramValCount = 0;
+    int iterate = 0;
+    const char* paramNames[1] = { param };
+    profileValues* profVals = NULL;
+
+    T2Debug("Calling rbus_getExt for %s \n", param);
+    if(RBUS_ERROR_SUCCESS != rbus_getExt(t2bus_handle, 1, paramNames, &paramValCount, &rbusPropertyValues)) {
+        T2Error("Failed to retrieve param : %s\n", param);
+        paramValCount = 0 ;
+    } else {
+        if(rbusPropertyValues == NULL || paramValCount == 0) {
+            T2Info("ParameterName : %s Retrieved value count : %d\n", param, paramValCount);
+        }
+    }
+
+    T2Debug("Received %d parameters for %s fetch \n", paramValCount, param);
+
+    // Populate bus independent parameter value array
+    if(paramValCount == 0) {
+        if(rbusPropertyValues != NULL) {
+            rbusProperty_Release(rbusPropertyValues);
+        }
+        return createParamValues(param, "NULL");
+    }
+
+    profVals = (profileValues *) malloc(sizeof(profileValues));
+    if(profVals == NULL) {
+        rbusProperty_Release(rbusPropertyValues);
+        return NULL;
+    }
+    profVals->paramValueCount = paramValCount;
+    profVals->paramValues = (tr181ValStruct_t**) malloc(paramValCount * sizeof(tr181ValStruct_t*));
+    if(profVals->paramValues != NULL) {
+        rbusProperty_t nextProperty = rbusPropertyValues;
+        for( iterate = 0; iterate < paramValCount; ++iterate ) { // Loop through values obtained from query for individual param in list
+            profVals->paramValues[iterate] = NULL;
+            if(nextProperty) {
+                rbusValue_t value = rbusProperty_GetValue(nextProperty);
+                profVals->paramValues[iterate] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
+                if(profVals->paramValues[iterate]) {
+                    profVals->paramValues[iterate]->parameterName = strdup(rbusProperty_GetName(nextProperty));
+                    profVals->paramValues[iterate]->parameterValue = rbusValue_ToString(value, NULL, 0);
+                }
+                nextProperty = rbusProperty_GetNext(nextProperty);
+            }
+        }
+    }
+    rbusProperty_Release(rbusPropertyValues);
+    return profVals;
+}
+
+/**
+ * Only fully qualified names can be demultiplexed from a multi name rbus_getExt
+ * response by name. Partial paths and wildcards are fetched individually.
+ */
+static bool isBatchableParam(const char *param) {
+    size_t len = strlen(param);
+    if(len == 0 || param[len - 1] == '.')
+        return false;
+    if(strchr(param, '*') != NULL || strchr(param, '{') != NULL)
+        return false;
+    return true;
+}
+
+/**
+ * Fetch a batch of parameters owned by the same provider with one rbus_getExt call.
+ * Results are matched back to the requesting index by name. If the provider rejects
+ * the batch, e.g. because one of the names does not exist, every parameter of the
+ * batch is retried with an individual get so that one bad name does not fail the rest.
+ */
+static void getRbusParamBatch(ParamBatch *batch, const char **paramNames, profileValues **results) {
+    const char** batchNames = NULL;
+    rbusProperty_t rbusPropertyValues = NULL;
+    rbusProperty_t nextProperty = NULL;
+    int paramValCount = 0;
+    int i = 0;
+
+    if(batch->count == 1) {
+        results[batch->paramIndex[0]] = getRbusSingleParamValues(paramNames[batch->paramIndex[0]]);
+        return;
+    }
+
+    batchNames = (const char**) malloc(batch->count * sizeof(char*));
+    if(batchNames == NULL)
+        return;
+    for( i = 0; i < batch->count; i++ )
+        batchNames[i] = paramNames[batch->paramIndex[i]];
+
+    T2Debug("Calling rbus_getExt for batch of %d params starting with %s \n", batch->count, batchNames[0]);
+    if(RBUS_ERROR_SUCCESS != rbus_getExt(t2bus_handle, batch->count, batchNames, &paramValCount, &rbusPropertyValues)) {
+        T2Info("Batch get of %d params failed, retrying individually\n", batch->count);
+        if(rbusPropertyValues != NULL)
+            rbusProperty_Release(rbusPropertyValues);
+        for( i = 0; i < batch->count; i++ )
+            results[batch->paramIndex[i]] = getRbusSingleParamValues(batchNames[i]);
+        free(batchNames);
+        return;
+    }
+
+    nextProperty = rbusPropertyValues;
+    while(nextProperty) {
+        const char* name = rbusProperty_GetName(nextProperty);
+        for( i = 0; name != NULL && i < batch->count; i++ ) {
+            if(results[batch->paramIndex[i]] == NULL && strcmp(name, batchNames[i]) == 0) {
+                char* stringValue = rbusValue_ToString(rbusProperty_GetValue(nextProperty), NULL, 0);
+                profileValues* profVals = createParamValues(name, stringValue ? stringValue : "");
+                if(profVals != NULL)
+                    profVals->paramValueCount = 1;
+                free(stringValue);
+                results[batch->paramIndex[i]] = profVals;
+                break;
+            }
+        }
+        nextProperty = rbusProperty_GetNext(nextProperty);
+    }
+    if(rbusPropertyValues != NULL)
+        rbusProperty_Release(rbusPropertyValues);
+
+    for( i = 0; i < batch->count; i++ ) {
+        if(results[batch->paramIndex[i]] == NULL) {
+            T2Info("ParameterName : %s missing from batch response\n", batchNames[i]);
+            results[batch->paramIndex[i]] = createParamValues(batchNames[i], "NULL");
+        }
+    }
+    free(batchNames);
+}
+
+static time_t getMonotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static void freeComponentNames(char **componentNames, int numComponents) {
+    int i = 0;
+    if(componentNames == NULL)
+        return;
+    for( i = 0; i < numComponents; i++ )
+        free(componentNames[i]);
+    free(componentNames);
+}
+
+/**
+ * Remember the provider of a parameter, or that it has none, so that the name is not
+ * discovered again before the entry expires.
+ */
+static void cacheParamProvider(const char *paramName, const char *provider, time_t now) {
+    ProviderCacheEntry *entry = NULL;
+
+    pthread_mutex_lock(&providerCacheMutex);
+    if(providerCache == NULL)
+        providerCache = hash_map_create();
+    entry = (ProviderCacheEntry *) hash_map_get(providerCache, paramName);
+    if(entry == NULL) {
+        entry = (ProviderCacheEntry *) calloc(1, sizeof(ProviderCacheEntry));
+        if(entry == NULL) {
+            pthread_mutex_unlock(&providerCacheMutex);
+            return;
+        }
+        hash_map_put(providerCache, strdup(paramName), entry);
+    }
+    free(entry->provider);
+    entry->provider = provider ? strdup(provider) : NULL;
+    entry->expiry = now + (entry->provider ? RBUS_PROVIDER_CACHE_TTL : RBUS_PROVIDER_NEGATIVE_TTL);
+    pthread_mutex_unlock(&providerCacheMutex);
+}
+
+/**
+ * Resolve the provider of every parameter, indexed like paramNames. Providers are
+ * taken from the cache, the other names are discovered with one lookup. rbus fails
+ * the whole lookup when one name cannot be resolved, in that case the names are
+ * resolved one by one. Names left unresolved stay NULL, which makes them fall back to
+ * an individual get, and are not looked up again for RBUS_PROVIDER_NEGATIVE_TTL.
+ */
+static char** discoverParamProviders(const char **paramNames, int count) {
+    char** componentNames = NULL;
+    char** providers = NULL;
+    const char** unresolved = NULL;
+    int* unresolvedIndex = NULL;
+    int unresolvedCount = 0;
+    int numComponents = 0;
+    time_t now = getMonotonicSeconds();
+    int i = 0;
+
+    providers = (char**) calloc(count, sizeof(char*));
+    unresolved = (const char**) malloc(count * sizeof(char*));
+    unresolvedIndex = (int*) malloc(count * sizeof(int));
+    if(providers == NULL || unresolved == NULL || unresolvedIndex == NULL) {
+        free(providers);
+        free(unresolved);
+        free(unresolvedIndex);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&providerCacheMutex);
+    for( i = 0; i < count; i++ ) {
+        ProviderCacheEntry *entry = providerCache ? (ProviderCacheEntry *) hash_map_get(providerCache, paramNames[i]) : NULL;
+        if(entry && entry->expiry > now) {
+            providers[i] = entry->provider ? strdup(entry->provider) : NULL;
+        } else {
+            unresolved[unresolvedCount] = paramNames[i];
+            unresolvedIndex[unresolvedCount++] = i;
+        }
+    }
+    pthread_mutex_unlock(&providerCacheMutex);
+
+    if(unresolvedCount > 0) {
+        T2Debug("Discovering providers of %d params\n", unresolvedCount);
+        if(RBUS_ERROR_SUCCESS == rbus_discoverComponentName(t2bus_handle, unresolvedCount, unresolved, &numComponents, &componentNames)
+                && numComponents == unresolvedCount) {
+            for( i = 0; i < unresolvedCount; i++ ) {
+                providers[unresolvedIndex[i]] = componentNames[i];
+                componentNames[i] = NULL;
+            }
+        } else if(unresolvedCount > 1) {
+            freeComponentNames(componentNames, numComponents);
+            for( i = 0; i < unresolvedCount; i++ ) {
+                componentNames = NULL;
+                numComponents = 0;
+                if(RBUS_ERROR_SUCCESS == rbus_discoverComponentName(t2bus_handle, 1, &unresolved[i], &numComponents, &componentNames)
+                        && numComponents == 1) {
+                    providers[unresolvedIndex[i]] = componentNames[0];
+                    componentNames[0] = NULL;
+                }
+                freeComponentNames(componentNames, numComponents);
+            }
+            componentNames = NULL;
+            numComponents = 0;
+        }
+        freeComponentNames(componentNames, numComponents);
+
+        for( i = 0; i < unresolvedCount; i++ ) {
+            if(providers[unresolvedIndex[i]] == NULL)
+                T2Info("Unable to resolve provider of %s, using individual get\n", unresolved[i]);
+            cacheParamProvider(unresolved[i], providers[unresolvedIndex[i]], now);
+        }
+    }
+    free(unresolved);
+    free(unresolvedIndex);
+    return providers;
+}
+
 Vector* getRbusProfileParamValues(Vector *paramList) {
     T2Debug("%s ++in\n", __FUNCTION__);
-    unsigned int i = 0;
+    int i = 0, j = 0;
+    int count = 0;
+    char** componentNames = NULL;
+    const char** paramNames = NULL;
+    bool* grouped = NULL;
+    profileValues** results = NULL;
+    Vector *batches = NULL;
     Vector *profileValueList = NULL;
     Vector_Create(&profileValueList);
 
@@ -137,71 +421,71 @@ Vector* getRbusProfileParamValues(Vector *paramList) {
     	Vector_Destroy(profileValueList, free);
         return NULL ;
     }
-    char** paramNames = (char **) malloc(paramList->count * sizeof(char*));
-
-    T2Debug("TR-181 Param count : %d\n", paramList->count);
-    for( ; i < paramList->count; i++ ) { // Loop through paramlist from profile
-
-        tr181ValStruct_t **paramValues = NULL;
-        rbusProperty_t rbusPropertyValues = NULL;
-        int paramValCount = 0;
-        int iterate = 0;
-        profileValues* profVals = (profileValues *) malloc(sizeof(profileValues));
-        char *param = (char*)((Param *) Vector_At(paramList, i))->alias ;
-        paramNames[0] = strdup(param);
-        T2Debug("Calling rbus_getExt for %s \n", paramNames[0]);
-        if(RBUS_ERROR_SUCCESS != rbus_getExt(t2bus_handle, 1, (const char**)paramNames, &paramValCount, &rbusPropertyValues)) {
-            T2Error("Failed to retrieve param : %s\n", paramNames[0]);
-            paramValCount = 0 ;
-        } else {
-            if(rbusPropertyValues == NULL || paramValCount == 0) {
-                T2Info("ParameterName : %s Retrieved value count : %d\n", paramNames[0], paramValCount);
-            }
-        }
-
-        profVals->paramValueCount = paramValCount;
-
-        T2Debug("Received %d parameters for %s fetch \n", paramValCount, paramNames[0]);
+    count = Vector_Size(paramList);
+    T2Debug("TR-181 Param count : %d\n", count);
+    if(count == 0) {
+        T2Debug("%s --Out\n", __FUNCTION__);
+        return profileValueList;
+    }
 
-        // Populate bus independent parameter value array
-        if(paramValCount == 0) {
-            paramValues = (tr181ValStruct_t**) malloc(sizeof(tr181ValStruct_t*));
-            if(paramValues != NULL) {
-                paramValues[0] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
-                paramValues[0]->parameterName = strdup(param);
-                paramValues[0]->parameterValue = strdup("NULL");
-            }
-	    if(rbusPropertyValues != NULL){
-	          rbusProperty_Release(rbusPropertyValues);
-	    }
-        }else {
-            paramValues = (tr181ValStruct_t**) malloc(paramValCount * sizeof(tr181ValStruct_t*));
-            if(paramValues != NULL) {
-                rbusProperty_t nextProperty = rbusPropertyValues;
-                for( iterate = 0; iterate < paramValCount; ++iterate ) { // Loop through values obtained from query for individual param in list
-                    if(nextProperty) {
-                        char* stringValue = NULL;
-                        rbusValue_t value = rbusProperty_GetValue(nextProperty);
-                        paramValues[iterate] = (tr181ValStruct_t*) malloc(sizeof(tr181ValStruct_t));
-                        if(paramValues[iterate]) {
-                            stringValue = (char*)rbusProperty_GetName(nextProperty);
-                            paramValues[iterate]->parameterName = strdup(stringValue);
-                            paramValues[iterate]->parameterValue = rbusValue_ToString(value, NULL, 0);
-                        }
-                    }
-                    nextProperty = rbusProperty_GetNext(nextProperty);
+    paramNames = (const char**) malloc(count * sizeof(char*));
+    grouped = (bool*) calloc(count, sizeof(bool));
+    results = (profileValues**) calloc(count, sizeof(profileValues*));
+    if(paramNames == NULL || grouped == NULL || results == NULL) {
+        T2Error("Unable to allocate memory for param batches\n");
+        free(paramNames);
+        free(grouped);
+        free(results);
+        Vector_Destroy(profileValueList, free);
+        return NULL;
+    }
+    for( i = 0; i < count; i++ )
+        paramNames[i] = ((Param *) Vector_At(paramList, i))->alias;
+
+    // Resolve the provider of each parameter so that gets can be grouped per provider
+    componentNames = discoverParamProviders(paramNames, count);
+
+    Vector_Create(&batches);
+    for( i = 0; i < count; i++ ) { // Loop through paramlist from profile
+        ParamBatch *batch = NULL;
+        if(grouped[i])
+            continue;
+        grouped[i] = true;
+        batch = createParamBatch(componentNames ? componentNames[i] : NULL, NULL, RBUS_GET_BATCH_SIZE);
+        if(batch == NULL)
+            continue;
+        batch->paramIndex[batch->count++] = i;
+
+        if(componentNames && componentNames[i] && isBatchableParam(paramNames[i])) {
+            for( j = i + 1; j < count && batch->count < RBUS_GET_BATCH_SIZE; j++ ) {
+                if(!grouped[j] && componentNames[j] && isBatchableParam(paramNames[j])
+                        && strcmp(componentNames[i], componentNames[j]) == 0) {
+                    grouped[j] = true;
+                    batch->paramIndex[batch->count++] = j;
                 }
-                rbusProperty_Release(rbusPropertyValues);
             }
         }
-        free(paramNames[0]);
-
-        profVals->paramValues = paramValues;
-        // End of populating bus independent parameter value array
-        Vector_PushBack(profileValueList, profVals);
+        Vector_PushBack(batches, batch);
     } // End of looping through tr181 parameter list from profile
-    if(paramNames)
-        free(paramNames);
+
+    // Providers are queried in parallel, the collector owns the batches from here on
+    collectParamBatches(batches, paramNames, count, getRbusParamBatch, results);
+
+    // Keep the result list aligned with the profile param list
+    for( i = 0; i < count; i++ ) {
+        if(results[i] == NULL)
+            results[i] = createParamValues(paramNames[i], "NULL");
+        Vector_PushBack(profileValueList, results[i]);
+    }
+
+    if(componentNames) {
+        for( i = 0; i < count; i++ )
+            free(componentNames[i]);
+        free(componentNames);
+    }
+    free(paramNames);
+    free(grouped);
+    free(results);
 
     T2Debug("%s --Out\n", __FUNCTION__);
     return profileValueList;
@@ -663,37 +947,243 @@ T2ERROR publishEventsProfileUpdates() {
     
 }
 
-void triggerCondtionReceiveHandler(
+/**
+ * Event subscriptions of trigger conditions and onChange parameters share the
+ * single consumer handle t2bus_handle. Each parameter and filter combination is
+ * subscribed once and reference counted, events fan out to every trigger
+ * condition and every Param that asked for it.
+ */
+typedef struct _EventSubscription
+{
+    uintptr_t id;
+    char *name;
+    char *oprator;      // Relation filter operator, NULL for plain value change
+    int threshold;
+    unsigned int triggerRefCount;
+    Vector *watchers;   // onChange params fed by this subscription
+}EventSubscription;
+
+static Vector *eventSubscriptionList = NULL;
+static uintptr_t nextEventSubscriptionId = 1;
+// Serializes subscribe/unsubscribe requests, never taken from the event handler
+static pthread_mutex_t eventSubConfigMutex = PTHREAD_MUTEX_INITIALIZER;
+// Guards eventSubscriptionList and the value change state of subscribed params
+static pthread_mutex_t eventSubMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char* rbusValueToParamString(rbusValue_t value) {
+    if(rbusValue_GetType(value) == RBUS_BOOLEAN)
+        return strdup(rbusValue_GetBoolean(value) ? "true" : "false");
+    return rbusValue_ToString(value, NULL, 0);
+}
+
+static bool getFilterOperator(const char *oprator, rbusFilter_RelationOperator_t *filterOperator) {
+    if(strcmp(oprator, "lt") == 0)
+        *filterOperator = RBUS_FILTER_OPERATOR_LESS_THAN;
+    else if(strcmp(oprator, "gt") == 0)
+        *filterOperator = RBUS_FILTER_OPERATOR_GREATER_THAN;
+    else if(strcmp(oprator, "eq") == 0)
+        *filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
+    else
+        return false;
+    return true;
+}
+
+// Must be called with eventSubMutex held
+static EventSubscription* findEventSubscription(const char *name, const char *oprator, int threshold) {
+    int i = 0;
+    for( i = 0; eventSubscriptionList && i < Vector_Size(eventSubscriptionList); i++ ) {
+        EventSubscription *eventSub = (EventSubscription *) Vector_At(eventSubscriptionList, i);
+        if(strcmp(eventSub->name, name) != 0)
+            continue;
+        if(oprator == NULL && eventSub->oprator == NULL)
+            return eventSub;
+        if(oprator && eventSub->oprator && strcmp(eventSub->oprator, oprator) == 0 && eventSub->threshold == threshold)
+            return eventSub;
+    }
+    return NULL;
+}
+
+// Must be called with eventSubMutex held
+static EventSubscription* findEventSubscriptionById(uintptr_t id) {
+    int i = 0;
+    for( i = 0; eventSubscriptionList && i < Vector_Size(eventSubscriptionList); i++ ) {
+        EventSubscription *eventSub = (EventSubscription *) Vector_At(eventSubscriptionList, i);
+        if(eventSub->id == id)
+            return eventSub;
+    }
+    return NULL;
+}
+
+static void freeEventSubscription(EventSubscription *eventSub) {
+    if(eventSub) {
+        free(eventSub->name);
+        if(eventSub->oprator)
+            free(eventSub->oprator);
+        Vector_Destroy(eventSub->watchers, NULL);
+        free(eventSub);
+    }
+}
+
+static void eventSubscriptionHandler(
     rbusHandle_t handle,
     rbusEvent_t const* event,
     rbusEventSubscription_t* subscription)
 {
+    EventSubscription *eventSub = NULL;
+    rbusValue_t newValue = NULL;
+    rbusValue_t filter = NULL;
+    char *stringValue = NULL;
+    char *oprator = NULL;
+    int threshold = 0;
+    bool trigger = false;
+    int i = 0;
     (void)handle;
 
-    rbusValue_t newValue = rbusObject_GetValue(event->data, "value");
-    rbusValue_t oldValue = rbusObject_GetValue(event->data, "oldValue");
-    rbusValue_t filter = rbusObject_GetValue(event->data, "filter");
-
     T2Debug("Consumer receiver event for param %s\n", event->name);
+    newValue = rbusObject_GetValue(event->data, "value");
+    filter = rbusObject_GetValue(event->data, "filter");
+    if(newValue)
+        stringValue = rbusValueToParamString(newValue);
+
+    pthread_mutex_lock(&eventSubMutex);
+    eventSub = findEventSubscriptionById((uintptr_t) subscription->userData);
+    if(eventSub == NULL) {
+        // Unsubscribed while the event was in flight
+        pthread_mutex_unlock(&eventSubMutex);
+        free(stringValue);
+        return;
+    }
+    for( i = 0; stringValue && i < Vector_Size(eventSub->watchers); i++ ) {
+        Param *param = (Param *) Vector_At(eventSub->watchers, i);
+        if(param->firstValue == NULL)
+            param->firstValue = strdup(stringValue);
+        if(param->lastValue)
+            free(param->lastValue);
+        param->lastValue = strdup(stringValue);
+        param->changeCount++;
+    }
+    if(eventSub->triggerRefCount > 0) {
+        trigger = true;
+        oprator = eventSub->oprator ? strdup(eventSub->oprator) : NULL;
+        threshold = eventSub->threshold;
+    }
+    pthread_mutex_unlock(&eventSubMutex);
+    free(stringValue);
 
-    if(newValue){
-        T2Debug("  New Value: \n");
+    if(trigger) {
+        if(filter) {
+            T2Debug("Filter event\n");
+            trigger = (rbusValue_GetBoolean(filter) == 1);
+        }
+        else {
+            T2Debug("ValueChange event\n");
+        }
+        if(trigger)
+            triggerReportOnCondtion(event->name, oprator ? oprator : "any", threshold);
     }
-    if(oldValue){
-        T2Debug("  Old Value: \n");
+    free(oprator);
+}
+
+/**
+ * Take a reference on the subscription for name and filter, subscribing on first use.
+ * oprator NULL subscribes to plain value changes.
+ */
+static EventSubscription* acquireEventSubscription(const char *name, const char *oprator, int threshold) {
+    EventSubscription *eventSub = NULL;
+    rbusFilter_RelationOperator_t filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
+    rbusFilter_t filter = NULL;
+    rbusValue_t filterValue = NULL;
+    uintptr_t id = 0;
+    int rc = RBUS_ERROR_SUCCESS;
+
+    if(oprator && !getFilterOperator(oprator, &filterOperator)) {
+        T2Error("Unsupported trigger condition operator %s for %s\n", oprator, name);
+        return NULL;
     }
 
-    if(filter) {
-      T2Debug("Filter event\n");
-      if(rbusValue_GetBoolean(filter) == 1) {
-        triggerReportOnCondtion(event->name);
-      }
+    pthread_mutex_lock(&eventSubMutex);
+    if(eventSubscriptionList == NULL)
+        Vector_Create(&eventSubscriptionList);
+    eventSub = findEventSubscription(name, oprator, threshold);
+    id = nextEventSubscriptionId++;
+    pthread_mutex_unlock(&eventSubMutex);
+    if(eventSub)
+        return eventSub;
+
+    if(oprator == NULL) {
+        rc = rbusEvent_Subscribe(t2bus_handle, name, eventSubscriptionHandler, (void *) id, 0);
     }
     else {
-      T2Debug("ValueChange event\n");
-      triggerReportOnCondtion(event->name);
-    }  
+        rbusEventSubscription_t subscription = {name, NULL, 0, 0, eventSubscriptionHandler, (void *) id, NULL, NULL};
+        T2Debug("Ex filterOperator %s ( %d ) , threshold %d \n", oprator, filterOperator, threshold);
+        rbusValue_Init(&filterValue);
+        rbusValue_SetInt32(filterValue, threshold);
+        rbusFilter_InitRelation(&filter, filterOperator, filterValue);
+        subscription.filter = filter;
+        rc = rbusEvent_SubscribeEx(t2bus_handle, &subscription, 1, 0);
+        rbusValue_Release(filterValue);
+        rbusFilter_Release(filter);
+    }
+    if(rc != RBUS_ERROR_SUCCESS) {
+        T2Error("%s Subscribe for %s failed with error %d\n", __FUNCTION__, name, rc);
+        return NULL;
+    }
 
+    eventSub = (EventSubscription *) malloc(sizeof(EventSubscription));
+    if(eventSub == NULL) {
+        T2Error("Unable to allocate memory for event subscription\n");
+        return NULL;
+    }
+    memset(eventSub, 0, sizeof(EventSubscription));
+    eventSub->id = id;
+    eventSub->name = strdup(name);
+    eventSub->oprator = oprator ? strdup(oprator) : NULL;
+    eventSub->threshold = threshold;
+    Vector_Create(&eventSub->watchers);
+    pthread_mutex_lock(&eventSubMutex);
+    Vector_PushBack(eventSubscriptionList, eventSub);
+    pthread_mutex_unlock(&eventSubMutex);
+    T2Info("Subscribed to %s %s %d\n", name, oprator ? oprator : "any", threshold);
+    return eventSub;
+}
+
+/**
+ * Unsubscribe once neither a trigger condition nor a param references the subscription.
+ * Must be called with eventSubConfigMutex held.
+ */
+static void releaseEventSubscription(EventSubscription *eventSub) {
+    rbusFilter_RelationOperator_t filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
+    rbusFilter_t filter = NULL;
+    rbusValue_t filterValue = NULL;
+    int rc = RBUS_ERROR_SUCCESS;
+
+    pthread_mutex_lock(&eventSubMutex);
+    if(eventSub->triggerRefCount > 0 || Vector_Size(eventSub->watchers) > 0) {
+        pthread_mutex_unlock(&eventSubMutex);
+        return;
+    }
+    Vector_RemoveItem(eventSubscriptionList, eventSub, NULL);
+    pthread_mutex_unlock(&eventSubMutex);
+
+    if(eventSub->oprator == NULL) {
+        rc = rbusEvent_Unsubscribe(t2bus_handle, eventSub->name);
+    }
+    else {
+        rbusEventSubscription_t subscription = {eventSub->name, NULL, 0, 0, eventSubscriptionHandler, (void *) eventSub->id, NULL, NULL};
+        getFilterOperator(eventSub->oprator, &filterOperator);
+        rbusValue_Init(&filterValue);
+        rbusValue_SetInt32(filterValue, eventSub->threshold);
+        rbusFilter_InitRelation(&filter, filterOperator, filterValue);
+        subscription.filter = filter;
+        rc = rbusEvent_UnsubscribeEx(t2bus_handle, &subscription, 1);
+        rbusValue_Release(filterValue);
+        rbusFilter_Release(filter);
+    }
+    if(rc != RBUS_ERROR_SUCCESS)
+        T2Debug("%s UnSubscribe failed for %s\n", __FUNCTION__, eventSub->name);
+    else
+        T2Info("Unsubscribed from %s %s %d\n", eventSub->name, eventSub->oprator ? eventSub->oprator : "any", eventSub->threshold);
+    freeEventSubscription(eventSub);
 }
 
 T2ERROR rbusT2ConsumerReg(Vector *triggerConditionList)
@@ -718,133 +1208,206 @@ T2ERROR rbusT2ConsumerReg(Vector *triggerConditionList)
 
 T2ERROR rbusT2ConsumerUnReg(Vector *triggerConditionList)
 {
-    int j,rc;
-    //char user_data[32] = {0};
+    int j;
     T2Debug("%s ++in\n", __FUNCTION__);
 
-    if(!t2bus_handle && T2ERROR_SUCCESS != rBusInterface_Init()) {
-        T2Error("%s Failed in getting bus handles \n", __FUNCTION__);
-        T2Debug("%s --out\n", __FUNCTION__);
-        return T2ERROR_FAILURE;
-    }
-
+    pthread_mutex_lock(&eventSubConfigMutex);
     for( j = 0; j < triggerConditionList->count; j++ ) {
         TriggerCondition *triggerCondition = ((TriggerCondition *) Vector_At(triggerConditionList, j));
+        EventSubscription *eventSub = NULL;
+        const char *oprator = NULL;
+        if(!triggerCondition->isSubscribed)
+            continue;
         T2Debug("Adding %s to unregister list \n", triggerCondition->reference);
-        rbusFilter_RelationOperator_t filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
-        rbusFilter_t filter;
-        rbusValue_t filterValue;
-        rbusEventSubscription_t subscription = {triggerCondition->reference, NULL, 0, 0, (void *)triggerCondtionReceiveHandler, NULL, NULL, NULL};
-
-        if(strcmp(triggerCondition->oprator,"lt") == 0)
-        {
-            filterOperator = RBUS_FILTER_OPERATOR_LESS_THAN;
-        }
-        if(strcmp(triggerCondition->oprator,"gt") == 0)
-        {
-            filterOperator = RBUS_FILTER_OPERATOR_GREATER_THAN;
-        }
-        if(strcmp(triggerCondition->oprator,"eq") == 0)
-        {
-            filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
-        }
-        if(strcmp(triggerCondition->oprator,"any") == 0)
-        {
-            rc = rbusEvent_Unsubscribe(
-            t2bus_handle,
-            triggerCondition->reference);
-            if (rc != RBUS_ERROR_SUCCESS)
-            {
-                T2Debug("%s UnSubscribe failed\n",__FUNCTION__);
-            }
-        }
-        else
-        {
-            rbusValue_Init(&filterValue);
-            rbusValue_SetInt32(filterValue, triggerCondition->threshold);
-            rbusFilter_InitRelation(&filter, filterOperator, filterValue);
-            subscription.filter = filter;
-            rc = rbusEvent_UnsubscribeEx(t2bus_handle, &subscription, 1);
-            if (rc != RBUS_ERROR_SUCCESS)
-            {
-                T2Debug("%s UnSubscribeEx failed\n",__FUNCTION__);
-            }
-        }
+
+        if(strcmp(triggerCondition->oprator, "any") != 0)
+            oprator = triggerCondition->oprator;
+        pthread_mutex_lock(&eventSubMutex);
+        eventSub = findEventSubscription(triggerCondition->reference, oprator, triggerCondition->threshold);
+        if(eventSub && eventSub->triggerRefCount > 0)
+            eventSub->triggerRefCount--;
+        triggerCondition->isSubscribed = false;
+        pthread_mutex_unlock(&eventSubMutex);
+        if(eventSub)
+            releaseEventSubscription(eventSub);
     }
+    pthread_mutex_unlock(&eventSubConfigMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
 T2ERROR T2RbusConsumer(TriggerCondition *triggerCondition)
 {
-    int rc = RBUS_ERROR_SUCCESS;
-    int ret = T2ERROR_SUCCESS;
-    char user_data[32] = {0};
-    //char componentName[] = "t2consumer";
+    EventSubscription *eventSub = NULL;
+    const char *oprator = NULL;
     T2Debug("--in %s\n", __FUNCTION__);
     if(triggerCondition->isSubscribed == true){
        T2Debug("%s already subscribed\n", triggerCondition->reference);
        return T2ERROR_SUCCESS;
     }    
-       
-    rbusFilter_RelationOperator_t filterOperator; 
-    rbusFilter_t filter;
-    rbusValue_t filterValue;
-    rbusEventSubscription_t subscription = {triggerCondition->reference, NULL, 0, 0, triggerCondtionReceiveHandler, NULL, NULL, NULL};
-      
-    if(strcmp(triggerCondition->oprator,"lt") == 0)
-    {
-       filterOperator = RBUS_FILTER_OPERATOR_LESS_THAN;
-    }
-    if(strcmp(triggerCondition->oprator,"gt") == 0)
-    {
-       filterOperator = RBUS_FILTER_OPERATOR_GREATER_THAN;
+
+    if(!t2bus_handle && T2ERROR_SUCCESS != rBusInterface_Init()) {
+        T2Debug("Consumer: rbus_open failed\n");
+        return T2ERROR_FAILURE;
     }
-    if(strcmp(triggerCondition->oprator,"eq") == 0)
-    {
-        filterOperator = RBUS_FILTER_OPERATOR_EQUAL;
+
+    T2Debug("filterOperator %s , threshold %d \n",triggerCondition->oprator, triggerCondition->threshold);
+    if(strcmp(triggerCondition->oprator, "any") != 0)
+        oprator = triggerCondition->oprator;
+
+    pthread_mutex_lock(&eventSubConfigMutex);
+    eventSub = acquireEventSubscription(triggerCondition->reference, oprator, triggerCondition->threshold);
+    if(eventSub) {
+        pthread_mutex_lock(&eventSubMutex);
+        eventSub->triggerRefCount++;
+        triggerCondition->isSubscribed = true;
+        pthread_mutex_unlock(&eventSubMutex);
     }
+    pthread_mutex_unlock(&eventSubConfigMutex);
+
+    return eventSub ? T2ERROR_SUCCESS : T2ERROR_FAILURE;
+}
+
+/**
+ * Subscribe the onChange parameters of a profile to rbus value change events.
+ * Parameters whose provider does not publish value changes stay on polling.
+ */
+T2ERROR rbusT2ParamSubscribe(Vector *paramList)
+{
+    EventSubscription *eventSub = NULL;
+    int i = 0;
+    T2Debug("%s ++in\n", __FUNCTION__);
 
     if(!t2bus_handle && T2ERROR_SUCCESS != rBusInterface_Init()) {
-        T2Debug("Consumer: rbus_open failed: %d\n", rc);
+        T2Error("%s Failed in getting bus handles \n", __FUNCTION__);
+        T2Debug("%s --out\n", __FUNCTION__);
         return T2ERROR_FAILURE;
     }
-    strcpy(user_data,"Not used");
-    if(strcmp(triggerCondition->oprator,"any") == 0)
-    {
-        T2Debug("filterOperator %s , threshold %d \n",triggerCondition->oprator, triggerCondition->threshold);
-        rc = rbusEvent_Subscribe(
-        t2bus_handle,
-        triggerCondition->reference,
-        triggerCondtionReceiveHandler,
-        user_data,
-        0);
-        if (rc != RBUS_ERROR_SUCCESS){
-            T2Error(" %s Subscribe failed\n",__FUNCTION__);
-	    ret = T2ERROR_FAILURE;
+
+    pthread_mutex_lock(&eventSubConfigMutex);
+    for( i = 0; i < Vector_Size(paramList); i++ ) {
+        Param *param = (Param *) Vector_At(paramList, i);
+        if(param->method != PARAM_METHOD_ONCHANGE || param->isSubscribed)
+            continue;
+        if(!isBatchableParam(param->alias)) {
+            T2Warning("onChange is not supported for partial path %s, polling instead\n", param->alias);
+            continue;
+        }
+
+        eventSub = acquireEventSubscription(param->alias, NULL, 0);
+        if(eventSub == NULL) {
+            T2Warning("Value change subscription for %s failed, polling instead\n", param->alias);
+            continue;
         }
-	else{
-	    triggerCondition->isSubscribed = true;
-	}
+        pthread_mutex_lock(&eventSubMutex);
+        Vector_PushBack(eventSub->watchers, param);
+        param->isSubscribed = true;
+        pthread_mutex_unlock(&eventSubMutex);
     }
-    else	
-    {
-        T2Debug("Ex filterOperator %s ( %d ) , threshold %d \n",triggerCondition->oprator, filterOperator, triggerCondition->threshold);
-        rbusValue_Init(&filterValue);
-        rbusValue_SetInt32(filterValue, triggerCondition->threshold);
-        rbusFilter_InitRelation(&filter, filterOperator, filterValue);
-        subscription.filter = filter;
-        rc = rbusEvent_SubscribeEx(t2bus_handle, &subscription, 1, 0);
-	if (rc != RBUS_ERROR_SUCCESS){
-            T2Error(" %s SubscribeEx failed\n",__FUNCTION__);
-	    ret = T2ERROR_FAILURE;
+    pthread_mutex_unlock(&eventSubConfigMutex);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Detach the onChange parameters of a profile. Must be called before the params are freed.
+ */
+T2ERROR rbusT2ParamUnSubscribe(Vector *paramList)
+{
+    EventSubscription *eventSub = NULL;
+    int i = 0, j = 0;
+    T2Debug("%s ++in\n", __FUNCTION__);
+
+    pthread_mutex_lock(&eventSubConfigMutex);
+    for( i = 0; i < Vector_Size(paramList); i++ ) {
+        Param *param = (Param *) Vector_At(paramList, i);
+        if(!param->isSubscribed)
+            continue;
+
+        pthread_mutex_lock(&eventSubMutex);
+        eventSub = findEventSubscription(param->alias, NULL, 0);
+        for( j = 0; eventSub && j < Vector_Size(eventSub->watchers); j++ ) {
+            if(Vector_At(eventSub->watchers, j) == param) {
+                Vector_RemoveItem(eventSub->watchers, param, NULL);
+                break;
+            }
         }
-	else{
-            triggerCondition->isSubscribed = true;
-	}
-        rbusValue_Release(filterValue);
-        rbusFilter_Release(filter);
+        param->isSubscribed = false;
+        pthread_mutex_unlock(&eventSubMutex);
+        if(eventSub)
+            releaseEventSubscription(eventSub);
     }
-    return ret;
+    pthread_mutex_unlock(&eventSubConfigMutex);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Report the held value of a subscribed parameter and start a new interval.
+ * absolute reports the latest value, count the number of changes and summary
+ * "first,last,count" of the changes seen since the previous report.
+ * Returns false when the parameter has to be polled, the polled value is then
+ * handed to rbusT2ParamSeedValue.
+ */
+bool getRbusSubscribedParamValue(Param *param, char **paramValue)
+{
+    char buf[32] = {'\0'};
+    size_t len = 0;
+    bool served = false;
+
+    pthread_mutex_lock(&eventSubMutex);
+    if(!param->isSubscribed) {
+        pthread_mutex_unlock(&eventSubMutex);
+        return false;
+    }
+    switch(param->use) {
+        case PARAM_USE_COUNT:
+            snprintf(buf, sizeof(buf), "%u", param->changeCount);
+            *paramValue = strdup(buf);
+            served = true;
+            break;
+        case PARAM_USE_SUMMARY:
+            if(param->lastValue) {
+                const char *first = param->firstValue ? param->firstValue : param->lastValue;
+                snprintf(buf, sizeof(buf), "%u", param->changeCount);
+                len = strlen(first) + strlen(param->lastValue) + strlen(buf) + 3;
+                *paramValue = (char *) malloc(len);
+                if(*paramValue) {
+                    snprintf(*paramValue, len, "%s,%s,%s", first, param->lastValue, buf);
+                    served = true;
+                }
+            }
+            break;
+        case PARAM_USE_ABSOLUTE:
+        default:
+            if(param->lastValue) {
+                *paramValue = strdup(param->lastValue);
+                served = true;
+            }
+            break;
+    }
+    if(served) {
+        if(param->firstValue) {
+            free(param->firstValue);
+            param->firstValue = NULL;
+        }
+        param->changeCount = 0;
+    }
+    pthread_mutex_unlock(&eventSubMutex);
+    return served;
+}
+
+/**
+ * Seed a subscribed parameter with a polled value, events only carry later changes.
+ */
+void rbusT2ParamSeedValue(Param *param, const char *paramValue)
+{
+    pthread_mutex_lock(&eventSubMutex);
+    if(param->isSubscribed && param->lastValue == NULL && paramValue)
+        param->lastValue = strdup(paramValue);
+    pthread_mutex_unlock(&eventSubMutex);
 }
 
 rbusError_t t2TriggerConditionGetHandler(rbusHandle_t handle, rbusProperty_t property, rbusGetHandlerOptions_t* opts)
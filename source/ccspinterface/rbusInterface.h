@@ -24,8 +24,24 @@
 #include <vector.h>
 
 #include "busInterface.h"
+#include "t2common.h"
 #include "telemetry2_0.h"
 
+/* Maximum number of parameters of one provider fetched by a single rbus_getExt call */
+#ifndef RBUS_GET_BATCH_SIZE
+#define RBUS_GET_BATCH_SIZE 16
+#endif
+
+/* Seconds the discovered provider of a parameter is reused for grouping gets */
+#ifndef RBUS_PROVIDER_CACHE_TTL
+#define RBUS_PROVIDER_CACHE_TTL 3600
+#endif
+
+/* Seconds a parameter whose provider could not be discovered is not looked up again */
+#ifndef RBUS_PROVIDER_NEGATIVE_TTL
+#define RBUS_PROVIDER_NEGATIVE_TTL 900
+#endif
+
 T2ERROR getRbusParameterVal(const char* paramName, char **paramValue);
 
 Vector* getRbusProfileParamValues(Vector *paramList);
@@ -38,4 +54,12 @@ T2ERROR rbusT2ConsumerReg(Vector *triggerConditionList);
 
 T2ERROR rbusT2ConsumerUnReg(Vector *triggerConditionList);
 
+T2ERROR rbusT2ParamSubscribe(Vector *paramList);
+
+T2ERROR rbusT2ParamUnSubscribe(Vector *paramList);
+
+bool getRbusSubscribedParamValue(Param *param, char **paramValue);
+
+void rbusT2ParamSeedValue(Param *param, const char *paramValue);
+
 #endif
@@ -35,6 +35,8 @@
 #define TR181BUF_LENGTH 512
 #define OBJ_DELIMITER "{i}"
 #define DELIMITER_SIZE 3
+#define MAX_INSTANCE_LEVELS 4
+#define NUM_OF_ENTRIES_SUFFIX "NumberOfEntries"
 
 #include "t2log_wrapper.h"
 #include "t2common.h"
@@ -53,6 +55,22 @@ static char *logPath = NULL;
 static char *persistentPath = NULL;
 static pthread_mutex_t dcaMutex = PTHREAD_MUTEX_INITIALIZER;
 
+typedef struct _InstanceCache {
+    Vector *paramNames;  /**< Parameters matching the multi-instance pattern, in instance order */
+    Vector *countParams; /**< NumberOfEntries parameter of every table expanded by the pattern */
+    Vector *counts;      /**< Values of countParams when the pattern was resolved */
+} InstanceCache;
+
+typedef struct _InstanceMatch {
+    char *name;
+    char *value;
+    int instances[MAX_INSTANCE_LEVELS];
+    int levels;
+} InstanceMatch;
+
+/* Resolved multi-instance patterns, protected by dcaMutex */
+static hash_map_t *instanceCacheMap = NULL;
+
 /* @} */ // End of group DCA_TYPES
 /**
  * @addtogroup DCA_APIS
@@ -81,7 +99,12 @@ int processTopPattern(char *logfile, GList *pchead, int pcIndex, Vector* grepRes
                 }
             }else {
                 if(NULL != tmp->pattern) {
-                    getProcUsage(tmp->pattern, grepResultList);
+                    int options = PROC_USAGE_DEFAULT;
+                    if(NULL != tmp->header && NULL != strstr(tmp->header, "_pss"))
+                        options |= PROC_USAGE_PSS;
+                    if(NULL != tmp->header && NULL != strstr(tmp->header, "_threads"))
+                        options |= PROC_USAGE_THREADS;
+                    getProcUsage(tmp->pattern, grepResultList, options);
                 }
             }
         }
@@ -129,6 +152,321 @@ static void appendData(pcdata_t* dst, const char* src) {
 }
 
 
+static void freeInstanceCache(InstanceCache *cache) {
+    if(cache) {
+        Vector_Destroy(cache->paramNames, free);
+        Vector_Destroy(cache->countParams, free);
+        Vector_Destroy(cache->counts, free);
+        free(cache);
+    }
+}
+
+static void freeInstanceMatch(void *data) {
+    if(data != NULL) {
+        InstanceMatch *match = (InstanceMatch *) data;
+        free(match->name);
+        free(match->value);
+        free(match);
+    }
+}
+
+static void freeParamValues(void *data) {
+    if(data != NULL) {
+        profileValues *profVals = (profileValues *) data;
+        // Placeholder entries are allocated even when the value count is 0
+        freeParamValueSt(profVals->paramValues, profVals->paramValueCount > 0 ? profVals->paramValueCount : 1);
+        free(profVals);
+    }
+}
+
+/**
+ * @brief Fetch a list of parameter names or partial paths with one bus request.
+ *
+ * @return Vector of profileValues aligned with names, to be released with freeParamValues.
+ */
+static Vector* getTr181Values(Vector *names) {
+    Vector *paramList = NULL;
+    Vector *values = NULL;
+    Param *params = NULL;
+    size_t i = 0;
+
+    if(Vector_Size(names) == 0)
+        return NULL;
+
+    params = (Param *) calloc(Vector_Size(names), sizeof(Param));
+    if(params == NULL)
+        return NULL;
+    Vector_Create(&paramList);
+    for( i = 0; i < Vector_Size(names); i++ ) {
+        params[i].name = (char *) Vector_At(names, i);
+        params[i].alias = params[i].name;
+        Vector_PushBack(paramList, &params[i]);
+    }
+    values = getProfileParameterValues(paramList);
+    Vector_Destroy(paramList, NULL);
+    free(params);
+    return values;
+}
+
+/**
+ * @brief Match a parameter name against a pattern with {i} instance tokens.
+ *
+ * @param[in]  pattern    Pattern such as Device.WiFi.AccessPoint.{i}.AssociatedDevice.{i}.SignalStrength
+ * @param[in]  name       Parameter name returned by the bus
+ * @param[out] match      Instance numbers substituted for each token
+ *
+ * @return true if the name is an instance of the pattern
+ */
+static bool matchInstancePattern(const char *pattern, const char *name, InstanceMatch *match) {
+    const char *p = pattern;
+    const char *n = name;
+    char *end = NULL;
+
+    match->levels = 0;
+    while(*p != '\0') {
+        if(strncmp(p, OBJ_DELIMITER, DELIMITER_SIZE) == 0) {
+            if(!isdigit((unsigned char) *n) || match->levels >= MAX_INSTANCE_LEVELS)
+                return false;
+            match->instances[match->levels++] = (int) strtol(n, &end, 10);
+            n = end;
+            p += DELIMITER_SIZE;
+        }else {
+            if(*p != *n)
+                return false;
+            p++;
+            n++;
+        }
+    }
+    return (*n == '\0');
+}
+
+static int compareInstanceMatch(const void *a, const void *b) {
+    const InstanceMatch *m1 = *(InstanceMatch * const *) a;
+    const InstanceMatch *m2 = *(InstanceMatch * const *) b;
+    int i = 0;
+    for( i = 0; i < m1->levels && i < m2->levels; i++ ) {
+        if(m1->instances[i] != m2->instances[i])
+            return (m1->instances[i] < m2->instances[i]) ? -1 : 1;
+    }
+    return m1->levels - m2->levels;
+}
+
+/**
+ * @brief Build the NumberOfEntries parameter of the table at the given token level,
+ *        e.g. Device.WiFi.AccessPoint.1.AssociatedDeviceNumberOfEntries for level 1.
+ */
+static char* getCountParamName(const char *pattern, const InstanceMatch *match, int level) {
+    char buff[TR181BUF_LENGTH + 15] = { '\0' };
+    const char *p = pattern;
+    const char *tck = NULL;
+    size_t len = 0;
+    int i = 0;
+
+    for( i = 0; i <= level; i++ ) {
+        tck = strstr(p, OBJ_DELIMITER);
+        if(tck == NULL)
+            return NULL;
+        if(i == level) {
+            // Table name without the trailing '.' followed by NumberOfEntries
+            if(tck == p || *(tck - 1) != '.')
+                return NULL;
+            snprintf(buff + len, sizeof(buff) - len, "%.*s%s", (int) (tck - p - 1), p, NUM_OF_ENTRIES_SUFFIX);
+        }else {
+            snprintf(buff + len, sizeof(buff) - len, "%.*s%d", (int) (tck - p), p, match->instances[i]);
+            len = strlen(buff);
+            p = tck + DELIMITER_SIZE;
+        }
+    }
+    return strdup(buff);
+}
+
+static void addUniqueName(Vector *names, char *name) {
+    size_t i = 0;
+    if(name == NULL)
+        return;
+    for( i = 0; i < Vector_Size(names); i++ ) {
+        if(strcmp((char *) Vector_At(names, i), name) == 0) {
+            free(name);
+            return;
+        }
+    }
+    Vector_PushBack(names, name);
+}
+
+/**
+ * @brief Check the cached instance list of a pattern against the current NumberOfEntries values.
+ */
+static bool isInstanceCacheValid(InstanceCache *cache) {
+    Vector *values = NULL;
+    bool valid = true;
+    size_t i = 0;
+
+    if(Vector_Size(cache->countParams) == 0)
+        return false;
+
+    values = getTr181Values(cache->countParams);
+    if(values == NULL || Vector_Size(values) != Vector_Size(cache->countParams)) {
+        valid = false;
+    }else {
+        for( i = 0; i < Vector_Size(values) && valid; i++ ) {
+            profileValues *profVals = (profileValues *) Vector_At(values, i);
+            if(profVals == NULL || profVals->paramValueCount <= 0 || profVals->paramValues[0] == NULL
+                    || profVals->paramValues[0]->parameterValue == NULL
+                    || strcmp(profVals->paramValues[0]->parameterValue, (char *) Vector_At(cache->counts, i)) != 0)
+                valid = false;
+        }
+    }
+    if(values)
+        Vector_Destroy(values, freeParamValues);
+    return valid;
+}
+
+/**
+ * @brief Resolve every instance of a multi-instance pattern with a partial path get of the
+ *        outermost table, supports nested {i} tokens up to MAX_INSTANCE_LEVELS.
+ *
+ * @param[in]  pattern  Pattern with {i} tokens
+ * @param[out] matches  Matching parameters and values in instance order
+ *
+ * @return Instance cache entry for the pattern, NULL on failure
+ */
+static InstanceCache* resolveInstancePattern(const char *pattern, Vector *matches) {
+    InstanceCache *cache = NULL;
+    Vector *names = NULL;
+    Vector *values = NULL;
+    InstanceMatch **sorted = NULL;
+    InstanceMatch topLevel;
+    const char *tck = strstr(pattern, OBJ_DELIMITER);
+    size_t i = 0;
+    int j = 0, level = 0;
+
+    Vector_Create(&names);
+    Vector_PushBack(names, strndup(pattern, tck - pattern));
+    values = getTr181Values(names);
+    Vector_Destroy(names, free);
+    if(values == NULL)
+        return NULL;
+
+    for( i = 0; i < Vector_Size(values); i++ ) {
+        profileValues *profVals = (profileValues *) Vector_At(values, i);
+        for( j = 0; profVals && j < profVals->paramValueCount; j++ ) {
+            InstanceMatch *match = NULL;
+            if(profVals->paramValues[j] == NULL || profVals->paramValues[j]->parameterName == NULL)
+                continue;
+            match = (InstanceMatch *) calloc(1, sizeof(InstanceMatch));
+            if(match && matchInstancePattern(pattern, profVals->paramValues[j]->parameterName, match)) {
+                match->name = strdup(profVals->paramValues[j]->parameterName);
+                match->value = strdup(profVals->paramValues[j]->parameterValue ? profVals->paramValues[j]->parameterValue : "");
+                Vector_PushBack(matches, match);
+            }else {
+                free(match);
+            }
+        }
+    }
+    Vector_Destroy(values, freeParamValues);
+
+    // Providers do not guarantee instance order of partial path responses
+    if(Vector_Size(matches) > 1) {
+        sorted = (InstanceMatch **) malloc(Vector_Size(matches) * sizeof(InstanceMatch *));
+        if(sorted) {
+            for( i = 0; i < Vector_Size(matches); i++ )
+                sorted[i] = (InstanceMatch *) Vector_At(matches, i);
+            qsort(sorted, Vector_Size(matches), sizeof(InstanceMatch *), compareInstanceMatch);
+            for( i = 0; i < Vector_Size(matches); i++ )
+                matches->data[i] = sorted[i];
+            free(sorted);
+        }
+    }
+
+    cache = (InstanceCache *) calloc(1, sizeof(InstanceCache));
+    if(cache == NULL)
+        return NULL;
+    Vector_Create(&cache->paramNames);
+    Vector_Create(&cache->countParams);
+    Vector_Create(&cache->counts);
+
+    memset(&topLevel, 0, sizeof(topLevel));
+    addUniqueName(cache->countParams, getCountParamName(pattern, &topLevel, 0));
+    for( i = 0; i < Vector_Size(matches); i++ ) {
+        InstanceMatch *match = (InstanceMatch *) Vector_At(matches, i);
+        Vector_PushBack(cache->paramNames, strdup(match->name));
+        for( level = 1; level < match->levels; level++ )
+            addUniqueName(cache->countParams, getCountParamName(pattern, match, level));
+    }
+
+    // Remember the table sizes the instance list was resolved for
+    values = getTr181Values(cache->countParams);
+    for( i = 0; i < Vector_Size(cache->countParams); i++ ) {
+        profileValues *profVals = (values && i < Vector_Size(values)) ? (profileValues *) Vector_At(values, i) : NULL;
+        if(profVals == NULL || profVals->paramValueCount <= 0 || profVals->paramValues[0] == NULL
+                || profVals->paramValues[0]->parameterValue == NULL) {
+            // Tables without a NumberOfEntries parameter are resolved again on every collection
+            T2Debug("No instance count available for %s\n", (char *) Vector_At(cache->countParams, i));
+            Vector_Destroy(cache->counts, free);
+            Vector_Destroy(cache->countParams, free);
+            Vector_Create(&cache->countParams);
+            Vector_Create(&cache->counts);
+            break;
+        }
+        Vector_PushBack(cache->counts, strdup(profVals->paramValues[0]->parameterValue));
+    }
+    if(values)
+        Vector_Destroy(values, freeParamValues);
+    return cache;
+}
+
+/**
+ * @brief Collect all instance values of a multi-instance object into the telemetry node.
+ *
+ * The instance list of a pattern is cached and reused while the NumberOfEntries of the
+ * expanded tables are unchanged, so a steady state collection costs one batched get of
+ * the counts and one batched get of the instance parameters.
+ */
+static T2ERROR processMultiInstanceObject(pcdata_t *node) {
+    T2ERROR ret_val = T2ERROR_FAILURE;
+    InstanceCache *cache = NULL;
+    Vector *matches = NULL;
+    Vector *values = NULL;
+    size_t i = 0;
+
+    if(instanceCacheMap == NULL)
+        instanceCacheMap = hash_map_create();
+
+    cache = (InstanceCache *) hash_map_get(instanceCacheMap, node->pattern);
+    if(cache && isInstanceCacheValid(cache)) {
+        values = getTr181Values(cache->paramNames);
+        for( i = 0; values && i < Vector_Size(values); i++ ) {
+            profileValues *profVals = (profileValues *) Vector_At(values, i);
+            if(profVals && profVals->paramValueCount > 0 && profVals->paramValues[0]) {
+                appendData(node, profVals->paramValues[0]->parameterValue);
+                ret_val = T2ERROR_SUCCESS;
+            }else {
+                T2Debug("Telemetry data source not found. Type = <message_bus>. Content string = %s\n", (char *) Vector_At(cache->paramNames, i));
+            }
+        }
+        if(values)
+            Vector_Destroy(values, freeParamValues);
+        return (Vector_Size(cache->paramNames) == 0) ? T2ERROR_SUCCESS : ret_val;
+    }
+
+    // Instance list is unknown or the table sizes changed
+    if(cache)
+        freeInstanceCache((InstanceCache *) hash_map_remove(instanceCacheMap, node->pattern));
+
+    Vector_Create(&matches);
+    cache = resolveInstancePattern(node->pattern, matches);
+    if(cache) {
+        hash_map_put(instanceCacheMap, strdup(node->pattern), cache);
+        ret_val = T2ERROR_SUCCESS;
+    }else {
+        T2Debug("Failed to resolve instances. Type = <message_bus>. Content string = %s\n", node->pattern);
+    }
+    for( i = 0; i < Vector_Size(matches); i++ )
+        appendData(node, ((InstanceMatch *) Vector_At(matches, i))->value);
+    Vector_Destroy(matches, freeInstanceMatch);
+    return ret_val;
+}
+
 /**
  *  @brief This API process tr181 objects through ccsp message bus
  *
@@ -143,11 +481,8 @@ static void appendData(pcdata_t* dst, const char* src) {
 static T2ERROR processTr181Objects(char *logfile, GList *pchead, int pcIndex) {
     T2Debug("%s ++in\n", __FUNCTION__);
     T2ERROR ret_val = T2ERROR_FAILURE;
-    int length, obj_count, i = 0;
     GList *tlist = NULL;
     pcdata_t *tmp = NULL;
-    char tr181objBuff[TR181BUF_LENGTH + 15] = { '\0' };
-    char *tck, *first_tck = NULL;
 
     //Loop through the given list and fill the data field of each node
     for( tlist = pchead; tlist != NULL; tlist = g_list_next(tlist) ) {
@@ -157,10 +492,7 @@ static T2ERROR processTr181Objects(char *logfile, GList *pchead, int pcIndex) {
             if(NULL != tmp->header && NULL != tmp->pattern && strlen(tmp->pattern) < TR181BUF_LENGTH && NULL == tmp->data) {
 
                 //Check whether given object has multi-instance token, if no token found it will be treated as a single instance object
-                //Or if more than one token found, skip the object as it is not valid/supported
-                //Check for first multi-instance token
-                tck = strstr(tmp->pattern, OBJ_DELIMITER);
-                if(NULL == tck) { //Single instance check
+                if(NULL == strstr(tmp->pattern, OBJ_DELIMITER)) { //Single instance check
                     ret_val = getParameterValue(tmp->pattern, &tr181dataBuff);
                     if(T2ERROR_SUCCESS == ret_val) {
                         appendData(tmp, tr181dataBuff);
@@ -169,40 +501,8 @@ static T2ERROR processTr181Objects(char *logfile, GList *pchead, int pcIndex) {
                     }else {
                         T2Debug("Telemetry data source not found. Type = <message_bus>. Content string = %s\n", tmp->pattern);
                     }
-                }else { //Multi-instance check
-                    first_tck = tck;
-                    //Check for a next multi-instance token
-                    tck = strstr(tck + DELIMITER_SIZE, OBJ_DELIMITER);
-                    if(NULL == tck) {
-                        //Get NumberOfEntries of a multi-instance object
-                        length = first_tck - tmp->pattern;
-                        snprintf(tr181objBuff, sizeof(tr181objBuff), "%sNumberOfEntries", tmp->pattern);
-                        ret_val = getParameterValue(tr181objBuff, &tr181dataBuff);
-                        if(T2ERROR_SUCCESS == ret_val) {
-                            obj_count = atoi(tr181dataBuff);
-                            free(tr181dataBuff);
-                            tr181dataBuff = NULL ;
-                            //Collect all all instance value of a object
-                            if(obj_count > 0) {
-                                for( i = 1; i <= obj_count; i++ ) {
-                                    //Replace multi-instance token with an object instance number
-                                    snprintf(tr181objBuff, sizeof(tr181objBuff), "%s%d%s", tmp->pattern, i, (tmp->pattern + length + DELIMITER_SIZE));
-                                    ret_val = getParameterValue(tr181objBuff, &tr181dataBuff);
-                                    if(T2ERROR_SUCCESS == ret_val) {
-                                        appendData(tmp, tr181dataBuff);
-                                    }else {
-                                        T2Debug("Telemetry data source not found. Type = <message_bus>. Content string = %s\n", tr181objBuff);
-                                    }
-                                    free(tr181dataBuff);
-                                    tr181dataBuff = NULL;
-                                } //End of for loop
-                            }
-                        }else {
-                            T2Debug("Failed to get NumberOfEntries. Type = <message_bus>. Content string = %s\n", tr181objBuff);
-                        }
-                    }else {
-                        T2Debug("Skipping Telemetry object due to invalid format. Type = <message_bus>. Content string = %s\n", tmp->pattern);
-                    }
+                }else { //Multi-instance check, nested tokens are supported
+                    ret_val = processMultiInstanceObject(tmp);
                 } //End of Mult-instance check
             }
         }
@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <fcntl.h>           /* Definition of AT_* constants */
 #include <unistd.h>
@@ -44,6 +46,14 @@
 #define PIDOF_SIZE 50
 #define MEM_STRING_SIZE 20
 #define PROC_PATH_SIZE 50
+#define STAT_BUF_SIZE 2048
+#define THREAD_NAME_SIZE 17
+
+/* Per report sampling caps to keep the cost of optional process stats bounded */
+#define MAX_PROC_INSTANCES_SAMPLED 8
+#define MAX_THREADS_SAMPLED 32
+#define MAX_THREADS_REPORTED 5
+#define THREAD_SAMPLE_INTERVAL 1
 
 #include "vector.h"
 #include "dcautil.h"
@@ -56,21 +66,32 @@
  * @{
  */
 
-#define PREFIX_SIZE 5
+/* Field positions as documented in proc(5) for /proc/<pid>/stat */
+#define STAT_FIELD_STATE  3
+#define STAT_FIELD_UTIME  14
+#define STAT_FIELD_STIME  15
+#define STAT_FIELD_CUTIME 16
+#define STAT_FIELD_CSTIME 17
+#define STAT_FIELD_RSS    24
 
 typedef struct proc_info {
-    int utime; /**< User mode jiffies */
-    int stime; /**< Kernel mode jiffies */
-    int cutime; /**< User mode jiffies with childs */
-    int cstime; /**< Kernel mode jiffies with childs */
-    unsigned int rss; /**< Resident Set Size */
+    unsigned long utime; /**< User mode jiffies */
+    unsigned long stime; /**< Kernel mode jiffies */
+    unsigned long cutime; /**< User mode jiffies with childs */
+    unsigned long cstime; /**< Kernel mode jiffies with childs */
+    unsigned long rss; /**< Resident Set Size */
+    char comm[THREAD_NAME_SIZE]; /**< Executable or thread name */
 } procinfo;
 
 typedef struct _procMemCpuInfo {
     pid_t *pid;
+    int *statFd; /**< /proc/<pid>/stat descriptors kept open for the duration of one sample */
     char processName[BUF_LEN];
     char cpuUse[BUF_LEN];
     char memUse[BUF_LEN];
+    char pssUse[BUF_LEN];
+    char ussUse[BUF_LEN];
+    char *threadCpuUse;
     int total_instance;
 } procMemCpuInfo;
 
@@ -78,35 +99,90 @@ typedef struct _procMemCpuInfo {
 int getProcInfo(procMemCpuInfo *pInfo);
 int getMemInfo(procMemCpuInfo *pmInfo);
 int getCPUInfo(procMemCpuInfo *pInfo);
+int getSmapsInfo(procMemCpuInfo *pmInfo);
+int getThreadCPUInfo(procMemCpuInfo *pmInfo);
 
 /**
  * @addtogroup DCA_APIS
  * @{
  */
 
+static void addProcUsageResult(Vector* grepResultList, const char* prefix, const char* processName, const char* value) {
+    size_t keyLen = 0;
+    char *key = NULL;
+    GrepResult* result = NULL;
+
+    if(NULL == value || '\0' == value[0])
+        return;
+
+    keyLen = strlen(prefix) + strlen(processName) + 1;
+    key = (char *) malloc(keyLen);
+    if(NULL == key)
+        return;
+
+    snprintf(key, keyLen, "%s%s", prefix, processName);
+    T2Debug("Add to search result %s , value = %s \n", key, value);
+    result = (GrepResult*) malloc(sizeof(GrepResult));
+    if(result) {
+        result->markerName = key;
+        result->markerValue = strdup(value);
+        Vector_PushBack(grepResultList, result);
+    } else {
+        free(key);
+    }
+}
+
+static void openProcStatFds(procMemCpuInfo *pmInfo) {
+    char szFileName[PROC_PATH_SIZE];
+    int index = 0;
+
+    pmInfo->statFd = (int *) malloc(pmInfo->total_instance * sizeof(int));
+    if(NULL == pmInfo->statFd)
+        return;
+
+    for( index = 0; index < pmInfo->total_instance; index++ ) {
+        snprintf(szFileName, sizeof(szFileName), "/proc/%u/stat", (unsigned) pmInfo->pid[index]);
+        pmInfo->statFd[index] = open(szFileName, O_RDONLY);
+    }
+}
+
+static void closeProcStatFds(procMemCpuInfo *pmInfo) {
+    int index = 0;
+
+    if(NULL == pmInfo->statFd)
+        return;
+
+    for( index = 0; index < pmInfo->total_instance; index++ ) {
+        if(pmInfo->statFd[index] >= 0)
+            close(pmInfo->statFd[index]);
+    }
+    free(pmInfo->statFd);
+    pmInfo->statFd = NULL;
+}
+
 /**
  * @brief To get process usage.
  *
  * @param[in] processName   Process name.
+ * @param[in] grepResultList  List to which cpu_, mem_ and optional pss_, uss_, cpu_thr_ results are added.
+ * @param[in] options       Bitmask of PROC_USAGE_* flags selecting the optional stats.
  *
  * @return  Returns status of operation.
  * @retval  0 on sucess, appropiate errorcode otherwise.
  */
-int getProcUsage(char *processName, Vector* grepResultList) {
+int getProcUsage(char *processName, Vector* grepResultList, int options) {
     T2Debug("%s ++in \n", __FUNCTION__);
     if(processName != NULL) {
     	T2Debug("Process name is %s \n", processName);
         procMemCpuInfo pInfo;
         char pidofCommand[PIDOF_SIZE];
         FILE *cmdPid;
-        char *mem_key = NULL, *cpu_key = NULL;
         int ret = 0;
         int index = 0;
         pid_t *pid = NULL;
         pid_t *temp = NULL;
-        int pname_prefix_len = strlen(processName) + PREFIX_SIZE + 1;
         memset(&pInfo, '\0', sizeof(procMemCpuInfo));
-        memcpy(pInfo.processName, processName, strlen(processName) + 1);
+        strncpy(pInfo.processName, processName, sizeof(pInfo.processName) - 1);
 
         snprintf(pidofCommand, sizeof(pidofCommand), "pidof %s", processName);
         T2Debug("Command for collecting process info : \n %s \n", pidofCommand);
@@ -147,49 +223,137 @@ int getProcUsage(char *processName, Vector* grepResultList) {
         pInfo.pid = pid;
         pclose(cmdPid);
 
-        if(0 != getProcInfo(&pInfo)) {
-            mem_key = malloc(pname_prefix_len);
-            cpu_key = malloc(pname_prefix_len);
-            if(NULL != mem_key && NULL != cpu_key) {
-                snprintf(cpu_key, pname_prefix_len, "cpu_%s", processName);
-                snprintf(mem_key, pname_prefix_len, "mem_%s", processName);
- 
-                T2Debug("Add to search result %s , value = %s , %s \n",cpu_key,  pInfo.cpuUse, pInfo.memUse);
-                GrepResult* cpuInfo = (GrepResult*) malloc(sizeof(GrepResult));
-                if(cpuInfo) {
-                    cpuInfo->markerName = strdup(cpu_key);
-                    cpuInfo->markerValue = strdup(pInfo.cpuUse);
-                    Vector_PushBack(grepResultList, cpuInfo);
-                }
-
-                GrepResult* memInfo = (GrepResult*) malloc(sizeof(GrepResult));
-                if(memInfo) {
-                    memInfo->markerName = strdup(mem_key);
-                    memInfo->markerValue = strdup(pInfo.memUse);
-                    Vector_PushBack(grepResultList, memInfo);
-                }
-
-                ret = 1;
-            }
+        openProcStatFds(&pInfo);
 
-            if(mem_key)
-                free(mem_key);
-
-            if(cpu_key)
-                free(cpu_key);
+        if(0 != getProcInfo(&pInfo)) {
+            addProcUsageResult(grepResultList, "cpu_", processName, pInfo.cpuUse);
+            addProcUsageResult(grepResultList, "mem_", processName, pInfo.memUse);
 
-            if(pid)
-                free(pid);
+            if((options & PROC_USAGE_PSS) && 0 != getSmapsInfo(&pInfo)) {
+                addProcUsageResult(grepResultList, "pss_", processName, pInfo.pssUse);
+                addProcUsageResult(grepResultList, "uss_", processName, pInfo.ussUse);
+            }
 
-            return ret;
+            if((options & PROC_USAGE_THREADS) && 0 != getThreadCPUInfo(&pInfo)) {
+                addProcUsageResult(grepResultList, "cpu_thr_", processName, pInfo.threadCpuUse);
+            }
+            ret = 1;
         }
+
+        closeProcStatFds(&pInfo);
+        if(pInfo.threadCpuUse)
+            free(pInfo.threadCpuUse);
         if(pid)
             free(pid);
+        T2Debug("%s --out \n", __FUNCTION__);
+        return ret;
     }
     T2Debug("%s --out \n", __FUNCTION__);
     return 0;
 }
 
+/**
+ * @brief To parse the fields of a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat line.
+ *
+ * The command name may contain spaces and parentheses, so fields are located from the
+ * last ')' and only the ones used by telemetry are converted.
+ *
+ * @param[in]  statStr  Contents of the stat file.
+ * @param[out] pinfo    Process info.
+ *
+ * @return  Returns status of operation.
+ * @retval  Return 1 on success, 0 if the line is malformed.
+ */
+static int parseProcStat(const char *statStr, procinfo *pinfo) {
+    const char *s = NULL, *t = NULL;
+    char *end = NULL;
+    size_t nameLen = 0;
+    int field = STAT_FIELD_STATE;
+    unsigned long value = 0;
+
+    s = strchr(statStr, '(');
+    t = strrchr(statStr, ')');
+    if(NULL == s || NULL == t || t < s)
+        return 0;
+
+    nameLen = t - s - 1;
+    if(nameLen >= sizeof(pinfo->comm))
+        nameLen = sizeof(pinfo->comm) - 1;
+    memcpy(pinfo->comm, s + 1, nameLen);
+    pinfo->comm[nameLen] = '\0';
+
+    s = t + 1;
+    while(field <= STAT_FIELD_RSS) {
+        while(*s == ' ')
+            s++;
+        if(*s == '\0' || *s == '\n')
+            return 0;
+
+        if(field == STAT_FIELD_STATE) {
+            /* Single character state field */
+            while(*s != ' ' && *s != '\0')
+                s++;
+            field++;
+            continue;
+        }
+
+        /* Numeric fields may be negative (priority, nice); only the unsigned ones are kept */
+        if(*s == '-')
+            s++;
+        value = strtoul(s, &end, 10);
+        if(end == s)
+            return 0;
+        s = end;
+
+        switch(field) {
+            case STAT_FIELD_UTIME:
+                pinfo->utime = value;
+                break;
+            case STAT_FIELD_STIME:
+                pinfo->stime = value;
+                break;
+            case STAT_FIELD_CUTIME:
+                pinfo->cutime = value;
+                break;
+            case STAT_FIELD_CSTIME:
+                pinfo->cstime = value;
+                break;
+            case STAT_FIELD_RSS:
+                pinfo->rss = value;
+                break;
+            default:
+                break;
+        }
+        field++;
+    }
+    return 1;
+}
+
+/**
+ * @brief To read a stat file through an already open descriptor.
+ *
+ * pread() at offset 0 re-samples the file without reopening it.
+ *
+ * @param[in] fd       Descriptor of /proc/<pid>/stat.
+ * @param[in] pinfo    Process info.
+ *
+ * @return  Returns status of operation.
+ * @retval  Return 1 on success, appropiate errorcode otherwise.
+ */
+static int getProcStatFromFd(int fd, procinfo * pinfo) {
+    char szStatStr[STAT_BUF_SIZE];
+    ssize_t j = 0;
+
+    if(fd < 0 || NULL == pinfo)
+        return 0;
+
+    if((j = pread(fd, szStatStr, sizeof(szStatStr) - 1, 0)) <= 0)
+        return 0;
+    szStatStr[j] = '\0';
+
+    return parseProcStat(szStatStr, pinfo);
+}
+
 /**
  * @brief To get status of a process from its process ID. 
  *
@@ -203,56 +367,38 @@ int getProcUsage(char *processName, Vector* grepResultList) {
  */
 int getProcPidStat(int pid, procinfo * pinfo) {
     T2Debug("%s ++in \n", __FUNCTION__);
-    char szFileName[CMD_LEN], szStatStr[2048], *s, *t;
-    int ppid, fd, pgrp, session, tty, tpgid, counter, priority, starttime, signal, blocked, sigignore, sigcatch, j;
-    char exName[CMD_LEN], state;
-    //unsigned euid, egid;
-    unsigned int flags, minflt, cminflt, majflt, cmajflt, timeout, itrealvalue, vsize, rlim, startcode, endcode, startstack, kstkesp, kstkeip, wchan;
+    char szFileName[PROC_PATH_SIZE];
+    int fd, ret = 0;
 
     if(NULL == pinfo) {
         T2Debug("Invalid input(pinfo=NULL) to get process info");
         return 0;
     }
 
-    sprintf(szFileName, "/proc/%u/stat", (unsigned) pid);
+    snprintf(szFileName, sizeof(szFileName), "/proc/%u/stat", (unsigned) pid);
     if((fd = open(szFileName, O_RDONLY)) == -1)
     {
         T2Debug("Failed to open file in get process info");
         return 0;
     }
 
-    /* if(-1 != fstat(fd, &st)) {
-        euid = st.st_uid;
-        egid = st.st_gid;
-    }else {
-        euid = egid = -1;
-    } */
-
-
-    if((j = read(fd, szStatStr, 2047)) == -1) {
-        close(fd);
-        return 0;
-    }
-    szStatStr[j++] = '\0';
-    /** pid **/
-    s = strchr(szStatStr, '(') + 1;
-    t = strchr(szStatStr, ')');
-    strncpy(exName, s, t - s);
-    exName[t - s] = '\0';
-
-    sscanf(t + 2, "%c %d %d %d %d %d %u %u %u %u %u %d %d %d %d %d %d %u %u %d %u %u %u %u %u %u %u %u %d %d %d %d %u",
-    /*       1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 24 25 26 27 28 29 30 31 32 33*/
-    &(state), &(ppid), &(pgrp), &(session), &(tty), &(tpgid), &(flags), &(minflt), &(cminflt), &(majflt), &(cmajflt), &(pinfo->utime),
-            &(pinfo->stime), &(pinfo->cutime), &(pinfo->cstime), &(counter), &(priority), &(timeout), &(itrealvalue), &(starttime), &(vsize),
-            &(pinfo->rss), &(rlim), &(startcode), &(endcode), &(startstack), &(kstkesp), &(kstkeip), &(signal), &(blocked), &(sigignore), &(sigcatch),
-            &(wchan));
-
+    ret = getProcStatFromFd(fd, pinfo);
     close(fd);
 
     T2Debug("%s --out \n", __FUNCTION__);
 
-    return 1;
+    return ret;
 }
+
+/**
+ * @brief To sample a process instance, reusing the descriptor opened for this report if any.
+ */
+static int getProcInstanceStat(procMemCpuInfo *pmInfo, int index, procinfo *pinfo) {
+    if(pmInfo->statFd && pmInfo->statFd[index] >= 0)
+        return getProcStatFromFd(pmInfo->statFd[index], pinfo);
+    return getProcPidStat(pmInfo->pid[index], pinfo);
+}
+
 /**
  * @brief To get CPU and mem info.
  *
@@ -272,6 +418,13 @@ int getProcInfo(procMemCpuInfo *pmInfo) {
     return 1;
 }
 
+static void formatMemValue(unsigned long memInKb, char *buf, size_t len) {
+    if(memInKb >= 1024)
+        snprintf(buf, len, "%lum", memInKb / 1024);
+    else
+        snprintf(buf, len, "%luk", memInKb);
+}
+
 /**
  * @brief To get the reserve memory of a given process.
  *
@@ -282,29 +435,200 @@ int getProcInfo(procMemCpuInfo *pmInfo) {
  */
 int getMemInfo(procMemCpuInfo *pmInfo) {
     T2Debug("%s ++in \n", __FUNCTION__);
-    static char retMem[MEM_STRING_SIZE];
-    int intStr = 0, intValue = 0;
-    double residentMemory = 0.0;
     procinfo pinfo;
     long pageSizeInKb = sysconf(_SC_PAGE_SIZE) / 1024; /* x86-64 is configured to use 2MB pages */
-    unsigned int total_memory = 0;
+    unsigned long total_memory = 0;
     int index = 0;
 
     for( index = 0; index < (pmInfo->total_instance); index++ ) {
         memset(&pinfo, 0, sizeof(procinfo));
-        if(0 == getProcPidStat(pmInfo->pid[index], &pinfo))
+        if(0 == getProcInstanceStat(pmInfo, index, &pinfo))
             return 0;
         total_memory += pinfo.rss;
     }
 
-    residentMemory = total_memory * pageSizeInKb;
-    intStr = (int) residentMemory;
-    intValue = intStr;
-    if(intValue >= 1024)
-        intStr = intStr / 1024;
-    snprintf(retMem, sizeof(retMem), "%d%c", intStr, (intValue >= 1024) ? 'm' : 'k');
+    formatMemValue(total_memory * pageSizeInKb, pmInfo->memUse, sizeof(pmInfo->memUse));
+    T2Debug("%s --out \n", __FUNCTION__);
+    return 1;
+}
+
+/**
+ * @brief To get proportional and unique set size of a given process from smaps_rollup.
+ *
+ * USS is the sum of Private_Clean and Private_Dirty. Kernels without smaps_rollup
+ * are skipped instead of walking the full smaps file.
+ *
+ * @param[out] pmInfo  Memory  Info.
+ *
+ * @return  Returns status of operation.
+ * @retval  Return 1 on success, 0 if smaps_rollup is not available.
+ */
+int getSmapsInfo(procMemCpuInfo *pmInfo) {
+    T2Debug("%s ++in \n", __FUNCTION__);
+    char szFileName[PROC_PATH_SIZE];
+    char line[MAXLEN];
+    unsigned long pss = 0, uss = 0, value = 0;
+    int index = 0, found = 0;
+    FILE *fp = NULL;
+
+    for( index = 0; index < (pmInfo->total_instance) && index < MAX_PROC_INSTANCES_SAMPLED; index++ ) {
+        snprintf(szFileName, sizeof(szFileName), "/proc/%u/smaps_rollup", (unsigned) pmInfo->pid[index]);
+        if(NULL == (fp = fopen(szFileName, "r"))) {
+            T2Debug("Unable to open %s \n", szFileName);
+            continue;
+        }
+        while(fgets(line, sizeof(line), fp) != NULL) {
+            if(1 == sscanf(line, "Pss: %lu", &value)) {
+                pss += value;
+                found = 1;
+            }else if(1 == sscanf(line, "Private_Clean: %lu", &value) || 1 == sscanf(line, "Private_Dirty: %lu", &value)) {
+                uss += value;
+            }
+        }
+        fclose(fp);
+    }
+
+    if(!found) {
+        T2Debug("%s --out \n", __FUNCTION__);
+        return 0;
+    }
+
+    formatMemValue(pss, pmInfo->pssUse, sizeof(pmInfo->pssUse));
+    formatMemValue(uss, pmInfo->ussUse, sizeof(pmInfo->ussUse));
+    T2Debug("%s --out \n", __FUNCTION__);
+    return 1;
+}
+
+/**
+ * @brief To get total CPU time of the device.
+ *
+ * @param[out] totalTime   Total time of device.
+ *
+ * @return  Returns status of operation.
+ * @retval  Return 1 on success, appropiate errorcode otherwise.
+ */
+int getTotalCpuTimes(int * totalTime)
+{
+    FILE *fp;
+    long double a[10];
+    int total;
+
+    fp = fopen("/proc/stat","r");
+
+    if(!fp)
+    return 0;
+
+    fscanf(fp,"%*s %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf",
+            &a[0],&a[1],&a[2],&a[3],&a[4],&a[5],&a[6],&a[7],&a[8],&a[9]);
+    fclose(fp);
+    total = (a[0]+a[1]+a[2]+a[3]+a[4]+a[5]+a[6]+a[7]+a[8]+a[9]);
+    *totalTime = total;
+
+    return 1;
+}
+
+typedef struct _threadSample {
+    int fd;
+    unsigned long ticks;
+    float util;
+    char comm[THREAD_NAME_SIZE];
+} threadSample;
+
+/**
+ * @brief To get per thread CPU utilization of a given process.
+ *
+ * All threads of the sampled instances share a single sampling window and at most
+ * MAX_THREADS_SAMPLED stat files are opened. The busiest MAX_THREADS_REPORTED threads
+ * are reported as a comma separated list of name:percentage.
+ *
+ * @param[out] pmInfo  CPU Info.
+ *
+ * @return  Returns status of operation.
+ * @retval  Return 1 on success, appropiate errorcode otherwise.
+ */
+int getThreadCPUInfo(procMemCpuInfo *pmInfo) {
+    T2Debug("%s ++in \n", __FUNCTION__);
+    threadSample samples[MAX_THREADS_SAMPLED];
+    char szFileName[CMD_LEN];
+    char entry[BUF_LEN + THREAD_NAME_SIZE];
+    struct dirent *dent = NULL;
+    DIR *dir = NULL;
+    procinfo pinfo;
+    int count = 0, index = 0, i = 0, reported = 0, best = 0;
+    int t[2];
+    int no_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t len = 0;
+
+    for( index = 0; index < (pmInfo->total_instance) && index < MAX_PROC_INSTANCES_SAMPLED && count < MAX_THREADS_SAMPLED; index++ ) {
+        snprintf(szFileName, sizeof(szFileName), "/proc/%u/task", (unsigned) pmInfo->pid[index]);
+        if(NULL == (dir = opendir(szFileName)))
+            continue;
+        while(count < MAX_THREADS_SAMPLED && NULL != (dent = readdir(dir))) {
+            if(!isdigit((unsigned char) dent->d_name[0]))
+                continue;
+            snprintf(szFileName, sizeof(szFileName), "/proc/%u/task/%s/stat", (unsigned) pmInfo->pid[index], dent->d_name);
+            memset(&samples[count], 0, sizeof(threadSample));
+            if((samples[count].fd = open(szFileName, O_RDONLY)) == -1)
+                continue;
+            memset(&pinfo, 0, sizeof(procinfo));
+            if(0 == getProcStatFromFd(samples[count].fd, &pinfo)) {
+                close(samples[count].fd);
+                continue;
+            }
+            samples[count].ticks = pinfo.utime + pinfo.stime;
+            strncpy(samples[count].comm, pinfo.comm, sizeof(samples[count].comm) - 1);
+            count++;
+        }
+        closedir(dir);
+    }
+
+    if(count == 0 || 0 == getTotalCpuTimes(&t[0])) {
+        for( i = 0; i < count; i++ )
+            close(samples[i].fd);
+        T2Debug("%s --out \n", __FUNCTION__);
+        return 0;
+    }
+
+    sleep(THREAD_SAMPLE_INTERVAL);
+
+    if(0 == getTotalCpuTimes(&t[1]) || t[1] <= t[0]) {
+        for( i = 0; i < count; i++ )
+            close(samples[i].fd);
+        T2Debug("%s --out \n", __FUNCTION__);
+        return 0;
+    }
+
+    for( i = 0; i < count; i++ ) {
+        memset(&pinfo, 0, sizeof(procinfo));
+        /* Threads that exited during the window are reported as idle */
+        if(0 != getProcStatFromFd(samples[i].fd, &pinfo) && (pinfo.utime + pinfo.stime) >= samples[i].ticks)
+            samples[i].util = ((float) (pinfo.utime + pinfo.stime - samples[i].ticks) / (t[1] - t[0])) * 100 * no_cpu;
+        close(samples[i].fd);
+    }
+
+    pmInfo->threadCpuUse = (char *) malloc(MAX_THREADS_REPORTED * sizeof(entry));
+    if(NULL == pmInfo->threadCpuUse) {
+        T2Debug("%s --out \n", __FUNCTION__);
+        return 0;
+    }
+    pmInfo->threadCpuUse[0] = '\0';
+
+    for( reported = 0; reported < MAX_THREADS_REPORTED && reported < count; reported++ ) {
+        best = reported;
+        for( i = reported + 1; i < count; i++ ) {
+            if(samples[i].util > samples[best].util)
+                best = i;
+        }
+        if(best != reported) {
+            threadSample swap = samples[reported];
+            samples[reported] = samples[best];
+            samples[best] = swap;
+        }
+        snprintf(entry, sizeof(entry), "%s%s:%.1f", (reported == 0) ? "" : ",", samples[reported].comm, samples[reported].util);
+        strncat(pmInfo->threadCpuUse + len, entry, MAX_THREADS_REPORTED * sizeof(entry) - len - 1);
+        len += strlen(pmInfo->threadCpuUse + len);
+    }
 
-    strncpy(pmInfo->memUse, retMem, strlen(retMem) + 1);
     T2Debug("%s --out \n", __FUNCTION__);
     return 1;
 }
@@ -391,107 +715,61 @@ int getCPUInfo(procMemCpuInfo *pInfo) {
 #else //ENABLE_XCAM_SUPPORT & ENABLE_RDKB_SUPPORT
 
 /**
- * @brief To get total CPU time of the device.
- *
- * @param[out] totalTime   Total time of device.
+ * @brief To get CPU utilization of all instances of a process.
  *
- * @return  Returns status of operation.
- * @retval  Return 1 on success, appropiate errorcode otherwise.
- */
-int getTotalCpuTimes(int * totalTime)
-{
-    FILE *fp;
-    long double a[10];
-    int total;
-
-    fp = fopen("/proc/stat","r");
-
-    if(!fp)
-    return 0;
-
-    fscanf(fp,"%*s %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf %Lf",
-            &a[0],&a[1],&a[2],&a[3],&a[4],&a[5],&a[6],&a[7],&a[8],&a[9]);
-    fclose(fp);
-    total = (a[0]+a[1]+a[2]+a[3]+a[4]+a[5]+a[6]+a[7]+a[8]+a[9]);
-    *totalTime = total;
-
-    return 1;
-}
-
-/**
- * @brief To get process CPU utilization of the process.
+ * Every instance is sampled within the same window so the cost is a single sleep
+ * per process, independent of the number of instances.
  *
- * @param[in]  pid            Process id.
- * @param[out] procCpuUtil    CPU utilization of process.
+ * @param[out] pmInfo  CPU info.
  *
  * @return  Returns status of operation.
- * @retval  Return 1 on success, appropiate errorcode otherwise.
+ * @retval  Return 1 on success.
  */
-int getProcessCpuUtilization(int pid, int *procCpuUtil)
-{
-    procinfo pinfo1;
+int getCPUInfo(procMemCpuInfo *pmInfo) {
+    procinfo pinfo;
+    unsigned long *ticks = NULL;
+    int *valid = NULL;
     int no_cpu;
-    float total_time_process[2],time[2];
     int t[2];
-    float sub1;
-    float time1;
-    float util=0;
-
-    no_cpu=sysconf(_SC_NPROCESSORS_ONLN);
-    if( 0 == getProcPidStat(pid, &pinfo1))
-    return 0;
-
-    total_time_process[0]= pinfo1.utime +
-    pinfo1.stime +
-    pinfo1.cutime +
-    pinfo1.cstime;
-    //start=pinfo1.starttime;
-
-    if( !getTotalCpuTimes(&t[0]) )
-    return 0;
-
-    time[0] = t[0];
-    sleep(2);
-
-    if( 0 == getProcPidStat(pid,&pinfo1))
-    return 0;
-
-    total_time_process[1]= pinfo1.utime +
-    pinfo1.stime +
-    pinfo1.cutime +
-    pinfo1.cstime;
-
-    if( 0 == getTotalCpuTimes(&t[1]) )
-    return 0;
-
-    time[1] = t[1];
-    sub1 = total_time_process[1]-total_time_process[0];
-    time1= time[1] - time[0];
-    util = (sub1/time1)*100*no_cpu;
-
-    if(procCpuUtil)
-    *procCpuUtil = util;
-    else
-    return 0;
-
-    return 1;
-}
-
-int getCPUInfo(procMemCpuInfo *pmInfo) {
-    int cpu = 0;
-    int total_cpu = 0;
+    float total_cpu = 0;
     int index = 0;
 
+    no_cpu = sysconf(_SC_NPROCESSORS_ONLN);
+    ticks = (unsigned long *) calloc(pmInfo->total_instance, sizeof(unsigned long));
+    valid = (int *) calloc(pmInfo->total_instance, sizeof(int));
+    if(NULL == ticks || NULL == valid) {
+        free(ticks);
+        free(valid);
+        return 0;
+    }
+
     for(index=0;index<(pmInfo->total_instance);index++)
     {
-        if (0 == getProcessCpuUtilization(pmInfo->pid[index], &cpu))
-        {
+        memset(&pinfo, 0, sizeof(procinfo));
+        if(0 == getProcInstanceStat(pmInfo, index, &pinfo))
             continue;
+        ticks[index] = pinfo.utime + pinfo.stime + pinfo.cutime + pinfo.cstime;
+        valid[index] = 1;
+    }
+
+    if(getTotalCpuTimes(&t[0]))
+    {
+        sleep(2);
+        if(getTotalCpuTimes(&t[1]) && t[1] > t[0])
+        {
+            for(index=0;index<(pmInfo->total_instance);index++)
+            {
+                memset(&pinfo, 0, sizeof(procinfo));
+                if(!valid[index] || 0 == getProcInstanceStat(pmInfo, index, &pinfo))
+                    continue;
+                total_cpu += ((float)(pinfo.utime + pinfo.stime + pinfo.cutime + pinfo.cstime - ticks[index]) / (t[1] - t[0])) * 100 * no_cpu;
+            }
         }
-        total_cpu+=cpu;
     }
 
-    snprintf(pmInfo->cpuUse, sizeof(pmInfo->cpuUse), "%.1f", (float)total_cpu);
+    free(ticks);
+    free(valid);
+    snprintf(pmInfo->cpuUse, sizeof(pmInfo->cpuUse), "%.1f", total_cpu);
     return 1;
 }
 
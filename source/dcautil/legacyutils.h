@@ -93,7 +93,12 @@ void addToSearchResult(char *key, char *value);
 
 void clearSearchResultJson(cJSON **root);
 
-int getProcUsage(char *processName, Vector* grepResultList );
+/* Optional stats for getProcUsage, selected from the top_log.txt marker header */
+#define PROC_USAGE_DEFAULT  0x0
+#define PROC_USAGE_PSS      0x1   /* pss_<name> and uss_<name> from /proc/<pid>/smaps_rollup */
+#define PROC_USAGE_THREADS  0x2   /* cpu_thr_<name> busiest threads from /proc/<pid>/task */
+
+int getProcUsage(char *processName, Vector* grepResultList, int options);
 
 bool isPropsInitialized();
 
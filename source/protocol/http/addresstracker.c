@@ -0,0 +1,475 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "addresstracker.h"
+#include "t2log_wrapper.h"
+#include "vector.h"
+
+#define NETLINK_BUFFER_SIZE 16384
+
+/* Milliseconds before a failed sync with the kernel's address tables is tried again */
+#ifndef ADDRESS_TRACKER_RESYNC_DELAY
+#define ADDRESS_TRACKER_RESYNC_DELAY 5000
+#endif
+
+typedef struct _TrackedLink
+{
+    int index;
+    char name[IF_NAMESIZE];
+}TrackedLink;
+
+typedef struct _TrackedAddress
+{
+    int index;
+    struct in6_addr address;
+}TrackedAddress;
+
+// Links by index and the global IPv6 addresses on them, under trackerMutex
+static pthread_mutex_t trackerMutex = PTHREAD_MUTEX_INITIALIZER;
+static Vector *trackedLinks = NULL;
+static Vector *trackedAddresses = NULL;
+static bool trackerStarted = false;
+static bool trackerSynced = false;
+static pthread_t trackerThread;
+static int netlinkSocket = -1;
+static int trackerWakeup[2] = { -1, -1 };
+static unsigned int dumpSequence = 0;
+
+static bool isGlobalIPv6Address(const struct in6_addr *address)
+{
+    return !IN6_IS_ADDR_LINKLOCAL(address) && !IN6_IS_ADDR_LOOPBACK(address) && !IN6_IS_ADDR_UNSPECIFIED(address);
+}
+
+/**
+ * Direct scan of the interface, used until the tracker is in sync or when it could
+ * not be started.
+ */
+static ADDRESS_TYPE scanInterfaceAddressType(const char *interfaceName)
+{
+    struct ifaddrs *ifap, *ifa;
+    ADDRESS_TYPE addressType = ADDR_IPV4;
+
+    if(getifaddrs(&ifap) == -1) {
+        return ADDR_UNKNOWN;
+    }
+
+    for( ifa = ifap; ifa; ifa = ifa->ifa_next ) {
+        struct sockaddr_in6 *ipv6Addr = NULL;
+        if(ifa->ifa_name == NULL || ifa->ifa_addr == NULL || strcmp(ifa->ifa_name, interfaceName))
+            continue;
+        if(ifa->ifa_addr->sa_family != AF_INET6)
+            continue;
+
+        ipv6Addr = (struct sockaddr_in6 *) ifa->ifa_addr;
+        if(ipv6Addr->sin6_scope_id == 0 && isGlobalIPv6Address(&ipv6Addr->sin6_addr)) {
+            addressType = ADDR_IPV6;
+            break;
+        }
+    }
+
+    freeifaddrs(ifap);
+    return addressType;
+}
+
+// The functions below are called with trackerMutex held
+static TrackedLink* findTrackedLink(int index)
+{
+    size_t linkIndex;
+
+    for(linkIndex = 0; linkIndex < Vector_Size(trackedLinks); linkIndex++)
+    {
+        TrackedLink *link = (TrackedLink *) Vector_At(trackedLinks, linkIndex);
+        if(link->index == index)
+            return link;
+    }
+    return NULL;
+}
+
+static TrackedAddress* findTrackedAddress(int index, const struct in6_addr *address)
+{
+    size_t addressIndex;
+
+    for(addressIndex = 0; addressIndex < Vector_Size(trackedAddresses); addressIndex++)
+    {
+        TrackedAddress *tracked = (TrackedAddress *) Vector_At(trackedAddresses, addressIndex);
+        if(tracked->index == index && memcmp(&tracked->address, address, sizeof(struct in6_addr)) == 0)
+            return tracked;
+    }
+    return NULL;
+}
+
+static void removeLinkAddresses(int index)
+{
+    size_t addressIndex = 0;
+
+    while(addressIndex < Vector_Size(trackedAddresses))
+    {
+        TrackedAddress *tracked = (TrackedAddress *) Vector_At(trackedAddresses, addressIndex);
+        if(tracked->index == index)
+            Vector_RemoveItem(trackedAddresses, tracked, free);
+        else
+            addressIndex++;
+    }
+}
+
+static void clearTrackedState()
+{
+    while(Vector_Size(trackedLinks) > 0)
+        Vector_RemoveItem(trackedLinks, Vector_At(trackedLinks, 0), free);
+    while(Vector_Size(trackedAddresses) > 0)
+        Vector_RemoveItem(trackedAddresses, Vector_At(trackedAddresses, 0), free);
+}
+
+static void handleLinkMessage(struct nlmsghdr *header)
+{
+    struct ifinfomsg *info = (struct ifinfomsg *) NLMSG_DATA(header);
+    int length = IFLA_PAYLOAD(header);
+    struct rtattr *attribute = NULL;
+    TrackedLink *link = findTrackedLink(info->ifi_index);
+
+    if(header->nlmsg_type == RTM_DELLINK)
+    {
+        if(link)
+            Vector_RemoveItem(trackedLinks, link, free);
+        removeLinkAddresses(info->ifi_index);
+        return;
+    }
+    for(attribute = IFLA_RTA(info); RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length))
+    {
+        if(attribute->rta_type != IFLA_IFNAME)
+            continue;
+        if(link == NULL && (link = (TrackedLink *) calloc(1, sizeof(TrackedLink))) != NULL)
+        {
+            link->index = info->ifi_index;
+            Vector_PushBack(trackedLinks, link);
+        }
+        // Also covers a renamed link
+        if(link)
+            snprintf(link->name, sizeof(link->name), "%s", (char *) RTA_DATA(attribute));
+        break;
+    }
+}
+
+static void handleAddressMessage(struct nlmsghdr *header)
+{
+    struct ifaddrmsg *info = (struct ifaddrmsg *) NLMSG_DATA(header);
+    int length = IFA_PAYLOAD(header);
+    struct rtattr *attribute = NULL;
+    struct in6_addr *address = NULL;
+    TrackedAddress *tracked = NULL;
+
+    if(info->ifa_family != AF_INET6)
+        return;
+    for(attribute = IFA_RTA(info); RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length))
+    {
+        // IFA_LOCAL is the own address of a point-to-point link, IFA_ADDRESS the peer's
+        if(attribute->rta_type == IFA_LOCAL || (attribute->rta_type == IFA_ADDRESS && address == NULL))
+            address = (struct in6_addr *) RTA_DATA(attribute);
+    }
+    if(address == NULL || info->ifa_scope != RT_SCOPE_UNIVERSE || !isGlobalIPv6Address(address))
+        return;
+
+    tracked = findTrackedAddress(info->ifa_index, address);
+    if(header->nlmsg_type == RTM_DELADDR)
+    {
+        if(tracked)
+            Vector_RemoveItem(trackedAddresses, tracked, free);
+    }
+    else if(tracked == NULL && (tracked = (TrackedAddress *) calloc(1, sizeof(TrackedAddress))) != NULL)
+    {
+        tracked->index = info->ifa_index;
+        memcpy(&tracked->address, address, sizeof(struct in6_addr));
+        Vector_PushBack(trackedAddresses, tracked);
+    }
+}
+
+/**
+ * Read one batch of netlink messages into the tracked state. Returns 1 once the
+ * reply to the dump with the given sequence is complete, -1 on errors including a
+ * receive buffer overrun that lost events, otherwise 0.
+ */
+static int readNetlinkMessages(unsigned int sequence)
+{
+    char buffer[NETLINK_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+    struct sockaddr_nl source;
+    struct iovec iov = { buffer, sizeof(buffer) };
+    struct msghdr msg;
+    struct nlmsghdr *header = NULL;
+    ssize_t received;
+    int length;
+    int result = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &source;
+    msg.msg_namelen = sizeof(source);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    do
+    {
+        received = recvmsg(netlinkSocket, &msg, 0);
+    } while(received < 0 && errno == EINTR);
+    if(received < 0)
+    {
+        T2Warning("Netlink receive failed : %s\n", strerror(errno));
+        return -1;
+    }
+    // Only the kernel may update the state
+    if(source.nl_pid != 0)
+        return 0;
+
+    length = (int) received;
+    pthread_mutex_lock(&trackerMutex);
+    for(header = (struct nlmsghdr *) buffer; NLMSG_OK(header, length); header = NLMSG_NEXT(header, length))
+    {
+        if(header->nlmsg_type == NLMSG_DONE)
+        {
+            if(sequence != 0 && header->nlmsg_seq == sequence)
+                result = 1;
+        }
+        else if(header->nlmsg_type == NLMSG_ERROR)
+        {
+            if(sequence != 0 && header->nlmsg_seq == sequence)
+                result = -1;
+        }
+        else if(header->nlmsg_type == RTM_NEWLINK || header->nlmsg_type == RTM_DELLINK)
+        {
+            handleLinkMessage(header);
+        }
+        else if(header->nlmsg_type == RTM_NEWADDR || header->nlmsg_type == RTM_DELADDR)
+        {
+            handleAddressMessage(header);
+        }
+    }
+    pthread_mutex_unlock(&trackerMutex);
+    return result;
+}
+
+static bool dumpNetlinkTable(int type, unsigned char family)
+{
+    struct
+    {
+        struct nlmsghdr header;
+        struct rtgenmsg message;
+    } request;
+    struct sockaddr_nl kernel;
+    int result = 0;
+
+    memset(&request, 0, sizeof(request));
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = ++dumpSequence;
+    request.message.rtgen_family = family;
+    if(sendto(netlinkSocket, &request, request.header.nlmsg_len, 0, (struct sockaddr *) &kernel, sizeof(kernel)) < 0)
+    {
+        T2Warning("Netlink dump request failed : %s\n", strerror(errno));
+        return false;
+    }
+    // Events that arrive in between are applied as they come
+    while((result = readNetlinkMessages(request.header.nlmsg_seq)) == 0);
+    return result == 1;
+}
+
+/**
+ * Rebuild the state from a dump of links and IPv6 addresses, after the start and
+ * whenever events were lost.
+ */
+static bool syncAddressTracker()
+{
+    pthread_mutex_lock(&trackerMutex);
+    trackerSynced = false;
+    clearTrackedState();
+    pthread_mutex_unlock(&trackerMutex);
+
+    if(!dumpNetlinkTable(RTM_GETLINK, AF_UNSPEC) || !dumpNetlinkTable(RTM_GETADDR, AF_INET6))
+        return false;
+
+    pthread_mutex_lock(&trackerMutex);
+    trackerSynced = true;
+    pthread_mutex_unlock(&trackerMutex);
+    T2Info("Interface address tracker in sync\n");
+    return true;
+}
+
+static void* trackerMain(void *data)
+{
+    struct pollfd fds[2];
+    bool synced = false;
+
+    (void) data;
+    T2Debug("%s ++in\n", __FUNCTION__);
+    fds[0].fd = netlinkSocket;
+    fds[0].events = POLLIN;
+    fds[1].fd = trackerWakeup[0];
+    fds[1].events = POLLIN;
+    while(true)
+    {
+        if(!synced)
+            synced = syncAddressTracker();
+        if(poll(fds, 2, synced ? -1 : ADDRESS_TRACKER_RESYNC_DELAY) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            T2Error("Address tracker poll failed : %s\n", strerror(errno));
+            break;
+        }
+        if(fds[1].revents)
+            break;
+        if((fds[0].revents & POLLIN) && readNetlinkMessages(0) < 0)
+        {
+            T2Warning("Address events lost, resyncing\n");
+            synced = false;
+        }
+    }
+    pthread_mutex_lock(&trackerMutex);
+    trackerSynced = false;
+    pthread_mutex_unlock(&trackerMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return NULL;
+}
+
+// Called with trackerMutex held
+static void startAddressTracker()
+{
+    struct sockaddr_nl local;
+
+    trackerStarted = true;
+    netlinkSocket = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if(netlinkSocket < 0)
+    {
+        T2Error("Unable to open netlink socket : %s\n", strerror(errno));
+        return;
+    }
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_LINK | RTMGRP_IPV6_IFADDR;
+    if(bind(netlinkSocket, (struct sockaddr *) &local, sizeof(local)) < 0 || pipe(trackerWakeup) != 0)
+    {
+        T2Error("Unable to listen for address changes : %s\n", strerror(errno));
+        close(netlinkSocket);
+        netlinkSocket = -1;
+        return;
+    }
+    Vector_Create(&trackedLinks);
+    Vector_Create(&trackedAddresses);
+    if(pthread_create(&trackerThread, NULL, trackerMain, NULL) != 0)
+    {
+        T2Error("Unable to start address tracker thread\n");
+        Vector_Destroy(trackedLinks, free);
+        Vector_Destroy(trackedAddresses, free);
+        trackedLinks = NULL;
+        trackedAddresses = NULL;
+        close(trackerWakeup[0]);
+        close(trackerWakeup[1]);
+        trackerWakeup[0] = trackerWakeup[1] = -1;
+        close(netlinkSocket);
+        netlinkSocket = -1;
+    }
+}
+
+ADDRESS_TYPE getInterfaceAddressType(const char *interfaceName)
+{
+    ADDRESS_TYPE addressType = ADDR_IPV4;
+    TrackedLink *link = NULL;
+    size_t index;
+
+    if(interfaceName == NULL)
+        return ADDR_UNKNOWN;
+
+    pthread_mutex_lock(&trackerMutex);
+    if(!trackerStarted)
+        startAddressTracker();
+    if(!trackerSynced)
+    {
+        pthread_mutex_unlock(&trackerMutex);
+        return scanInterfaceAddressType(interfaceName);
+    }
+    for(index = 0; index < Vector_Size(trackedLinks); index++)
+    {
+        TrackedLink *tempLink = (TrackedLink *) Vector_At(trackedLinks, index);
+        if(strcmp(tempLink->name, interfaceName) == 0)
+        {
+            link = tempLink;
+            break;
+        }
+    }
+    for(index = 0; link && index < Vector_Size(trackedAddresses); index++)
+    {
+        if(((TrackedAddress *) Vector_At(trackedAddresses, index))->index == link->index)
+        {
+            addressType = ADDR_IPV6;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&trackerMutex);
+    return addressType;
+}
+
+void uninitAddressTracker()
+{
+    char wakeup = 0;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&trackerMutex);
+    if(netlinkSocket < 0)
+    {
+        trackerStarted = false;
+        pthread_mutex_unlock(&trackerMutex);
+        T2Debug("%s --out\n", __FUNCTION__);
+        return;
+    }
+    pthread_mutex_unlock(&trackerMutex);
+
+    if(write(trackerWakeup[1], &wakeup, 1) != 1)
+        T2Warning("Unable to wake address tracker\n");
+    pthread_join(trackerThread, NULL);
+
+    pthread_mutex_lock(&trackerMutex);
+    close(trackerWakeup[0]);
+    close(trackerWakeup[1]);
+    trackerWakeup[0] = trackerWakeup[1] = -1;
+    close(netlinkSocket);
+    netlinkSocket = -1;
+    Vector_Destroy(trackedLinks, free);
+    Vector_Destroy(trackedAddresses, free);
+    trackedLinks = NULL;
+    trackedAddresses = NULL;
+    trackerStarted = false;
+    pthread_mutex_unlock(&trackerMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+}
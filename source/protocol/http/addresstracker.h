@@ -0,0 +1,40 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef _ADDRESSTRACKER_H_
+#define _ADDRESSTRACKER_H_
+
+typedef enum _ADDRESS_TYPE
+{
+    ADDR_UNKNOWN,
+    ADDR_IPV4,
+    ADDR_IPV6
+}ADDRESS_TYPE;
+
+/**
+ * Address family uploads over an interface should use, IPv6 only when the interface
+ * has a global IPv6 address. Answered from state kept current by a netlink listener,
+ * interfaces are scanned directly until it is in sync.
+ */
+ADDRESS_TYPE getInterfaceAddressType(const char *interfaceName);
+
+void uninitAddressTracker();
+
+#endif /* _ADDRESSTRACKER_H_ */
@@ -24,82 +24,297 @@
 #include <net/if.h>
 #include <netdb.h>
 #include <string.h>
-#include <ifaddrs.h>
 #include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <curl/curl.h>
+#include <zlib.h>
 
 #include "curlinterface.h"
+#include "addresstracker.h"
 #include "t2log_wrapper.h"
 
-static pthread_once_t curlFileMutexOnce = PTHREAD_ONCE_INIT;
-static pthread_mutex_t curlFileMutex;
+/*
+ * Compression state shared by all report threads. The zlib stream is reset rather than
+ * reallocated between reports of the same format and level, and its output goes into
+ * one buffer that only grows.
+ */
+static pthread_mutex_t compressionMutex = PTHREAD_MUTEX_INITIALIZER;
+static z_stream compressionStream;
+static bool compressionStreamReady = false;
+static HTTPComp compressionStreamType = COMP_NONE;
+static int compressionStreamLevel = HTTP_COMPRESSION_LEVEL_DEFAULT;
+static unsigned char *compressionBuffer = NULL;
+static size_t compressionBufferSize = 0;
 
-typedef enum _ADDRESS_TYPE
+/*
+ * Idle easy handles kept per destination, so a report reuses a handle and its
+ * settings instead of creating one per upload. All handles attach to one share
+ * object, which keeps the DNS cache, TLS sessions and open connections across
+ * handles and destinations.
+ */
+typedef struct _CurlPoolEntry
 {
-    ADDR_UNKNOWN,
-    ADDR_IPV4,
-    ADDR_IPV6
-}ADDRESS_TYPE;
+    char *destination;
+    CURL *handle;
+    struct timespec lastUsed;
+}CurlPoolEntry;
 
-static void sendOverHTTPInit(){
-	pthread_mutex_init(&curlFileMutex, NULL);
+static pthread_mutex_t curlPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static Vector *curlHandlePool = NULL;
+static CURLSH *curlShare = NULL;
+static pthread_mutex_t curlShareLocks[CURL_LOCK_DATA_LAST];
+
+static void curlShareLock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr)
+{
+    (void) handle;
+    (void) access;
+    (void) userptr;
+    pthread_mutex_lock(&curlShareLocks[data]);
+}
+
+static void curlShareUnlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+    (void) handle;
+    (void) userptr;
+    pthread_mutex_unlock(&curlShareLocks[data]);
+}
+
+static CURLSH* getCurlShare()
+{
+    int i;
+    if(curlShare == NULL)
+    {
+        curlShare = curl_share_init();
+        if(curlShare == NULL)
+        {
+            T2Error("Unable to initialize Curl share, handles will not share caches\n");
+            return NULL;
+        }
+        for(i = 0; i < CURL_LOCK_DATA_LAST; i++)
+            pthread_mutex_init(&curlShareLocks[i], NULL);
+        curl_share_setopt(curlShare, CURLSHOPT_LOCKFUNC, curlShareLock);
+        curl_share_setopt(curlShare, CURLSHOPT_UNLOCKFUNC, curlShareUnlock);
+        curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        if(curl_share_setopt(curlShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) != CURLSHE_OK)
+            T2Info("Curl connection cache cannot be shared, connections are reused per handle only\n");
+    }
+    return curlShare;
 }
 
-#if defined(ENABLE_RDKB_SUPPORT)
 /**
- * Return address type assigned to interface as IPv6 only if
- * a global IPv6 IP is assigned .
- */
-static ADDRESS_TYPE getAddressType(const char *cif) {
-    struct ifaddrs *ifap, *ifa;
-    int ret = 0;
-    int family;
-    char host[NI_MAXHOST] = {'\0'};
-    ADDRESS_TYPE addressType = ADDR_IPV4;
-
-    getifaddrs(&ifap);
-    if(getifaddrs(&ifap) == -1) {
-        return ADDR_UNKNOWN;
-    }
-
-    for( ifa = ifap; ifa; ifa = ifa->ifa_next ) {
-        if(ifa->ifa_name == NULL || strcmp(ifa->ifa_name, cif))
-        continue;
-
-        family = ifa->ifa_addr->sa_family;
-        if(family != AF_INET6)
-        continue;
-
-        ret = getnameinfo(ifa->ifa_addr, sizeof(struct sockaddr_in6), host, NI_MAXHOST, NULL, 0, NI_NUMERICHOST);
-        if(ret == 0) {
-            struct sockaddr_in6 *ipv6Addr = (struct sockaddr_in6 *) ifa->ifa_addr ;
-            if(ipv6Addr->sin6_scope_id != 0 || strncmp(host, "::1", NI_MAXHOST) == 0) {
-                T2Debug("Address %s is link local or localhost . Cannot be considered as valid Ipv6 address .\n", host);
-                continue;
-            } else {
-                addressType = ADDR_IPV6;
-                break;
+ * Destination of a URL, its scheme and authority. Handles are pooled and reports
+ * spooled per destination.
+ */
+char* getHTTPDestination(const char *url)
+{
+    const char *authority = strstr(url, "://");
+    size_t length;
+
+    authority = authority ? authority + 3 : url;
+    length = strcspn(authority, "/?#");
+    return strndup(url, (authority - url) + length);
+}
+
+static void freeCurlPoolEntry(void *data)
+{
+    if(data != NULL)
+    {
+        CurlPoolEntry *entry = (CurlPoolEntry *) data;
+        curl_easy_cleanup(entry->handle);
+        free(entry->destination);
+        free(entry);
+    }
+}
+
+static bool isCurlPoolEntryExpired(const CurlPoolEntry *entry, const struct timespec *now)
+{
+    return (now->tv_sec - entry->lastUsed.tv_sec) >= CURL_HANDLE_IDLE_TIMEOUT;
+}
+
+/**
+ * Take an idle handle of the destination from the pool, or create one. Pooled
+ * handles are reset so no option of their previous report carries over. Idle
+ * handles past CURL_HANDLE_IDLE_TIMEOUT are dropped on the way.
+ */
+static CURL* acquireCurlHandle(const char *url)
+{
+    CURL *curl = NULL;
+    CurlPoolEntry *entry = NULL;
+    char *destination = NULL;
+    struct timespec now;
+    size_t index;
+
+    destination = getHTTPDestination(url);
+    if(destination == NULL)
+        return NULL;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    pthread_mutex_lock(&curlPoolMutex);
+    if(curlHandlePool)
+    {
+        index = Vector_Size(curlHandlePool);
+        while(index > 0)
+        {
+            index--;
+            entry = (CurlPoolEntry *) Vector_At(curlHandlePool, index);
+            if(isCurlPoolEntryExpired(entry, &now))
+            {
+                T2Debug("Dropping Curl handle of %s idle for %ld seconds\n", entry->destination, (long) (now.tv_sec - entry->lastUsed.tv_sec));
+                Vector_RemoveItem(curlHandlePool, entry, freeCurlPoolEntry);
+            }
+            else if(curl == NULL && strcmp(entry->destination, destination) == 0)
+            {
+                curl = entry->handle;
+                entry->handle = NULL;
+                Vector_RemoveItem(curlHandlePool, entry, NULL);
+                free(entry->destination);
+                free(entry);
             }
         }
     }
+    pthread_mutex_unlock(&curlPoolMutex);
+
+    if(curl)
+    {
+        curl_easy_reset(curl);
+    }
+    else
+    {
+        curl = curl_easy_init();
+        if(curl == NULL)
+        {
+            free(destination);
+            return NULL;
+        }
+    }
+    free(destination);
 
-    freeifaddrs(ifap);
-    return addressType;
+    pthread_mutex_lock(&curlPoolMutex);
+    if(getCurlShare())
+        curl_easy_setopt(curl, CURLOPT_SHARE, curlShare);
+    pthread_mutex_unlock(&curlPoolMutex);
+    return curl;
 }
-#endif
 
-static size_t writeToFile(void *ptr, size_t size, size_t nmemb, void *stream) {
-    size_t written = fwrite(ptr, size, nmemb, (FILE *) stream);
-    return written;
+/**
+ * Return a handle after use. A handle whose transfer failed is dropped rather than
+ * pooled, as is one beyond CURL_HANDLE_POOL_SIZE idle handles of its destination.
+ */
+static void releaseCurlHandle(CURL *curl, const char *url, bool reusable)
+{
+    CurlPoolEntry *entry = NULL;
+    char *destination = NULL;
+    size_t index;
+    unsigned int pooled = 0;
+
+    if(curl == NULL)
+        return;
+    if(reusable)
+        destination = getHTTPDestination(url);
+    if(destination == NULL)
+    {
+        curl_easy_cleanup(curl);
+        return;
+    }
+
+    pthread_mutex_lock(&curlPoolMutex);
+    if(curlHandlePool == NULL)
+        Vector_Create(&curlHandlePool);
+    for(index = 0; curlHandlePool && index < Vector_Size(curlHandlePool); index++)
+    {
+        if(strcmp(((CurlPoolEntry *) Vector_At(curlHandlePool, index))->destination, destination) == 0)
+            pooled++;
+    }
+    if(curlHandlePool && pooled < CURL_HANDLE_POOL_SIZE)
+        entry = (CurlPoolEntry *) malloc(sizeof(CurlPoolEntry));
+    if(entry)
+    {
+        entry->destination = destination;
+        entry->handle = curl;
+        clock_gettime(CLOCK_MONOTONIC, &entry->lastUsed);
+        Vector_PushBack(curlHandlePool, entry);
+    }
+    pthread_mutex_unlock(&curlPoolMutex);
+
+    if(entry == NULL)
+    {
+        free(destination);
+        curl_easy_cleanup(curl);
+    }
 }
 
-static T2ERROR setHeader(CURL *curl, const char* destURL, struct curl_slist **headerList)
+void uninitCurlHandlePool()
+{
+    int i;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&curlPoolMutex);
+    if(curlHandlePool)
+    {
+        Vector_Destroy(curlHandlePool, freeCurlPoolEntry);
+        curlHandlePool = NULL;
+    }
+    if(curlShare)
+    {
+        curl_share_cleanup(curlShare);
+        curlShare = NULL;
+        for(i = 0; i < CURL_LOCK_DATA_LAST; i++)
+            pthread_mutex_destroy(&curlShareLocks[i]);
+    }
+    pthread_mutex_unlock(&curlPoolMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+}
+
+/**
+ * Keep the start of a response body, bytes beyond HTTP_RESPONSE_MAX_SIZE are
+ * counted and dropped without failing the transfer.
+ */
+static size_t writeToResponse(void *ptr, size_t size, size_t nmemb, void *data)
+{
+    HTTPResponse *response = (HTTPResponse *) data;
+    size_t bytes = size * nmemb;
+    size_t room = sizeof(response->body) - 1 - response->length;
+    size_t copied = (bytes < room) ? bytes : room;
+
+    memcpy(response->body + response->length, ptr, copied);
+    response->length += copied;
+    response->body[response->length] = '\0';
+    response->received += bytes;
+    return bytes;
+}
+
+/**
+ * Response bodies only reach the disk, in CURL_OUTPUT_FILE, while the debug flag is set.
+ */
+static void logHTTPResponse(const HTTPResponse *response)
+{
+    FILE *fp = NULL;
+
+    if(response->received > response->length)
+        T2Debug("Response of %zu bytes truncated to %zu bytes\n", response->received, response->length);
+    if(access(ENABLE_DEBUG_FLAG, F_OK) == -1)
+        return;
+    fp = fopen(CURL_OUTPUT_FILE, "wb");
+    if(fp)
+    {
+        fwrite(response->body, 1, response->length, fp);
+        fclose(fp);
+    }
+}
+
+static T2ERROR setHeader(CURL *curl, const char* destURL, const char *contentType, const char *contentEncoding, struct curl_slist **headerList)
 {
     
     T2Debug("%s ++in\n", __FUNCTION__);
 
     T2Debug("%s DEST URL %s \n", __FUNCTION__, destURL);
     CURLcode code=CURLE_OK;
+#if defined(ENABLE_RDKB_SUPPORT)
+    ADDRESS_TYPE addressType = ADDR_UNKNOWN;
+#endif
     code = curl_easy_setopt(curl, CURLOPT_URL, destURL);
     if(code != CURLE_OK){
        T2Error("%s : Curl set opts failed with error %s \n", __FUNCTION__, curl_easy_strerror(code));
@@ -118,15 +333,16 @@ static T2ERROR setHeader(CURL *curl, const char* destURL, struct curl_slist **he
     }
 
 #if defined(ENABLE_RDKB_SUPPORT)
-    if(getAddressType(INTERFACE) == ADDR_UNKNOWN)
+    addressType = getInterfaceAddressType(INTERFACE);
+    if(addressType == ADDR_UNKNOWN)
     {
         T2Error("Unknown Address Type - returning failure\n");
         return T2ERROR_FAILURE;
     }
 #if defined(_HUB4_PRODUCT_REQ_)
-    else if((getAddressType(INTERFACE) == ADDR_IPV4) && (getAddressType("brlan0") != ADDR_IPV6))
+    else if((addressType == ADDR_IPV4) && (getInterfaceAddressType("brlan0") != ADDR_IPV6))
 #else
-    else if(getAddressType(INTERFACE) == ADDR_IPV4)
+    else if(addressType == ADDR_IPV4)
 #endif
         curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
     else
@@ -134,75 +350,297 @@ static T2ERROR setHeader(CURL *curl, const char* destURL, struct curl_slist **he
 
     curl_easy_setopt(curl, CURLOPT_INTERFACE, INTERFACE);
 #endif
-    *headerList = curl_slist_append(NULL, "Accept: application/json");
-    curl_slist_append(*headerList, "Content-type: application/json");
+    *headerList = curl_slist_append(NULL, HEADER_ACCEPT);
+    curl_slist_append(*headerList, contentType);
+    if(contentEncoding)
+        curl_slist_append(*headerList, contentEncoding);
 
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, *headerList);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToFile);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToResponse);
 
     T2Debug("%s --out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-static T2ERROR setPayload(CURL *curl, const char* payload)
+static T2ERROR setPayload(CURL *curl, const char* payload, size_t payloadSize)
 {
     CURLcode code = CURLE_OK ;
     code = curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
     if(code != CURLE_OK){
         T2Error("%s : Curl set opts failed with error %s \n", __FUNCTION__, curl_easy_strerror(code));
     }
-    code = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(payload));
+    code = curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)payloadSize);
     if(code != CURLE_OK){
         T2Error("%s : Curl set opts failed with error %s \n", __FUNCTION__, curl_easy_strerror(code));
     }
     return T2ERROR_SUCCESS;
 }
 
+HTTPReport* createHTTPReport(char *payload, size_t payloadSize, const char *contentType)
+{
+    HTTPReport *report = (HTTPReport *) malloc(sizeof(HTTPReport));
+    if(report == NULL)
+    {
+        T2Error("Unable to allocate cached report\n");
+        return NULL;
+    }
+    report->payload = payload;
+    report->payloadSize = payloadSize;
+    report->contentType = contentType;
+    report->contentEncoding = NULL;
+    return report;
+}
+
+// Called with compressionMutex held
+static bool prepareCompressionStream(HTTPComp compression, int level)
+{
+    // 15 window bits give a zlib stream, +16 a gzip one
+    int windowBits = (compression == COMP_GZIP) ? 15 + 16 : 15;
+
+    if(compressionStreamReady && compressionStreamType == compression && compressionStreamLevel == level)
+        return deflateReset(&compressionStream) == Z_OK;
+    if(compressionStreamReady)
+    {
+        deflateEnd(&compressionStream);
+        compressionStreamReady = false;
+    }
+    memset(&compressionStream, 0, sizeof(compressionStream));
+    if(deflateInit2(&compressionStream, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        T2Error("Unable to initialize compression stream\n");
+        return false;
+    }
+    compressionStreamReady = true;
+    compressionStreamType = compression;
+    compressionStreamLevel = level;
+    return true;
+}
+
+/**
+ * Replace the payload of report with its gzip or deflate (zlib) encoding and set the
+ * matching Content-Encoding. The report is left untouched on failure.
+ */
+T2ERROR compressHTTPReport(HTTPReport *report, HTTPComp compression, int level)
+{
+    char *compressed = NULL;
+    size_t compressedSize = 0;
+    int status = Z_OK;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(compression == COMP_NONE || report->contentEncoding != NULL)
+        return T2ERROR_SUCCESS;
+
+    pthread_mutex_lock(&compressionMutex);
+    if(!prepareCompressionStream(compression, level))
+    {
+        pthread_mutex_unlock(&compressionMutex);
+        return T2ERROR_FAILURE;
+    }
+    compressionStream.next_in = (Bytef *) report->payload;
+    compressionStream.avail_in = report->payloadSize;
+    do
+    {
+        if(compressionStream.total_out == compressionBufferSize)
+        {
+            unsigned char *buffer = (unsigned char *) realloc(compressionBuffer, compressionBufferSize + COMPRESSION_CHUNK_SIZE);
+            if(buffer == NULL)
+            {
+                T2Error("Unable to grow compression buffer\n");
+                status = Z_MEM_ERROR;
+                break;
+            }
+            compressionBuffer = buffer;
+            compressionBufferSize += COMPRESSION_CHUNK_SIZE;
+        }
+        compressionStream.next_out = compressionBuffer + compressionStream.total_out;
+        compressionStream.avail_out = compressionBufferSize - compressionStream.total_out;
+        status = deflate(&compressionStream, Z_FINISH);
+    } while(status == Z_OK || status == Z_BUF_ERROR);
+
+    if(status == Z_STREAM_END)
+    {
+        compressedSize = compressionStream.total_out;
+        compressed = (char *) malloc(compressedSize);
+        if(compressed)
+            memcpy(compressed, compressionBuffer, compressedSize);
+    }
+    pthread_mutex_unlock(&compressionMutex);
+
+    if(compressed == NULL)
+    {
+        T2Error("Failed to compress report of %zu bytes\n", report->payloadSize);
+        return T2ERROR_FAILURE;
+    }
+    T2Info("Report compressed from %zu to %zu bytes\n", report->payloadSize, compressedSize);
+    free(report->payload);
+    report->payload = compressed;
+    report->payloadSize = compressedSize;
+    report->contentEncoding = (compression == COMP_GZIP) ? HEADER_CONTENTENCODING_GZIP : HEADER_CONTENTENCODING_DEFLATE;
+    T2Debug("%s --out\n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Undo compressHTTPReport, the payload is NUL terminated afterwards. A report
+ * without Content-Encoding is left as it is.
+ */
+T2ERROR decompressHTTPReport(HTTPReport *report)
+{
+    z_stream stream;
+    char *payload = NULL;
+    size_t capacity = 0;
+    int status = Z_OK;
+
+    if(report == NULL)
+        return T2ERROR_INVALID_ARGS;
+    if(report->contentEncoding == NULL)
+        return T2ERROR_SUCCESS;
+
+    memset(&stream, 0, sizeof(stream));
+    // +32 detects the gzip or zlib header
+    if(inflateInit2(&stream, 15 + 32) != Z_OK)
+        return T2ERROR_FAILURE;
+    stream.next_in = (Bytef *) report->payload;
+    stream.avail_in = report->payloadSize;
+    while(status == Z_OK)
+    {
+        if(stream.total_out + 1 >= capacity)
+        {
+            char *grown = (char *) realloc(payload, capacity + report->payloadSize * 2 + COMPRESSION_CHUNK_SIZE);
+            if(grown == NULL)
+                break;
+            payload = grown;
+            capacity += report->payloadSize * 2 + COMPRESSION_CHUNK_SIZE;
+        }
+        stream.next_out = (Bytef *) payload + stream.total_out;
+        // One byte is kept for the terminating NUL
+        stream.avail_out = capacity - stream.total_out - 1;
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    inflateEnd(&stream);
+    if(status != Z_STREAM_END)
+    {
+        T2Error("Unable to decompress report of %zu bytes\n", report->payloadSize);
+        free(payload);
+        return T2ERROR_FAILURE;
+    }
+    payload[stream.total_out] = '\0';
+    free(report->payload);
+    report->payload = payload;
+    report->payloadSize = stream.total_out;
+    report->contentEncoding = NULL;
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Pack reports into one request body, starting at first and taking as many as fit in
+ * maxSize, but at least one. count is set to the number of reports packed.
+ */
+HTTPReport* createHTTPReportBatch(Vector *reports, size_t first, size_t maxSize, HTTPBatch batch, size_t *count)
+{
+    HTTPReport *report = NULL;
+    char *payload = NULL;
+    size_t length = 0;
+    size_t index;
+    size_t last = first;
+    // JSON arrays add brackets and a separator per report, NDJSON a newline per report
+    size_t size = (batch == BATCH_JSONARRAY) ? 1 : 0;
+
+    *count = 0;
+    if(batch == BATCH_NONE || first >= Vector_Size(reports))
+        return NULL;
+    for(index = first; index < Vector_Size(reports); index++)
+    {
+        size_t itemSize = ((HTTPReport *) Vector_At(reports, index))->payloadSize + 1;
+        if(index > first && size + itemSize > maxSize)
+            break;
+        size += itemSize;
+        last = index + 1;
+    }
+    payload = (char *) malloc(size + 1);
+    if(payload == NULL)
+        return NULL;
+    if(batch == BATCH_JSONARRAY)
+        payload[length++] = '[';
+    for(index = first; index < last; index++)
+    {
+        HTTPReport *item = (HTTPReport *) Vector_At(reports, index);
+        if(batch == BATCH_JSONARRAY && index > first)
+            payload[length++] = ',';
+        memcpy(payload + length, item->payload, item->payloadSize);
+        length += item->payloadSize;
+        if(batch == BATCH_NDJSON)
+            payload[length++] = '\n';
+    }
+    if(batch == BATCH_JSONARRAY)
+        payload[length++] = ']';
+    payload[length] = '\0';
+
+    report = createHTTPReport(payload, length, (batch == BATCH_NDJSON) ? HEADER_CONTENTTYPE_NDJSON : HEADER_CONTENTTYPE);
+    if(report == NULL)
+    {
+        free(payload);
+        return NULL;
+    }
+    *count = last - first;
+    return report;
+}
+
+void freeHTTPReport(void *data)
+{
+    if(data != NULL)
+    {
+        HTTPReport *report = (HTTPReport *) data;
+        free(report->payload);
+        free(report);
+    }
+}
+
 T2ERROR sendReportOverHTTP(char *httpUrl, char* payload)
+{
+    HTTPReport report = { payload, strlen(payload), HEADER_CONTENTTYPE, NULL };
+    return sendHTTPReport(httpUrl, &report);
+}
+
+T2ERROR sendHTTPReport(char *httpUrl, HTTPReport *report)
 {
     CURL *curl = NULL;
-    FILE *fp = NULL;
     CURLcode res;
     T2ERROR ret = T2ERROR_FAILURE;
     long http_code;
     struct curl_slist *headerList = NULL;
+    HTTPResponse response;
 
     T2Debug("%s ++in\n", __FUNCTION__);
-    curl = curl_easy_init();
+    curl = acquireCurlHandle(httpUrl);
     if (curl) {
-        if(setHeader(curl, httpUrl, &headerList) != T2ERROR_SUCCESS)
+        if(setHeader(curl, httpUrl, report->contentType, report->contentEncoding, &headerList) != T2ERROR_SUCCESS)
         {
             T2Error("Failed to Set HTTP Header\n");
-            curl_easy_cleanup(curl);
+            curl_slist_free_all(headerList);
+            releaseCurlHandle(curl, httpUrl, false);
             return ret;
         }
-        setPayload(curl, payload);
+        setPayload(curl, report->payload, report->payloadSize);
 
-        pthread_once(&curlFileMutexOnce, sendOverHTTPInit);
-        pthread_mutex_lock(&curlFileMutex);
-
-        fp = fopen(CURL_OUTPUT_FILE, "wb");
-        if (fp) {
-            curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-            res = curl_easy_perform(curl);
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-            if (res != CURLE_OK)
-            {
-                fprintf(stderr, "curl failed: %s\n", curl_easy_strerror(res));
-                T2Error("Failed to send report over HTTP, HTTP Response Code : %ld\n", http_code);
-            }
-            else
-            {
-                T2Info("Report Sent Successfully over HTTP : %ld\n", http_code);
-                ret = T2ERROR_SUCCESS;
-            }
-
-            fclose(fp);
+        memset(&response, 0, sizeof(response));
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+        res = curl_easy_perform(curl);
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+        if (res != CURLE_OK)
+        {
+            fprintf(stderr, "curl failed: %s\n", curl_easy_strerror(res));
+            T2Error("Failed to send report over HTTP, HTTP Response Code : %ld\n", http_code);
         }
-        curl_slist_free_all(headerList);
-        curl_easy_cleanup(curl);
+        else
+        {
+            T2Info("Report Sent Successfully over HTTP : %ld\n", http_code);
+            ret = T2ERROR_SUCCESS;
+        }
+        logHTTPResponse(&response);
 
-        pthread_mutex_unlock(&curlFileMutex);
+        curl_slist_free_all(headerList);
+        releaseCurlHandle(curl, httpUrl, ret == T2ERROR_SUCCESS);
     }
     else
     {
@@ -227,3 +665,604 @@ T2ERROR sendCachedReportsOverHTTP(char *httpUrl, Vector *reportList)
     }
     return T2ERROR_SUCCESS;
 }
+
+T2ERROR sendCachedHTTPReports(char *httpUrl, Vector *reportList)
+{
+    while(Vector_Size(reportList) > 0)
+    {
+        HTTPReport* report = (HTTPReport *)Vector_At(reportList, 0);
+        if(T2ERROR_FAILURE == sendHTTPReport(httpUrl, report))
+        {
+            T2Error("Failed to send cached report, left with %d reports in cache \n", Vector_Size(reportList));
+            return T2ERROR_FAILURE;
+        }
+        Vector_RemoveItem(reportList, report, NULL);
+        freeHTTPReport(report);
+    }
+    return T2ERROR_SUCCESS;
+}
+
+/*
+ * Asynchronous uploads. Report threads queue encoded reports and return, one
+ * uploader thread runs them concurrently on a curl multi handle and hands each
+ * report back through its completion callback.
+ */
+typedef struct _HTTPUpload
+{
+    char *url;
+    char *destination;
+    HTTPReport *report;
+    HTTPUploadCallback callback;
+    void *userData;
+    CURL *curl;
+    struct curl_slist *headerList;
+    HTTPResponse response;
+    T2ERROR status;
+    // Tests whether a destination with an open breaker has recovered
+    bool probe;
+}HTTPUpload;
+
+typedef enum
+{
+    BREAKER_CLOSED,
+    BREAKER_OPEN,
+    BREAKER_HALF_OPEN
+}HTTPBreakerState;
+
+/*
+ * Circuit breaker of a destination. After HTTP_BREAKER_FAILURE_THRESHOLD failed
+ * uploads in a row it opens and uploads fail without a connection attempt until
+ * retryAt. The first upload after that is the only one let through as a probe, its
+ * result closes the breaker or opens it again with twice the backoff.
+ */
+typedef struct _HTTPDestinationState
+{
+    char *destination;
+    HTTPBreakerState state;
+    unsigned int failures;
+    unsigned int openCount;
+    struct timespec retryAt;
+    // The retry handler is still to be called for the current backoff
+    bool retryPending;
+    bool probeInFlight;
+}HTTPDestinationState;
+
+static pthread_mutex_t uploadQueueMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t uploadQueueCond = PTHREAD_COND_INITIALIZER;
+static Vector *uploadQueue = NULL;
+static Vector *activeUploads = NULL;
+static pthread_t uploaderThread;
+static bool uploaderRunning = false;
+// Written to wake the uploader from curl_multi_wait when a report is queued
+static int uploaderWakeup[2] = { -1, -1 };
+static Vector *destinationStates = NULL;
+static HTTPRetryHandler retryHandler = NULL;
+static unsigned int retrySeed = 0;
+
+static bool isTimeReached(const struct timespec *deadline, const struct timespec *now)
+{
+    return now->tv_sec > deadline->tv_sec || (now->tv_sec == deadline->tv_sec && now->tv_nsec >= deadline->tv_nsec);
+}
+
+static long getMillisecondsUntil(const struct timespec *deadline, const struct timespec *now)
+{
+    if(isTimeReached(deadline, now))
+        return 0;
+    // Rounded up, 0 only once the deadline is reached
+    return (deadline->tv_sec - now->tv_sec) * 1000 + (deadline->tv_nsec - now->tv_nsec + 999999) / 1000000;
+}
+
+static void freeDestinationState(void *data)
+{
+    if(data != NULL)
+    {
+        HTTPDestinationState *state = (HTTPDestinationState *) data;
+        free(state->destination);
+        free(state);
+    }
+}
+
+// Called with uploadQueueMutex held
+static HTTPDestinationState* getDestinationState(const char *destination)
+{
+    HTTPDestinationState *state = NULL;
+    size_t index;
+
+    for(index = 0; index < Vector_Size(destinationStates); index++)
+    {
+        state = (HTTPDestinationState *) Vector_At(destinationStates, index);
+        if(strcmp(state->destination, destination) == 0)
+            return state;
+    }
+    state = (HTTPDestinationState *) calloc(1, sizeof(HTTPDestinationState));
+    if(state == NULL || (state->destination = strdup(destination)) == NULL)
+    {
+        free(state);
+        return NULL;
+    }
+    state->state = BREAKER_CLOSED;
+    Vector_PushBack(destinationStates, state);
+    return state;
+}
+
+/**
+ * Open the breaker for an exponential backoff, jittered over its upper half so
+ * devices that failed together do not retry together.
+ */
+static void openDestinationBreaker(HTTPDestinationState *state)
+{
+    unsigned int shift = (state->openCount < 16) ? state->openCount : 16;
+    unsigned long backoff = (unsigned long) HTTP_RETRY_BACKOFF_BASE << shift;
+    unsigned long delay = 0;
+
+    if(backoff > HTTP_RETRY_BACKOFF_MAX)
+        backoff = HTTP_RETRY_BACKOFF_MAX;
+    delay = backoff / 2 + rand_r(&retrySeed) % (backoff / 2 + 1);
+    state->state = BREAKER_OPEN;
+    state->openCount++;
+    state->retryPending = true;
+    state->probeInFlight = false;
+    clock_gettime(CLOCK_MONOTONIC, &state->retryAt);
+    state->retryAt.tv_sec += delay;
+    T2Warning("Uploads to %s failing, retrying in %lu seconds\n", state->destination, delay);
+}
+
+// Called with uploadQueueMutex held
+static void recordUploadResult(HTTPUpload *upload, bool success)
+{
+    HTTPDestinationState *state = getDestinationState(upload->destination);
+
+    if(state == NULL)
+        return;
+    if(upload->probe)
+        state->probeInFlight = false;
+    if(success)
+    {
+        if(state->state != BREAKER_CLOSED)
+            T2Info("Uploads to %s recovered\n", state->destination);
+        state->state = BREAKER_CLOSED;
+        state->failures = 0;
+        state->openCount = 0;
+        state->retryPending = false;
+    }
+    else if(state->state == BREAKER_HALF_OPEN && upload->probe)
+    {
+        openDestinationBreaker(state);
+    }
+    else if(state->state == BREAKER_CLOSED && ++state->failures >= HTTP_BREAKER_FAILURE_THRESHOLD)
+    {
+        openDestinationBreaker(state);
+    }
+}
+
+/**
+ * Collect the destinations whose backoff ran out, so their spooled reports can be
+ * retried. waitMs is set to the time until the next backoff runs out, -1 if none.
+ * Called with uploadQueueMutex held.
+ */
+static void collectDueRetries(const struct timespec *now, Vector *dueRetries, long *waitMs)
+{
+    size_t index;
+
+    *waitMs = -1;
+    for(index = 0; index < Vector_Size(destinationStates); index++)
+    {
+        HTTPDestinationState *state = (HTTPDestinationState *) Vector_At(destinationStates, index);
+        long untilRetry;
+        if(state->state != BREAKER_OPEN || !state->retryPending)
+            continue;
+        untilRetry = getMillisecondsUntil(&state->retryAt, now);
+        if(untilRetry == 0)
+        {
+            char *destination = strdup(state->destination);
+            state->retryPending = false;
+            if(destination)
+                Vector_PushBack(dueRetries, destination);
+        }
+        else if(*waitMs < 0 || untilRetry < *waitMs)
+        {
+            *waitMs = untilRetry;
+        }
+    }
+}
+
+static void runDueRetries(Vector *dueRetries)
+{
+    while(Vector_Size(dueRetries) > 0)
+    {
+        char *destination = (char *) Vector_At(dueRetries, 0);
+        Vector_RemoveItem(dueRetries, destination, NULL);
+        if(retryHandler && !retryHandler(destination))
+        {
+            // The owner of the spool was busy, try again shortly
+            HTTPDestinationState *state = NULL;
+            pthread_mutex_lock(&uploadQueueMutex);
+            state = getDestinationState(destination);
+            if(state && state->state == BREAKER_OPEN)
+            {
+                clock_gettime(CLOCK_MONOTONIC, &state->retryAt);
+                state->retryAt.tv_sec += HTTP_RETRY_HANDLER_DELAY;
+                state->retryPending = true;
+            }
+            pthread_mutex_unlock(&uploadQueueMutex);
+        }
+        free(destination);
+    }
+}
+
+static void wakeUploader()
+{
+    char signal = 1;
+    if(uploaderWakeup[1] != -1 && write(uploaderWakeup[1], &signal, 1) < 0)
+        T2Debug("Uploader wakeup already pending\n");
+}
+
+static void completeHTTPUpload(HTTPUpload *upload)
+{
+    if(upload->callback)
+        upload->callback(upload->report, upload->status, upload->userData);
+    else
+        freeHTTPReport(upload->report);
+    free(upload->url);
+    free(upload->destination);
+    free(upload);
+}
+
+static void completeHTTPUploads(Vector *uploads)
+{
+    while(Vector_Size(uploads) > 0)
+    {
+        HTTPUpload *upload = (HTTPUpload *) Vector_At(uploads, 0);
+        Vector_RemoveItem(uploads, upload, NULL);
+        completeHTTPUpload(upload);
+    }
+}
+
+static void finishHTTPUpload(HTTPUpload *upload, T2ERROR status, Vector *finishedUploads)
+{
+    curl_slist_free_all(upload->headerList);
+    upload->headerList = NULL;
+    releaseCurlHandle(upload->curl, upload->url, status == T2ERROR_SUCCESS);
+    upload->curl = NULL;
+    upload->status = status;
+    Vector_PushBack(finishedUploads, upload);
+}
+
+static unsigned int countActiveUploads(const char *destination)
+{
+    unsigned int count = 0;
+    size_t index;
+    for(index = 0; index < Vector_Size(activeUploads); index++)
+    {
+        if(strcmp(((HTTPUpload *) Vector_At(activeUploads, index))->destination, destination) == 0)
+            count++;
+    }
+    return count;
+}
+
+/**
+ * Start queued uploads in order as far as HTTP_UPLOAD_MAX_ACTIVE and the per
+ * destination limit allow. Uploads that cannot be started are finished as failed.
+ * Called with uploadQueueMutex held.
+ */
+static void startQueuedUploads(CURLM *multi, Vector *finishedUploads, const struct timespec *now)
+{
+    size_t index = 0;
+
+    while(index < Vector_Size(uploadQueue) && Vector_Size(activeUploads) < HTTP_UPLOAD_MAX_ACTIVE)
+    {
+        HTTPUpload *upload = (HTTPUpload *) Vector_At(uploadQueue, index);
+        HTTPDestinationState *state = getDestinationState(upload->destination);
+        if(state && state->state == BREAKER_OPEN && !isTimeReached(&state->retryAt, now))
+        {
+            // No connection attempt while the breaker is open, the owner spools the report
+            T2Debug("Breaker open for %s, upload not attempted\n", upload->destination);
+            Vector_RemoveItem(uploadQueue, upload, NULL);
+            upload->status = T2ERROR_FAILURE;
+            Vector_PushBack(finishedUploads, upload);
+            continue;
+        }
+        if(state && state->state == BREAKER_OPEN)
+            state->state = BREAKER_HALF_OPEN;
+        if((state && state->state == BREAKER_HALF_OPEN && state->probeInFlight)
+                || countActiveUploads(upload->destination) >= HTTP_UPLOAD_MAX_PER_DESTINATION)
+        {
+            index++;
+            continue;
+        }
+        Vector_RemoveItem(uploadQueue, upload, NULL);
+        if(state && state->state == BREAKER_HALF_OPEN)
+        {
+            T2Info("Probing %s\n", upload->destination);
+            upload->probe = true;
+            state->probeInFlight = true;
+        }
+
+        upload->curl = acquireCurlHandle(upload->url);
+        if(upload->curl == NULL)
+        {
+            T2Error("Unable to initialize Curl\n");
+            recordUploadResult(upload, false);
+            finishHTTPUpload(upload, T2ERROR_FAILURE, finishedUploads);
+            continue;
+        }
+        if(setHeader(upload->curl, upload->url, upload->report->contentType, upload->report->contentEncoding, &upload->headerList) != T2ERROR_SUCCESS)
+        {
+            T2Error("Failed to Set HTTP Header\n");
+            recordUploadResult(upload, false);
+            finishHTTPUpload(upload, T2ERROR_FAILURE, finishedUploads);
+            continue;
+        }
+        setPayload(upload->curl, upload->report->payload, upload->report->payloadSize);
+        curl_easy_setopt(upload->curl, CURLOPT_WRITEDATA, &upload->response);
+        curl_easy_setopt(upload->curl, CURLOPT_PRIVATE, upload);
+        if(curl_multi_add_handle(multi, upload->curl) != CURLM_OK)
+        {
+            T2Error("Unable to start upload to %s\n", upload->destination);
+            recordUploadResult(upload, false);
+            finishHTTPUpload(upload, T2ERROR_FAILURE, finishedUploads);
+            continue;
+        }
+        Vector_PushBack(activeUploads, upload);
+    }
+}
+
+static void collectFinishedUploads(CURLM *multi, Vector *finishedUploads)
+{
+    CURLMsg *msg = NULL;
+    int pending = 0;
+
+    while((msg = curl_multi_info_read(multi, &pending)) != NULL)
+    {
+        HTTPUpload *upload = NULL;
+        CURLcode res = msg->data.result;
+        long http_code = 0;
+
+        if(msg->msg != CURLMSG_DONE)
+            continue;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &upload);
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+        curl_multi_remove_handle(multi, msg->easy_handle);
+        Vector_RemoveItem(activeUploads, upload, NULL);
+        pthread_mutex_lock(&uploadQueueMutex);
+        recordUploadResult(upload, res == CURLE_OK);
+        pthread_mutex_unlock(&uploadQueueMutex);
+        if(res != CURLE_OK)
+        {
+            T2Error("Failed to send report over HTTP : %s, HTTP Response Code : %ld\n", curl_easy_strerror(res), http_code);
+            finishHTTPUpload(upload, T2ERROR_FAILURE, finishedUploads);
+        }
+        else
+        {
+            T2Info("Report Sent Successfully over HTTP : %ld\n", http_code);
+            finishHTTPUpload(upload, T2ERROR_SUCCESS, finishedUploads);
+        }
+        logHTTPResponse(&upload->response);
+    }
+}
+
+static void* uploaderMain(void *data)
+{
+    CURLM *multi = (CURLM *) data;
+    Vector *finishedUploads = NULL;
+    Vector *dueRetries = NULL;
+    struct curl_waitfd wakeupFd;
+    struct timespec now;
+    struct timespec deadline;
+    long waitMs = -1;
+    char drain[64];
+    int running = 0;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    Vector_Create(&finishedUploads);
+    Vector_Create(&dueRetries);
+    wakeupFd.fd = uploaderWakeup[0];
+    wakeupFd.events = CURL_WAIT_POLLIN;
+    wakeupFd.revents = 0;
+
+    pthread_mutex_lock(&uploadQueueMutex);
+    while(uploaderRunning)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        startQueuedUploads(multi, finishedUploads, &now);
+        collectDueRetries(&now, dueRetries, &waitMs);
+        if(Vector_Size(activeUploads) == 0 && Vector_Size(finishedUploads) == 0 && Vector_Size(dueRetries) == 0)
+        {
+            if(waitMs < 0)
+            {
+                pthread_cond_wait(&uploadQueueCond, &uploadQueueMutex);
+            }
+            else
+            {
+                deadline.tv_sec = now.tv_sec + waitMs / 1000;
+                deadline.tv_nsec = now.tv_nsec + (waitMs % 1000) * 1000000;
+                if(deadline.tv_nsec >= 1000000000)
+                {
+                    deadline.tv_sec++;
+                    deadline.tv_nsec -= 1000000000;
+                }
+                pthread_cond_timedwait(&uploadQueueCond, &uploadQueueMutex, &deadline);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&uploadQueueMutex);
+
+        // Callbacks and retries run without the queue lock, they may queue further reports
+        runDueRetries(dueRetries);
+        completeHTTPUploads(finishedUploads);
+        if(Vector_Size(activeUploads) > 0)
+        {
+            curl_multi_perform(multi, &running);
+            collectFinishedUploads(multi, finishedUploads);
+            completeHTTPUploads(finishedUploads);
+        }
+        if(Vector_Size(activeUploads) > 0)
+        {
+            curl_multi_wait(multi, &wakeupFd, 1, (waitMs >= 0 && waitMs < HTTP_UPLOAD_POLL_TIMEOUT) ? (int) waitMs : HTTP_UPLOAD_POLL_TIMEOUT, NULL);
+            while(read(uploaderWakeup[0], drain, sizeof(drain)) > 0);
+        }
+        pthread_mutex_lock(&uploadQueueMutex);
+    }
+
+    // Whatever is still queued or in flight at shutdown is handed back as failed
+    while(Vector_Size(activeUploads) > 0)
+    {
+        HTTPUpload *upload = (HTTPUpload *) Vector_At(activeUploads, 0);
+        curl_multi_remove_handle(multi, upload->curl);
+        Vector_RemoveItem(activeUploads, upload, NULL);
+        finishHTTPUpload(upload, T2ERROR_FAILURE, finishedUploads);
+    }
+    while(Vector_Size(uploadQueue) > 0)
+    {
+        HTTPUpload *upload = (HTTPUpload *) Vector_At(uploadQueue, 0);
+        Vector_RemoveItem(uploadQueue, upload, NULL);
+        upload->status = T2ERROR_FAILURE;
+        Vector_PushBack(finishedUploads, upload);
+    }
+    pthread_mutex_unlock(&uploadQueueMutex);
+
+    completeHTTPUploads(finishedUploads);
+    Vector_Destroy(finishedUploads, NULL);
+    Vector_Destroy(dueRetries, free);
+    curl_multi_cleanup(multi);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return NULL;
+}
+
+/**
+ * Start the uploader thread on first use, called with uploadQueueMutex held.
+ */
+static T2ERROR startHTTPUploader()
+{
+    CURLM *multi = NULL;
+    pthread_condattr_t condAttr;
+
+    if(uploaderRunning)
+        return T2ERROR_SUCCESS;
+
+    multi = curl_multi_init();
+    if(multi == NULL)
+    {
+        T2Error("Unable to initialize Curl multi handle\n");
+        return T2ERROR_FAILURE;
+    }
+    if(pipe(uploaderWakeup) != 0)
+    {
+        T2Error("Unable to create uploader wakeup pipe\n");
+        uploaderWakeup[0] = uploaderWakeup[1] = -1;
+        curl_multi_cleanup(multi);
+        return T2ERROR_FAILURE;
+    }
+    fcntl(uploaderWakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(uploaderWakeup[1], F_SETFL, O_NONBLOCK);
+    // Backoff deadlines are monotonic, so is the wait for them
+    pthread_condattr_init(&condAttr);
+    pthread_condattr_setclock(&condAttr, CLOCK_MONOTONIC);
+    pthread_cond_init(&uploadQueueCond, &condAttr);
+    pthread_condattr_destroy(&condAttr);
+    retrySeed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+    if(destinationStates == NULL)
+        Vector_Create(&destinationStates);
+    if(uploadQueue == NULL)
+        Vector_Create(&uploadQueue);
+    if(activeUploads == NULL)
+        Vector_Create(&activeUploads);
+
+    uploaderRunning = true;
+    if(pthread_create(&uploaderThread, NULL, uploaderMain, multi) != 0)
+    {
+        T2Error("Unable to start uploader thread\n");
+        uploaderRunning = false;
+        close(uploaderWakeup[0]);
+        close(uploaderWakeup[1]);
+        uploaderWakeup[0] = uploaderWakeup[1] = -1;
+        curl_multi_cleanup(multi);
+        return T2ERROR_FAILURE;
+    }
+    T2Info("Started HTTP uploader thread\n");
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR queueHTTPReport(const char *httpUrl, HTTPReport *report, HTTPUploadCallback callback, void *userData)
+{
+    HTTPUpload *upload = NULL;
+    T2ERROR ret = T2ERROR_FAILURE;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(httpUrl == NULL || report == NULL)
+    {
+        T2Error("Invalid report to upload\n");
+        return T2ERROR_INVALID_ARGS;
+    }
+    upload = (HTTPUpload *) calloc(1, sizeof(HTTPUpload));
+    if(upload == NULL)
+        return T2ERROR_FAILURE;
+    upload->url = strdup(httpUrl);
+    upload->destination = getHTTPDestination(httpUrl);
+    upload->report = report;
+    upload->callback = callback;
+    upload->userData = userData;
+    if(upload->url == NULL || upload->destination == NULL)
+    {
+        free(upload->url);
+        free(upload->destination);
+        free(upload);
+        return T2ERROR_FAILURE;
+    }
+
+    pthread_mutex_lock(&uploadQueueMutex);
+    if(startHTTPUploader() == T2ERROR_SUCCESS)
+    {
+        Vector_PushBack(uploadQueue, upload);
+        pthread_cond_signal(&uploadQueueCond);
+        wakeUploader();
+        ret = T2ERROR_SUCCESS;
+    }
+    pthread_mutex_unlock(&uploadQueueMutex);
+
+    if(ret != T2ERROR_SUCCESS)
+    {
+        free(upload->url);
+        free(upload->destination);
+        free(upload);
+    }
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
+void uninitHTTPUploader()
+{
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&uploadQueueMutex);
+    if(!uploaderRunning)
+    {
+        pthread_mutex_unlock(&uploadQueueMutex);
+        return;
+    }
+    uploaderRunning = false;
+    pthread_cond_signal(&uploadQueueCond);
+    wakeUploader();
+    pthread_mutex_unlock(&uploadQueueMutex);
+
+    pthread_join(uploaderThread, NULL);
+
+    pthread_mutex_lock(&uploadQueueMutex);
+    Vector_Destroy(uploadQueue, NULL);
+    uploadQueue = NULL;
+    Vector_Destroy(activeUploads, NULL);
+    activeUploads = NULL;
+    Vector_Destroy(destinationStates, freeDestinationState);
+    destinationStates = NULL;
+    close(uploaderWakeup[0]);
+    close(uploaderWakeup[1]);
+    uploaderWakeup[0] = uploaderWakeup[1] = -1;
+    pthread_mutex_unlock(&uploadQueueMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+}
+
+void setHTTPRetryHandler(HTTPRetryHandler handler)
+{
+    pthread_mutex_lock(&uploadQueueMutex);
+    retryHandler = handler;
+    pthread_mutex_unlock(&uploadQueueMutex);
+}
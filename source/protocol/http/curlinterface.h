@@ -23,21 +23,140 @@
 #include <curl/curl.h>
 #include "telemetry2_0.h"
 #include "vector.h"
+#include "reportgen.h"
 
 #define TIMEOUT        30
 #define INTERFACE      "erouter0"
 #define TLSVERSION     CURL_SSLVERSION_TLSv1_2
 
 
+// Response bodies are written here only while ENABLE_DEBUG_FLAG is present
 #define CURL_OUTPUT_FILE    "/tmp/output.txt"
 
+/* Bytes of a response body kept in memory, the rest is dropped */
+#ifndef HTTP_RESPONSE_MAX_SIZE
+#define HTTP_RESPONSE_MAX_SIZE 512
+#endif
+
 #define HTTP_METHOD         "POST"
 
 #define HEADER_ACCEPT       "Accept: application/json"
 #define HEADER_CONTENTTYPE  "Content-type: application/json"
+#define HEADER_CONTENTTYPE_MSGPACK  "Content-type: application/msgpack"
+#define HEADER_CONTENTTYPE_NDJSON   "Content-type: application/x-ndjson"
+#define HEADER_CONTENTENCODING_GZIP     "Content-Encoding: gzip"
+#define HEADER_CONTENTENCODING_DEFLATE  "Content-Encoding: deflate"
+
+/* Output chunk of the shared compression buffer, it grows in these steps */
+#ifndef COMPRESSION_CHUNK_SIZE
+#define COMPRESSION_CHUNK_SIZE 16384
+#endif
+
+/* Idle handles kept per destination and the seconds an idle handle is kept for */
+#ifndef CURL_HANDLE_POOL_SIZE
+#define CURL_HANDLE_POOL_SIZE 2
+#endif
+
+#ifndef CURL_HANDLE_IDLE_TIMEOUT
+#define CURL_HANDLE_IDLE_TIMEOUT 300
+#endif
+
+/* Uploads run at once in total and per destination, and the longest the uploader
+ * sleeps in curl_multi_wait in milliseconds */
+#ifndef HTTP_UPLOAD_MAX_ACTIVE
+#define HTTP_UPLOAD_MAX_ACTIVE 8
+#endif
+
+#ifndef HTTP_UPLOAD_MAX_PER_DESTINATION
+#define HTTP_UPLOAD_MAX_PER_DESTINATION CURL_HANDLE_POOL_SIZE
+#endif
+
+#ifndef HTTP_UPLOAD_POLL_TIMEOUT
+#define HTTP_UPLOAD_POLL_TIMEOUT 1000
+#endif
+
+/* Failed uploads in a row that open a destination's breaker, and the backoff in seconds
+ * before the first retry, doubling on every failed probe up to the maximum */
+#ifndef HTTP_BREAKER_FAILURE_THRESHOLD
+#define HTTP_BREAKER_FAILURE_THRESHOLD 3
+#endif
+
+#ifndef HTTP_RETRY_BACKOFF_BASE
+#define HTTP_RETRY_BACKOFF_BASE 30
+#endif
+
+#ifndef HTTP_RETRY_BACKOFF_MAX
+#define HTTP_RETRY_BACKOFF_MAX 3600
+#endif
+
+/* Seconds before a retry the handler could not take is offered again */
+#ifndef HTTP_RETRY_HANDLER_DELAY
+#define HTTP_RETRY_HANDLER_DELAY 5
+#endif
+
+/**
+ * Encoded report ready for upload. The payload may be binary, payloadSize is its
+ * length and contentType the Content-type header line to send it with.
+ * contentEncoding is the Content-Encoding header line of a compressed payload.
+ */
+typedef struct _HTTPReport
+{
+    char *payload;
+    size_t payloadSize;
+    const char *contentType;
+    const char *contentEncoding;
+}HTTPReport;
+
+/**
+ * Bounded sink of a response body, body is NUL terminated and received counts
+ * all bytes of the response including those that did not fit.
+ */
+typedef struct _HTTPResponse
+{
+    char body[HTTP_RESPONSE_MAX_SIZE];
+    size_t length;
+    size_t received;
+}HTTPResponse;
+
+/**
+ * Completion of a queued upload, called on the uploader thread. The report is
+ * handed back to the callback, which owns it from then on. It must not block or do
+ * file I/O, the uploader thread completes the transfers of all destinations.
+ */
+typedef void (*HTTPUploadCallback)(HTTPReport *report, T2ERROR status, void *userData);
+
+/**
+ * Called on the uploader thread when the backoff of a destination ran out, to queue
+ * its spooled reports without blocking. Returns false when that cannot be done now.
+ */
+typedef bool (*HTTPRetryHandler)(const char *destination);
+
+char* getHTTPDestination(const char *url);
+
+HTTPReport* createHTTPReport(char *payload, size_t payloadSize, const char *contentType);
+
+T2ERROR compressHTTPReport(HTTPReport *report, HTTPComp compression, int level);
+
+T2ERROR decompressHTTPReport(HTTPReport *report);
+
+HTTPReport* createHTTPReportBatch(Vector *reports, size_t first, size_t maxSize, HTTPBatch batch, size_t *count);
+
+void freeHTTPReport(void *data);
 
 T2ERROR sendReportOverHTTP(char *httpUrl, char* payload);
 
+T2ERROR sendHTTPReport(char *httpUrl, HTTPReport *report);
+
 T2ERROR sendCachedReportsOverHTTP(char *httpUrl, Vector *reportList);
 
+T2ERROR sendCachedHTTPReports(char *httpUrl, Vector *reportList);
+
+void uninitCurlHandlePool();
+
+T2ERROR queueHTTPReport(const char *httpUrl, HTTPReport *report, HTTPUploadCallback callback, void *userData);
+
+void uninitHTTPUploader();
+
+void setHTTPRetryHandler(HTTPRetryHandler handler);
+
 #endif /* _CURLINTERFACE_H_ */
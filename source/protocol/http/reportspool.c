@@ -0,0 +1,835 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <zlib.h>
+
+#include "reportspool.h"
+#include "t2log_wrapper.h"
+
+/*
+ * Record layout, integers little endian:
+ *   0  magic "T2RS"       4  sequence            12 URL length
+ *   16 stored length      20 payload length      24 flags, 3 bytes reserved
+ *   28 CRC-32 of bytes 0-27, the URL and the stored payload
+ * followed by the URL and the stored payload.
+ */
+#define SPOOL_RECORD_MAGIC          0x53523254
+#define SPOOL_RECORD_HEADER_SIZE    32
+#define SPOOL_RECORD_CRC_OFFSET     28
+
+#define SPOOL_FLAG_STORE_DEFLATED   0x01
+#define SPOOL_FLAG_MSGPACK          0x02
+#define SPOOL_FLAG_GZIP             0x04
+#define SPOOL_FLAG_DEFLATE          0x08
+
+/* Payloads smaller than this are stored as they are */
+#define SPOOL_COMPRESSION_MIN_SIZE  64
+
+typedef struct _SpoolRecord
+{
+    uint64_t sequence;
+    const char *url;
+    uint32_t urlLength;
+    const unsigned char *data;
+    uint32_t storedLength;
+    uint32_t payloadLength;
+    uint8_t flags;
+    size_t offset;
+    size_t length;
+}SpoolRecord;
+
+typedef struct _SpoolBuffer
+{
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+}SpoolBuffer;
+
+static pthread_mutex_t spoolListMutex = PTHREAD_MUTEX_INITIALIZER;
+static Vector *spoolList = NULL;
+
+static void putU32(unsigned char *out, uint32_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = (value >> 8) & 0xFF;
+    out[2] = (value >> 16) & 0xFF;
+    out[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t getU32(const unsigned char *in)
+{
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static void putU64(unsigned char *out, uint64_t value)
+{
+    putU32(out, (uint32_t) value);
+    putU32(out + 4, (uint32_t) (value >> 32));
+}
+
+static uint64_t getU64(const unsigned char *in)
+{
+    return (uint64_t) getU32(in) | ((uint64_t) getU32(in + 4) << 32);
+}
+
+static uint32_t getSpoolRecordCrc(const unsigned char *header, const char *url, uint32_t urlLength, const unsigned char *data, uint32_t storedLength)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    crc = crc32(crc, header, SPOOL_RECORD_CRC_OFFSET);
+    crc = crc32(crc, (const Bytef *) url, urlLength);
+    crc = crc32(crc, data, storedLength);
+    return (uint32_t) crc;
+}
+
+/**
+ * Parse the record at offset, false if it is incomplete or fails its checks.
+ */
+static bool parseSpoolRecord(const unsigned char *buffer, size_t size, size_t offset, SpoolRecord *record)
+{
+    const unsigned char *header = buffer + offset;
+    size_t available;
+
+    if(offset > size || size - offset < SPOOL_RECORD_HEADER_SIZE)
+        return false;
+    if(getU32(header) != SPOOL_RECORD_MAGIC)
+        return false;
+
+    record->sequence = getU64(header + 4);
+    record->urlLength = getU32(header + 12);
+    record->storedLength = getU32(header + 16);
+    record->payloadLength = getU32(header + 20);
+    record->flags = header[24];
+    available = size - offset - SPOOL_RECORD_HEADER_SIZE;
+    if(record->urlLength == 0 || record->urlLength > available || record->storedLength > available - record->urlLength)
+        return false;
+    if(!(record->flags & SPOOL_FLAG_STORE_DEFLATED) && record->payloadLength != record->storedLength)
+        return false;
+
+    record->url = (const char *) (header + SPOOL_RECORD_HEADER_SIZE);
+    record->data = header + SPOOL_RECORD_HEADER_SIZE + record->urlLength;
+    if(getU32(header + SPOOL_RECORD_CRC_OFFSET) != getSpoolRecordCrc(header, record->url, record->urlLength, record->data, record->storedLength))
+        return false;
+
+    record->offset = offset;
+    record->length = SPOOL_RECORD_HEADER_SIZE + record->urlLength + record->storedLength;
+    return true;
+}
+
+/**
+ * Find the first intact record at or after offset, skipping over damaged data up to
+ * the next "T2RS" magic whose record passes its checks. Returns size if there is none.
+ */
+static size_t findSpoolRecord(const unsigned char *buffer, size_t size, size_t offset, SpoolRecord *record)
+{
+    while(offset < size && size - offset >= SPOOL_RECORD_HEADER_SIZE)
+    {
+        const unsigned char *next = (const unsigned char *) memchr(buffer + offset, 'T', size - offset);
+        if(next == NULL)
+            break;
+        offset = next - buffer;
+        if(parseSpoolRecord(buffer, size, offset, record))
+            return offset;
+        offset++;
+    }
+    return size;
+}
+
+static bool reserveSpoolBuffer(SpoolBuffer *buffer, size_t length)
+{
+    unsigned char *data = NULL;
+    size_t capacity = buffer->capacity ? buffer->capacity : 1024;
+
+    if(buffer->length + length <= buffer->capacity)
+        return true;
+    while(capacity < buffer->length + length)
+        capacity *= 2;
+    data = (unsigned char *) realloc(buffer->data, capacity);
+    if(data == NULL)
+        return false;
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static bool appendSpoolBuffer(SpoolBuffer *buffer, const void *data, size_t length)
+{
+    if(!reserveSpoolBuffer(buffer, length))
+        return false;
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+    return true;
+}
+
+static uint8_t getReportFlags(const HTTPReport *report)
+{
+    uint8_t flags = 0;
+    if(report->contentType && strcmp(report->contentType, HEADER_CONTENTTYPE_MSGPACK) == 0)
+        flags |= SPOOL_FLAG_MSGPACK;
+    if(report->contentEncoding && strcmp(report->contentEncoding, HEADER_CONTENTENCODING_GZIP) == 0)
+        flags |= SPOOL_FLAG_GZIP;
+    else if(report->contentEncoding && strcmp(report->contentEncoding, HEADER_CONTENTENCODING_DEFLATE) == 0)
+        flags |= SPOOL_FLAG_DEFLATE;
+    return flags;
+}
+
+static bool encodeSpoolRecord(SpoolBuffer *buffer, uint64_t sequence, const char *url, const HTTPReport *report)
+{
+    unsigned char header[SPOOL_RECORD_HEADER_SIZE];
+    const unsigned char *data = (const unsigned char *) report->payload;
+    unsigned char *deflated = NULL;
+    uLongf storedLength = report->payloadSize;
+    uint32_t urlLength = strlen(url);
+    uint8_t flags = getReportFlags(report);
+    bool ret = false;
+
+    if(report->payloadSize > UINT32_MAX)
+        return false;
+#if REPORT_SPOOL_COMPRESSION
+    if(report->contentEncoding == NULL && report->payloadSize >= SPOOL_COMPRESSION_MIN_SIZE)
+    {
+        uLongf deflatedLength = compressBound(report->payloadSize);
+        deflated = (unsigned char *) malloc(deflatedLength);
+        if(deflated && compress2(deflated, &deflatedLength, data, report->payloadSize, Z_DEFAULT_COMPRESSION) == Z_OK
+                && deflatedLength < report->payloadSize)
+        {
+            data = deflated;
+            storedLength = deflatedLength;
+            flags |= SPOOL_FLAG_STORE_DEFLATED;
+        }
+    }
+#endif
+    memset(header, 0, sizeof(header));
+    putU32(header, SPOOL_RECORD_MAGIC);
+    putU64(header + 4, sequence);
+    putU32(header + 12, urlLength);
+    putU32(header + 16, (uint32_t) storedLength);
+    putU32(header + 20, (uint32_t) report->payloadSize);
+    header[24] = flags;
+    putU32(header + SPOOL_RECORD_CRC_OFFSET, getSpoolRecordCrc(header, url, urlLength, data, storedLength));
+
+    if(reserveSpoolBuffer(buffer, sizeof(header) + urlLength + storedLength))
+    {
+        appendSpoolBuffer(buffer, header, sizeof(header));
+        appendSpoolBuffer(buffer, url, urlLength);
+        appendSpoolBuffer(buffer, data, storedLength);
+        ret = true;
+    }
+    free(deflated);
+    return ret;
+}
+
+static HTTPReport* decodeSpoolRecord(const SpoolRecord *record)
+{
+    HTTPReport *report = NULL;
+    char *payload = (char *) malloc(record->payloadLength + 1);
+
+    if(payload == NULL)
+        return NULL;
+    if(record->flags & SPOOL_FLAG_STORE_DEFLATED)
+    {
+        uLongf payloadLength = record->payloadLength;
+        if(uncompress((Bytef *) payload, &payloadLength, record->data, record->storedLength) != Z_OK || payloadLength != record->payloadLength)
+        {
+            free(payload);
+            return NULL;
+        }
+    }
+    else
+    {
+        memcpy(payload, record->data, record->payloadLength);
+    }
+    // JSON payloads are used as strings as well
+    payload[record->payloadLength] = '\0';
+
+    report = createHTTPReport(payload, record->payloadLength, (record->flags & SPOOL_FLAG_MSGPACK) ? HEADER_CONTENTTYPE_MSGPACK : HEADER_CONTENTTYPE);
+    if(report == NULL)
+    {
+        free(payload);
+        return NULL;
+    }
+    if(record->flags & SPOOL_FLAG_GZIP)
+        report->contentEncoding = HEADER_CONTENTENCODING_GZIP;
+    else if(record->flags & SPOOL_FLAG_DEFLATE)
+        report->contentEncoding = HEADER_CONTENTENCODING_DEFLATE;
+    return report;
+}
+
+static T2ERROR readSpoolFile(const char *path, unsigned char **data, size_t *size)
+{
+    struct stat st;
+    unsigned char *buffer = NULL;
+    size_t total = 0;
+    int fd = open(path, O_RDONLY);
+
+    *data = NULL;
+    *size = 0;
+    if(fd == -1)
+        return (errno == ENOENT) ? T2ERROR_SUCCESS : T2ERROR_FAILURE;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return T2ERROR_FAILURE;
+    }
+    if(st.st_size > 0)
+    {
+        buffer = (unsigned char *) malloc(st.st_size);
+        if(buffer == NULL)
+        {
+            close(fd);
+            return T2ERROR_FAILURE;
+        }
+        while(total < (size_t) st.st_size)
+        {
+            ssize_t bytes = read(fd, buffer + total, st.st_size - total);
+            if(bytes < 0 && errno == EINTR)
+                continue;
+            if(bytes <= 0)
+                break;
+            total += bytes;
+        }
+    }
+    close(fd);
+    // A short read leaves the records behind it unknown
+    if(total < (size_t) st.st_size)
+    {
+        free(buffer);
+        return T2ERROR_FAILURE;
+    }
+    *data = buffer;
+    *size = total;
+    return T2ERROR_SUCCESS;
+}
+
+static bool writeAll(int fd, const unsigned char *data, size_t length)
+{
+    while(length > 0)
+    {
+        ssize_t bytes = write(fd, data, length);
+        if(bytes < 0 && errno == EINTR)
+            continue;
+        if(bytes <= 0)
+            return false;
+        data += bytes;
+        length -= bytes;
+    }
+    return true;
+}
+
+static void syncSpoolDirectory()
+{
+    int fd = open(REPORT_SPOOL_PATH, O_RDONLY);
+    if(fd != -1)
+    {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+/**
+ * Replace the spool file with data through a temporary file, so a crash leaves
+ * either the old or the new spool behind.
+ */
+static T2ERROR rewriteSpoolFile(ReportSpool *spool, const unsigned char *data, size_t length)
+{
+    char tmpPath[REPORT_SPOOL_PATH_SIZE];
+    int fd = -1;
+
+    if(length == 0)
+    {
+        if(unlink(spool->path) != 0 && errno != ENOENT)
+            return T2ERROR_FAILURE;
+        syncSpoolDirectory();
+        return T2ERROR_SUCCESS;
+    }
+    snprintf(tmpPath, sizeof(tmpPath), "%s.tmp", spool->path);
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if(fd == -1)
+    {
+        T2Error("Unable to create %s : %s\n", tmpPath, strerror(errno));
+        return T2ERROR_FAILURE;
+    }
+    if(!writeAll(fd, data, length) || fsync(fd) != 0)
+    {
+        T2Error("Unable to write %s : %s\n", tmpPath, strerror(errno));
+        close(fd);
+        unlink(tmpPath);
+        return T2ERROR_FAILURE;
+    }
+    close(fd);
+    if(rename(tmpPath, spool->path) != 0)
+    {
+        T2Error("Unable to replace %s : %s\n", spool->path, strerror(errno));
+        unlink(tmpPath);
+        return T2ERROR_FAILURE;
+    }
+    syncSpoolDirectory();
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Count the intact records of the spool file. Damaged data between records, such as
+ * a record torn by a crash, is skipped up to the next intact record and dropped from
+ * the file; anything after the last record is cut off.
+ */
+static T2ERROR recoverReportSpool(ReportSpool *spool)
+{
+    unsigned char *data = NULL;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t end = 0;
+    size_t damaged = 0;
+    SpoolBuffer intact = { NULL, 0, 0 };
+    bool compact = false;
+    SpoolRecord record;
+    T2ERROR ret = T2ERROR_SUCCESS;
+
+    spool->recovered = false;
+    spool->recordCount = 0;
+    spool->size = 0;
+    if(readSpoolFile(spool->path, &data, &size) != T2ERROR_SUCCESS)
+    {
+        T2Error("Unable to read report spool %s\n", spool->path);
+        return T2ERROR_FAILURE;
+    }
+    while((offset = findSpoolRecord(data, size, offset, &record)) < size)
+    {
+        if(offset > end)
+        {
+            // Records behind damaged data are moved up in a copy of the intact ones
+            if(!compact && !appendSpoolBuffer(&intact, data, end))
+                ret = T2ERROR_FAILURE;
+            compact = true;
+            damaged += offset - end;
+        }
+        if(compact && !appendSpoolBuffer(&intact, data + offset, record.length))
+            ret = T2ERROR_FAILURE;
+        spool->recordCount++;
+        if(record.sequence >= spool->nextSequence)
+            spool->nextSequence = record.sequence + 1;
+        offset += record.length;
+        end = offset;
+    }
+    damaged += size - end;
+
+    if(ret != T2ERROR_SUCCESS)
+    {
+        T2Error("Unable to recover report spool %s\n", spool->path);
+    }
+    else if(compact)
+    {
+        T2Warning("Dropping %zu bytes of damaged records from %s\n", damaged, spool->path);
+        ret = rewriteSpoolFile(spool, intact.data, intact.length);
+        end = intact.length;
+    }
+    else if(end < size)
+    {
+        T2Warning("Dropping %zu bytes of incomplete records from %s\n", size - end, spool->path);
+        if(truncate(spool->path, end) == 0)
+        {
+            int fd = open(spool->path, O_WRONLY);
+            if(fd != -1)
+            {
+                fsync(fd);
+                close(fd);
+            }
+        }
+        else
+        {
+            ret = rewriteSpoolFile(spool, data, end);
+        }
+    }
+    if(ret == T2ERROR_SUCCESS)
+    {
+        spool->size = end;
+        spool->recovered = true;
+        if(spool->recordCount > 0)
+            T2Info("%u reports spooled for %s\n", spool->recordCount, spool->destination);
+    }
+    else
+    {
+        spool->recordCount = 0;
+    }
+    free(intact.data);
+    free(data);
+    return ret;
+}
+
+static void freeReportSpool(void *data)
+{
+    if(data != NULL)
+    {
+        ReportSpool *spool = (ReportSpool *) data;
+        pthread_mutex_destroy(&spool->lock);
+        free(spool->destination);
+        free(spool->path);
+        free(spool);
+    }
+}
+
+ReportSpool* getReportSpool(const char *httpUrl)
+{
+    ReportSpool *spool = NULL;
+    char *destination = NULL;
+    char fileName[REPORT_SPOOL_PATH_SIZE];
+    size_t index;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(httpUrl == NULL || (destination = getHTTPDestination(httpUrl)) == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&spoolListMutex);
+    if(spoolList == NULL)
+        Vector_Create(&spoolList);
+    for(index = 0; index < Vector_Size(spoolList); index++)
+    {
+        ReportSpool *tempSpool = (ReportSpool *) Vector_At(spoolList, index);
+        if(strcmp(tempSpool->destination, destination) == 0)
+        {
+            spool = tempSpool;
+            break;
+        }
+    }
+    if(spool == NULL && (spool = (ReportSpool *) calloc(1, sizeof(ReportSpool))) != NULL)
+    {
+        // One file per destination, named after it with everything but letters and digits replaced
+        snprintf(fileName, sizeof(fileName), "%s%s.spool", REPORT_SPOOL_PATH, destination);
+        for(index = strlen(REPORT_SPOOL_PATH); fileName[index] != '\0' && strcmp(fileName + index, ".spool") != 0; index++)
+        {
+            if(!((fileName[index] >= 'a' && fileName[index] <= 'z') || (fileName[index] >= 'A' && fileName[index] <= 'Z')
+                    || (fileName[index] >= '0' && fileName[index] <= '9')))
+                fileName[index] = '_';
+        }
+        if(mkdir(REPORT_SPOOL_PATH, 0700) != 0 && errno != EEXIST)
+            T2Error("Unable to create %s : %s\n", REPORT_SPOOL_PATH, strerror(errno));
+        spool->destination = destination;
+        destination = NULL;
+        spool->path = strdup(fileName);
+        spool->quota = REPORT_SPOOL_QUOTA;
+        spool->nextSequence = 1;
+        pthread_mutex_init(&spool->lock, NULL);
+        recoverReportSpool(spool);
+        Vector_PushBack(spoolList, spool);
+    }
+    pthread_mutex_unlock(&spoolListMutex);
+
+    free(destination);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return spool;
+}
+
+/**
+ * Append reports in one write followed by one fsync. When the batch does not fit
+ * the quota the spool is rewritten without its oldest records instead.
+ */
+T2ERROR appendReportSpool(ReportSpool *spool, const char *httpUrl, Vector *reports)
+{
+    SpoolBuffer batch = { NULL, 0, 0 };
+    unsigned int batchCount = 0;
+    T2ERROR ret = T2ERROR_FAILURE;
+    size_t index;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(spool == NULL || httpUrl == NULL || Vector_Size(reports) == 0)
+        return T2ERROR_INVALID_ARGS;
+
+    pthread_mutex_lock(&spool->lock);
+    // The size of a spool that could not be read is unknown, appending could cut off or bury its records
+    if(!spool->recovered && recoverReportSpool(spool) != T2ERROR_SUCCESS)
+    {
+        T2Error("Report spool of %s is not usable, %zu reports not spooled\n", spool->destination, Vector_Size(reports));
+        pthread_mutex_unlock(&spool->lock);
+        return T2ERROR_FAILURE;
+    }
+    for(index = 0; index < Vector_Size(reports); index++)
+    {
+        if(encodeSpoolRecord(&batch, spool->nextSequence, httpUrl, (HTTPReport *) Vector_At(reports, index)))
+        {
+            spool->nextSequence++;
+            batchCount++;
+        }
+        else
+        {
+            T2Error("Unable to spool report for %s\n", spool->destination);
+        }
+    }
+
+    if(batchCount == 0)
+    {
+        ret = T2ERROR_FAILURE;
+    }
+    else if(spool->size + batch.length <= spool->quota)
+    {
+        int fd = open(spool->path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if(fd == -1)
+        {
+            T2Error("Unable to open %s : %s\n", spool->path, strerror(errno));
+        }
+        else
+        {
+            if(writeAll(fd, batch.data, batch.length) && fsync(fd) == 0)
+            {
+                spool->size += batch.length;
+                spool->recordCount += batchCount;
+                ret = T2ERROR_SUCCESS;
+            }
+            else
+            {
+                T2Error("Unable to append to %s : %s\n", spool->path, strerror(errno));
+                // Do not leave a partial record in front of later appends
+                if(ftruncate(fd, spool->size) == 0)
+                    fsync(fd);
+            }
+            close(fd);
+            if(ret == T2ERROR_SUCCESS && spool->size == batch.length)
+                syncSpoolDirectory();
+        }
+    }
+    else
+    {
+        unsigned char *data = NULL;
+        size_t size = 0;
+        size_t offset = 0;
+        size_t excess = 0;
+        unsigned int dropped = 0;
+        unsigned int kept = 0;
+        SpoolBuffer spoolData = { NULL, 0, 0 };
+        SpoolRecord record;
+
+        // The old spool is kept unless all of it and the batch made it into the rewrite
+        if(readSpoolFile(spool->path, &data, &size) != T2ERROR_SUCCESS
+                || !appendSpoolBuffer(&spoolData, data, spool->size <= size ? spool->size : size)
+                || !appendSpoolBuffer(&spoolData, batch.data, batch.length))
+        {
+            T2Error("Unable to rewrite report spool of %s, %u reports not spooled\n", spool->destination, batchCount);
+        }
+        else
+        {
+            if(spoolData.length > spool->quota)
+                excess = spoolData.length - spool->quota;
+            while(parseSpoolRecord(spoolData.data, spoolData.length, offset, &record) && offset < excess)
+            {
+                offset += record.length;
+                dropped++;
+            }
+            for(size = offset; parseSpoolRecord(spoolData.data, spoolData.length, size, &record); size += record.length)
+                kept++;
+            T2Warning("Report spool of %s over its quota of %zu bytes, dropping %u oldest reports\n", spool->destination, spool->quota, dropped);
+            if(rewriteSpoolFile(spool, spoolData.data + offset, size - offset) == T2ERROR_SUCCESS)
+            {
+                spool->size = size - offset;
+                spool->recordCount = kept;
+                ret = T2ERROR_SUCCESS;
+            }
+        }
+        free(data);
+        free(spoolData.data);
+    }
+    if(ret == T2ERROR_SUCCESS)
+        T2Info("Report spooled, No. of reports spooled for %s = %u\n", spool->destination, spool->recordCount);
+    pthread_mutex_unlock(&spool->lock);
+
+    free(batch.data);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
+/**
+ * Load the spooled reports oldest first. Only one replay runs per spool, the
+ * records stay in the spool until finishReportSpoolReplay removes the
+ * acknowledged ones.
+ */
+T2ERROR loadReportSpool(ReportSpool *spool, Vector *spooledReports)
+{
+    unsigned char *data = NULL;
+    size_t size = 0;
+    size_t offset = 0;
+    SpoolRecord record;
+    T2ERROR ret = T2ERROR_FAILURE;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(spool == NULL || spooledReports == NULL)
+        return T2ERROR_INVALID_ARGS;
+
+    pthread_mutex_lock(&spool->lock);
+    if(spool->replayInProgress || spool->recordCount == 0)
+    {
+        pthread_mutex_unlock(&spool->lock);
+        return T2ERROR_FAILURE;
+    }
+    if(readSpoolFile(spool->path, &data, &size) == T2ERROR_SUCCESS)
+    {
+        while(parseSpoolRecord(data, size, offset, &record))
+        {
+            SpooledReport *spooled = (SpooledReport *) calloc(1, sizeof(SpooledReport));
+            if(spooled)
+            {
+                spooled->sequence = record.sequence;
+                spooled->url = strndup(record.url, record.urlLength);
+                spooled->report = decodeSpoolRecord(&record);
+            }
+            if(spooled && spooled->url && spooled->report)
+            {
+                spooled->upload = spooled->report;
+                Vector_PushBack(spooledReports, spooled);
+            }
+            else
+            {
+                // Left in the spool, dropped with the rest of it once the quota is reached
+                T2Error("Unable to load spooled report %llu of %s\n", (unsigned long long) record.sequence, spool->destination);
+                freeSpooledReport(spooled);
+            }
+            offset += record.length;
+        }
+        free(data);
+    }
+    if(Vector_Size(spooledReports) > 0)
+    {
+        spool->replayInProgress = true;
+        ret = T2ERROR_SUCCESS;
+    }
+    pthread_mutex_unlock(&spool->lock);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
+static bool isSpoolRecordAcknowledged(Vector *spooledReports, uint64_t sequence)
+{
+    size_t index;
+    for(index = 0; index < Vector_Size(spooledReports); index++)
+    {
+        SpooledReport *spooled = (SpooledReport *) Vector_At(spooledReports, index);
+        if(spooled->sequence == sequence)
+            return spooled->acknowledged;
+    }
+    return false;
+}
+
+/**
+ * Remove the acknowledged records of a replay from the spool.
+ */
+T2ERROR finishReportSpoolReplay(ReportSpool *spool, Vector *spooledReports)
+{
+    unsigned char *data = NULL;
+    size_t size = 0;
+    size_t offset = 0;
+    SpoolBuffer remaining = { NULL, 0, 0 };
+    unsigned int removed = 0;
+    unsigned int kept = 0;
+    SpoolRecord record;
+    T2ERROR ret = T2ERROR_SUCCESS;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(spool == NULL)
+        return T2ERROR_INVALID_ARGS;
+
+    pthread_mutex_lock(&spool->lock);
+    spool->replayInProgress = false;
+    if(readSpoolFile(spool->path, &data, &size) != T2ERROR_SUCCESS)
+    {
+        pthread_mutex_unlock(&spool->lock);
+        return T2ERROR_FAILURE;
+    }
+    while(parseSpoolRecord(data, size, offset, &record))
+    {
+        if(isSpoolRecordAcknowledged(spooledReports, record.sequence))
+        {
+            removed++;
+        }
+        else if(appendSpoolBuffer(&remaining, data + offset, record.length))
+        {
+            kept++;
+        }
+        offset += record.length;
+    }
+    if(removed > 0)
+    {
+        spool->replayCount++;
+        ret = rewriteSpoolFile(spool, remaining.data, remaining.length);
+        if(ret == T2ERROR_SUCCESS)
+        {
+            spool->size = remaining.length;
+            spool->recordCount = kept;
+        }
+        T2Info("Removed %u sent reports from spool of %s, %u left\n", removed, spool->destination, spool->recordCount);
+    }
+    pthread_mutex_unlock(&spool->lock);
+
+    free(remaining.data);
+    free(data);
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
+}
+
+unsigned int getReportSpoolCount(ReportSpool *spool)
+{
+    unsigned int count = 0;
+    if(spool)
+    {
+        pthread_mutex_lock(&spool->lock);
+        count = spool->recordCount;
+        pthread_mutex_unlock(&spool->lock);
+    }
+    return count;
+}
+
+unsigned int getReportSpoolReplayCount(ReportSpool *spool)
+{
+    unsigned int count = 0;
+    if(spool)
+    {
+        pthread_mutex_lock(&spool->lock);
+        count = spool->replayCount;
+        pthread_mutex_unlock(&spool->lock);
+    }
+    return count;
+}
+
+void freeSpooledReport(void *data)
+{
+    if(data != NULL)
+    {
+        SpooledReport *spooled = (SpooledReport *) data;
+        free(spooled->url);
+        freeHTTPReport(spooled->report);
+        free(spooled);
+    }
+}
+
+void uninitReportSpools()
+{
+    T2Debug("%s ++in\n", __FUNCTION__);
+    pthread_mutex_lock(&spoolListMutex);
+    if(spoolList)
+    {
+        Vector_Destroy(spoolList, freeReportSpool);
+        spoolList = NULL;
+    }
+    pthread_mutex_unlock(&spoolListMutex);
+    T2Debug("%s --out\n", __FUNCTION__);
+}
@@ -0,0 +1,101 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+#ifndef _REPORTSPOOL_H_
+#define _REPORTSPOOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "telemetry2_0.h"
+#include "vector.h"
+#include "curlinterface.h"
+
+#if defined(ENABLE_RDKB_SUPPORT)
+#define REPORT_SPOOL_PATH "/nvram/.t2reportspool/"
+#else
+#define REPORT_SPOOL_PATH "/opt/.t2reportspool/"
+#endif
+
+#define REPORT_SPOOL_PATH_SIZE 256
+
+/* Bytes a destination's spool file may grow to, the oldest records are dropped beyond it */
+#ifndef REPORT_SPOOL_QUOTA
+#define REPORT_SPOOL_QUOTA (256 * 1024)
+#endif
+
+/* Records of reports not already content encoded are deflated when that makes them smaller */
+#ifndef REPORT_SPOOL_COMPRESSION
+#define REPORT_SPOOL_COMPRESSION 1
+#endif
+
+/**
+ * Append-only file of reports that could not be uploaded to one destination,
+ * kept across reboots. Each record carries its length, target URL and a CRC;
+ * records damaged by a crash are dropped from the file when it is opened.
+ */
+typedef struct _ReportSpool
+{
+    char *destination;
+    char *path;
+    size_t quota;
+    size_t size;
+    unsigned int recordCount;
+    uint64_t nextSequence;
+    // The file was read and size matches it, appends wait for a successful recovery
+    bool recovered;
+    // Records handed out by loadReportSpool and not yet settled
+    bool replayInProgress;
+    // Replays that delivered records, older values may have reached the server since
+    unsigned int replayCount;
+    pthread_mutex_t lock;
+}ReportSpool;
+
+/**
+ * A record loaded for replay, acknowledged once its upload succeeded. upload is
+ * the report the record is sent in, the record's own or a batch it was packed into.
+ */
+typedef struct _SpooledReport
+{
+    uint64_t sequence;
+    char *url;
+    HTTPReport *report;
+    HTTPReport *upload;
+    bool acknowledged;
+}SpooledReport;
+
+ReportSpool* getReportSpool(const char *httpUrl);
+
+T2ERROR appendReportSpool(ReportSpool *spool, const char *httpUrl, Vector *reports);
+
+T2ERROR loadReportSpool(ReportSpool *spool, Vector *spooledReports);
+
+T2ERROR finishReportSpoolReplay(ReportSpool *spool, Vector *spooledReports);
+
+unsigned int getReportSpoolCount(ReportSpool *spool);
+
+unsigned int getReportSpoolReplayCount(ReportSpool *spool);
+
+void freeSpooledReport(void *data);
+
+void uninitReportSpools();
+
+#endif /* _REPORTSPOOL_H_ */
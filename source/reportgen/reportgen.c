@@ -20,7 +20,6 @@
 #include <time.h>
 #include <stdlib.h>
 #include <string.h>
-#include <curl/curl.h>
 
 #include "reportgen.h"
 #include "t2log_wrapper.h"
@@ -58,128 +57,1429 @@ void getTimeStamp (char** timeStamp) {
 
 }
 
-T2ERROR destroyJSONReport(cJSON *jsonObj)
+static bool reserveJSONReport(JSONReportWriter *writer, size_t len)
 {
-    cJSON_Delete(jsonObj);
+    size_t required = writer->length + len + 1;
+    size_t capacity = writer->capacity;
+    char *buffer = NULL;
+
+    if(writer->failed)
+        return false;
+    if(required <= capacity)
+        return true;
+    while(capacity < required)
+        capacity *= 2;
+    buffer = (char *) realloc(writer->buffer, capacity);
+    if(buffer == NULL)
+    {
+        T2Error("Unable to grow report buffer to %zu bytes\n", capacity);
+        writer->failed = true;
+        return false;
+    }
+    writer->buffer = buffer;
+    writer->capacity = capacity;
+    return true;
+}
+
+static void appendJSONRaw(JSONReportWriter *writer, const char *data, size_t len)
+{
+    if(!reserveJSONReport(writer, len))
+        return;
+    memcpy(writer->buffer + writer->length, data, len);
+    writer->length += len;
+    writer->buffer[writer->length] = '\0';
+}
+
+/**
+ * Append a quoted string with the same escaping as cJSON_PrintUnformatted.
+ * Runs of characters that need no escaping are copied in one go.
+ */
+static void appendJSONString(JSONReportWriter *writer, const char *value)
+{
+    const unsigned char *run = (const unsigned char *) value;
+    const unsigned char *ptr = run;
+    char escaped[8] = {'\0'};
+
+    appendJSONRaw(writer, "\"", 1);
+    for(; *ptr; ptr++)
+    {
+        if(*ptr >= 0x20 && *ptr != '"' && *ptr != '\\')
+            continue;
+        appendJSONRaw(writer, (const char *) run, ptr - run);
+        switch(*ptr)
+        {
+            case '"': appendJSONRaw(writer, "\\\"", 2); break;
+            case '\\': appendJSONRaw(writer, "\\\\", 2); break;
+            case '\b': appendJSONRaw(writer, "\\b", 2); break;
+            case '\f': appendJSONRaw(writer, "\\f", 2); break;
+            case '\n': appendJSONRaw(writer, "\\n", 2); break;
+            case '\r': appendJSONRaw(writer, "\\r", 2); break;
+            case '\t': appendJSONRaw(writer, "\\t", 2); break;
+            default:
+                snprintf(escaped, sizeof(escaped), "\\u%04x", *ptr);
+                appendJSONRaw(writer, escaped, 6);
+                break;
+        }
+        run = ptr + 1;
+    }
+    appendJSONRaw(writer, (const char *) run, ptr - run);
+    appendJSONRaw(writer, "\"", 1);
+}
+
+static bool addReportItemOffset(size_t **itemOffsets, unsigned int itemCount, unsigned int *itemCapacity, size_t offset)
+{
+    if(itemCount == *itemCapacity)
+    {
+        unsigned int capacity = *itemCapacity ? *itemCapacity * 2 : 32;
+        size_t *offsets = (size_t *) realloc(*itemOffsets, capacity * sizeof(size_t));
+        if(offsets == NULL)
+        {
+            T2Error("Unable to grow report item offsets to %u entries\n", capacity);
+            return false;
+        }
+        *itemOffsets = offsets;
+        *itemCapacity = capacity;
+    }
+    (*itemOffsets)[itemCount] = offset;
+    return true;
+}
+
+/**
+ * Enter one more nesting level, growing the per-level comma state when needed.
+ */
+static bool pushJSONReportDepth(JSONReportWriter *writer)
+{
+    if(writer->failed)
+        return false;
+    if(writer->depth + 1 >= writer->depthCapacity)
+    {
+        unsigned int capacity = writer->depthCapacity ? writer->depthCapacity * 2 : JSON_REPORT_DEPTH_HINT;
+        bool *needComma = (bool *) realloc(writer->needComma, capacity * sizeof(bool));
+        if(needComma == NULL)
+        {
+            T2Error("Unable to grow report nesting to %u levels\n", capacity);
+            writer->failed = true;
+            return false;
+        }
+        writer->needComma = needComma;
+        writer->depthCapacity = capacity;
+    }
+    writer->depth++;
+    writer->needComma[writer->depth] = false;
+    return true;
+}
+
+// Remember where a top-level item starts, including its separating comma
+static void recordJSONReportItem(JSONReportWriter *writer)
+{
+    if(writer->depth != 1 || writer->failed)
+        return;
+    if(!addReportItemOffset(&writer->itemOffsets, writer->itemCount, &writer->itemCapacity, writer->length))
+        writer->failed = true;
+    else
+        writer->itemCount++;
+}
+
+static void beginJSONReportItemNamed(JSONReportWriter *writer, const JSONReportFragment *name)
+{
+    recordJSONReportItem(writer);
+    if(writer->needComma[writer->depth])
+        appendJSONRaw(writer, ",", 1);
+    writer->needComma[writer->depth] = true;
+    appendJSONRaw(writer, "{", 1);
+    appendJSONRaw(writer, name->data, name->length);
+    appendJSONRaw(writer, ":", 1);
+}
+
+static void beginJSONReportItem(JSONReportWriter *writer, const char *name)
+{
+    recordJSONReportItem(writer);
+    if(writer->needComma[writer->depth])
+        appendJSONRaw(writer, ",", 1);
+    writer->needComma[writer->depth] = true;
+    appendJSONRaw(writer, "{", 1);
+    appendJSONString(writer, name);
+    appendJSONRaw(writer, ":", 1);
+}
+
+static void addJSONReportNamedString(JSONReportWriter *writer, const JSONReportFragment *name, const char *value)
+{
+    beginJSONReportItemNamed(writer, name);
+    appendJSONString(writer, value ? value : "NULL");
+    appendJSONRaw(writer, "}", 1);
+}
+
+static void beginJSONReportNamedList(JSONReportWriter *writer, const JSONReportFragment *name)
+{
+    beginJSONReportItemNamed(writer, name);
+    appendJSONRaw(writer, "[", 1);
+    pushJSONReportDepth(writer);
+}
+
+// Writer without an enclosing root, used to pre-serialize template fragments
+static T2ERROR initJSONScratch(JSONReportWriter *writer, size_t capacity)
+{
+    memset(writer, 0, sizeof(JSONReportWriter));
+    writer->capacity = capacity;
+    writer->buffer = (char *) malloc(writer->capacity);
+    writer->depthCapacity = JSON_REPORT_DEPTH_HINT;
+    writer->needComma = (bool *) calloc(writer->depthCapacity, sizeof(bool));
+    if(writer->buffer == NULL || writer->needComma == NULL)
+    {
+        free(writer->buffer);
+        free(writer->needComma);
+        return T2ERROR_FAILURE;
+    }
+    writer->buffer[0] = '\0';
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Serialize str as a quoted JSON string into a standalone fragment.
+ */
+static T2ERROR compileJSONFragment(JSONReportFragment *fragment, const char *str)
+{
+    JSONReportWriter scratch;
+
+    if(T2ERROR_SUCCESS != initJSONScratch(&scratch, strlen(str) + 3))
+        return T2ERROR_FAILURE;
+    appendJSONString(&scratch, str);
+    free(scratch.needComma);
+    if(scratch.failed)
+    {
+        free(scratch.buffer);
+        return T2ERROR_FAILURE;
+    }
+    fragment->data = scratch.buffer;
+    fragment->length = scratch.length;
+    return T2ERROR_SUCCESS;
+}
+
+size_t estimateJSONReportSize(Vector *staticParamList, Vector *paramList, Vector *gMarkerList, Vector *eMarkerList)
+{
+    // {"":""}, per item
+    const size_t itemOverhead = 8;
+    size_t size = JSON_REPORT_MIN_SIZE;
+    int index = 0;
+
+    for(index = 0; staticParamList && index < Vector_Size(staticParamList); index++)
+    {
+        StaticParam *sparam = (StaticParam *) Vector_At(staticParamList, index);
+        if(sparam->name && sparam->value)
+            size += strlen(sparam->name) + strlen(sparam->value) + itemOverhead;
+    }
+    for(index = 0; paramList && index < Vector_Size(paramList); index++)
+    {
+        Param *param = (Param *) Vector_At(paramList, index);
+        if(param->name)
+            size += strlen(param->name) + JSON_REPORT_VALUE_ESTIMATE + itemOverhead;
+    }
+    for(index = 0; gMarkerList && index < Vector_Size(gMarkerList); index++)
+    {
+        GrepMarker *gMarker = (GrepMarker *) Vector_At(gMarkerList, index);
+        if(gMarker->markerName)
+            size += strlen(gMarker->markerName) + JSON_REPORT_VALUE_ESTIMATE + itemOverhead;
+    }
+    for(index = 0; eMarkerList && index < Vector_Size(eMarkerList); index++)
+    {
+        EventMarker *eMarker = (EventMarker *) Vector_At(eMarkerList, index);
+        const char *name = eMarker->alias ? eMarker->alias : eMarker->markerName;
+        if(name)
+            size += strlen(name) + JSON_REPORT_VALUE_ESTIMATE + itemOverhead;
+    }
+    return size;
+}
+
+T2ERROR initJSONReport(JSONReportWriter **writer, const char *rootName, size_t sizeHint)
+{
+    JSONReportWriter *jsonWriter = (JSONReportWriter *) malloc(sizeof(JSONReportWriter));
+    if(jsonWriter == NULL)
+    {
+        T2Error("Failed to allocate report writer\n");
+        return T2ERROR_FAILURE;
+    }
+    memset(jsonWriter, 0, sizeof(JSONReportWriter));
+    jsonWriter->capacity = sizeHint > JSON_REPORT_MIN_SIZE ? sizeHint : JSON_REPORT_MIN_SIZE;
+    jsonWriter->buffer = (char *) malloc(jsonWriter->capacity);
+    jsonWriter->depthCapacity = JSON_REPORT_DEPTH_HINT;
+    jsonWriter->needComma = (bool *) calloc(jsonWriter->depthCapacity, sizeof(bool));
+    if(jsonWriter->buffer == NULL || jsonWriter->needComma == NULL)
+    {
+        T2Error("Failed to allocate %zu bytes for report\n", jsonWriter->capacity);
+        free(jsonWriter->buffer);
+        free(jsonWriter->needComma);
+        free(jsonWriter);
+        return T2ERROR_FAILURE;
+    }
+    jsonWriter->buffer[0] = '\0';
+
+    appendJSONRaw(jsonWriter, "{", 1);
+    appendJSONString(jsonWriter, rootName);
+    appendJSONRaw(jsonWriter, ":[", 2);
+    jsonWriter->depth = 1;
+    jsonWriter->rootLength = jsonWriter->length;
+    *writer = jsonWriter;
+    return T2ERROR_SUCCESS;
+}
+
+static void freeJSONReportNode(void *data)
+{
+    JSONReportNode *node = (JSONReportNode *) data;
+    if(node == NULL)
+        return;
+    free(node->segment);
+    free(node->key.data);
+    free(node->staticValue.data);
+    free(node->value);
+    if(node->children)
+        Vector_Destroy(node->children, freeJSONReportNode);
+    free(node);
+}
+
+static JSONReportNode* createJSONReportNode(const char *segment, size_t length, bool transient)
+{
+    JSONReportNode *node = (JSONReportNode *) malloc(sizeof(JSONReportNode));
+    if(node == NULL)
+        return NULL;
+    memset(node, 0, sizeof(JSONReportNode));
+    node->transient = transient;
+    node->segment = strndup(segment, length);
+    if(node->segment == NULL || T2ERROR_SUCCESS != compileJSONFragment(&node->key, node->segment)
+            || T2ERROR_SUCCESS != Vector_Create(&node->children))
+    {
+        freeJSONReportNode(node);
+        return NULL;
+    }
+    return node;
+}
+
+static JSONReportNode* findJSONReportChild(Vector *children, const char *segment, size_t length)
+{
+    int index = 0;
+    for(index = 0; index < Vector_Size(children); index++)
+    {
+        JSONReportNode *candidate = (JSONReportNode *) Vector_At(children, index);
+        if(strncmp(candidate->segment, segment, length) == 0 && candidate->segment[length] == '\0')
+            return candidate;
+    }
+    return NULL;
+}
+
+/**
+ * Return the compiled node for a dotted path, creating missing nodes on the way.
+ * Empty segments, e.g. of a trailing '.', are skipped.
+ */
+static JSONReportNode* compileJSONReportPath(JSONReportTemplate *reportTemplate, const char *path)
+{
+    JSONReportNode *root = reportTemplate->hierarchy;
+    JSONReportNode *node = root;
+    const char *segment = path;
+
+    while(*segment)
+    {
+        const char *end = strchr(segment, '.');
+        size_t length = end ? (size_t)(end - segment) : strlen(segment);
+
+        if(length > 0)
+        {
+            JSONReportNode *child = findJSONReportChild(node->children, segment, length);
+            if(child == NULL)
+            {
+                child = createJSONReportNode(segment, length, false);
+                if(child == NULL)
+                    return NULL;
+                child->index = reportTemplate->nodeCount++;
+                Vector_PushBack(node->children, child);
+            }
+            node = child;
+        }
+        if(end == NULL)
+            break;
+        segment = end + 1;
+    }
+    return node == root ? NULL : node;
+}
+
+static Vector* getJSONReportNodeExtras(const JSONReportWriter *writer, const JSONReportNode *node)
+{
+    if(node->transient || writer->nodeExtras == NULL)
+        return NULL;
+    return writer->nodeExtras[node->index];
+}
+
+/**
+ * Return the node of this report for a dotted path. Compiled nodes are reused,
+ * segments the template does not know are added as transient nodes of the writer.
+ */
+static JSONReportNode* insertJSONReportPath(JSONReportWriter *writer, const char *path)
+{
+    JSONReportNode *root = writer->reportTemplate->hierarchy;
+    JSONReportNode *node = root;
+    const char *segment = path;
+
+    while(*segment)
+    {
+        const char *end = strchr(segment, '.');
+        size_t length = end ? (size_t)(end - segment) : strlen(segment);
+
+        if(length > 0)
+        {
+            JSONReportNode *child = NULL;
+            Vector **extras = NULL;
+
+            child = findJSONReportChild(node->children, segment, length);
+            if(child == NULL && !node->transient)
+            {
+                extras = &writer->nodeExtras[node->index];
+                child = findJSONReportChild(*extras, segment, length);
+            }
+            if(child == NULL)
+            {
+                child = createJSONReportNode(segment, length, true);
+                if(child == NULL)
+                    return NULL;
+                if(extras && *extras == NULL && T2ERROR_SUCCESS != Vector_Create(extras))
+                {
+                    freeJSONReportNode(child);
+                    return NULL;
+                }
+                Vector_PushBack(extras ? *extras : node->children, child);
+            }
+            node = child;
+        }
+        if(end == NULL)
+            break;
+        segment = end + 1;
+    }
+    return node == root ? NULL : node;
+}
+
+static const char* getJSONReportNodeValue(const JSONReportWriter *writer, const JSONReportNode *node)
+{
+    if(node->transient)
+        return node->value;
+    return writer->nodeValues ? writer->nodeValues[node->index] : NULL;
+}
+
+static void setJSONReportNodeValue(JSONReportWriter *writer, const JSONReportNode *node, const char *value)
+{
+    char **slot = NULL;
+    if(node == NULL)
+        return;
+    slot = node->transient ? &((JSONReportNode *) node)->value : &writer->nodeValues[node->index];
+    if(*slot)
+        free(*slot);
+    *slot = strdup(value ? value : "NULL");
+}
+
+static void setJSONReportPathValue(JSONReportWriter *writer, const char *path, const char *value)
+{
+    JSONReportNode *node = NULL;
+    if(path == NULL)
+        return;
+    node = insertJSONReportPath(writer, path);
+    if(node == NULL)
+    {
+        T2Error("Unable to add %s to report hierarchy\n", path);
+        return;
+    }
+    setJSONReportNodeValue(writer, node, value);
+}
+
+static bool writeJSONReportNode(JSONReportWriter *writer, const JSONReportNode *node);
+
+/**
+ * Write one child that carries a value somewhere below it. An object is opened
+ * speculatively and rolled back when its subtree turns out to be empty. A node
+ * that has a value and children keeps its own value under the empty key.
+ */
+static bool writeJSONReportChild(JSONReportWriter *writer, const JSONReportNode *child)
+{
+    const char *value = getJSONReportNodeValue(writer, child);
+    bool hasValue = (value != NULL || child->staticValue.data != NULL);
+    bool hasChildren = (Vector_Size(child->children) > 0 || Vector_Size(getJSONReportNodeExtras(writer, child)) > 0);
+    size_t rollback = writer->length;
+    bool needComma = writer->needComma[writer->depth];
+
+    if(!hasChildren && !hasValue)
+        return false;
+
+    if(writer->needComma[writer->depth])
+        appendJSONRaw(writer, ",", 1);
+    writer->needComma[writer->depth] = true;
+    appendJSONRaw(writer, child->key.data, child->key.length);
+    appendJSONRaw(writer, ":", 1);
+
+    if(!hasChildren)
+    {
+        if(value)
+            appendJSONString(writer, value);
+        else
+            appendJSONRaw(writer, child->staticValue.data, child->staticValue.length);
+        return true;
+    }
+
+    appendJSONRaw(writer, "{", 1);
+    if(!pushJSONReportDepth(writer))
+        return false;
+    if(hasValue)
+    {
+        appendJSONRaw(writer, "\"\":", 3);
+        if(value)
+            appendJSONString(writer, value);
+        else
+            appendJSONRaw(writer, child->staticValue.data, child->staticValue.length);
+        writer->needComma[writer->depth] = true;
+    }
+    if(!writeJSONReportNode(writer, child) && !hasValue)
+    {
+        writer->depth--;
+        writer->length = rollback;
+        if(writer->buffer)
+            writer->buffer[rollback] = '\0';
+        writer->needComma[writer->depth] = needComma;
+        return false;
+    }
+    writer->depth--;
+    appendJSONRaw(writer, "}", 1);
+    return true;
+}
+
+/**
+ * Write the compiled children of node followed by the ones this report added.
+ */
+static bool writeJSONReportNode(JSONReportWriter *writer, const JSONReportNode *node)
+{
+    Vector *extras = getJSONReportNodeExtras(writer, node);
+    bool written = false;
+    int index = 0;
+
+    for(index = 0; index < Vector_Size(node->children) && !writer->failed; index++)
+    {
+        if(writeJSONReportChild(writer, (JSONReportNode *) Vector_At(node->children, index)))
+            written = true;
+    }
+    for(index = 0; index < Vector_Size(extras) && !writer->failed; index++)
+    {
+        if(writeJSONReportChild(writer, (JSONReportNode *) Vector_At(extras, index)))
+            written = true;
+    }
+    return written;
+}
+
+static void freeJSONReportValues(JSONReportWriter *writer)
+{
+    unsigned int index = 0;
+    unsigned int nodeCount = writer->reportTemplate ? writer->reportTemplate->nodeCount : 0;
+
+    for(index = 0; index < nodeCount; index++)
+    {
+        if(writer->nodeValues)
+            free(writer->nodeValues[index]);
+        if(writer->nodeExtras && writer->nodeExtras[index])
+            Vector_Destroy(writer->nodeExtras[index], freeJSONReportNode);
+    }
+    free(writer->nodeValues);
+    free(writer->nodeExtras);
+    writer->nodeValues = NULL;
+    writer->nodeExtras = NULL;
+}
+
+static JSONReportNode* getJSONReportHierarchy(JSONReportWriter *writer)
+{
+    return writer->reportTemplate ? writer->reportTemplate->hierarchy : NULL;
+}
+
+static T2ERROR compileJSONReportHierarchy(JSONReportTemplate *reportTemplate, Vector *staticParamList, Vector *paramList, Vector *eMarkerList)
+{
+    int index = 0;
+
+    reportTemplate->hierarchy = (JSONReportNode *) malloc(sizeof(JSONReportNode));
+    if(reportTemplate->hierarchy == NULL)
+        return T2ERROR_FAILURE;
+    memset(reportTemplate->hierarchy, 0, sizeof(JSONReportNode));
+    reportTemplate->hierarchy->index = reportTemplate->nodeCount++;
+    if(T2ERROR_SUCCESS != Vector_Create(&reportTemplate->hierarchy->children))
+        return T2ERROR_FAILURE;
+
+    for(index = 0; index < Vector_Size(staticParamList); index++)
+    {
+        StaticParam *sparam = (StaticParam *) Vector_At(staticParamList, index);
+        JSONReportNode *node = NULL;
+        if(sparam->name == NULL || sparam->value == NULL)
+            continue;
+        node = compileJSONReportPath(reportTemplate, sparam->name);
+        if(node == NULL)
+            return T2ERROR_FAILURE;
+        free(node->staticValue.data);
+        if(T2ERROR_SUCCESS != compileJSONFragment(&node->staticValue, sparam->value))
+            return T2ERROR_FAILURE;
+    }
+
+    if(reportTemplate->paramCount > 0)
+    {
+        reportTemplate->paramNodes = (JSONReportNode **) calloc(reportTemplate->paramCount, sizeof(JSONReportNode *));
+        if(reportTemplate->paramNodes == NULL)
+            return T2ERROR_FAILURE;
+        for(index = 0; index < reportTemplate->paramCount; index++)
+        {
+            Param *param = (Param *) Vector_At(paramList, index);
+            if(param->name && (reportTemplate->paramNodes[index] = compileJSONReportPath(reportTemplate, param->name)) == NULL)
+                return T2ERROR_FAILURE;
+        }
+    }
+
+    if(reportTemplate->eventCount > 0)
+    {
+        reportTemplate->eventNodes = (JSONReportNode **) calloc(reportTemplate->eventCount, sizeof(JSONReportNode *));
+        if(reportTemplate->eventNodes == NULL)
+            return T2ERROR_FAILURE;
+        for(index = 0; index < reportTemplate->eventCount; index++)
+        {
+            EventMarker *eventMarker = (EventMarker *) Vector_At(eMarkerList, index);
+            const char *name = eventMarker->alias ? eventMarker->alias : eventMarker->markerName;
+            if(name && (reportTemplate->eventNodes[index] = compileJSONReportPath(reportTemplate, name)) == NULL)
+                return T2ERROR_FAILURE;
+        }
+    }
+    return T2ERROR_SUCCESS;
+}
+
+void freeJSONReportTemplate(JSONReportTemplate *reportTemplate)
+{
+    int index = 0;
+    if(reportTemplate == NULL)
+        return;
+    if(reportTemplate->staticItems.data)
+        free(reportTemplate->staticItems.data);
+    for(index = 0; reportTemplate->paramNames && index < reportTemplate->paramCount; index++)
+        free(reportTemplate->paramNames[index].data);
+    free(reportTemplate->paramNames);
+    for(index = 0; reportTemplate->eventNames && index < reportTemplate->eventCount; index++)
+        free(reportTemplate->eventNames[index].data);
+    free(reportTemplate->eventNames);
+    freeJSONReportNode(reportTemplate->hierarchy);
+    free(reportTemplate->paramNodes);
+    free(reportTemplate->eventNodes);
+    free(reportTemplate);
+}
+
+/**
+ * Pre-serialize the static parameters and the quoted names of parameters and event
+ * markers of a profile. For the object hierarchy format all names are compiled into
+ * a path trie instead. Lists must not change for the lifetime of the template,
+ * a profile update replaces the profile and with it the template.
+ */
+JSONReportTemplate* compileJSONReportTemplate(Vector *staticParamList, Vector *paramList, Vector *eMarkerList, bool objectHierarchy)
+{
+    JSONReportTemplate *reportTemplate = NULL;
+    int index = 0;
+    T2Debug("%s ++in \n", __FUNCTION__);
+
+    reportTemplate = (JSONReportTemplate *) malloc(sizeof(JSONReportTemplate));
+    if(reportTemplate == NULL)
+    {
+        T2Error("Unable to allocate memory for report template\n");
+        return NULL;
+    }
+    memset(reportTemplate, 0, sizeof(JSONReportTemplate));
+    reportTemplate->staticParamList = staticParamList;
+    reportTemplate->paramList = paramList;
+    reportTemplate->eMarkerList = eMarkerList;
+    reportTemplate->sizeHint = estimateJSONReportSize(staticParamList, paramList, NULL, eMarkerList);
+
+    if(Vector_Size(staticParamList) > 0)
+    {
+        JSONReportWriter scratch;
+        if(T2ERROR_SUCCESS != initJSONScratch(&scratch, reportTemplate->sizeHint))
+            goto error;
+        encodeStaticParamsInJSON(&scratch, staticParamList);
+        free(scratch.needComma);
+        if(scratch.failed)
+        {
+            free(scratch.buffer);
+            goto error;
+        }
+        reportTemplate->staticItems.data = scratch.buffer;
+        reportTemplate->staticItems.length = scratch.length;
+    }
+
+    reportTemplate->paramCount = Vector_Size(paramList);
+    if(reportTemplate->paramCount > 0)
+    {
+        reportTemplate->paramNames = (JSONReportFragment *) calloc(reportTemplate->paramCount, sizeof(JSONReportFragment));
+        if(reportTemplate->paramNames == NULL)
+            goto error;
+        for(index = 0; index < reportTemplate->paramCount; index++)
+        {
+            Param *param = (Param *) Vector_At(paramList, index);
+            if(param->name && T2ERROR_SUCCESS != compileJSONFragment(&reportTemplate->paramNames[index], param->name))
+                goto error;
+        }
+    }
+
+    reportTemplate->eventCount = Vector_Size(eMarkerList);
+    if(reportTemplate->eventCount > 0)
+    {
+        reportTemplate->eventNames = (JSONReportFragment *) calloc(reportTemplate->eventCount, sizeof(JSONReportFragment));
+        if(reportTemplate->eventNames == NULL)
+            goto error;
+        for(index = 0; index < reportTemplate->eventCount; index++)
+        {
+            EventMarker *eventMarker = (EventMarker *) Vector_At(eMarkerList, index);
+            const char *name = eventMarker->alias ? eventMarker->alias : eventMarker->markerName;
+            if(name && T2ERROR_SUCCESS != compileJSONFragment(&reportTemplate->eventNames[index], name))
+                goto error;
+        }
+    }
+
+    if(objectHierarchy && T2ERROR_SUCCESS != compileJSONReportHierarchy(reportTemplate, staticParamList, paramList, eMarkerList))
+        goto error;
+
+    T2Debug("%s --Out \n", __FUNCTION__);
+    return reportTemplate;
+
+error:
+    T2Error("Unable to compile report template\n");
+    freeJSONReportTemplate(reportTemplate);
+    return NULL;
+}
+
+T2ERROR initJSONReportFromTemplate(JSONReportWriter **writer, const char *rootName, const JSONReportTemplate *reportTemplate)
+{
+    if(T2ERROR_SUCCESS != initJSONReport(writer, rootName, reportTemplate ? reportTemplate->sizeHint : 0))
+        return T2ERROR_FAILURE;
+    (*writer)->reportTemplate = reportTemplate;
+    if(reportTemplate && reportTemplate->hierarchy)
+    {
+        // The template is shared by the reports of a profile, values live with the report
+        (*writer)->nodeValues = (char **) calloc(reportTemplate->nodeCount, sizeof(char *));
+        (*writer)->nodeExtras = (Vector **) calloc(reportTemplate->nodeCount, sizeof(Vector *));
+        if((*writer)->nodeValues == NULL || (*writer)->nodeExtras == NULL)
+        {
+            T2Error("Unable to allocate report hierarchy values\n");
+            destroyJSONReport(*writer);
+            *writer = NULL;
+            return T2ERROR_FAILURE;
+        }
+    }
+    return T2ERROR_SUCCESS;
+}
+
+void addJSONReportString(JSONReportWriter *writer, const char *name, const char *value)
+{
+    if(name == NULL)
+        return;
+    beginJSONReportItem(writer, name);
+    appendJSONString(writer, value ? value : "NULL");
+    appendJSONRaw(writer, "}", 1);
+}
+
+void beginJSONReportList(JSONReportWriter *writer, const char *name)
+{
+    beginJSONReportItem(writer, name);
+    appendJSONRaw(writer, "[", 1);
+    pushJSONReportDepth(writer);
+}
+
+void endJSONReportList(JSONReportWriter *writer)
+{
+    appendJSONRaw(writer, "]}", 2);
+    if(writer->depth > 1)
+        writer->depth--;
+}
+
+// Items written so far are repeated in every part of a split report
+void markJSONReportHeader(JSONReportWriter *writer)
+{
+    writer->itemCount = 0;
+}
+
+T2ERROR destroyJSONReport(JSONReportWriter *writer)
+{
+    if(writer)
+    {
+        freeJSONReportValues(writer);
+        if(writer->buffer)
+            free(writer->buffer);
+        free(writer->needComma);
+        free(writer->itemOffsets);
+        free(writer);
+    }
+    return T2ERROR_SUCCESS;
+}
+
+ReportDelta* createReportDelta(int paramCount, int eventCount, unsigned int snapshotPeriod)
+{
+    ReportDelta *delta = (ReportDelta *) malloc(sizeof(ReportDelta));
+    size_t count = (size_t) paramCount + eventCount;
+    if(delta == NULL)
+    {
+        T2Error("Unable to allocate delta report state\n");
+        return NULL;
+    }
+    memset(delta, 0, sizeof(ReportDelta));
+    if(count > 0)
+    {
+        // One block, committed and pending hashes of params followed by those of events
+        delta->paramHashes = (uint64_t *) calloc(2 * count, sizeof(uint64_t));
+        if(delta->paramHashes == NULL)
+        {
+            T2Error("Unable to allocate delta report state\n");
+            free(delta);
+            return NULL;
+        }
+        delta->eventHashes = delta->paramHashes + paramCount;
+        delta->pendingParamHashes = delta->paramHashes + count;
+        delta->pendingEventHashes = delta->pendingParamHashes + paramCount;
+    }
+    delta->paramCount = paramCount;
+    delta->eventCount = eventCount;
+    delta->snapshotPeriod = snapshotPeriod ? snapshotPeriod : REPORT_DELTA_SNAPSHOT_PERIOD;
+    return delta;
+}
+
+void freeReportDelta(ReportDelta *delta)
+{
+    if(delta)
+    {
+        free(delta->paramHashes);
+        free(delta);
+    }
+}
+
+/**
+ * Start a report, it is a full snapshot if asked for, if nothing was uploaded yet or
+ * the snapshot period is due. Values not encoded in this report keep their hash.
+ */
+void beginReportDelta(ReportDelta *delta, bool fullReport)
+{
+    if(delta == NULL)
+        return;
+    delta->fullReport = fullReport || !delta->hasBaseline || delta->reportsSinceSnapshot + 1 >= delta->snapshotPeriod;
+    if(delta->paramHashes)
+        memcpy(delta->pendingParamHashes, delta->paramHashes, ((size_t) delta->paramCount + delta->eventCount) * sizeof(uint64_t));
+    T2Debug("Generating %s report\n", delta->fullReport ? "full" : "delta");
+}
+
+// The report was uploaded, its values become the baseline of the next one
+void commitReportDelta(ReportDelta *delta)
+{
+    if(delta == NULL)
+        return;
+    if(delta->paramHashes)
+        memcpy(delta->paramHashes, delta->pendingParamHashes, ((size_t) delta->paramCount + delta->eventCount) * sizeof(uint64_t));
+    delta->reportsSinceSnapshot = delta->fullReport ? 0 : delta->reportsSinceSnapshot + 1;
+    delta->hasBaseline = true;
+}
+
+// FNV-1a, a terminating zero is hashed as well so that "a","b" and "ab" differ
+static uint64_t hashReportValue(uint64_t hash, const char *value)
+{
+    const unsigned char *ptr = (const unsigned char *) (value ? value : "");
+    do
+    {
+        hash ^= *ptr;
+        hash *= 0x100000001b3ULL;
+    } while(*ptr++);
+    return hash;
+}
+
+#define REPORT_HASH_SEED 0xcbf29ce484222325ULL
+
+/**
+ * Record the hash of the index-th param's values and tell whether they can be left
+ * out of a delta report.
+ */
+static bool isParamValueUnchanged(ReportDelta *delta, int index, tr181ValStruct_t **paramValues, int paramValCount)
+{
+    uint64_t hash = REPORT_HASH_SEED;
+    int valIndex = 0;
+
+    if(delta == NULL || index >= delta->paramCount)
+        return false;
+    if(paramValCount == 0)
+        hash = hashReportValue(hash, "NULL");
+    for(valIndex = 0; valIndex < paramValCount; valIndex++)
+    {
+        if(paramValues[valIndex] == NULL)
+            continue;
+        if(paramValCount > 1)
+            hash = hashReportValue(hash, paramValues[valIndex]->parameterName);
+        hash = hashReportValue(hash, paramValues[valIndex]->parameterValue);
+    }
+    delta->pendingParamHashes[index] = hash;
+    return !delta->fullReport && hash == delta->paramHashes[index];
+}
+
+static bool isEventValueUnchanged(ReportDelta *delta, int index, const char *value)
+{
+    uint64_t hash = 0;
+    if(delta == NULL || index >= delta->eventCount)
+        return false;
+    hash = hashReportValue(REPORT_HASH_SEED, value);
+    delta->pendingEventHashes[index] = hash;
+    return !delta->fullReport && hash == delta->eventHashes[index];
+}
+
+/**
+ * Add one value either to the streamed key/value report or, for the object hierarchy
+ * format, to its trie node. node and name are the precompiled forms of rawName if any.
+ */
+static void addJSONReportValue(JSONReportWriter *writer, const JSONReportNode *node, const JSONReportFragment *name, const char *rawName, const char *value)
+{
+    if(getJSONReportHierarchy(writer))
+    {
+        if(node)
+            setJSONReportNodeValue(writer, node, value);
+        else
+            setJSONReportPathValue(writer, rawName, value);
+    }
+    else if(name)
+        addJSONReportNamedString(writer, name, value);
+    else
+        addJSONReportString(writer, rawName, value);
+}
+
+T2ERROR encodeParamResultInJSON(JSONReportWriter *writer, Vector *paramNameList, Vector *paramValueList)
+{
+    int index = 0;
+    const JSONReportTemplate *reportTemplate = writer->reportTemplate;
+    ReportDelta *delta = writer->delta;
+    T2Debug("%s ++in \n", __FUNCTION__);
+
+    if(reportTemplate && (reportTemplate->paramList != paramNameList || reportTemplate->paramCount != Vector_Size(paramNameList)))
+        reportTemplate = NULL;
+    if(delta && delta->paramCount != Vector_Size(paramNameList))
+        delta = NULL;
+
+    for(; index < Vector_Size(paramNameList); index++)
+    {
+        Param* param = (Param *)Vector_At(paramNameList, index);
+        const JSONReportFragment *name = (reportTemplate && reportTemplate->paramNames[index].data) ? &reportTemplate->paramNames[index] : NULL;
+        JSONReportNode *node = (reportTemplate && reportTemplate->paramNodes) ? reportTemplate->paramNodes[index] : NULL;
+        tr181ValStruct_t **paramValues = ((profileValues *)Vector_At(paramValueList, index))->paramValues;
+        if(param == NULL || paramValues == NULL ) {
+            // Ignore tr181 params returning null values in report
+            continue ;
+        }
+        int paramValCount = ((profileValues *)Vector_At(paramValueList, index))->paramValueCount;
+        T2Debug("Parameter Name : %s valueCount = %d\n", param->name, paramValCount);
+        if(isParamValueUnchanged(delta, index, paramValues, paramValCount))
+            continue;
+        if(paramValCount == 0)
+        {
+            T2Info("Paramter was not successfully retrieved... \n");
+            addJSONReportValue(writer, node, name, param->name, "NULL");
+        }
+        else if(paramValCount == 1) // Single value
+        {
+            if(paramValues[0]) {
+                addJSONReportValue(writer, node, name, param->name, paramValues[0]->parameterValue);
+            }
+        }
+        else if(getJSONReportHierarchy(writer))
+        {
+            // Instances of a partial path are placed by their full parameter name
+            int valIndex = 0;
+            for (; valIndex < paramValCount; valIndex++)
+            {
+                if(paramValues[valIndex]){
+                    setJSONReportPathValue(writer, paramValues[valIndex]->parameterName, paramValues[valIndex]->parameterValue);
+                }
+            }
+        }
+        else
+        {
+            int valIndex = 0;
+            if(name)
+                beginJSONReportNamedList(writer, name);
+            else
+                beginJSONReportList(writer, param->name);
+            for (; valIndex < paramValCount; valIndex++)
+            {
+                if(paramValues[valIndex]){
+                    addJSONReportString(writer, paramValues[valIndex]->parameterName, paramValues[valIndex]->parameterValue);
+                }
+            }
+            endJSONReportList(writer);
+        }
+    }
+    T2Debug("%s --Out \n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR encodeStaticParamsInJSON(JSONReportWriter *writer, Vector *staticParamList)
+{
+    T2Debug("%s ++in \n", __FUNCTION__);
+
+    int index = 0;
+    const JSONReportTemplate *reportTemplate = writer->reportTemplate;
+    if(reportTemplate && reportTemplate->staticParamList == staticParamList)
+    {
+        // Object hierarchy reports carry the static values in the compiled trie
+        if(reportTemplate->staticItems.length > 0 && reportTemplate->hierarchy == NULL)
+        {
+            if(writer->needComma[writer->depth])
+                appendJSONRaw(writer, ",", 1);
+            writer->needComma[writer->depth] = true;
+            appendJSONRaw(writer, reportTemplate->staticItems.data, reportTemplate->staticItems.length);
+        }
+        markJSONReportHeader(writer);
+        T2Debug("%s --Out \n", __FUNCTION__);
+        return T2ERROR_SUCCESS;
+    }
+
+    for(; index < Vector_Size(staticParamList); index++)
+    {
+        StaticParam *sparam = (StaticParam *)Vector_At(staticParamList, index);
+        if(sparam) {
+            if(sparam->name == NULL || sparam->value == NULL )
+                continue ;
+            addJSONReportValue(writer, NULL, NULL, sparam->name, sparam->value);
+        }
+    }
+    markJSONReportHeader(writer);
+
+    T2Debug("%s --Out \n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Tag a delta report, so that values left out are not taken as gone. The tag is part
+ * of the header repeated in every part of a split report.
+ */
+T2ERROR encodeReportTypeInJSON(JSONReportWriter *writer)
+{
+    if(writer->delta == NULL || writer->delta->fullReport)
+        return T2ERROR_SUCCESS;
+    addJSONReportValue(writer, NULL, NULL, REPORT_TYPE_NAME, REPORT_TYPE_DELTA);
+    markJSONReportHeader(writer);
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR encodeGrepResultInJSON(JSONReportWriter *writer, Vector *grepResult)
+{
+    T2Debug("%s ++in \n", __FUNCTION__);
+    int index = 0;
+    for(; index < Vector_Size(grepResult); index++)
+    {
+        GrepResult* grep = (GrepResult *)Vector_At(grepResult, index);
+        if(grep) {
+            if(grep->markerName == NULL || grep->markerValue == NULL ) // Ignore null values
+                continue ;
+            addJSONReportValue(writer, NULL, NULL, grep->markerName, grep->markerValue);
+        }
+    }
+    T2Debug("%s --Out \n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-T2ERROR encodeParamResultInJSON(cJSON *valArray, Vector *paramNameList, Vector *paramValueList)
+T2ERROR encodeEventMarkersInJSON(JSONReportWriter *writer, Vector *eventMarkerList)
 {
-    int index = 0;
     T2Debug("%s ++in \n", __FUNCTION__);
+    int index = 0;
+    const JSONReportTemplate *reportTemplate = writer->reportTemplate;
+    ReportDelta *delta = writer->delta;
+    if(reportTemplate && (reportTemplate->eMarkerList != eventMarkerList || reportTemplate->eventCount != Vector_Size(eventMarkerList)))
+        reportTemplate = NULL;
+    if(delta && delta->eventCount != Vector_Size(eventMarkerList))
+        delta = NULL;
+
+    for(; index < Vector_Size(eventMarkerList); index++)
+    {
+        EventMarker* eventMarker = (EventMarker *)Vector_At(eventMarkerList, index);
+        const JSONReportFragment *name = (reportTemplate && reportTemplate->eventNames[index].data) ? &reportTemplate->eventNames[index] : NULL;
+        JSONReportNode *node = (reportTemplate && reportTemplate->eventNodes) ? reportTemplate->eventNodes[index] : NULL;
+        switch(eventMarker->mType)
+        {
+            case MTYPE_COUNTER:
+                if(eventMarker->u.count > 0)
+                {
+                    char stringValue[16] = {'\0'};
+                    snprintf(stringValue, sizeof(stringValue), "%u", eventMarker->u.count);
+                    addJSONReportValue(writer, node, name, eventMarker->alias ? eventMarker->alias : eventMarker->markerName, stringValue);
+
+                    T2Debug("Marker value for : %s is %d\n", eventMarker->markerName, eventMarker->u.count);
+                    eventMarker->u.count = 0;
+                }
+                break;
+
+            case MTYPE_ABSOLUTE:
+            default:
+                if(eventMarker->u.markerValue != NULL)
+                {
+                    if(!isEventValueUnchanged(delta, index, eventMarker->u.markerValue))
+                        addJSONReportValue(writer, node, name, eventMarker->alias ? eventMarker->alias : eventMarker->markerName, eventMarker->u.markerValue);
+
+                    T2Debug("Marker value for : %s is %s\n", eventMarker->markerName, eventMarker->u.markerValue);
+                    free(eventMarker->u.markerValue);
+                    eventMarker->u.markerValue = NULL;
+                }
+        }
+    }
+    T2Debug("%s --Out \n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+
+}
+
+/**
+ * Close the report and hand the buffer over to the caller, the writer is left empty.
+ */
+static void closeJSONReport(JSONReportWriter *writer)
+{
+    while(writer->depth > 1)
+        endJSONReportList(writer);
+    if(getJSONReportHierarchy(writer))
+    {
+        appendJSONRaw(writer, "{", 1);
+        if(pushJSONReportDepth(writer))
+        {
+            writeJSONReportNode(writer, getJSONReportHierarchy(writer));
+            writer->depth--;
+        }
+        appendJSONRaw(writer, "}", 1);
+    }
+    appendJSONRaw(writer, "]}", 2);
+}
+
+T2ERROR prepareJSONReport(JSONReportWriter *writer, char** reportBuff)
+{
+    T2Debug("%s ++in\n", __FUNCTION__);
+    *reportBuff = NULL;
+    closeJSONReport(writer);
+    if(writer->failed || writer->buffer == NULL)
+    {
+        T2Error("Failed to generate json report\n");
+        return T2ERROR_FAILURE;
+    }
+    *reportBuff = writer->buffer;
+    writer->buffer = NULL;
+    writer->length = 0;
+    writer->capacity = 0;
+    T2Debug("%s --Out\n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
+}
+
+void freeReportPart(void *data)
+{
+    if(data != NULL)
+    {
+        ReportPart *part = (ReportPart *) data;
+        free(part->data);
+        free(part);
+    }
+}
+
+static T2ERROR addReportPart(Vector *reportParts, char *data, size_t length)
+{
+    ReportPart *part = NULL;
+    if(data == NULL)
+        return T2ERROR_FAILURE;
+    part = (ReportPart *) malloc(sizeof(ReportPart));
+    if(part == NULL)
+    {
+        T2Error("Unable to allocate report part\n");
+        free(data);
+        return T2ERROR_FAILURE;
+    }
+    part->data = data;
+    part->length = length;
+    Vector_PushBack(reportParts, part);
+    return T2ERROR_SUCCESS;
+}
+
+/**
+ * Group items greedily into parts of at most maxReportSize bytes, partSize being the size
+ * of a part without items and itemOverhead the bytes added to each copied item. An item
+ * that does not fit a part on its own is sent alone. partStarts receives the first item
+ * of each part, the number of parts is returned.
+ */
+static unsigned int planReportParts(const size_t *itemOffsets, unsigned int itemCount, size_t bodyEnd,
+        size_t itemOverhead, size_t partSize, size_t maxReportSize, unsigned int *partStarts)
+{
+    unsigned int partCount = 0;
+    unsigned int index = 0;
+    size_t size = 0;
 
+    for(index = 0; index < itemCount; index++)
+    {
+        size_t itemEnd = (index + 1 < itemCount) ? itemOffsets[index + 1] : bodyEnd;
+        size_t itemSize = itemEnd - itemOffsets[index] + itemOverhead;
+
+        if(partCount == 0 || size + itemSize > maxReportSize)
+        {
+            partStarts[partCount++] = index;
+            size = partSize;
+        }
+        size += itemSize;
+    }
+    return partCount;
+}
+
+/**
+ * Close the report and hand it over as one or more parts of at most maxReportSize bytes,
+ * 0 meaning no limit. Reports are only cut between top-level items. Each part repeats
+ * the root and the static items and carries a REPORT_PART_NAME item. Object hierarchy
+ * reports are a single item and are never split.
+ */
+T2ERROR prepareJSONReportParts(JSONReportWriter *writer, size_t maxReportSize, Vector *reportParts)
+{
+    size_t partItemSize = 0;
+    unsigned int *partStarts = NULL;
+    unsigned int partCount = 0;
+    unsigned int partIndex = 0;
+    size_t headerLength = 0;
+    size_t bodyEnd = 0;
+    T2ERROR ret = T2ERROR_SUCCESS;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    closeJSONReport(writer);
+    if(writer->failed || writer->buffer == NULL)
+    {
+        T2Error("Failed to generate json report\n");
+        return T2ERROR_FAILURE;
+    }
+    if(maxReportSize == 0 || writer->length <= maxReportSize || writer->itemCount == 0)
+    {
+        if(maxReportSize > 0 && writer->length > maxReportSize)
+            T2Warning("Report of %zu bytes cannot be split to the max limit : %zu\n", writer->length, maxReportSize);
+        ret = addReportPart(reportParts, writer->buffer, writer->length);
+        writer->buffer = NULL;
+        writer->length = 0;
+        writer->capacity = 0;
+        T2Debug("%s --Out\n", __FUNCTION__);
+        return ret;
+    }
+
+    headerLength = writer->itemOffsets[0];
+    bodyEnd = writer->length - 2;
+    // There are never more parts than items, bound the index digits by the item count
+    partItemSize = sizeof("{\"" REPORT_PART_NAME "\":\"/\"}") + 2 * snprintf(NULL, 0, "%u", writer->itemCount);
+    partStarts = (unsigned int *) malloc(writer->itemCount * sizeof(unsigned int));
+    if(partStarts == NULL)
+    {
+        T2Error("Unable to allocate report parts\n");
+        return T2ERROR_FAILURE;
+    }
+    // header, comma, part item, "]}"
+    partCount = planReportParts(writer->itemOffsets, writer->itemCount, bodyEnd, 1,
+            headerLength + 1 + partItemSize + 2, maxReportSize, partStarts);
+    T2Info("Report of %zu bytes is split into %u parts\n", writer->length, partCount);
+
+    for(partIndex = 0; partIndex < partCount && ret == T2ERROR_SUCCESS; partIndex++)
+    {
+        unsigned int first = partStarts[partIndex];
+        unsigned int last = (partIndex + 1 < partCount) ? partStarts[partIndex + 1] : writer->itemCount;
+        size_t itemsEnd = (last < writer->itemCount) ? writer->itemOffsets[last] : bodyEnd;
+        size_t capacity = headerLength + 1 + partItemSize + (itemsEnd - writer->itemOffsets[first]) + (last - first) + 3;
+        char *part = (char *) malloc(capacity);
+        size_t length = 0;
+        unsigned int index = 0;
+
+        if(part == NULL)
+        {
+            T2Error("Unable to allocate report part of %zu bytes\n", capacity);
+            ret = T2ERROR_FAILURE;
+            break;
+        }
+        memcpy(part, writer->buffer, headerLength);
+        length = headerLength;
+        length += snprintf(part + length, capacity - length, "%s{\"" REPORT_PART_NAME "\":\"%u/%u\"}",
+                headerLength > writer->rootLength ? "," : "", partIndex + 1, partCount);
+        for(index = first; index < last; index++)
+        {
+            size_t itemStart = writer->itemOffsets[index];
+            size_t itemEnd = (index + 1 < writer->itemCount) ? writer->itemOffsets[index + 1] : bodyEnd;
+            // The first item after the root has no separator of its own
+            if(writer->buffer[itemStart] != ',')
+                part[length++] = ',';
+            memcpy(part + length, writer->buffer + itemStart, itemEnd - itemStart);
+            length += itemEnd - itemStart;
+        }
+        memcpy(part + length, "]}", 3);
+        length += 2;
+        if(length > maxReportSize)
+            T2Warning("Report part %u of %zu bytes exceeds the max limit : %zu\n", partIndex + 1, length, maxReportSize);
+        ret = addReportPart(reportParts, part, length);
+    }
+    free(partStarts);
+    T2Debug("%s --Out\n", __FUNCTION__);
+    return ret;
+}
+
+static void packMsgPackString(msgpack_packer *packer, const char *value)
+{
+    size_t length = strlen(value);
+    msgpack_pack_str(packer, length);
+    msgpack_pack_str_body(packer, value, length);
+}
+
+// Count an item of the report array and remember where it starts
+static void beginMsgPackReportItem(MsgPackReportWriter *writer)
+{
+    if(!addReportItemOffset(&writer->itemOffsets, writer->itemCount, &writer->itemCapacity, writer->items.size))
+        writer->failed = true;
+    writer->itemCount++;
+}
+
+// One {"name":"value"} item of the report array
+static void addMsgPackReportString(MsgPackReportWriter *writer, const char *name, const char *value)
+{
+    beginMsgPackReportItem(writer);
+    msgpack_pack_map(&writer->packer, 1);
+    packMsgPackString(&writer->packer, name);
+    packMsgPackString(&writer->packer, value ? value : "NULL");
+}
+
+T2ERROR initMsgPackReport(MsgPackReportWriter **writer, const char *rootName)
+{
+    MsgPackReportWriter *packWriter = NULL;
+    *writer = NULL;
+    packWriter = (MsgPackReportWriter *) malloc(sizeof(MsgPackReportWriter));
+    if(packWriter == NULL)
+    {
+        T2Error("Unable to allocate MessagePack report\n");
+        return T2ERROR_FAILURE;
+    }
+    memset(packWriter, 0, sizeof(MsgPackReportWriter));
+    packWriter->rootName = strdup(rootName);
+    if(packWriter->rootName == NULL)
+    {
+        free(packWriter);
+        return T2ERROR_FAILURE;
+    }
+    msgpack_sbuffer_init(&packWriter->items);
+    msgpack_packer_init(&packWriter->packer, &packWriter->items, msgpack_sbuffer_write);
+    *writer = packWriter;
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR destroyMsgPackReport(MsgPackReportWriter *writer)
+{
+    if(writer)
+    {
+        msgpack_sbuffer_destroy(&writer->items);
+        free(writer->itemOffsets);
+        free(writer->rootName);
+        free(writer);
+    }
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR encodeParamResultInMsgPack(MsgPackReportWriter *writer, Vector *paramNameList, Vector *paramValueList)
+{
+    int index = 0;
+    ReportDelta *delta = writer->delta;
+    T2Debug("%s ++in \n", __FUNCTION__);
+    if(delta && delta->paramCount != Vector_Size(paramNameList))
+        delta = NULL;
     for(; index < Vector_Size(paramNameList); index++)
     {
         Param* param = (Param *)Vector_At(paramNameList, index);
         tr181ValStruct_t **paramValues = ((profileValues *)Vector_At(paramValueList, index))->paramValues;
-        if(param == NULL || paramValues == NULL ) {
-            // Ignore tr181 params returning null values in report
-            continue ;
-        }
         int paramValCount = ((profileValues *)Vector_At(paramValueList, index))->paramValueCount;
-        T2Debug("Parameter Name : %s valueCount = %d\n", param->name, paramValCount);
+        if(param == NULL || paramValues == NULL )
+            continue ;
+        if(isParamValueUnchanged(delta, index, paramValues, paramValCount))
+            continue;
         if(paramValCount == 0)
         {
-            cJSON *arrayItem = cJSON_CreateObject();
             T2Info("Paramter was not successfully retrieved... \n");
-            cJSON_AddStringToObject(arrayItem, param->name, "NULL");
-            cJSON_AddItemToArray(valArray, arrayItem);
+            addMsgPackReportString(writer, param->name, "NULL");
         }
-        else if(paramValCount == 1) // Single value
+        else if(paramValCount == 1)
         {
-            if(paramValues[0]) {
-                cJSON *arrayItem = cJSON_CreateObject();
-                cJSON_AddStringToObject(arrayItem, param->name, paramValues[0]->parameterValue);
-                cJSON_AddItemToArray(valArray, arrayItem);
-            }
+            if(paramValues[0])
+                addMsgPackReportString(writer, param->name, paramValues[0]->parameterValue);
         }
         else
         {
-            cJSON *valList = NULL;
-            cJSON *valItem = NULL;
             int valIndex = 0;
-            cJSON *arrayItem = cJSON_CreateObject();
-            cJSON_AddItemToObject(arrayItem, param->name, valList = cJSON_CreateArray());
-            for (; valIndex < paramValCount; valIndex++)
+            uint32_t valCount = 0;
+            for (valIndex = 0; valIndex < paramValCount; valIndex++)
             {
-                if(paramValues[valIndex]){
-                    valItem = cJSON_CreateObject();
-                    cJSON_AddStringToObject(valItem, paramValues[valIndex]->parameterName, paramValues[valIndex]->parameterValue);
-                    cJSON_AddItemToArray(valList, valItem);
+                if(paramValues[valIndex])
+                    valCount++;
+            }
+            beginMsgPackReportItem(writer);
+            msgpack_pack_map(&writer->packer, 1);
+            packMsgPackString(&writer->packer, param->name);
+            msgpack_pack_array(&writer->packer, valCount);
+            for (valIndex = 0; valIndex < paramValCount; valIndex++)
+            {
+                if(paramValues[valIndex])
+                {
+                    msgpack_pack_map(&writer->packer, 1);
+                    packMsgPackString(&writer->packer, paramValues[valIndex]->parameterName);
+                    packMsgPackString(&writer->packer, paramValues[valIndex]->parameterValue ? paramValues[valIndex]->parameterValue : "NULL");
                 }
             }
-            cJSON_AddItemToArray(valArray, arrayItem);
         }
     }
     T2Debug("%s --Out \n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-T2ERROR encodeStaticParamsInJSON(cJSON *valArray, Vector *staticParamList)
+T2ERROR encodeStaticParamsInMsgPack(MsgPackReportWriter *writer, Vector *staticParamList)
 {
-    T2Debug("%s ++in \n", __FUNCTION__);
-
     int index = 0;
-    cJSON *arrayItem = NULL;
+    T2Debug("%s ++in \n", __FUNCTION__);
     for(; index < Vector_Size(staticParamList); index++)
     {
         StaticParam *sparam = (StaticParam *)Vector_At(staticParamList, index);
-        if(sparam) {
-            if(sparam->name == NULL || sparam->value == NULL )
-                continue ;
-            arrayItem = cJSON_CreateObject();
-            cJSON_AddStringToObject(arrayItem, sparam->name, sparam->value);
-            cJSON_AddItemToArray(valArray, arrayItem);
-        }
+        if(sparam && sparam->name && sparam->value)
+            addMsgPackReportString(writer, sparam->name, sparam->value);
     }
-
+    // Static items are repeated in every part of a split report
+    writer->headerItemCount = writer->itemCount;
     T2Debug("%s --Out \n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-T2ERROR encodeGrepResultInJSON(cJSON *valArray, Vector *grepResult)
+T2ERROR encodeReportTypeInMsgPack(MsgPackReportWriter *writer)
+{
+    if(writer->delta == NULL || writer->delta->fullReport)
+        return T2ERROR_SUCCESS;
+    addMsgPackReportString(writer, REPORT_TYPE_NAME, REPORT_TYPE_DELTA);
+    writer->headerItemCount = writer->itemCount;
+    return T2ERROR_SUCCESS;
+}
+
+T2ERROR encodeGrepResultInMsgPack(MsgPackReportWriter *writer, Vector *grepResult)
 {
-    T2Debug("%s ++in \n", __FUNCTION__);
     int index = 0;
-    cJSON *arrayItem = NULL;
+    T2Debug("%s ++in \n", __FUNCTION__);
     for(; index < Vector_Size(grepResult); index++)
     {
         GrepResult* grep = (GrepResult *)Vector_At(grepResult, index);
-        if(grep) {
-            if(grep->markerName == NULL || grep->markerValue == NULL ) // Ignore null values
-                continue ;
-            arrayItem = cJSON_CreateObject();
-            cJSON_AddStringToObject(arrayItem, grep->markerName, grep->markerValue);
-            cJSON_AddItemToArray(valArray, arrayItem);
-        }
+        if(grep && grep->markerName && grep->markerValue)
+            addMsgPackReportString(writer, grep->markerName, grep->markerValue);
     }
     T2Debug("%s --Out \n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-T2ERROR encodeEventMarkersInJSON(cJSON *valArray, Vector *eventMarkerList)
+T2ERROR encodeEventMarkersInMsgPack(MsgPackReportWriter *writer, Vector *eventMarkerList)
 {
-    T2Debug("%s ++in \n", __FUNCTION__);
     int index = 0;
-    cJSON *arrayItem = NULL;
+    ReportDelta *delta = writer->delta;
+    T2Debug("%s ++in \n", __FUNCTION__);
+    if(delta && delta->eventCount != Vector_Size(eventMarkerList))
+        delta = NULL;
     for(; index < Vector_Size(eventMarkerList); index++)
     {
         EventMarker* eventMarker = (EventMarker *)Vector_At(eventMarkerList, index);
+        const char *name = eventMarker->alias ? eventMarker->alias : eventMarker->markerName;
         switch(eventMarker->mType)
         {
             case MTYPE_COUNTER:
                 if(eventMarker->u.count > 0)
                 {
-                    char stringValue[10] = {'\0'};
-                    sprintf(stringValue, "%d", eventMarker->u.count);
-                    arrayItem = cJSON_CreateObject();
-                    if (eventMarker->alias) {
-                        cJSON_AddStringToObject(arrayItem, eventMarker->alias, stringValue);
-                    } else {
-                        cJSON_AddStringToObject(arrayItem, eventMarker->markerName, stringValue);
-                    }
-                    cJSON_AddItemToArray(valArray, arrayItem);
+                    beginMsgPackReportItem(writer);
+                    msgpack_pack_map(&writer->packer, 1);
+                    packMsgPackString(&writer->packer, name);
+                    msgpack_pack_unsigned_int(&writer->packer, eventMarker->u.count);
 
                     T2Debug("Marker value for : %s is %d\n", eventMarker->markerName, eventMarker->u.count);
                     eventMarker->u.count = 0;
@@ -190,13 +1490,8 @@ T2ERROR encodeEventMarkersInJSON(cJSON *valArray, Vector *eventMarkerList)
             default:
                 if(eventMarker->u.markerValue != NULL)
                 {
-                    arrayItem = cJSON_CreateObject();
-                    if (eventMarker->alias) {
-                        cJSON_AddStringToObject(arrayItem, eventMarker->alias, eventMarker->u.markerValue);
-                    } else {
-                        cJSON_AddStringToObject(arrayItem, eventMarker->markerName, eventMarker->u.markerValue);
-                    }
-                    cJSON_AddItemToArray(valArray, arrayItem);
+                    if(!isEventValueUnchanged(delta, index, eventMarker->u.markerValue))
+                        addMsgPackReportString(writer, name, eventMarker->u.markerValue);
 
                     T2Debug("Marker value for : %s is %s\n", eventMarker->markerName, eventMarker->u.markerValue);
                     free(eventMarker->u.markerValue);
@@ -206,101 +1501,332 @@ T2ERROR encodeEventMarkersInJSON(cJSON *valArray, Vector *eventMarkerList)
     }
     T2Debug("%s --Out \n", __FUNCTION__);
     return T2ERROR_SUCCESS;
-
 }
 
-T2ERROR prepareJSONReport(cJSON* jsonObj, char** reportBuff)
+/**
+ * Prepend the root map and array headers and hand the packed report over to the
+ * caller. The buffer is binary, reportSize is its length.
+ */
+T2ERROR prepareMsgPackReport(MsgPackReportWriter *writer, char **reportBuff, size_t *reportSize)
 {
+    msgpack_sbuffer report;
+    msgpack_packer packer;
+
     T2Debug("%s ++in\n", __FUNCTION__);
-    *reportBuff = cJSON_PrintUnformatted(jsonObj);
+    *reportBuff = NULL;
+    *reportSize = 0;
+    if(writer->failed)
+    {
+        T2Error("Failed to generate MessagePack report\n");
+        return T2ERROR_FAILURE;
+    }
+    msgpack_sbuffer_init(&report);
+    msgpack_packer_init(&packer, &report, msgpack_sbuffer_write);
+    msgpack_pack_map(&packer, 1);
+    packMsgPackString(&packer, writer->rootName);
+    msgpack_pack_array(&packer, writer->itemCount);
+    if(writer->items.size > 0 && 0 != msgpack_sbuffer_write(&report, writer->items.data, writer->items.size))
+    {
+        T2Error("Failed to generate MessagePack report\n");
+        msgpack_sbuffer_destroy(&report);
+        return T2ERROR_FAILURE;
+    }
+    *reportSize = report.size;
+    *reportBuff = msgpack_sbuffer_release(&report);
     if(*reportBuff == NULL)
     {
-        T2Error("Failed to get unformatted json\n");
+        T2Error("Failed to generate MessagePack report\n");
+        *reportSize = 0;
         return T2ERROR_FAILURE;
     }
     T2Debug("%s --Out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
-char *prepareHttpUrl(T2HTTP *http)
+/**
+ * MessagePack counterpart of prepareJSONReportParts, parts are cut between the items
+ * following the static ones.
+ */
+T2ERROR prepareMsgPackReportParts(MsgPackReportWriter *writer, size_t maxReportSize, Vector *reportParts)
 {
-    CURL *curl = curl_easy_init();
-    char *httpUrl = strdup(http->URL);
-    T2Debug("%s: Default URL: %s \n", __FUNCTION__, httpUrl);
+    unsigned int bodyCount = writer->itemCount - writer->headerItemCount;
+    // map, root string and array headers plus the {"ReportPart":"<index>/<count>"} item
+    const size_t partSize = 1 + 5 + strlen(writer->rootName) + 5
+            + 1 + 5 + sizeof(REPORT_PART_NAME) + 5 + 1 + 2 * snprintf(NULL, 0, "%u", bodyCount);
+    unsigned int *partStarts = NULL;
+    unsigned int partCount = 0;
+    unsigned int partIndex = 0;
+    size_t headerLength = 0;
+    char *reportBuff = NULL;
+    size_t reportSize = 0;
+    T2ERROR ret = T2ERROR_SUCCESS;
 
-    if (http->RequestURIparamList && http->RequestURIparamList->count)
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(writer->failed)
     {
-        unsigned int index = 0;
-        int params_len = 0;
-        char *url_params = NULL;
+        T2Error("Failed to generate MessagePack report\n");
+        return T2ERROR_FAILURE;
+    }
+    headerLength = bodyCount > 0 ? writer->itemOffsets[writer->headerItemCount] : writer->items.size;
+    if(maxReportSize == 0 || partSize + writer->items.size <= maxReportSize || bodyCount == 0)
+    {
+        ret = prepareMsgPackReport(writer, &reportBuff, &reportSize);
+        if(ret == T2ERROR_SUCCESS)
+        {
+            if(maxReportSize > 0 && reportSize > maxReportSize)
+                T2Warning("Report of %zu bytes cannot be split to the max limit : %zu\n", reportSize, maxReportSize);
+            ret = addReportPart(reportParts, reportBuff, reportSize);
+        }
+        T2Debug("%s --Out\n", __FUNCTION__);
+        return ret;
+    }
+
+    partStarts = (unsigned int *) malloc(bodyCount * sizeof(unsigned int));
+    if(partStarts == NULL)
+    {
+        T2Error("Unable to allocate report parts\n");
+        return T2ERROR_FAILURE;
+    }
+    partCount = planReportParts(writer->itemOffsets + writer->headerItemCount, bodyCount, writer->items.size, 0,
+            partSize + headerLength, maxReportSize, partStarts);
+    T2Info("Report of %zu bytes is split into %u parts\n", writer->items.size, partCount);
+
+    for(partIndex = 0; partIndex < partCount && ret == T2ERROR_SUCCESS; partIndex++)
+    {
+        unsigned int first = writer->headerItemCount + partStarts[partIndex];
+        unsigned int last = writer->headerItemCount + ((partIndex + 1 < partCount) ? partStarts[partIndex + 1] : bodyCount);
+        size_t itemsEnd = (last < writer->itemCount) ? writer->itemOffsets[last] : writer->items.size;
+        char partName[sizeof("4294967295/4294967295")] = {'\0'};
+        msgpack_sbuffer part;
+        msgpack_packer packer;
 
-        for(; index < http->RequestURIparamList->count; index++)
+        snprintf(partName, sizeof(partName), "%u/%u", partIndex + 1, partCount);
+        msgpack_sbuffer_init(&part);
+        msgpack_packer_init(&packer, &part, msgpack_sbuffer_write);
+        msgpack_pack_map(&packer, 1);
+        packMsgPackString(&packer, writer->rootName);
+        msgpack_pack_array(&packer, writer->headerItemCount + 1 + (last - first));
+        if((headerLength > 0 && 0 != msgpack_sbuffer_write(&part, writer->items.data, headerLength))
+                || 0 != msgpack_pack_map(&packer, 1))
+            ret = T2ERROR_FAILURE;
+        packMsgPackString(&packer, REPORT_PART_NAME);
+        packMsgPackString(&packer, partName);
+        if(ret == T2ERROR_SUCCESS && 0 != msgpack_sbuffer_write(&part, writer->items.data + writer->itemOffsets[first], itemsEnd - writer->itemOffsets[first]))
+            ret = T2ERROR_FAILURE;
+        if(ret != T2ERROR_SUCCESS)
         {
-            HTTPReqParam * httpParam = (HTTPReqParam *)(Vector_At)(http->RequestURIparamList, index);
-            char *httpParamVal = NULL;
-            char *paramValue = NULL;
+            T2Error("Failed to generate MessagePack report part\n");
+            msgpack_sbuffer_destroy(&part);
+            break;
+        }
+        if(part.size > maxReportSize)
+            T2Warning("Report part %u of %zu bytes exceeds the max limit : %zu\n", partIndex + 1, part.size, maxReportSize);
+        reportSize = part.size;
+        ret = addReportPart(reportParts, msgpack_sbuffer_release(&part), reportSize);
+    }
+    free(partStarts);
+    T2Debug("%s --Out\n", __FUNCTION__);
+    return ret;
+}
+
+/**
+ * Percent-encode everything but the unreserved characters of RFC 3986, as
+ * curl_easy_escape does. Returns the encoded length, out may be NULL to measure.
+ */
+static size_t escapeHttpUrlValue(const char *value, char *out)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    size_t length = 0;
+
+    for(; *value; value++)
+    {
+        unsigned char c = (unsigned char) *value;
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                || c == '-' || c == '.' || c == '_' || c == '~')
+        {
+            if(out)
+                out[length] = c;
+            length++;
+        }
+        else
+        {
+            if(out)
+            {
+                out[length] = '%';
+                out[length + 1] = hex[c >> 4];
+                out[length + 2] = hex[c & 0x0F];
+            }
+            length += 3;
+        }
+    }
+    if(out)
+        out[length] = '\0';
+    return length;
+}
+
+static T2ERROR setHTTPUrlParamValue(HTTPUrlParam *urlParam, const char *value)
+{
+    size_t nameLength = strlen(urlParam->param->HttpName);
+    size_t length = nameLength + 1 + escapeHttpUrlValue(value, NULL);
+    char *fragment = (char *) malloc(length + 1);
+
+    if(fragment == NULL)
+    {
+        T2Error("Unable to allocate %lu bytes of memory at Line %d on %s \n", (unsigned long) length + 1, __LINE__, __FILE__);
+        return T2ERROR_FAILURE;
+    }
+    memcpy(fragment, urlParam->param->HttpName, nameLength);
+    fragment[nameLength] = '=';
+    escapeHttpUrlValue(value, fragment + nameLength + 1);
+    free(urlParam->fragment.data);
+    urlParam->fragment.data = fragment;
+    urlParam->fragment.length = length;
+    return T2ERROR_SUCCESS;
+}
+
+HTTPUrlTemplate* compileHTTPUrlTemplate(T2HTTP *http)
+{
+    HTTPUrlTemplate *urlTemplate = NULL;
+    int index;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(http == NULL || http->URL == NULL)
+        return NULL;
+    urlTemplate = (HTTPUrlTemplate *) calloc(1, sizeof(HTTPUrlTemplate));
+    if(urlTemplate == NULL || (urlTemplate->baseUrl.data = strdup(http->URL)) == NULL)
+    {
+        free(urlTemplate);
+        return NULL;
+    }
+    urlTemplate->baseUrl.length = strlen(http->URL);
+    urlTemplate->paramCount = Vector_Size(http->RequestURIparamList);
+    if(urlTemplate->paramCount > 0
+            && (urlTemplate->params = (HTTPUrlParam *) calloc(urlTemplate->paramCount, sizeof(HTTPUrlParam))) == NULL)
+    {
+        freeHTTPUrlTemplate(urlTemplate);
+        return NULL;
+    }
+    for(index = 0; index < urlTemplate->paramCount; index++)
+    {
+        HTTPUrlParam *urlParam = &urlTemplate->params[index];
+        urlParam->param = (const HTTPReqParam *) Vector_At(http->RequestURIparamList, index);
+        // Static values are escaped here once, dynamic ones on their first report
+        if(urlParam->param->HttpValue && T2ERROR_SUCCESS != setHTTPUrlParamValue(urlParam, urlParam->param->HttpValue))
+        {
+            freeHTTPUrlTemplate(urlTemplate);
+            return NULL;
+        }
+    }
+    T2Debug("%s --out\n", __FUNCTION__);
+    return urlTemplate;
+}
+
+void freeHTTPUrlTemplate(HTTPUrlTemplate *urlTemplate)
+{
+    int index;
+
+    if(urlTemplate == NULL)
+        return;
+    for(index = 0; urlTemplate->params && index < urlTemplate->paramCount; index++)
+    {
+        free(urlTemplate->params[index].fragment.data);
+        free(urlTemplate->params[index].lastValue);
+    }
+    free(urlTemplate->params);
+    free(urlTemplate->baseUrl.data);
+    free(urlTemplate->buffer);
+    free(urlTemplate);
+}
+
+/**
+ * Refresh the dynamic parameters and assemble the URL. Values are read through
+ * getParameterValue, from the parameter cache for parameters with a cacheTTL rule.
+ * The returned URL is owned by the template and valid until the next call.
+ */
+const char* buildHttpUrl(HTTPUrlTemplate *urlTemplate)
+{
+    size_t length = 0;
+    bool firstParam = true;
+    int index;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    if(urlTemplate == NULL)
+        return NULL;
 
-            if (httpParam->HttpValue)		//Static parameter
+    length = urlTemplate->baseUrl.length;
+    for(index = 0; index < urlTemplate->paramCount; index++)
+    {
+        HTTPUrlParam *urlParam = &urlTemplate->params[index];
+        urlParam->included = false;
+        if(urlParam->param->HttpValue == NULL)		//Dynamic parameter
+        {
+            char *paramValue = NULL;
+            if(T2ERROR_SUCCESS != getParameterValue(urlParam->param->HttpRef, &paramValue))
             {
-                httpParamVal = curl_easy_escape(curl, httpParam->HttpValue, 0);
+                T2Error("Failed to retrieve param : %s\n", urlParam->param->HttpRef);
+                continue;
             }
-            else				//Dynamic parameter
+            if(paramValue[0] == '\0')
             {
-                if(T2ERROR_SUCCESS != getParameterValue(httpParam->HttpRef, &paramValue))
-                {
-                    T2Error("Failed to retrieve param : %s\n", httpParam->HttpRef);
-                    continue;
-                }
-                else
+                free(paramValue);
+                T2Error("Param value is empty for : %s\n", urlParam->param->HttpRef);
+                continue;
+            }
+            if(urlParam->lastValue == NULL || strcmp(urlParam->lastValue, paramValue) != 0)
+            {
+                if(T2ERROR_SUCCESS != setHTTPUrlParamValue(urlParam, paramValue))
                 {
-                    if (paramValue[0] == '\0') {
-                        free(paramValue);
-                        T2Error("Param value is empty for : %s\n", httpParam->HttpRef);
-                        continue;
-                    }
-
-                    httpParamVal = curl_easy_escape(curl, paramValue, 0);
                     free(paramValue);
-                    paramValue = NULL;
+                    continue;
                 }
+                free(urlParam->lastValue);
+                urlParam->lastValue = paramValue;
             }
-
-            int new_params_len = params_len /* current params length */
-                           + strlen(httpParam->HttpName) /* Length of parameter 'Name' */ + strlen("=")
-                           + strlen("&") /* Add '&' for next paramter */ + 1;
-            if(httpParamVal)
+            else
             {
-                new_params_len += strlen(httpParamVal);
-            }
-            url_params = realloc(url_params, new_params_len);
-            if(url_params == NULL){
-                T2Error("Unable to allocate %d bytes of memory at Line %d on %s \n",new_params_len, __LINE__, __FILE__);
-                curl_free(httpParamVal);
-                continue;
+                free(paramValue);
             }
-            params_len += snprintf(url_params+params_len, new_params_len-params_len, "%s=%s&", httpParam->HttpName, httpParamVal);
-
-            curl_free(httpParamVal);
         }
+        if(urlParam->fragment.data == NULL)
+            continue;
+        urlParam->included = true;
+        length += 1 + urlParam->fragment.length;
+    }
 
-        if (params_len > 0 && url_params != NULL)
+    if(length + 1 > urlTemplate->capacity)
+    {
+        char *buffer = (char *) realloc(urlTemplate->buffer, length + 1);
+        if(buffer == NULL)
         {
-            url_params[params_len-1] = '\0';
-
-            int url_len = strlen(httpUrl);
-            int modified_url_len = url_len + strlen("?") + strlen(url_params) + 1;
-
-            httpUrl = realloc(httpUrl, modified_url_len);
-            snprintf(httpUrl+url_len, modified_url_len-url_len, "?%s", url_params);
-
+            T2Error("Unable to allocate %lu bytes of memory at Line %d on %s \n", (unsigned long) length + 1, __LINE__, __FILE__);
+            return NULL;
         }
-       if(url_params){
-           free(url_params);
-       }
+        urlTemplate->buffer = buffer;
+        urlTemplate->capacity = length + 1;
+    }
+    memcpy(urlTemplate->buffer, urlTemplate->baseUrl.data, urlTemplate->baseUrl.length);
+    length = urlTemplate->baseUrl.length;
+    for(index = 0; index < urlTemplate->paramCount; index++)
+    {
+        if(!urlTemplate->params[index].included)
+            continue;
+        urlTemplate->buffer[length++] = firstParam ? '?' : '&';
+        firstParam = false;
+        memcpy(urlTemplate->buffer + length, urlTemplate->params[index].fragment.data, urlTemplate->params[index].fragment.length);
+        length += urlTemplate->params[index].fragment.length;
     }
+    urlTemplate->buffer[length] = '\0';
 
-    curl_easy_cleanup(curl);
-    T2Debug("%s: Modified URL: %s \n", __FUNCTION__, httpUrl);
+    T2Debug("%s: Modified URL: %s \n", __FUNCTION__, urlTemplate->buffer);
+    return urlTemplate->buffer;
+}
+
+char *prepareHttpUrl(T2HTTP *http)
+{
+    HTTPUrlTemplate *urlTemplate = compileHTTPUrlTemplate(http);
+    const char *url = buildHttpUrl(urlTemplate);
+    char *httpUrl = url ? strdup(url) : NULL;
 
+    freeHTTPUrlTemplate(urlTemplate);
     return httpUrl;
 }
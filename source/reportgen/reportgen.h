@@ -20,10 +20,41 @@
 #ifndef _REPORTGEN_H_
 #define _REPORTGEN_H_
 
-#include <cjson/cJSON.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <msgpack.h>
 
 #include "vector.h"
 
+/* Initial capacity of a report buffer when the size estimate is smaller */
+#ifndef JSON_REPORT_MIN_SIZE
+#define JSON_REPORT_MIN_SIZE 1024
+#endif
+
+/* Value length assumed per dynamic parameter and marker when estimating the report size */
+#ifndef JSON_REPORT_VALUE_ESTIMATE
+#define JSON_REPORT_VALUE_ESTIMATE 32
+#endif
+
+/* Initial nesting capacity of a report writer, object hierarchy reports nest one level
+ * per path segment and grow it as needed */
+#ifndef JSON_REPORT_DEPTH_HINT
+#define JSON_REPORT_DEPTH_HINT 16
+#endif
+
+/* Name of the item that numbers the parts of a split report as "<index>/<count>" */
+#define REPORT_PART_NAME "ReportPart"
+
+/* Every Nth report of a delta reporting profile carries all values */
+#ifndef REPORT_DELTA_SNAPSHOT_PERIOD
+#define REPORT_DELTA_SNAPSHOT_PERIOD 12
+#endif
+
+/* Header item that tells a delta report from a full one, full reports do not carry it */
+#define REPORT_TYPE_NAME "ReportType"
+#define REPORT_TYPE_DELTA "delta"
+
 typedef struct _HTTPReqParam
 {
     char* HttpName;
@@ -39,33 +70,253 @@ typedef enum
 
 typedef enum
 {
-    COMP_NONE
+    COMP_NONE,
+    COMP_GZIP,
+    COMP_DEFLATE
 }HTTPComp;
 
+/* How reports are packed into one request when spooled reports are resent */
+typedef enum
+{
+    BATCH_NONE,
+    BATCH_JSONARRAY,
+    BATCH_NDJSON
+}HTTPBatch;
+
+/* zlib levels 0-9, -1 lets zlib pick its default trade-off */
+#define HTTP_COMPRESSION_LEVEL_DEFAULT -1
+#define HTTP_COMPRESSION_LEVEL_MAX 9
+
 typedef struct _T2HTTP
 {
     char *URL;
     HTTPComp Compression;
+    int CompressionLevel;
+    HTTPBatch CachedReportBatch;
     HTTPMethod Method;
     Vector *RequestURIparamList;
 }T2HTTP;
 
+typedef struct _JSONReportFragment
+{
+    char *data;
+    size_t length;
+}JSONReportFragment;
+
+typedef struct _HTTPUrlParam
+{
+    const HTTPReqParam *param;
+    // "<name>=<escaped value>", rebuilt for a dynamic parameter when its value changes
+    JSONReportFragment fragment;
+    char *lastValue;
+    // Part of the URL being built, false when a dynamic value could not be fetched
+    bool included;
+}HTTPUrlParam;
+
+/**
+ * Upload URL of a profile with its request parameters, compiled once when the
+ * profile is added. Static parameters are escaped up front, the URL of a report
+ * is assembled into a buffer reused across reports.
+ */
+typedef struct _HTTPUrlTemplate
+{
+    JSONReportFragment baseUrl;
+    HTTPUrlParam *params;
+    int paramCount;
+    char *buffer;
+    size_t capacity;
+}HTTPUrlTemplate;
+
+/**
+ * Path trie node of an object hierarchy report. Nodes for the names known at
+ * profile load are compiled once into the profile's template and are not modified
+ * by reports, their values are kept by the report writer under the node's index.
+ * Names only known at report time, instances of partial path parameters and grep
+ * results, are added as transient nodes owned by the writer of that report.
+ */
+typedef struct _JSONReportNode
+{
+    char *segment;
+    JSONReportFragment key;
+    JSONReportFragment staticValue;
+    unsigned int index;
+    // Transient nodes only, compiled nodes keep their values in the writer
+    char *value;
+    bool transient;
+    Vector *children;
+}JSONReportNode;
+
+/**
+ * Parts of a profile's report that are identical in every cycle, serialized once
+ * when the profile is added. Name fragments are quoted and escaped and are kept
+ * aligned by index with the lists the template was compiled from.
+ */
+typedef struct _JSONReportTemplate
+{
+    const Vector *staticParamList;
+    const Vector *paramList;
+    const Vector *eMarkerList;
+    JSONReportFragment staticItems;
+    JSONReportFragment *paramNames;
+    int paramCount;
+    JSONReportFragment *eventNames;
+    int eventCount;
+    size_t sizeHint;
+    // Object hierarchy format only, leaf nodes aligned with paramList and eMarkerList
+    JSONReportNode *hierarchy;
+    JSONReportNode **paramNodes;
+    JSONReportNode **eventNodes;
+    unsigned int nodeCount;
+}JSONReportTemplate;
+
+/**
+ * Delta reporting state of a profile. Hashes of the values of the last successful
+ * upload are kept aligned by index with paramList and eMarkerList, values whose hash
+ * did not change are left out unless the report is a full snapshot.
+ */
+typedef struct _ReportDelta
+{
+    uint64_t *paramHashes;
+    uint64_t *eventHashes;
+    // Hashes of the report in progress, committed once it is uploaded
+    uint64_t *pendingParamHashes;
+    uint64_t *pendingEventHashes;
+    int paramCount;
+    int eventCount;
+    unsigned int snapshotPeriod;
+    unsigned int reportsSinceSnapshot;
+    bool hasBaseline;
+    bool fullReport;
+}ReportDelta;
+
+/**
+ * Streaming writer for the {"<root>":[{"name":"value"},...]} report layout.
+ * Items are escaped and appended straight into one growable buffer. With an
+ * object hierarchy template values are collected against the template's trie
+ * instead and written as {"<root>":[{"Device":{...}}]} by prepareJSONReport.
+ */
+typedef struct _JSONReportWriter
+{
+    char *buffer;
+    size_t length;
+    size_t capacity;
+    unsigned int depth;
+    bool *needComma;
+    unsigned int depthCapacity;
+    bool failed;
+    const JSONReportTemplate *reportTemplate;
+    // Object hierarchy values of this report, indexed by compiled node
+    char **nodeValues;
+    // Transient nodes of this report below each compiled node
+    Vector **nodeExtras;
+    ReportDelta *delta;
+    // Start of each top-level item after the static ones, where a report may be split
+    size_t rootLength;
+    size_t *itemOffsets;
+    unsigned int itemCount;
+    unsigned int itemCapacity;
+}JSONReportWriter;
+
+/**
+ * Writer for MessagePack reports, laid out like the JSON name/value format with
+ * counters packed as integers. Items are packed as they are encoded, the root map
+ * and array headers that need the item count are prepended by prepareMsgPackReport.
+ */
+typedef struct _MsgPackReportWriter
+{
+    msgpack_sbuffer items;
+    msgpack_packer packer;
+    uint32_t itemCount;
+    char *rootName;
+    bool failed;
+    ReportDelta *delta;
+    // Static items lead the buffer, followed by the items that may be split
+    uint32_t headerItemCount;
+    size_t *itemOffsets;
+    unsigned int itemCapacity;
+}MsgPackReportWriter;
+
+/**
+ * One self-contained report of a split. JSON parts are also NUL terminated.
+ */
+typedef struct _ReportPart
+{
+    char *data;
+    size_t length;
+}ReportPart;
+
 void freeProfileValues(void* data);
 
 void getTimeStamp (char** timeStamp);
 
-T2ERROR destroyJSONReport(cJSON *jsonObj);
+size_t estimateJSONReportSize(Vector *staticParamList, Vector *paramList, Vector *gMarkerList, Vector *eMarkerList);
 
-T2ERROR encodeParamResultInJSON(cJSON *valArray, Vector *paramNameList, Vector *paramValueList);
+T2ERROR initJSONReport(JSONReportWriter **writer, const char *rootName, size_t sizeHint);
 
-T2ERROR encodeStaticParamsInJSON(cJSON *valArray, Vector *staticParamList);
+JSONReportTemplate* compileJSONReportTemplate(Vector *staticParamList, Vector *paramList, Vector *eMarkerList, bool objectHierarchy);
 
-T2ERROR encodeGrepResultInJSON(cJSON *valArray, Vector *grepResult);
+void freeJSONReportTemplate(JSONReportTemplate *reportTemplate);
 
-T2ERROR encodeEventMarkersInJSON(cJSON *valArray, Vector *eventMarkerList);
+T2ERROR initJSONReportFromTemplate(JSONReportWriter **writer, const char *rootName, const JSONReportTemplate *reportTemplate);
 
-T2ERROR prepareJSONReport(cJSON* jsonObj, char** reportBuff);
+void addJSONReportString(JSONReportWriter *writer, const char *name, const char *value);
+
+void beginJSONReportList(JSONReportWriter *writer, const char *name);
+
+void endJSONReportList(JSONReportWriter *writer);
+
+void markJSONReportHeader(JSONReportWriter *writer);
+
+T2ERROR destroyJSONReport(JSONReportWriter *writer);
+
+T2ERROR encodeParamResultInJSON(JSONReportWriter *writer, Vector *paramNameList, Vector *paramValueList);
+
+T2ERROR encodeStaticParamsInJSON(JSONReportWriter *writer, Vector *staticParamList);
+
+T2ERROR encodeGrepResultInJSON(JSONReportWriter *writer, Vector *grepResult);
+
+T2ERROR encodeEventMarkersInJSON(JSONReportWriter *writer, Vector *eventMarkerList);
+
+T2ERROR encodeReportTypeInJSON(JSONReportWriter *writer);
+
+T2ERROR prepareJSONReport(JSONReportWriter *writer, char** reportBuff);
+
+T2ERROR prepareJSONReportParts(JSONReportWriter *writer, size_t maxReportSize, Vector *reportParts);
+
+void freeReportPart(void *data);
+
+T2ERROR initMsgPackReport(MsgPackReportWriter **writer, const char *rootName);
+
+T2ERROR destroyMsgPackReport(MsgPackReportWriter *writer);
+
+T2ERROR encodeParamResultInMsgPack(MsgPackReportWriter *writer, Vector *paramNameList, Vector *paramValueList);
+
+T2ERROR encodeStaticParamsInMsgPack(MsgPackReportWriter *writer, Vector *staticParamList);
+
+T2ERROR encodeGrepResultInMsgPack(MsgPackReportWriter *writer, Vector *grepResult);
+
+T2ERROR encodeEventMarkersInMsgPack(MsgPackReportWriter *writer, Vector *eventMarkerList);
+
+T2ERROR encodeReportTypeInMsgPack(MsgPackReportWriter *writer);
+
+T2ERROR prepareMsgPackReport(MsgPackReportWriter *writer, char **reportBuff, size_t *reportSize);
+
+T2ERROR prepareMsgPackReportParts(MsgPackReportWriter *writer, size_t maxReportSize, Vector *reportParts);
+
+ReportDelta* createReportDelta(int paramCount, int eventCount, unsigned int snapshotPeriod);
+
+void freeReportDelta(ReportDelta *delta);
+
+void beginReportDelta(ReportDelta *delta, bool fullReport);
+
+void commitReportDelta(ReportDelta *delta);
 
 char *prepareHttpUrl(T2HTTP *http);
 
+HTTPUrlTemplate* compileHTTPUrlTemplate(T2HTTP *http);
+
+void freeHTTPUrlTemplate(HTTPUrlTemplate *urlTemplate);
+
+const char* buildHttpUrl(HTTPUrlTemplate *urlTemplate);
+
 #endif /* _REPORTGEN_H_ */
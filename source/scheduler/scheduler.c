@@ -27,6 +27,9 @@
 #include <stddef.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 
 #include "t2log_wrapper.h"
 #include "scheduler.h"
@@ -39,15 +42,43 @@ static Vector *profileList = NULL;
 static pthread_mutex_t scMutex;
 static bool sc_initialized = false;
 
+// Armed timers, earliest deadline first, under scMutex
+static SchedulerProfile **timerHeap = NULL;
+static int heapSize = 0;
+static int heapCapacity = 0;
+static pthread_t schedulerThread;
+// Signalled whenever a callback returns, unregister waits on it
+static pthread_cond_t callbackCond;
+// Activation timeout callbacks running on their own threads, uninit waits for them
+static int activationCallbacks = 0;
+static bool schedulerRunning = false;
+// Written to wake the scheduler thread when timers change
+static int schedulerWakeup[2] = { -1, -1 };
+// Becomes readable when the realtime clock is set, -1 where unsupported
+static int clockChangeFd = -1;
+// CLOCK_REALTIME - CLOCK_MONOTONIC when the aligned timers were last computed
+static int64_t realtimeOffset = 0;
+
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+
+#define NSEC_PER_SEC 1000000000LL
+
+static int64_t getClockTime(clockid_t clockId)
+{
+    struct timespec ts;
+
+    clock_gettime(clockId, &ts);
+    return (int64_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
 void freeSchedulerProfile(void *data)
 {
     if(data != NULL)
     {
         SchedulerProfile *schProfile = (SchedulerProfile *)data;
         free(schProfile->name);
-        pthread_mutex_destroy(&schProfile->tMutex);
-        pthread_cond_destroy(&schProfile->tCond);
-        pthread_detach(schProfile->tId);
         free(schProfile);
     }
 }
@@ -93,101 +124,396 @@ int getLapsedTime (struct timespec *output, struct timespec *time1, struct times
     return 0;
 }
 
-void* TimeoutThread(void *arg)
+static bool isDeadlineBefore(const int64_t *a, const int64_t *b)
 {
-    SchedulerProfile *tProfile = (SchedulerProfile*)arg;
-    struct timespec _ts;
-    struct timespec _now;
-    struct timespec _MinThresholdTimeTs;
-    struct timespec _MinThresholdTimeStart;
-    unsigned int minThresholdTime = 0;
-    int n;
-    T2Debug("%s ++in\n", __FUNCTION__);
-    registerTriggerConditionConsumer();
+    return *a < *b;
+}
 
-    while(tProfile->repeat && !tProfile->terminated)
-    {
-        memset(&_ts, 0, sizeof(struct timespec));
-        memset(&_now, 0, sizeof(struct timespec));
+// Heap operations, called with scMutex held
+static void heapSwap(int i, int j)
+{
+    SchedulerProfile *tProfile = timerHeap[i];
+
+    timerHeap[i] = timerHeap[j];
+    timerHeap[j] = tProfile;
+    timerHeap[i]->heapIndex = i;
+    timerHeap[j]->heapIndex = j;
+}
 
-        pthread_mutex_lock(&tProfile->tMutex);
+static void heapSiftUp(int index)
+{
+    while(index > 0 && isDeadlineBefore(&timerHeap[index]->deadline, &timerHeap[(index - 1) / 2]->deadline))
+    {
+        heapSwap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
 
-        clock_gettime(CLOCK_REALTIME, &_now);
-        _ts.tv_sec = _now.tv_sec + tProfile->timeOutDuration;
+static void heapSiftDown(int index)
+{
+    while(true)
+    {
+        int earliest = index;
+        int child = 2 * index + 1;
+        if(child < heapSize && isDeadlineBefore(&timerHeap[child]->deadline, &timerHeap[earliest]->deadline))
+            earliest = child;
+        child++;
+        if(child < heapSize && isDeadlineBefore(&timerHeap[child]->deadline, &timerHeap[earliest]->deadline))
+            earliest = child;
+        if(earliest == index)
+            break;
+        heapSwap(index, earliest);
+        index = earliest;
+    }
+}
 
-        T2Info("Waiting for %d sec for next TIMEOUT for profile - %s\n", tProfile->timeOutDuration, tProfile->name);
-        n = pthread_cond_timedwait(&tProfile->tCond, &tProfile->tMutex, &_ts);
-        if(n == ETIMEDOUT)
+static T2ERROR heapInsert(SchedulerProfile *tProfile)
+{
+    if(heapSize == heapCapacity)
+    {
+        int capacity = heapCapacity ? heapCapacity * 2 : 16;
+        SchedulerProfile **heap = (SchedulerProfile **) realloc(timerHeap, capacity * sizeof(SchedulerProfile *));
+        if(heap == NULL)
         {
-            T2Info("TIMEOUT for profile - %s\n", tProfile->name);
-            timeoutNotificationCb(tProfile->name, false);
+            T2Error("Unable to grow the scheduler timer heap\n");
+            return T2ERROR_MEMALLOC_FAILED;
         }
-        else if (n == 0)
+        timerHeap = heap;
+        heapCapacity = capacity;
+    }
+    timerHeap[heapSize] = tProfile;
+    tProfile->heapIndex = heapSize++;
+    heapSiftUp(tProfile->heapIndex);
+    return T2ERROR_SUCCESS;
+}
+
+static void heapRemove(SchedulerProfile *tProfile)
+{
+    int index = tProfile->heapIndex;
+
+    if(index < 0)
+        return;
+    tProfile->heapIndex = -1;
+    heapSize--;
+    if(index == heapSize)
+        return;
+    timerHeap[index] = timerHeap[heapSize];
+    timerHeap[index]->heapIndex = index;
+    heapSiftUp(index);
+    heapSiftDown(timerHeap[index]->heapIndex);
+}
+
+// Move an armed timer after its deadline changed
+static void heapUpdate(SchedulerProfile *tProfile)
+{
+    if(tProfile->heapIndex < 0)
+        return;
+    heapSiftUp(tProfile->heapIndex);
+    heapSiftDown(tProfile->heapIndex);
+}
+
+static void wakeScheduler()
+{
+    char wakeup = 0;
+
+    if(schedulerWakeup[1] >= 0 && write(schedulerWakeup[1], &wakeup, 1) != 1 && errno != EAGAIN)
+        T2Warning("Unable to wake scheduler thread\n");
+}
+
+/**
+ * First report deadline after now. Without a time reference the grid starts now,
+ * with one it is placed so reports fall on timeRef + k * timeOutDuration in UTC.
+ */
+static int64_t getFirstPeriodDeadline(SchedulerProfile *tProfile, int64_t monotonicNow, int64_t realtimeNow)
+{
+    int64_t interval = (int64_t) tProfile->timeOutDuration * NSEC_PER_SEC;
+    int64_t offset;
+
+    if(tProfile->timeRef == 0 || interval == 0)
+        return monotonicNow + interval;
+    offset = (realtimeNow - (int64_t) tProfile->timeRef * NSEC_PER_SEC) % interval;
+    if(offset < 0)
+        offset += interval;
+    return monotonicNow + interval - offset;
+}
+
+// Heap key of a timer, the earliest of a pending interrupt, the next report and the activation timeout
+static void updateTimerDeadline(SchedulerProfile *tProfile, int64_t now)
+{
+    tProfile->deadline = tProfile->interruptPending ? now : tProfile->periodDeadline;
+    if(tProfile->timeToLive != INFINITE_TIMEOUT && tProfile->activationDeadline < tProfile->deadline)
+        tProfile->deadline = tProfile->activationDeadline;
+    heapUpdate(tProfile);
+}
+
+static void armTimer(SchedulerProfile *tProfile, int64_t now)
+{
+    updateTimerDeadline(tProfile, now);
+    if(T2ERROR_SUCCESS == heapInsert(tProfile))
+        T2Info("Waiting for %lld sec for next TIMEOUT for profile - %s\n",
+                (long long) ((tProfile->deadline - now + NSEC_PER_SEC - 1) / NSEC_PER_SEC), tProfile->name);
+}
+
+/**
+ * Detect a step of the realtime clock, by NTP at boot or by hand, and move the
+ * profiles aligned to a time reference onto the new wall clock grid. Profiles
+ * without a reference run on the monotonic clock only and keep their schedule.
+ * Called with scMutex held.
+ */
+static void checkRealtimeClock(int64_t now, bool clockSet)
+{
+    int64_t realtimeNow = getClockTime(CLOCK_REALTIME);
+    int64_t offset = realtimeNow - now;
+    int64_t step = offset - realtimeOffset;
+    int index;
+
+    if(!clockSet && step < SCHEDULER_CLOCK_STEP_THRESHOLD * NSEC_PER_SEC && step > -SCHEDULER_CLOCK_STEP_THRESHOLD * NSEC_PER_SEC)
+        return;
+    realtimeOffset = offset;
+    if(step == 0)
+        return;
+    T2Info("Realtime clock stepped by %lld ms, realigning report schedules\n", (long long) (step / 1000000));
+    for(index = 0; index < Vector_Size(profileList); index++)
+    {
+        SchedulerProfile *tProfile = (SchedulerProfile *)Vector_At(profileList, index);
+        if(tProfile->timeRef == 0 || tProfile->timeOutDuration == 0 || tProfile->heapIndex < 0)
+            continue;
+        tProfile->periodDeadline = getFirstPeriodDeadline(tProfile, now, realtimeNow);
+        updateTimerDeadline(tProfile, now);
+    }
+}
+
+static void armClockChangeTimer()
+{
+    struct itimerspec spec;
+
+    if(clockChangeFd < 0)
+        return;
+    // Never expires, only reports the clock being set
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = 0x7FFFFFFF;
+    if(timerfd_settime(clockChangeFd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) != 0)
+    {
+        T2Warning("Realtime clock changes are only noticed on the next timeout\n");
+        close(clockChangeFd);
+        clockChangeFd = -1;
+    }
+}
+
+static SchedulerProfile* findSchedulerProfile(const char *profileName)
+{
+    int index = 0;
+
+    for(; index < Vector_Size(profileList); ++index)
+    {
+        SchedulerProfile *tProfile = (SchedulerProfile *)Vector_At(profileList, index);
+        if(strcmp(tProfile->name, profileName) == 0)
+            return tProfile;
+    }
+    return NULL;
+}
+
+static void* registerTriggerConditions(void *arg)
+{
+    (void) arg;
+    registerTriggerConditionConsumer();
+    return NULL;
+}
+
+static void* activationTimeoutThread(void *arg)
+{
+    char *profileName = (char *) arg;
+
+    activationTimeoutCb(profileName);
+    free(profileName);
+    pthread_mutex_lock(&scMutex);
+    activationCallbacks--;
+    pthread_cond_broadcast(&callbackCond);
+    pthread_mutex_unlock(&scMutex);
+    return NULL;
+}
+
+/**
+ * Hand an expired profile to the activation timeout callback on a detached thread.
+ * Removing a profile waits for its report and uploads, which must not hold up the
+ * timers of other profiles. Called with scMutex held, takes over profileName.
+ */
+static void notifyActivationTimeout(char *profileName)
+{
+    pthread_t callbackThread;
+    pthread_attr_t callbackAttr;
+
+    pthread_attr_init(&callbackAttr);
+    pthread_attr_setdetachstate(&callbackAttr, PTHREAD_CREATE_DETACHED);
+    activationCallbacks++;
+    if(pthread_create(&callbackThread, &callbackAttr, activationTimeoutThread, profileName) != 0)
+    {
+        activationCallbacks--;
+        T2Error("Unable to start activation timeout handling for profile : %s, handling it on the scheduler thread\n", profileName);
+        pthread_mutex_unlock(&scMutex);
+        activationTimeoutCb(profileName);
+        free(profileName);
+        pthread_mutex_lock(&scMutex);
+    }
+    pthread_attr_destroy(&callbackAttr);
+}
+
+/**
+ * Advance the report deadline to the next slot on the grid after now, periods
+ * missed while the device was busy are skipped.
+ */
+static void advancePeriodDeadline(SchedulerProfile *tProfile, int64_t now)
+{
+    int64_t interval = (int64_t) tProfile->timeOutDuration * NSEC_PER_SEC;
+    int64_t periods;
+
+    if(interval <= 0 || now < tProfile->periodDeadline)
+        return;
+    periods = (now - tProfile->periodDeadline) / interval + 1;
+    if(periods > 1)
+        T2Warning("Profile : %s missed %lld report periods\n", tProfile->name, (long long) (periods - 1));
+    tProfile->periodDeadline += periods * interval;
+}
+
+/**
+ * Serve a timer whose deadline was reached, called on the scheduler thread with
+ * scMutex held. Callbacks run without it, they may register and unregister profiles.
+ */
+static void fireTimer(SchedulerProfile *tProfile, int64_t now)
+{
+    bool interrupted = tProfile->interruptPending;
+    bool notify = false;
+    unsigned int minThresholdTime = 0;
+
+    tProfile->interruptPending = false;
+    if(interrupted)
+    {
+        T2Info("Interrupted before TIMEOUT for profile : %s, minThresholdTime %u\n", tProfile->name, tProfile->minThresholdTime);
+        if(tProfile->minThresholdTime)
         {
-            T2Info("Interrupted before TIMEOUT for profile : %s, minThresholdTime %u\n", tProfile->name, minThresholdTime);
-            if(minThresholdTime) 
+            T2Debug("minThresholdTime left %lld -\n", (long long) ((now - tProfile->minThresholdStart) / NSEC_PER_SEC));
+            if((int64_t) tProfile->minThresholdTime * NSEC_PER_SEC < now - tProfile->minThresholdStart)
             {
-		 memset(&_MinThresholdTimeTs, 0, sizeof(struct timespec));
-                 clock_gettime(CLOCK_REALTIME, &_MinThresholdTimeTs);
-		 T2Debug("minThresholdTime left %ld -\n", (_MinThresholdTimeTs.tv_sec - _MinThresholdTimeStart.tv_sec));
-                 if(minThresholdTime < (_MinThresholdTimeTs.tv_sec - _MinThresholdTimeStart.tv_sec)){
-                      minThresholdTime = 0;
-		      T2Debug("minThresholdTime reset done\n");
-		 }     
+                tProfile->minThresholdTime = 0;
+                T2Debug("minThresholdTime reset done\n");
             }
+        }
+        notify = (tProfile->minThresholdTime == 0);
+        // The interrupted report stands in for a period that is due as well, which
+        // would otherwise fire again right away while this report is in progress
+        if(notify)
+            advancePeriodDeadline(tProfile, now);
+    }
+    else if(now >= tProfile->periodDeadline)
+    {
+        T2Info("TIMEOUT for profile - %s\n", tProfile->name);
+        notify = true;
+        advancePeriodDeadline(tProfile, now);
+    }
 
-            if(minThresholdTime == 0)
-            {
-                 timeoutNotificationCb(tProfile->name, true);
-                 if(tProfile->terminated)
-                 {
-                    T2Error("Profile : %s is being removed from scheduler \n", tProfile->name);
-                    pthread_mutex_unlock(&tProfile->tMutex);
-                    break;
-                 }
-                 minThresholdTime = getMinThresholdDuration(tProfile->name);
-                 T2Info("minThresholdTime %u\n", minThresholdTime);
-
-                 if(minThresholdTime)
-                 {
-		     memset(&_MinThresholdTimeStart, 0, sizeof(struct timespec));
-                     clock_gettime(CLOCK_REALTIME, &_MinThresholdTimeStart);
-                 }
-            }
+    if(notify)
+    {
+        tProfile->inCallback = true;
+        pthread_mutex_unlock(&scMutex);
+        timeoutNotificationCb(tProfile->name, interrupted);
+        if(interrupted)
+            minThresholdTime = getMinThresholdDuration(tProfile->name);
+        pthread_mutex_lock(&scMutex);
+        tProfile->inCallback = false;
+        pthread_cond_broadcast(&callbackCond);
+        if(tProfile->terminated)
+        {
+            T2Error("Profile : %s is being removed from scheduler \n", tProfile->name);
+            if(tProfile->freeAfterCallback)
+                freeSchedulerProfile(tProfile);
+            return;
         }
-        else
+        if(interrupted)
         {
-            T2Error("Profile : %s pthread_cond_timedwait ERROR!!!\n", tProfile->name);
+            tProfile->minThresholdTime = minThresholdTime;
+            T2Info("minThresholdTime %u\n", minThresholdTime);
+            if(minThresholdTime)
+                tProfile->minThresholdStart = getClockTime(CLOCK_MONOTONIC);
         }
+    }
+
+    /*
+     * Once the activation timeout passed, or after the single report
+     * of a profile without interval, invoke activationTimeout callback
+     * and remove the profile from the scheduler.
+     */
+    now = getClockTime(CLOCK_MONOTONIC);
+    if (tProfile->timeOutDuration == 0 || (tProfile->timeToLive != INFINITE_TIMEOUT && now >= tProfile->activationDeadline))
+    {
+        T2Info("Profile activation timeout for %s \n", tProfile->name);
+        char *profileName = strdup(tProfile->name);
+        Vector_RemoveItem(profileList, tProfile, freeSchedulerProfile);
+        if(profileName)
+            notifyActivationTimeout(profileName);
+        else
+            T2Error("Unable to notify activation timeout, out of memory\n");
+        return;
+    }
 
-        //Update activation timeout
-        if (tProfile->timeToLive != INFINITE_TIMEOUT)
+    // An interrupt that arrived during the callback is served right away
+    if(tProfile->repeat || tProfile->interruptPending)
+        armTimer(tProfile, now);
+}
+
+static void* SchedulerThread(void *arg)
+{
+    struct pollfd fds[2];
+    char drain[64];
+    int64_t now;
+    int timeout;
+    bool clockSet = false;
+    (void) arg;
+
+    T2Debug("%s ++in\n", __FUNCTION__);
+    fds[0].fd = schedulerWakeup[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = clockChangeFd;
+    fds[1].events = POLLIN;
+    pthread_mutex_lock(&scMutex);
+    while(schedulerRunning)
+    {
+        now = getClockTime(CLOCK_MONOTONIC);
+        checkRealtimeClock(now, clockSet);
+        clockSet = false;
+        if(heapSize > 0 && timerHeap[0]->deadline <= now)
         {
-            tProfile->timeToLive -= tProfile->timeOutDuration;
+            SchedulerProfile *tProfile = timerHeap[0];
+            heapRemove(tProfile);
+            fireTimer(tProfile, now);
+            continue;
         }
-
-        /*
-         * If timeToLive < timeOutDuration,
-         * invoke activationTimeout callback and
-         * exit timeout thread.
-         */
-        if (tProfile->timeOutDuration == 0 || tProfile->timeToLive < tProfile->timeOutDuration)
+        // Rounded up, so a timer is never found short of its deadline
+        timeout = -1;
+        if(heapSize > 0)
         {
-            T2Info("Profile activation timeout for %s \n", tProfile->name);
-            char *profileName = strdup(tProfile->name);
-            tProfile->repeat = false;
-            pthread_mutex_unlock(&tProfile->tMutex);
-            pthread_detach(pthread_self());
-
-            pthread_mutex_lock(&scMutex);
-            Vector_RemoveItem(profileList, tProfile, freeSchedulerProfile);
-            pthread_mutex_unlock(&scMutex);
-            activationTimeoutCb(profileName);
-            break;
+            int64_t wait = (timerHeap[0]->deadline - now + 999999) / 1000000;
+            timeout = (wait > 0x7FFFFFFF) ? 0x7FFFFFFF : (int) wait;
         }
+        pthread_mutex_unlock(&scMutex);
 
-        pthread_mutex_unlock(&tProfile->tMutex);
+        // Woken early by new timers, interrupts, removals and realtime clock changes
+        if(poll(fds, (clockChangeFd >= 0) ? 2 : 1, timeout) > 0)
+        {
+            if(fds[0].revents & POLLIN)
+                while(read(schedulerWakeup[0], drain, sizeof(drain)) > 0);
+            if(clockChangeFd >= 0 && (fds[1].revents & POLLIN))
+            {
+                uint64_t expirations;
+                if(read(clockChangeFd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED)
+                {
+                    clockSet = true;
+                    armClockChangeTimer();
+                }
+            }
+        }
+        pthread_mutex_lock(&scMutex);
     }
+    pthread_mutex_unlock(&scMutex);
     T2Debug("%s --out\n", __FUNCTION__);
     return NULL;
 }
@@ -203,21 +529,36 @@ T2ERROR SendInterruptToTimeoutThread(char* profileName)
     }
     int index = 0;
     pthread_mutex_lock(&scMutex);
-    for (; index < profileList->count; ++index)
+    for (; index < Vector_Size(profileList); ++index)
     {
         tProfile = (SchedulerProfile *)Vector_At(profileList, index);
         if(profileName == NULL || (strcmp(profileName, tProfile->name) == 0)) {
             T2Info("Sending Interrupt signal to Timeout Thread of profile : %s\n", tProfile->name);
-            pthread_mutex_lock(&tProfile->tMutex);
-            pthread_cond_signal(&tProfile->tCond);
-            pthread_mutex_unlock(&tProfile->tMutex);
+            tProfile->interruptPending = true;
+            updateTimerDeadline(tProfile, getClockTime(CLOCK_MONOTONIC));
         }
     }
+    wakeScheduler();
     pthread_mutex_unlock(&scMutex);
     T2Debug("%s --out\n", __FUNCTION__);
     return T2ERROR_SUCCESS;
 }
 
+static void closeSchedulerFds()
+{
+    if(schedulerWakeup[0] >= 0)
+    {
+        close(schedulerWakeup[0]);
+        close(schedulerWakeup[1]);
+        schedulerWakeup[0] = schedulerWakeup[1] = -1;
+    }
+    if(clockChangeFd >= 0)
+    {
+        close(clockChangeFd);
+        clockChangeFd = -1;
+    }
+}
+
 T2ERROR initScheduler(TimeoutNotificationCB notificationCb, ActivationTimeoutCB activationCB)
 {
     T2Debug("%s ++in\n", __FUNCTION__);
@@ -230,11 +571,39 @@ T2ERROR initScheduler(TimeoutNotificationCB notificationCb, ActivationTimeoutCB
     timeoutNotificationCb = notificationCb;
     activationTimeoutCb = activationCB;
 
-    sc_initialized = true;
     pthread_mutex_init(&scMutex, NULL);
+    pthread_cond_init(&callbackCond, NULL);
+    if(T2ERROR_SUCCESS != Vector_Create(&profileList))
+    {
+        T2Error("Unable to create scheduler profile list\n");
+        return T2ERROR_FAILURE;
+    }
+    if(pipe(schedulerWakeup) != 0)
+    {
+        T2Error("Unable to create scheduler wakeup pipe\n");
+        Vector_Destroy(profileList, NULL);
+        profileList = NULL;
+        return T2ERROR_FAILURE;
+    }
+    fcntl(schedulerWakeup[0], F_SETFL, O_NONBLOCK);
+    fcntl(schedulerWakeup[1], F_SETFL, O_NONBLOCK);
+    clockChangeFd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+    armClockChangeTimer();
+    realtimeOffset = getClockTime(CLOCK_REALTIME) - getClockTime(CLOCK_MONOTONIC);
+    schedulerRunning = true;
+    if(pthread_create(&schedulerThread, NULL, SchedulerThread, NULL) != 0)
+    {
+        T2Error("Unable to start scheduler thread\n");
+        schedulerRunning = false;
+        closeSchedulerFds();
+        Vector_Destroy(profileList, NULL);
+        profileList = NULL;
+        return T2ERROR_FAILURE;
+    }
+    sc_initialized = true;
 
     T2Debug("%s --out\n", __FUNCTION__);
-    return Vector_Create(&profileList);
+    return T2ERROR_SUCCESS;
 }
 
 void uninitScheduler()
@@ -252,78 +621,93 @@ void uninitScheduler()
     sc_initialized = false;
 
     pthread_mutex_lock(&scMutex);
-    for (; index < profileList->count; ++index)
+    schedulerRunning = false;
+    wakeScheduler();
+    pthread_mutex_unlock(&scMutex);
+    pthread_join(schedulerThread, NULL);
+    closeSchedulerFds();
+
+    pthread_mutex_lock(&scMutex);
+    while(activationCallbacks > 0)
+        pthread_cond_wait(&callbackCond, &scMutex);
+    for (; index < Vector_Size(profileList); ++index)
     {
         tProfile = (SchedulerProfile *)Vector_At(profileList, index);
-        pthread_mutex_lock(&tProfile->tMutex);
-        tProfile->terminated = true;
-        pthread_cond_signal(&tProfile->tCond);
-        pthread_mutex_unlock(&tProfile->tMutex);
-        pthread_join(tProfile->tId, NULL);
         T2Info("Profile %s successfully removed from Scheduler\n", tProfile->name);
     }
     Vector_Destroy(profileList, freeSchedulerProfile);
     profileList = NULL;
+    free(timerHeap);
+    timerHeap = NULL;
+    heapSize = heapCapacity = 0;
     pthread_mutex_unlock(&scMutex);
+    pthread_cond_destroy(&callbackCond);
     pthread_mutex_destroy(&scMutex);
     timeoutNotificationCb = NULL;
 
     T2Debug("%s --out\n", __FUNCTION__);
 }
 
-T2ERROR registerProfileWithScheduler(const char* profileName, unsigned int timeInterval, unsigned int activationTimeout, bool repeat)
+T2ERROR registerProfileWithScheduler(const char* profileName, unsigned int timeInterval, unsigned int activationTimeout, bool repeat, unsigned int timeRef)
 {
     T2ERROR ret;
+    int64_t now;
+    pthread_t consumerThread;
+    pthread_attr_t consumerAttr;
     T2Debug("%s ++in : profile - %s \n", __FUNCTION__,profileName);
-    if(timeoutNotificationCb == NULL)
+    if(timeoutNotificationCb == NULL || !sc_initialized)
     {
         T2Error("Timerout Callback not set - Scheduler isn't initialized yet, Unable to register profile\n");
         return T2ERROR_FAILURE;
     }
-    else
-    {
-        int index =  0 ;
-        bool isSchedulerAssigned = false ;
-        SchedulerProfile *tempSchProfile = NULL;
-        if(sc_initialized) { // Check for existing scheduler to avoid duplicate scheduler entries
-            pthread_mutex_lock(&scMutex);
-            for( ; index < profileList->count; ++index ) {
-                tempSchProfile = (SchedulerProfile *) Vector_At(profileList, index);
-                if(strcmp(tempSchProfile->name, profileName) == 0) {
-                    isSchedulerAssigned = true;
-                    break ;
-                }
-            }
-            pthread_mutex_unlock(&scMutex);
-            if (isSchedulerAssigned) {
-                T2Info("Scheduler already assigned for profile %s , exiting .\n", profileName );
-                T2Debug("%s --out\n", __FUNCTION__);
-                return T2ERROR_SUCCESS ;
-            }
-        }
-
-        SchedulerProfile *tProfile = (SchedulerProfile *)malloc(sizeof(SchedulerProfile));
-        tProfile->name = strdup(profileName);
-        tProfile->repeat = repeat;
-        tProfile->timeOutDuration = timeInterval;
-        tProfile->timeToLive = activationTimeout;
-        tProfile->terminated = false;
-        pthread_mutex_init(&tProfile->tMutex, NULL);
-        pthread_cond_init(&tProfile->tCond, NULL);
-        T2Info("Starting TimeoutThread for profile : %s\n", profileName);
-        pthread_create(&tProfile->tId, NULL, TimeoutThread, (void*)tProfile);
 
+    pthread_mutex_lock(&scMutex);
+    // Check for existing scheduler to avoid duplicate scheduler entries
+    if(findSchedulerProfile(profileName) != NULL)
+    {
+        pthread_mutex_unlock(&scMutex);
+        T2Info("Scheduler already assigned for profile %s , exiting .\n", profileName );
         T2Debug("%s --out\n", __FUNCTION__);
-        pthread_mutex_lock(&scMutex);
-        ret = Vector_PushBack(profileList, (void *)tProfile);
+        return T2ERROR_SUCCESS ;
+    }
+
+    SchedulerProfile *tProfile = (SchedulerProfile *)calloc(1, sizeof(SchedulerProfile));
+    if(tProfile == NULL || (tProfile->name = strdup(profileName)) == NULL)
+    {
         pthread_mutex_unlock(&scMutex);
-        return ret;
+        free(tProfile);
+        T2Error("Unable to allocate scheduler entry for profile : %s\n", profileName);
+        return T2ERROR_MEMALLOC_FAILED;
     }
+    tProfile->repeat = repeat;
+    tProfile->timeOutDuration = timeInterval;
+    tProfile->timeToLive = activationTimeout;
+    tProfile->timeRef = timeRef;
+    tProfile->terminated = false;
+    tProfile->heapIndex = -1;
+    now = getClockTime(CLOCK_MONOTONIC);
+    tProfile->periodDeadline = getFirstPeriodDeadline(tProfile, now, getClockTime(CLOCK_REALTIME));
+    if(activationTimeout != INFINITE_TIMEOUT)
+        tProfile->activationDeadline = now + (int64_t) activationTimeout * NSEC_PER_SEC;
+    T2Info("Scheduling timeouts for profile : %s%s\n", profileName, timeRef ? ", aligned to its time reference" : "");
+    ret = Vector_PushBack(profileList, (void *)tProfile);
+    armTimer(tProfile, now);
+    wakeScheduler();
+    pthread_mutex_unlock(&scMutex);
+
+    // Registration retries may sleep, keep them off the scheduler thread
+    pthread_attr_init(&consumerAttr);
+    pthread_attr_setdetachstate(&consumerAttr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&consumerThread, &consumerAttr, registerTriggerConditions, NULL) != 0)
+        T2Error("Unable to start trigger condition registration for profile : %s\n", profileName);
+    pthread_attr_destroy(&consumerAttr);
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return ret;
 }
 
 T2ERROR unregisterProfileFromScheduler(const char* profileName)
 {
-    int index = 0;
     SchedulerProfile *tProfile = NULL;
 
     T2Debug("%s ++in\n", __FUNCTION__);
@@ -335,27 +719,31 @@ T2ERROR unregisterProfileFromScheduler(const char* profileName)
     }
 
     pthread_mutex_lock(&scMutex);
-    for (; index < profileList->count; ++index)
+    tProfile = findSchedulerProfile(profileName);
+    if(tProfile == NULL)
     {
-        tProfile = (SchedulerProfile *)Vector_At(profileList, index);
-
-        if(strcmp(tProfile->name, profileName) == 0)
-        {
-            pthread_mutex_lock(&tProfile->tMutex);
-            tProfile->terminated = true;
-            pthread_cond_signal(&tProfile->tCond);
-            pthread_mutex_unlock(&tProfile->tMutex);
-
-            pthread_join(tProfile->tId, NULL);
-
-            Vector_RemoveItem(profileList, tProfile, freeSchedulerProfile);
-            pthread_mutex_unlock(&scMutex);
-
-            T2Debug("%s --out\n", __FUNCTION__);
-            return T2ERROR_SUCCESS;
-        }
+        pthread_mutex_unlock(&scMutex);
+        T2Info("profile: %s, not found in scheduler. Already removed\n", profileName);
+        return T2ERROR_FAILURE;
     }
+    tProfile->terminated = true;
+    heapRemove(tProfile);
+    Vector_RemoveItem(profileList, tProfile, NULL);
+    if(tProfile->inCallback && pthread_equal(pthread_self(), schedulerThread))
+    {
+        // Removed from within its own callback, freed once that returns
+        tProfile->freeAfterCallback = true;
+    }
+    else
+    {
+        // No callback for the profile may still be running when this returns
+        while(tProfile->inCallback)
+            pthread_cond_wait(&callbackCond, &scMutex);
+        freeSchedulerProfile(tProfile);
+    }
+    wakeScheduler();
     pthread_mutex_unlock(&scMutex);
-    T2Info("profile: %s, not found in scheduler. Already removed\n", profileName);
-    return T2ERROR_FAILURE;
+
+    T2Debug("%s --out\n", __FUNCTION__);
+    return T2ERROR_SUCCESS;
 }
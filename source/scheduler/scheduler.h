@@ -21,23 +21,46 @@
 #define _SCHEDULER_H_
 
 #include <sys/time.h>
+#include <stdint.h>
 #include <pthread.h>
 #include "telemetry2_0.h"
 
 
+/* A realtime clock jump beyond this many seconds realigns profiles with a TimeReference */
+#ifndef SCHEDULER_CLOCK_STEP_THRESHOLD
+#define SCHEDULER_CLOCK_STEP_THRESHOLD 2
+#endif
+
+/**
+ * Timer of a profile. All timers are kept in one min-heap ordered by deadline and
+ * served by a single scheduler thread, heapIndex is the timer's slot in the heap
+ * or -1 while it is not armed. Times are CLOCK_MONOTONIC nanoseconds, reports fall
+ * on the grid periodDeadline + k * timeOutDuration so they do not drift by the time
+ * a report takes. With a timeRef the grid is aligned to timeRef + k * timeOutDuration
+ * in UTC, and realigned when the realtime clock is stepped.
+ */
 typedef struct _SchedulerProfile
 {
     char* name;
     unsigned int timeOutDuration;
     unsigned int timeToLive;
+    unsigned int timeRef;
     bool repeat;
     bool terminated;
-    pthread_t tId;
-    pthread_mutex_t tMutex;
-    pthread_cond_t tCond;
-
+    int64_t deadline;
+    int64_t periodDeadline;
+    int64_t activationDeadline;
+    int heapIndex;
+    bool interruptPending;
+    // Callback running on the scheduler thread, the timer is freed once it returns
+    bool inCallback;
+    bool freeAfterCallback;
+    unsigned int minThresholdTime;
+    int64_t minThresholdStart;
 }SchedulerProfile;
 
+/* Timeout callbacks run on the scheduler thread and must not block, activation
+ * timeout callbacks run on a thread of their own */
 typedef void (*TimeoutNotificationCB)(const char* profileName, bool isClearSeekMap);
 typedef void (*ActivationTimeoutCB)(const char* profileName);
 
@@ -47,7 +70,7 @@ T2ERROR initScheduler(TimeoutNotificationCB notificationCb, ActivationTimeoutCB
 
 void uninitScheduler();
 
-T2ERROR registerProfileWithScheduler(const char* profileName, unsigned int timeInterval, unsigned int activationTimeout, bool repeat);
+T2ERROR registerProfileWithScheduler(const char* profileName, unsigned int timeInterval, unsigned int activationTimeout, bool repeat, unsigned int timeRef);
 
 T2ERROR unregisterProfileFromScheduler(const char* profileName);
 
@@ -21,9 +21,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <strings.h>
+#include <time.h>
 
 #include "xconfclient.h"
 #include "reportprofiles.h"
+#include "paramCache.h"
 #include "t2log_wrapper.h"
 
 static const int MAX_STATIC_PROP_VAL_LEN = 128 ;
@@ -61,8 +64,12 @@ static char * getProfileParameter(Profile * profile, const char *ref) {
         if(profile->reportingInterval)
             snprintf(pValue, MAX_STATIC_PROP_VAL_LEN, "%d", profile->reportingInterval);
     }else if(!strcmp(pName, "TimeReference")) {
-        if(profile->timeRef)
-            snprintf(pValue, MAX_STATIC_PROP_VAL_LEN, "%d", profile->timeRef);
+        if(profile->timeRef) {
+            time_t timeRef = profile->timeRef;
+            struct tm timeRefTm;
+            if(gmtime_r(&timeRef, &timeRefTm))
+                strftime(pValue, MAX_STATIC_PROP_VAL_LEN, "%Y-%m-%dT%H:%M:%SZ", &timeRefTm);
+        }
     }else if(!strcmp(pName, "ActivationTimeOut")) {
         if(profile->activationTimeoutPeriod)
             snprintf(pValue, MAX_STATIC_PROP_VAL_LEN, "%d", profile->activationTimeoutPeriod);
@@ -73,6 +80,76 @@ static char * getProfileParameter(Profile * profile, const char *ref) {
     return pValue;
 }
 
+static HTTPComp getHTTPCompression(const char *compression) {
+    if(compression == NULL || !strcasecmp(compression, "None"))
+        return COMP_NONE;
+    if(!strcasecmp(compression, "GZIP"))
+        return COMP_GZIP;
+    if(!strcasecmp(compression, "Deflate"))
+        return COMP_DEFLATE;
+    T2Warning("Unsupported HTTP compression %s, reports are sent uncompressed\n", compression);
+    return COMP_NONE;
+}
+
+static HTTPBatch getHTTPBatch(const char *batch) {
+    if(batch == NULL || !strcasecmp(batch, "None"))
+        return BATCH_NONE;
+    if(!strcasecmp(batch, "JSONArray"))
+        return BATCH_JSONARRAY;
+    if(!strcasecmp(batch, "NDJSON"))
+        return BATCH_NDJSON;
+    T2Warning("Unsupported cached report batch format %s, cached reports are sent one by one\n", batch);
+    return BATCH_NONE;
+}
+
+/**
+ * Seconds since the epoch of a TimeReference dateTime such as "2021-01-01T02:00:00Z",
+ * 0 for the unknown time "0001-01-01T00:00:00Z" and anything before 1970 or unparsable,
+ * which leaves the profile's reports unaligned.
+ */
+static unsigned int getTimeReference(const char *timeReference) {
+    int year, month, day, hour, minute, second, consumed = 0;
+    int offsetHour = 0, offsetMinute = 0, yearOfEra;
+    long long days, seconds;
+    const char *zone;
+
+    if(timeReference == NULL)
+        return 0;
+    if(sscanf(timeReference, "%4d-%2d-%2dT%2d:%2d:%2d%n", &year, &month, &day, &hour, &minute, &second, &consumed) != 6
+            || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        T2Warning("Unsupported TimeReference %s, reports are not aligned\n", timeReference);
+        return 0;
+    }
+    zone = timeReference + consumed;
+    if(*zone == '.')
+        while(*(++zone) >= '0' && *zone <= '9');
+    if((*zone == '+' || *zone == '-') && sscanf(zone + 1, "%2d:%2d", &offsetHour, &offsetMinute) == 2 && *zone == '-') {
+        offsetHour = -offsetHour;
+        offsetMinute = -offsetMinute;
+    }
+    if(year < 1970)
+        return 0;
+
+    // Days since the epoch of the civil date, years counted from March so leap days end them
+    if(month <= 2)
+        year--;
+    yearOfEra = year % 400;
+    days = (long long) (year / 400) * 146097 + yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100
+            + (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1 - 719468;
+    seconds = days * 86400 + hour * 3600 + minute * 60 + second - (offsetHour * 3600 + offsetMinute * 60);
+    if(seconds <= 0 || seconds > 0xFFFFFFFFLL)
+        return 0;
+    return (unsigned int) seconds;
+}
+
+static int getHTTPCompressionLevel(int level) {
+    if(level < HTTP_COMPRESSION_LEVEL_DEFAULT || level > HTTP_COMPRESSION_LEVEL_MAX) {
+        T2Warning("Invalid HTTP compression level %d, using default\n", level);
+        return HTTP_COMPRESSION_LEVEL_DEFAULT;
+    }
+    return level;
+}
+
 static T2ERROR addhttpURIreqParameter(Profile *profile, const char* Hname, const char* Href) {
     T2Debug("%s ++in\n", __FUNCTION__);
     if(NULL == Hname || NULL == Href )
@@ -97,7 +174,7 @@ static T2ERROR addhttpURIreqParameter(Profile *profile, const char* Hname, const
 }
 
 static T2ERROR addParameter(Profile *profile, const char* name, const char* ref, const char* fileName, int skipFreq, const char* ptype,
-        const char* use, bool ReportEmpty) {
+        const char* use, const char* method, bool ReportEmpty, bool hasCacheTTL, int cacheTTL) {
 
     T2Debug("%s ++in\n", __FUNCTION__);
 
@@ -121,10 +198,31 @@ static T2ERROR addParameter(Profile *profile, const char* name, const char* ref,
                 T2Error("Unable to allocate memory for TR-181 Parameter \n");
                 return T2ERROR_FAILURE;
             }
+            memset(param, 0, sizeof(Param));
             param->name = strdup(name);
             param->alias = strdup(ref);
             param->paramType = strdup(ptype);
             param->reportEmptyParam = ReportEmpty;
+            param->method = PARAM_METHOD_POLL;
+            param->use = PARAM_USE_ABSOLUTE;
+            if(method && (0 == strcmp(method, "onChange"))) {
+                param->method = PARAM_METHOD_ONCHANGE;
+                if((use == NULL) || (0 == strcmp(use, "absolute"))) {
+                    param->use = PARAM_USE_ABSOLUTE;
+                }else if(0 == strcmp(use, "count")) {
+                    param->use = PARAM_USE_COUNT;
+                }else if(0 == strcmp(use, "summary")) {
+                    param->use = PARAM_USE_SUMMARY;
+                }else {
+                    T2Info("Unsupported onChange parameter use %s. Defaulting to absolute \n", use);
+                }
+            }else if(method && (0 != strcmp(method, "poll"))) {
+                T2Info("Unsupported parameter method %s. Defaulting to poll \n", method);
+            }
+            // Seconds the fetched value is shared with other profiles, -1 until restart, 0 never
+            if(hasCacheTTL && T2ERROR_SUCCESS != setParamCacheTTL(ref, cacheTTL)) {
+                T2Info("Invalid cacheTTL %d for %s. Using the default \n", cacheTTL, ref);
+            }
 
             Vector_PushBack(profile->paramList, param);
         }
@@ -470,6 +568,8 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
     cJSON *jprofileTimeReference = cJSON_GetObjectItem(json_root, "TimeReference");
     cJSON *jprofileParameter = cJSON_GetObjectItem(json_root, "Parameter");
     cJSON *jprofileGenerateNow = cJSON_GetObjectItem(json_root, "GenerateNow");
+    cJSON *jprofileDeltaReporting = cJSON_GetObjectItem(json_root, "DeltaReporting");
+    cJSON *jprofileDeltaSnapshotPeriod = cJSON_GetObjectItem(json_root, "DeltaSnapshotPeriod");
     cJSON *jprofileTriggerCondition = cJSON_GetObjectItem(json_root, "TriggerCondition");
     if(jprofileParameter) {
         ThisProfileParameter_count = cJSON_GetArraySize(jprofileParameter);
@@ -493,6 +593,8 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
     cJSON *jprofileHTTPURL = NULL;
     cJSON *jprofileHTTPCompression = NULL;
     cJSON *jprofileHTTPMethod = NULL;
+    cJSON *jprofileHTTPCompressionLevel = NULL;
+    cJSON *jprofileHTTPCachedReportBatch = NULL;
     cJSON *jprofileHTTPRequestURIParameter = NULL;
     int ThisprofileHTTPRequestURIParameter_count = 0;
 
@@ -506,6 +608,8 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
 	        cJSON_Delete(json_root);
             return T2ERROR_FAILURE;
         }
+        jprofileHTTPCompressionLevel = cJSON_GetObjectItem(jprofileHTTP, "CompressionLevel");
+        jprofileHTTPCachedReportBatch = cJSON_GetObjectItem(jprofileHTTP, "CachedReportBatch");
         jprofileHTTPRequestURIParameter = cJSON_GetObjectItem(jprofileHTTP, "RequestURIParameter");
         if(jprofileHTTPRequestURIParameter) {
             ThisprofileHTTPRequestURIParameter_count = cJSON_GetArraySize(jprofileHTTPRequestURIParameter);
@@ -604,6 +708,11 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
     if (jprofileGenerateNow)
         profile->generateNow = (cJSON_IsTrue(jprofileGenerateNow) == 1);
 
+    if (jprofileDeltaReporting)
+        profile->deltaReporting = (cJSON_IsTrue(jprofileDeltaReporting) == 1);
+    if (cJSON_IsNumber(jprofileDeltaSnapshotPeriod) && jprofileDeltaSnapshotPeriod->valueint > 0)
+        profile->deltaSnapshotPeriod = jprofileDeltaSnapshotPeriod->valueint;
+
     if (profile->generateNow) {
         profile->reportingInterval = 0;
     } else {
@@ -618,10 +727,9 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
         }
     }
 
-    if(jprofileTimeReference) {
-        // profile->timeRef = strdup(jprofileTimeReference->valuestring);
-        /*  MUST TODO: Seems timeref is an unsigned int in profile structure . Handle the scenario accordingly */
-
+    if(cJSON_IsString(jprofileTimeReference)) {
+        profile->timeRef = getTimeReference(jprofileTimeReference->valuestring);
+        T2Debug("[[ profile->timeRef:%u]]\n", profile->timeRef);
     }
 
     T2Debug("[[profile->name:%s]]\n", profile->name);
@@ -661,11 +769,17 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
 
     if((profile->t2HTTPDest) && (strcmp(jprofileProtocol->valuestring, "HTTP") == 0)) {
         profile->t2HTTPDest->URL = strdup(jprofileHTTPURL->valuestring);
-        profile->t2HTTPDest->Compression = COMP_NONE; /*in 1911_sprint default none*/
+        profile->t2HTTPDest->Compression = getHTTPCompression(cJSON_IsString(jprofileHTTPCompression) ? jprofileHTTPCompression->valuestring : NULL);
+        profile->t2HTTPDest->CompressionLevel = HTTP_COMPRESSION_LEVEL_DEFAULT;
+        if(cJSON_IsNumber(jprofileHTTPCompressionLevel))
+            profile->t2HTTPDest->CompressionLevel = getHTTPCompressionLevel(jprofileHTTPCompressionLevel->valueint);
+        profile->t2HTTPDest->CachedReportBatch = getHTTPBatch(cJSON_IsString(jprofileHTTPCachedReportBatch) ? jprofileHTTPCachedReportBatch->valuestring : NULL);
         profile->t2HTTPDest->Method = HTTP_POST; /*1911_sprint default to POST */
 
         T2Debug("[[profile->t2HTTPDest->URL:%s]]\n", profile->t2HTTPDest->URL);
         T2Debug("[[profile->t2HTTPDest->Compression:%d]]\n", profile->t2HTTPDest->Compression);
+        T2Debug("[[profile->t2HTTPDest->CompressionLevel:%d]]\n", profile->t2HTTPDest->CompressionLevel);
+        T2Debug("[[profile->t2HTTPDest->CachedReportBatch:%d]]\n", profile->t2HTTPDest->CachedReportBatch);
         T2Debug("[[profile->t2HTTPDest->Method:%d]]\n", profile->t2HTTPDest->Method);
 
         if(jprofileHTTPRequestURIParameter) {
@@ -719,11 +833,13 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
     Vector_Create(&profile->staticParamList);
     Vector_Create(&profile->eMarkerList);
     Vector_Create(&profile->gMarkerList);
-    Vector_Create(&profile->cachedReportList);
 
     char* paramtype = NULL;
     char* use = NULL;
+    char* method = NULL;
     bool reportEmpty = false;
+    bool hasCacheTTL = false;
+    int cacheTTL = 0;
     char* header = NULL;
     char* content = NULL;
     char* logfile = NULL;
@@ -738,7 +854,10 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
         skipFrequency = 0;
         paramtype = NULL;
         use = NULL;
+        method = NULL;
         reportEmpty = false;
+        hasCacheTTL = false;
+        cacheTTL = 0;
 
         cJSON* pSubitem = cJSON_GetArrayItem(jprofileParameter, ProfileParameterIndex);
         if(pSubitem != NULL) {
@@ -770,6 +889,15 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
                         header = jpSubitemreference->valuestring; /*Default Name can be reference*/
                     }
                 }
+                cJSON *jpSubitemmethod = cJSON_GetObjectItem(pSubitem, "method"); // poll (default) or onChange
+                if(jpSubitemmethod) {
+                    method = jpSubitemmethod->valuestring;
+                }
+                cJSON *jpSubitemcacheTTL = cJSON_GetObjectItem(pSubitem, "cacheTTL");
+                if(cJSON_IsNumber(jpSubitemcacheTTL)) {
+                    hasCacheTTL = true;
+                    cacheTTL = jpSubitemcacheTTL->valueint;
+                }
             }else if(!(strcmp(paramtype, "event"))) {
 
                 cJSON *jpSubitemname = cJSON_GetObjectItem(pSubitem, "name"); // Optional repalcement name in report
@@ -804,7 +932,7 @@ T2ERROR processConfiguration(char** configData, char *profileName, char* profile
                 T2Error("%s Unknown parameter type %s \n", __FUNCTION__, paramtype);
                 continue;
             }
-            ret = addParameter(profile, header, content, logfile, skipFrequency, paramtype, use, reportEmpty); //add Multiple Report Profile Parameter
+            ret = addParameter(profile, header, content, logfile, skipFrequency, paramtype, use, method, reportEmpty, hasCacheTTL, cacheTTL); //add Multiple Report Profile Parameter
             if(ret != T2ERROR_SUCCESS) {
                 T2Error("%s Error in adding parameter to profile %s \n", __FUNCTION__, profile->name);
                 continue;
@@ -1052,6 +1180,7 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
     msgpack_object *EncodingType_str;
     msgpack_object *ReportingInterval_u64;
     msgpack_object *TimeReference_str;
+    char *timeReference = NULL;
     msgpack_object *ActivationTimeout_u64;
     msgpack_object *Parameter_array;
     msgpack_object *Parameter_array_map;
@@ -1060,14 +1189,21 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
     msgpack_object *Parameter_search_str;
     msgpack_object *Parameter_logFile_str;
     msgpack_object *Parameter_use_str;
+    msgpack_object *Parameter_method_str;
     msgpack_object *Parameter_reference_str;
     msgpack_object *Parameter_eventName_str;
     msgpack_object *Parameter_component_str;
     msgpack_object *Parameter_name_str;
     msgpack_object *Parameter_reportEmpty_boolean;
+    msgpack_object *Parameter_cacheTTL_int;
     msgpack_object *HTTP_map;
     msgpack_object *URL_str;
     msgpack_object *Compression_str;
+    msgpack_object *CompressionLevel_int;
+    char *compression = NULL;
+    int compressionLevel = HTTP_COMPRESSION_LEVEL_DEFAULT;
+    msgpack_object *CachedReportBatch_str;
+    char *cachedReportBatch = NULL;
     msgpack_object *Method_str;
     msgpack_object *RequestURIParameter_array;
     msgpack_object *RequestURIParameter_array_map;
@@ -1077,6 +1213,8 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
     msgpack_object *ReportFormat_str;
     msgpack_object *ReportTimestamp_str;
     msgpack_object *GenerateNow_boolean;
+    msgpack_object *DeltaReporting_boolean;
+    msgpack_object *DeltaSnapshotPeriod_u64;
 
     int i;
     int ret;
@@ -1161,6 +1299,13 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
     GenerateNow_boolean = msgpack_get_map_value(value_map, "GenerateNow");
     msgpack_print(GenerateNow_boolean, msgpack_get_obj_name(GenerateNow_boolean));
     MSGPACK_GET_NUMBER(GenerateNow_boolean, profile->generateNow);
+
+    DeltaReporting_boolean = msgpack_get_map_value(value_map, "DeltaReporting");
+    msgpack_print(DeltaReporting_boolean, msgpack_get_obj_name(DeltaReporting_boolean));
+    MSGPACK_GET_NUMBER(DeltaReporting_boolean, profile->deltaReporting);
+    DeltaSnapshotPeriod_u64 = msgpack_get_map_value(value_map, "DeltaSnapshotPeriod");
+    msgpack_print(DeltaSnapshotPeriod_u64, msgpack_get_obj_name(DeltaSnapshotPeriod_u64));
+    MSGPACK_GET_NUMBER(DeltaSnapshotPeriod_u64, profile->deltaSnapshotPeriod);
     T2Debug("profile->generateNow: %u\n", profile->generateNow);
     if(profile->generateNow) {
         profile->reportingInterval = 0;
@@ -1192,16 +1337,15 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
 
     TimeReference_str = msgpack_get_map_value(value_map, "TimeReference");
     msgpack_print(TimeReference_str, msgpack_get_obj_name(TimeReference_str));
-    /* profile->timeRef = msgpack_strdup(TimeReference_str); */
-    /* MUST TODO: Seems timeref is an unsigned int in profile structure. */
-    /* Handle the scenario accordingly */
+    timeReference = msgpack_strdup(TimeReference_str);
+    profile->timeRef = getTimeReference(timeReference);
+    free(timeReference);
 
     /* Parameter Markers configuration */
     Vector_Create(&profile->paramList);
     Vector_Create(&profile->staticParamList);
     Vector_Create(&profile->eMarkerList);
     Vector_Create(&profile->gMarkerList);
-    Vector_Create(&profile->cachedReportList);
 
     Parameter_array = msgpack_get_map_value(value_map, "Parameter");
     int profileParamCount = 0;
@@ -1212,10 +1356,13 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
 
         char* paramtype;
         char* use;
+        char* method;
         char* header;
         char* content;
         char* logfile;
         bool reportEmpty;
+        bool hasCacheTTL;
+        int cacheTTL;
         int skipFrequency;
 
         header = NULL;
@@ -1224,7 +1371,10 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
         skipFrequency = 0;
         paramtype = NULL;
         use = NULL;
+        method = NULL;
         reportEmpty = false;
+        hasCacheTTL = false;
+        cacheTTL = 0;
 
         Parameter_array_map = msgpack_get_array_element(Parameter_array, i);
 
@@ -1255,6 +1405,17 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
             if(NULL == header)
                 header = msgpack_strdup(Parameter_reference_str);
 
+            Parameter_method_str = msgpack_get_map_value(Parameter_array_map, "method");
+            msgpack_print(Parameter_method_str, msgpack_get_obj_name(Parameter_method_str));
+            method = msgpack_strdup(Parameter_method_str);
+
+            Parameter_cacheTTL_int = msgpack_get_map_value(Parameter_array_map, "cacheTTL");
+            if(Parameter_cacheTTL_int) {
+                msgpack_print(Parameter_cacheTTL_int, msgpack_get_obj_name(Parameter_cacheTTL_int));
+                MSGPACK_GET_NUMBER(Parameter_cacheTTL_int, cacheTTL);
+                hasCacheTTL = true;
+            }
+
         }else if(0 == msgpack_strcmp(Parameter_type_str, "event")) {
 
             Parameter_name_str = msgpack_get_map_value(Parameter_array_map, "name");
@@ -1287,9 +1448,10 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
             T2Error("%s Unknown parameter type %s \n", __FUNCTION__, paramtype);
             free(paramtype);
             free(use);
+            free(method);
             continue;
         }
-        ret = addParameter(profile, header, content, logfile, skipFrequency, paramtype, use, reportEmpty);
+        ret = addParameter(profile, header, content, logfile, skipFrequency, paramtype, use, method, reportEmpty, hasCacheTTL, cacheTTL);
         /* Add Multiple Report Profile Parameter */
         if(T2ERROR_SUCCESS != ret) {
             T2Error("%s Error in adding parameter to profile %s \n", __FUNCTION__, profile->name);
@@ -1301,6 +1463,7 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
         free(content);
         free(logfile);
         free(use);
+        free(method);
         free(paramtype);
     }
     T2Debug("Added parameter count:%d \n", profileParamCount);
@@ -1314,7 +1477,21 @@ T2ERROR processMsgPackConfiguration(msgpack_object *profiles_array_map, Profile
 
     Compression_str = msgpack_get_map_value(HTTP_map, "Compression");
     msgpack_print(Compression_str, msgpack_get_obj_name(Compression_str));
-    profile->t2HTTPDest->Compression = COMP_NONE; /*in 1911_sprint default none*/
+    compression = msgpack_strdup(Compression_str);
+    profile->t2HTTPDest->Compression = getHTTPCompression(compression);
+    free(compression);
+
+    CompressionLevel_int = msgpack_get_map_value(HTTP_map, "CompressionLevel");
+    msgpack_print(CompressionLevel_int, msgpack_get_obj_name(CompressionLevel_int));
+    compressionLevel = HTTP_COMPRESSION_LEVEL_DEFAULT;
+    MSGPACK_GET_NUMBER(CompressionLevel_int, compressionLevel);
+    profile->t2HTTPDest->CompressionLevel = getHTTPCompressionLevel(compressionLevel);
+
+    CachedReportBatch_str = msgpack_get_map_value(HTTP_map, "CachedReportBatch");
+    msgpack_print(CachedReportBatch_str, msgpack_get_obj_name(CachedReportBatch_str));
+    cachedReportBatch = msgpack_strdup(CachedReportBatch_str);
+    profile->t2HTTPDest->CachedReportBatch = getHTTPBatch(cachedReportBatch);
+    free(cachedReportBatch);
 
     Method_str = msgpack_get_map_value(HTTP_map, "Method");
     msgpack_print(Method_str, msgpack_get_obj_name(Method_str));
@@ -41,6 +41,10 @@
 #include "syslog.h"
 #include "reportprofiles.h"
 #include "xconfclient.h"
+#include "curlinterface.h"
+#include "reportspool.h"
+#include "addresstracker.h"
+#include "paramCollector.h"
 #ifdef DUAL_CORE_XB3
 #include "interChipHelper.h"
 #endif
@@ -86,7 +90,12 @@ T2ERROR initTelemetry()
 static void terminate() {
     uninitXConfClient();
     ReportProfiles_uninit();
+    uninitParamCollector();
     rdk_logger_deinit();
+    uninitHTTPUploader();
+    uninitReportSpools();
+    uninitCurlHandlePool();
+    uninitAddressTracker();
     curl_global_cleanup();
     if(0 != remove("/tmp/.t2ReadyToReceiveEvents")){
         T2Info("%s Unable to remove ready to receive event flag \n", __FUNCTION__);
@@ -0,0 +1,401 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+/**
+ * Report generation benchmark. Builds a synthetic profile with a configurable
+ * number of markers and compares the report encoders:
+ *  - the cJSON tree the reports were built with before, against the streaming
+ *    JSONReportWriter with a precompiled template
+ *  - payload size of the name/value report against the object hierarchy report
+ *  - MessagePack against JSON name/value reports, size and CPU time
+ *
+ * Usage: reportBenchmark [markerCount] [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <cjson/cJSON.h>
+
+#include "reportgen.h"
+#include "t2common.h"
+#include "busInterface.h"
+#include "vector.h"
+
+#define DEFAULT_MARKER_COUNT 2000
+#define DEFAULT_ITERATIONS 200
+#define STATIC_PARAM_COUNT 10
+/* Every Nth TR-181 parameter is a partial path returning several instances */
+#define MULTI_INSTANCE_PERIOD 50
+#define MULTI_INSTANCE_COUNT 4
+
+typedef struct _BenchmarkProfile
+{
+    Vector *staticParamList;
+    Vector *paramList;
+    Vector *paramValueList;
+    Vector *eMarkerList;
+} BenchmarkProfile;
+
+typedef struct _BenchmarkResult
+{
+    double wallUs;
+    double cpuUs;
+    size_t reportSize;
+} BenchmarkResult;
+
+static double getElapsedUs(clockid_t clock, const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) * 1000000.0 + (now.tv_nsec - start->tv_nsec) / 1000.0;
+}
+
+static profileValues* createBenchmarkValues(const char *name, int count)
+{
+    char instanceName[256] = {'\0'};
+    char value[32] = {'\0'};
+    int index = 0;
+    profileValues *profVals = (profileValues *) malloc(sizeof(profileValues));
+
+    profVals->paramValueCount = count;
+    profVals->paramValues = (tr181ValStruct_t **) malloc(count * sizeof(tr181ValStruct_t *));
+    for(index = 0; index < count; index++)
+    {
+        profVals->paramValues[index] = (tr181ValStruct_t *) malloc(sizeof(tr181ValStruct_t));
+        if(count > 1)
+            snprintf(instanceName, sizeof(instanceName), "%s%d.SignalStrength", name, index + 1);
+        else
+            snprintf(instanceName, sizeof(instanceName), "%s", name);
+        snprintf(value, sizeof(value), "%d", -40 - (index * 7 + count) % 50);
+        profVals->paramValues[index]->parameterName = strdup(instanceName);
+        profVals->paramValues[index]->parameterValue = strdup(value);
+    }
+    return profVals;
+}
+
+/**
+ * Split markerCount into STATIC_PARAM_COUNT static parameters, 60% TR-181
+ * parameters and the rest event markers, named like typical RDK-B profiles.
+ */
+static void createBenchmarkProfile(BenchmarkProfile *profile, int markerCount)
+{
+    char name[256] = {'\0'};
+    int paramCount = (markerCount - STATIC_PARAM_COUNT) * 6 / 10;
+    int eventCount = markerCount - STATIC_PARAM_COUNT - paramCount;
+    int index = 0;
+
+    Vector_Create(&profile->staticParamList);
+    Vector_Create(&profile->paramList);
+    Vector_Create(&profile->paramValueList);
+    Vector_Create(&profile->eMarkerList);
+
+    for(index = 0; index < STATIC_PARAM_COUNT; index++)
+    {
+        StaticParam *sparam = (StaticParam *) calloc(1, sizeof(StaticParam));
+        snprintf(name, sizeof(name), "Profile.Static%d", index);
+        sparam->paramType = strdup("dataModel");
+        sparam->name = strdup(name);
+        sparam->value = strdup("1.0.0_20201019_static");
+        Vector_PushBack(profile->staticParamList, sparam);
+    }
+
+    for(index = 0; index < paramCount; index++)
+    {
+        Param *param = (Param *) calloc(1, sizeof(Param));
+        bool multiInstance = (index % MULTI_INSTANCE_PERIOD) == 0;
+        if(multiInstance)
+            snprintf(name, sizeof(name), "Device.WiFi.AccessPoint.%d.AssociatedDevice.", index / MULTI_INSTANCE_PERIOD + 1);
+        else
+            snprintf(name, sizeof(name), "Device.WiFi.Radio.%d.Stats.X_RDKCENTRAL-COM_Param%d", index % 2 + 1, index);
+        param->paramType = strdup("dataModel");
+        param->name = strdup(name);
+        param->alias = strdup(name);
+        Vector_PushBack(profile->paramList, param);
+        Vector_PushBack(profile->paramValueList, createBenchmarkValues(name, multiInstance ? MULTI_INSTANCE_COUNT : 1));
+    }
+
+    for(index = 0; index < eventCount; index++)
+    {
+        EventMarker *eventMarker = (EventMarker *) calloc(1, sizeof(EventMarker));
+        snprintf(name, sizeof(name), "SYS_INFO_BENCH_EVENT_%d_split", index);
+        eventMarker->markerName = strdup(name);
+        eventMarker->compName = strdup("benchmark");
+        eventMarker->paramType = strdup("event");
+        eventMarker->mType = (index % 2) ? MTYPE_ABSOLUTE : MTYPE_COUNTER;
+        Vector_PushBack(profile->eMarkerList, eventMarker);
+    }
+}
+
+// Event markers are consumed by every report, give them fresh values
+static void setBenchmarkEventValues(BenchmarkProfile *profile)
+{
+    int index = 0;
+    for(index = 0; index < Vector_Size(profile->eMarkerList); index++)
+    {
+        EventMarker *eventMarker = (EventMarker *) Vector_At(profile->eMarkerList, index);
+        if(eventMarker->mType == MTYPE_COUNTER)
+            eventMarker->u.count = index + 1;
+        else
+            eventMarker->u.markerValue = strdup("value with \"quotes\" and a\ttab");
+    }
+}
+
+static void addCJSONItem(cJSON *valArray, const char *name, const char *value)
+{
+    cJSON *arrayItem = cJSON_CreateObject();
+    cJSON_AddStringToObject(arrayItem, name, value);
+    cJSON_AddItemToArray(valArray, arrayItem);
+}
+
+/**
+ * Report encoding as it was done with a cJSON tree before the streaming writer.
+ */
+static char* encodeReportWithCJSON(BenchmarkProfile *profile)
+{
+    cJSON *jsonObj = cJSON_CreateObject();
+    cJSON *valArray = NULL;
+    char *report = NULL;
+    int index = 0;
+
+    cJSON_AddItemToObject(jsonObj, "Report", valArray = cJSON_CreateArray());
+    for(index = 0; index < Vector_Size(profile->staticParamList); index++)
+    {
+        StaticParam *sparam = (StaticParam *) Vector_At(profile->staticParamList, index);
+        addCJSONItem(valArray, sparam->name, sparam->value);
+    }
+    for(index = 0; index < Vector_Size(profile->paramList); index++)
+    {
+        Param *param = (Param *) Vector_At(profile->paramList, index);
+        profileValues *profVals = (profileValues *) Vector_At(profile->paramValueList, index);
+        if(profVals->paramValueCount == 1)
+        {
+            addCJSONItem(valArray, param->name, profVals->paramValues[0]->parameterValue);
+        }
+        else
+        {
+            cJSON *valList = NULL;
+            cJSON *arrayItem = cJSON_CreateObject();
+            int valIndex = 0;
+            cJSON_AddItemToObject(arrayItem, param->name, valList = cJSON_CreateArray());
+            for(valIndex = 0; valIndex < profVals->paramValueCount; valIndex++)
+                addCJSONItem(valList, profVals->paramValues[valIndex]->parameterName, profVals->paramValues[valIndex]->parameterValue);
+            cJSON_AddItemToArray(valArray, arrayItem);
+        }
+    }
+    for(index = 0; index < Vector_Size(profile->eMarkerList); index++)
+    {
+        EventMarker *eventMarker = (EventMarker *) Vector_At(profile->eMarkerList, index);
+        if(eventMarker->mType == MTYPE_COUNTER)
+        {
+            char stringValue[16] = {'\0'};
+            snprintf(stringValue, sizeof(stringValue), "%u", eventMarker->u.count);
+            addCJSONItem(valArray, eventMarker->markerName, stringValue);
+            eventMarker->u.count = 0;
+        }
+        else
+        {
+            addCJSONItem(valArray, eventMarker->markerName, eventMarker->u.markerValue);
+            free(eventMarker->u.markerValue);
+            eventMarker->u.markerValue = NULL;
+        }
+    }
+    report = cJSON_PrintUnformatted(jsonObj);
+    cJSON_Delete(jsonObj);
+    return report;
+}
+
+static char* encodeReportWithWriter(BenchmarkProfile *profile, const JSONReportTemplate *reportTemplate, size_t *reportSize)
+{
+    JSONReportWriter *writer = NULL;
+    char *report = NULL;
+
+    if(T2ERROR_SUCCESS != initJSONReportFromTemplate(&writer, "Report", reportTemplate))
+        return NULL;
+    encodeStaticParamsInJSON(writer, profile->staticParamList);
+    encodeParamResultInJSON(writer, profile->paramList, profile->paramValueList);
+    encodeEventMarkersInJSON(writer, profile->eMarkerList);
+    prepareJSONReport(writer, &report);
+    destroyJSONReport(writer);
+    *reportSize = report ? strlen(report) : 0;
+    return report;
+}
+
+static char* encodeReportWithMsgPack(BenchmarkProfile *profile, const JSONReportTemplate *reportTemplate, size_t *reportSize)
+{
+    MsgPackReportWriter *writer = NULL;
+    char *report = NULL;
+
+    (void) reportTemplate;
+    *reportSize = 0;
+    if(T2ERROR_SUCCESS != initMsgPackReport(&writer, "Report"))
+        return NULL;
+    encodeStaticParamsInMsgPack(writer, profile->staticParamList);
+    encodeParamResultInMsgPack(writer, profile->paramList, profile->paramValueList);
+    encodeEventMarkersInMsgPack(writer, profile->eMarkerList);
+    prepareMsgPackReport(writer, &report, reportSize);
+    destroyMsgPackReport(writer);
+    return report;
+}
+
+typedef char* (*ReportEncoder)(BenchmarkProfile *profile, const JSONReportTemplate *reportTemplate, size_t *reportSize);
+
+static char* encodeCJSON(BenchmarkProfile *profile, const JSONReportTemplate *reportTemplate, size_t *reportSize)
+{
+    char *report = encodeReportWithCJSON(profile);
+    (void) reportTemplate;
+    *reportSize = report ? strlen(report) : 0;
+    return report;
+}
+
+/**
+ * Average wall and CPU time of one report, event values are reset outside the
+ * measured section.
+ */
+static void runReportBenchmark(BenchmarkProfile *profile, const JSONReportTemplate *reportTemplate,
+        ReportEncoder encoder, int iterations, BenchmarkResult *result)
+{
+    struct timespec wallStart, cpuStart;
+    int iteration = 0;
+
+    memset(result, 0, sizeof(BenchmarkResult));
+    for(iteration = 0; iteration < iterations; iteration++)
+    {
+        char *report = NULL;
+        size_t reportSize = 0;
+        setBenchmarkEventValues(profile);
+        clock_gettime(CLOCK_MONOTONIC, &wallStart);
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+        report = encoder(profile, reportTemplate, &reportSize);
+        result->cpuUs += getElapsedUs(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
+        result->wallUs += getElapsedUs(CLOCK_MONOTONIC, &wallStart);
+        result->reportSize = reportSize;
+        free(report);
+    }
+    result->wallUs /= iterations;
+    result->cpuUs /= iterations;
+}
+
+static void printResult(const char *name, const BenchmarkResult *result, const BenchmarkResult *reference)
+{
+    printf("%-28s %10zu bytes %10.1f us wall %10.1f us cpu", name, result->reportSize, result->wallUs, result->cpuUs);
+    if(reference && result->cpuUs > 0)
+        printf("   %.2fx", reference->cpuUs / result->cpuUs);
+    printf("\n");
+}
+
+static void jsonWriterBenchmark(BenchmarkProfile *profile, int iterations)
+{
+    BenchmarkResult cjsonResult, writerResult;
+    JSONReportTemplate *reportTemplate = NULL;
+    char *cjsonReport = NULL;
+    char *writerReport = NULL;
+    size_t writerReportSize = 0;
+
+    printf("%s ++in \n", __FUNCTION__);
+    reportTemplate = compileJSONReportTemplate(profile->staticParamList, profile->paramList, profile->eMarkerList, false);
+
+    // Both encoders must produce the same report
+    setBenchmarkEventValues(profile);
+    cjsonReport = encodeReportWithCJSON(profile);
+    setBenchmarkEventValues(profile);
+    writerReport = encodeReportWithWriter(profile, reportTemplate, &writerReportSize);
+    if(cjsonReport == NULL || writerReport == NULL || strcmp(cjsonReport, writerReport) != 0)
+        printf("Reports differ between cJSON and JSONReportWriter\n");
+    free(cjsonReport);
+    free(writerReport);
+
+    runReportBenchmark(profile, NULL, encodeCJSON, iterations, &cjsonResult);
+    runReportBenchmark(profile, reportTemplate, encodeReportWithWriter, iterations, &writerResult);
+    printResult("cJSON tree", &cjsonResult, NULL);
+    printResult("JSONReportWriter + template", &writerResult, &cjsonResult);
+
+    freeJSONReportTemplate(reportTemplate);
+    printf("%s --out \n", __FUNCTION__);
+}
+
+static void objectHierarchyBenchmark(BenchmarkProfile *profile, int iterations)
+{
+    BenchmarkResult keyValueResult, hierarchyResult;
+    JSONReportTemplate *keyValueTemplate = NULL;
+    JSONReportTemplate *hierarchyTemplate = NULL;
+
+    printf("%s ++in \n", __FUNCTION__);
+    keyValueTemplate = compileJSONReportTemplate(profile->staticParamList, profile->paramList, profile->eMarkerList, false);
+    hierarchyTemplate = compileJSONReportTemplate(profile->staticParamList, profile->paramList, profile->eMarkerList, true);
+    if(keyValueTemplate == NULL || hierarchyTemplate == NULL)
+    {
+        printf("Unable to compile report templates\n");
+    }
+    else
+    {
+        runReportBenchmark(profile, keyValueTemplate, encodeReportWithWriter, iterations, &keyValueResult);
+        runReportBenchmark(profile, hierarchyTemplate, encodeReportWithWriter, iterations, &hierarchyResult);
+        printResult("Name/value report", &keyValueResult, NULL);
+        printResult("Object hierarchy report", &hierarchyResult, &keyValueResult);
+        printf("Object hierarchy payload is %.1f%% of name/value\n", hierarchyResult.reportSize * 100.0 / keyValueResult.reportSize);
+    }
+    if(keyValueTemplate)
+        freeJSONReportTemplate(keyValueTemplate);
+    if(hierarchyTemplate)
+        freeJSONReportTemplate(hierarchyTemplate);
+    printf("%s --out \n", __FUNCTION__);
+}
+
+static void msgPackBenchmark(BenchmarkProfile *profile, int iterations)
+{
+    BenchmarkResult jsonResult, msgPackResult;
+    JSONReportTemplate *reportTemplate = NULL;
+
+    printf("%s ++in \n", __FUNCTION__);
+    reportTemplate = compileJSONReportTemplate(profile->staticParamList, profile->paramList, profile->eMarkerList, false);
+    runReportBenchmark(profile, reportTemplate, encodeReportWithWriter, iterations, &jsonResult);
+    runReportBenchmark(profile, NULL, encodeReportWithMsgPack, iterations, &msgPackResult);
+    printResult("JSON name/value report", &jsonResult, NULL);
+    printResult("MessagePack report", &msgPackResult, &jsonResult);
+    if(jsonResult.reportSize > 0)
+        printf("MessagePack payload is %.1f%% of JSON\n", msgPackResult.reportSize * 100.0 / jsonResult.reportSize);
+    if(reportTemplate)
+        freeJSONReportTemplate(reportTemplate);
+    printf("%s --out \n", __FUNCTION__);
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkProfile profile;
+    int markerCount = (argc > 1) ? atoi(argv[1]) : DEFAULT_MARKER_COUNT;
+    int iterations = (argc > 2) ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+
+    if(markerCount <= STATIC_PARAM_COUNT || iterations <= 0)
+    {
+        printf("Usage: %s [markerCount > %d] [iterations]\n", argv[0], STATIC_PARAM_COUNT);
+        return 1;
+    }
+    createBenchmarkProfile(&profile, markerCount);
+    printf("Profile with %d markers : %lu static, %lu TR-181, %lu events, %d iterations\n", markerCount,
+            (unsigned long) Vector_Size(profile.staticParamList), (unsigned long) Vector_Size(profile.paramList),
+            (unsigned long) Vector_Size(profile.eMarkerList), iterations);
+
+    jsonWriterBenchmark(&profile, iterations);
+    objectHierarchyBenchmark(&profile, iterations);
+    msgPackBenchmark(&profile, iterations);
+    return 0;
+}
@@ -0,0 +1,324 @@
+/*
+ * If not stated otherwise in this file or this component's Licenses.txt file the
+ * following copyright and licenses apply:
+ *
+ * Copyright 2019 RDK Management
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+*/
+
+
+/**
+ * Crash simulation for the report spool. A spool of several records is cut off
+ * and damaged at arbitrary offsets, the way an interrupted append or a bad flash
+ * page leaves it. Reopening it must recover every intact record and later
+ * appends must be readable behind them.
+ *
+ * The spool of a test only destination is created under REPORT_SPOOL_PATH and
+ * removed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "reportspool.h"
+#include "vector.h"
+#include "telemetry2_0.h"
+
+#define SPOOL_TEST_URL "https://t2spooltest.invalid/report?test=1"
+#define SPOOL_TEST_RECORDS 8
+#define SPOOL_TEST_ROUNDS 200
+
+typedef struct _SpoolImage
+{
+    unsigned char *data;
+    size_t size;
+    // End of each record, in spool order
+    size_t recordEnds[SPOOL_TEST_RECORDS];
+    uint64_t sequences[SPOOL_TEST_RECORDS];
+}SpoolImage;
+
+static int failures = 0;
+
+static void check(bool condition, const char *what, size_t offset)
+{
+    if(!condition)
+    {
+        printf("FAIL : %s at offset %zu\n", what, offset);
+        failures++;
+    }
+}
+
+// Payloads differ in size and in how well they compress
+static char* createTestPayload(int index)
+{
+    size_t length = 40 + index * 97;
+    char *payload = (char *) malloc(length + 1);
+    size_t pos;
+    for(pos = 0; pos < length; pos++)
+        payload[pos] = (index % 2) ? 'a' + (pos * 7 + index) % 26 : 'a' + rand() % 26;
+    payload[length] = '\0';
+    return payload;
+}
+
+static T2ERROR spoolTestReport(ReportSpool *spool, const char *payload)
+{
+    Vector *reports = NULL;
+    T2ERROR ret;
+    Vector_Create(&reports);
+    Vector_PushBack(reports, createHTTPReport(strdup(payload), strlen(payload), HEADER_CONTENTTYPE));
+    ret = appendReportSpool(spool, SPOOL_TEST_URL, reports);
+    Vector_Destroy(reports, freeHTTPReport);
+    return ret;
+}
+
+static bool readTestFile(const char *path, unsigned char **data, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    long length;
+    *data = NULL;
+    *size = 0;
+    if(file == NULL)
+        return false;
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    *data = (unsigned char *) malloc(length > 0 ? length : 1);
+    *size = fread(*data, 1, length, file);
+    fclose(file);
+    return *size == (size_t) length;
+}
+
+static void writeTestFile(const char *path, const unsigned char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if(file)
+    {
+        fwrite(data, 1, size, file);
+        fclose(file);
+    }
+}
+
+/**
+ * Reopen the spool and load its records, the replay is settled again without
+ * acknowledging any of them.
+ */
+static ReportSpool* reopenTestSpool(Vector **spooledReports)
+{
+    ReportSpool *spool = NULL;
+    uninitReportSpools();
+    spool = getReportSpool(SPOOL_TEST_URL);
+    Vector_Create(spooledReports);
+    if(spool && getReportSpoolCount(spool) > 0)
+    {
+        loadReportSpool(spool, *spooledReports);
+        finishReportSpoolReplay(spool, *spooledReports);
+    }
+    return spool;
+}
+
+static bool isPayloadOf(const SpooledReport *spooled, const char *payload)
+{
+    return spooled->report->payloadSize == strlen(payload) && memcmp(spooled->report->payload, payload, spooled->report->payloadSize) == 0
+        && strcmp(spooled->url, SPOOL_TEST_URL) == 0;
+}
+
+/**
+ * Check that the reopened spool holds exactly the records flagged in expected, in
+ * order, and that a report appended afterwards is read back behind them.
+ */
+static void checkRecovery(char **payloads, const bool *expected, size_t offset, const char *extra)
+{
+    Vector *spooledReports = NULL;
+    ReportSpool *spool = reopenTestSpool(&spooledReports);
+    size_t loaded = 0;
+    int index;
+
+    check(spool != NULL, "spool reopened", offset);
+    if(spool == NULL)
+        return;
+    for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+    {
+        if(!expected[index])
+            continue;
+        check(loaded < Vector_Size(spooledReports) && isPayloadOf((SpooledReport *) Vector_At(spooledReports, loaded), payloads[index]),
+                "intact record recovered", offset);
+        loaded++;
+    }
+    check(loaded == Vector_Size(spooledReports), "no damaged record recovered", offset);
+    check(getReportSpoolCount(spool) == loaded, "record count", offset);
+    Vector_Destroy(spooledReports, freeSpooledReport);
+
+    check(spoolTestReport(spool, extra) == T2ERROR_SUCCESS, "append after recovery", offset);
+    spool = reopenTestSpool(&spooledReports);
+    check(Vector_Size(spooledReports) == loaded + 1, "appended record read back", offset);
+    if(Vector_Size(spooledReports) == loaded + 1)
+    {
+        SpooledReport *last = (SpooledReport *) Vector_At(spooledReports, loaded);
+        check(isPayloadOf(last, extra), "appended record payload", offset);
+        if(loaded > 0)
+            check(last->sequence > ((SpooledReport *) Vector_At(spooledReports, loaded - 1))->sequence, "appended record sequence", offset);
+    }
+    Vector_Destroy(spooledReports, freeSpooledReport);
+}
+
+static void createSpoolImage(char **payloads, SpoolImage *image)
+{
+    ReportSpool *spool = NULL;
+    int index;
+
+    uninitReportSpools();
+    spool = getReportSpool(SPOOL_TEST_URL);
+    unlink(spool->path);
+    uninitReportSpools();
+    spool = getReportSpool(SPOOL_TEST_URL);
+    for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+    {
+        spoolTestReport(spool, payloads[index]);
+        image->recordEnds[index] = spool->size;
+    }
+    readTestFile(spool->path, &image->data, &image->size);
+}
+
+/**
+ * Cut the spool off at arbitrary offsets, every record that ends before the cut
+ * is recovered.
+ */
+void spoolTruncationTest(char **payloads, const SpoolImage *image, const char *path)
+{
+    bool expected[SPOOL_TEST_RECORDS];
+    int round;
+    int index;
+
+    printf("%s ++in \n", __FUNCTION__);
+    for(round = 0; round < SPOOL_TEST_ROUNDS; round++)
+    {
+        size_t offset = (round == 0) ? 0 : (size_t) rand() % image->size;
+        for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+            expected[index] = image->recordEnds[index] <= offset;
+        writeTestFile(path, image->data, offset);
+        checkRecovery(payloads, expected, offset, "appended after truncation");
+    }
+    printf("%s --out \n", __FUNCTION__);
+}
+
+/**
+ * Overwrite a few bytes at arbitrary offsets, only the record hit is lost and the
+ * records behind it are recovered.
+ */
+void spoolCorruptionTest(char **payloads, const SpoolImage *image, const char *path)
+{
+    bool expected[SPOOL_TEST_RECORDS];
+    unsigned char *damaged = (unsigned char *) malloc(image->size);
+    int round;
+    int index;
+
+    printf("%s ++in \n", __FUNCTION__);
+    for(round = 0; round < SPOOL_TEST_ROUNDS; round++)
+    {
+        size_t offset = (size_t) rand() % image->size;
+        size_t length = 1 + rand() % 8;
+        size_t pos;
+        if(offset + length > image->size)
+            length = image->size - offset;
+        memcpy(damaged, image->data, image->size);
+        for(pos = offset; pos < offset + length; pos++)
+            damaged[pos] ^= 0x5A;
+        for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+        {
+            size_t start = index ? image->recordEnds[index - 1] : 0;
+            expected[index] = offset >= image->recordEnds[index] || offset + length <= start;
+        }
+        writeTestFile(path, damaged, image->size);
+        checkRecovery(payloads, expected, offset, "appended after corruption");
+    }
+    free(damaged);
+    printf("%s --out \n", __FUNCTION__);
+}
+
+/**
+ * A spool that can not be read is not appended to, appends resume once it can be
+ * recovered.
+ */
+void spoolReadFailureTest(char **payloads, const SpoolImage *image, const char *path)
+{
+    Vector *spooledReports = NULL;
+    ReportSpool *spool = NULL;
+    bool expected[SPOOL_TEST_RECORDS];
+    int index;
+
+    printf("%s ++in \n", __FUNCTION__);
+    // A directory in place of the spool file opens but fails to read
+    unlink(path);
+    mkdir(path, 0700);
+    uninitReportSpools();
+    spool = getReportSpool(SPOOL_TEST_URL);
+    check(spool != NULL && getReportSpoolCount(spool) == 0, "unreadable spool has no records", 0);
+    check(spool != NULL && spoolTestReport(spool, payloads[0]) != T2ERROR_SUCCESS, "no append to unreadable spool", 0);
+    rmdir(path);
+
+    writeTestFile(path, image->data, image->size);
+    check(spool != NULL && spoolTestReport(spool, "appended after read failure") == T2ERROR_SUCCESS, "append after spool became readable", 0);
+    Vector_Create(&spooledReports);
+    if(spool && loadReportSpool(spool, spooledReports) == T2ERROR_SUCCESS)
+        finishReportSpoolReplay(spool, spooledReports);
+    check(Vector_Size(spooledReports) == SPOOL_TEST_RECORDS + 1, "records kept across read failure", 0);
+    for(index = 0; index < SPOOL_TEST_RECORDS && index < (int) Vector_Size(spooledReports); index++)
+        check(isPayloadOf((SpooledReport *) Vector_At(spooledReports, index), payloads[index]), "record kept across read failure", 0);
+    Vector_Destroy(spooledReports, freeSpooledReport);
+
+    for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+        expected[index] = true;
+    writeTestFile(path, image->data, image->size);
+    checkRecovery(payloads, expected, image->size, "appended to intact spool");
+    printf("%s --out \n", __FUNCTION__);
+}
+
+int main(int argc, char *argv[])
+{
+    char *payloads[SPOOL_TEST_RECORDS];
+    SpoolImage image;
+    ReportSpool *spool = NULL;
+    char *path = NULL;
+    int index;
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    memset(&image, 0, sizeof(image));
+    for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+        payloads[index] = createTestPayload(index);
+
+    createSpoolImage(payloads, &image);
+    spool = getReportSpool(SPOOL_TEST_URL);
+    if(spool == NULL || image.size != image.recordEnds[SPOOL_TEST_RECORDS - 1])
+    {
+        printf("FAIL : unable to create the test spool\n");
+        return 1;
+    }
+    path = strdup(spool->path);
+    spoolTruncationTest(payloads, &image, path);
+    spoolCorruptionTest(payloads, &image, path);
+    spoolReadFailureTest(payloads, &image, path);
+
+    unlink(path);
+    uninitReportSpools();
+    free(path);
+    free(image.data);
+    for(index = 0; index < SPOOL_TEST_RECORDS; index++)
+        free(payloads[index]);
+    printf("%s : %d failures\n", failures ? "FAIL" : "PASS", failures);
+    return failures ? 1 : 0;
+}
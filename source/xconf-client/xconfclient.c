@@ -57,36 +57,6 @@ T2ERROR ReportProfiles_deleteProfileXConf(ProfileXConf *profile);
 
 T2ERROR ReportProfiles_setProfileXConf(ProfileXConf *profile);
 
-typedef enum _IFADDRESS_TYPE
-{
-    ADDR_UNKNOWN,
-    ADDR_IPV4,
-    ADDR_IPV6
-}IFADDRESS_TYPE;
-
-#if 0
-static IFADDRESS_TYPE getAddressType(const char *cif) {
-    struct ifaddrs *ifap, *ifa;
-    IFADDRESS_TYPE addressType = 0;
-
-    getifaddrs(&ifap);
-    for (ifa = ifap; ifa; ifa = ifa->ifa_next) {
-        if (ifa->ifa_name == NULL || strcmp(ifa->ifa_name, cif))
-            continue;
-
-        if (ifa->ifa_addr->sa_family == AF_INET)
-            addressType = ADDR_IPV4;
-        else
-            addressType = ADDR_IPV6;
-
-        break;
-    }
-
-    freeifaddrs(ifap);
-    return addressType;
-}
-#endif
-
 static T2ERROR getBuildType(char* buildType) {
     char fileContent[255] = { '\0' };
     FILE *deviceFilePtr;
@@ -300,12 +270,13 @@ static T2ERROR doHttpGet(char* httpsUrl, char **data) {
  /* For now, Let curl start hopping between v4/v6 address like it is there for legacy dca till STBIT-1511 gets resolved.*/
  /*
 
-    if(getAddressType(IFINTERFACE) == ADDR_UNKNOWN)
+    ADDRESS_TYPE addressType = getInterfaceAddressType(IFINTERFACE);
+    if(addressType == ADDR_UNKNOWN)
       {
           T2Error("doHttpGet:: Unknown Address Type - returning failure\n");
           return T2ERROR_FAILURE;
      }
-     else if(getAddressType(IFINTERFACE) == ADDR_IPV4)
+     else if(addressType == ADDR_IPV4)
          curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V4);
      else
          curl_easy_setopt(curl, CURLOPT_IPRESOLVE, CURL_IPRESOLVE_V6);